@@ -33,12 +33,16 @@ http://www.accre.vanderbilt.edu
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
 #include "iniparse.h"
 #include "lio.h"
 #include "archive.h"
 #include "type_malloc.h"
 #include "thread_pool.h"
 #include "apr_time.h"
+#include "apr_wrapper.h"
+#include "string_token.h"
 
 // Check if path exists...if not, creates it
 
@@ -140,6 +144,404 @@ finally:
 }
 
 
+//**********************************************************************************
+// Aggregated archives.  Files at or below the aggregate size are packed into
+// shared container objects and larger files get a container of their own.
+// Each stream owns its open container so the writes into L-Store are large
+// and sequential.  The member locations are stored in the archive index.
+//**********************************************************************************
+
+typedef struct {
+    char *fname;      // Local file
+    char *member;     // Path relative to the archive root
+    int64_t size;
+} arc_work_t;
+
+typedef struct {
+    char *dest;
+    arc_work_t *work;
+    int n_work;
+    int next_work;
+    int next_container;
+    arc_member_t *members;
+    int n_members;
+    int max_members;
+    int64_t aggregate_size;
+    int64_t container_size;
+    int64_t bufsize;
+    int n_errors;
+    apr_thread_mutex_t *lock;
+} arc_aggregate_t;
+
+typedef struct {
+    arc_aggregate_t *ag;
+    lio_fd_t *fd;       // Currently open container
+    int container;
+    int64_t pos;        // End of the data in the container
+    int64_t flushed;    // Amount already written to L-Store
+    char *buffer;
+} arc_stream_t;
+
+//**********************************************************************************
+// arc_container_open - Opens the next container for the stream
+//**********************************************************************************
+
+int arc_container_open(arc_stream_t *s)
+{
+    arc_aggregate_t *ag = s->ag;
+    char *cname;
+    int err;
+
+    apr_thread_mutex_lock(ag->lock);
+    s->container = ag->next_container;
+    ag->next_container++;
+    apr_thread_mutex_unlock(ag->lock);
+
+    cname = arc_container_name(ag->dest, s->container);
+    err = gop_sync_exec(gop_lio_open_object(lio_gc, lio_gc->creds, cname, lio_fopen_flags("w"), NULL, &(s->fd), 60));
+    if (err != OP_STATE_SUCCESS) {
+        printf("ERROR: Failed to create container %s\n", cname);
+        s->fd = NULL;
+    }
+    free(cname);
+
+    s->pos = 0;
+    s->flushed = 0;
+    return((s->fd == NULL) ? 1 : 0);
+}
+
+//**********************************************************************************
+// arc_stream_flush - Writes any buffered data to the container
+//**********************************************************************************
+
+int arc_stream_flush(arc_stream_t *s)
+{
+    int64_t n;
+
+    n = s->pos - s->flushed;
+    if (n <= 0) return(0);
+
+    if (lio_write(s->fd, s->buffer, n, s->flushed, NULL) != n) {
+        printf("ERROR: Failed writing container %d offset=%" PRId64 " len=%" PRId64 "\n", s->container, s->flushed, n);
+        return(1);
+    }
+    s->flushed = s->pos;
+    return(0);
+}
+
+//**********************************************************************************
+// arc_container_close - Flushes and closes the stream's container
+//**********************************************************************************
+
+int arc_container_close(arc_stream_t *s)
+{
+    int err;
+
+    if (s->fd == NULL) return(0);
+
+    err = arc_stream_flush(s);
+    if (gop_sync_exec(gop_lio_close_object(s->fd)) != OP_STATE_SUCCESS) err = 1;
+    s->fd = NULL;
+    return(err);
+}
+
+//**********************************************************************************
+// arc_member_add - Records the member location for the index
+//**********************************************************************************
+
+void arc_member_add(arc_aggregate_t *ag, char *member, int container, int64_t offset, int64_t len)
+{
+    arc_member_t *m;
+
+    apr_thread_mutex_lock(ag->lock);
+    if (ag->n_members == ag->max_members) {
+        ag->max_members = (ag->max_members == 0) ? 1024 : 2*ag->max_members;
+        type_realloc(ag->members, arc_member_t, ag->max_members);
+    }
+    m = &(ag->members[ag->n_members]);
+    m->path = strdup(member);
+    m->container = container;
+    m->offset = offset;
+    m->len = len;
+    ag->n_members++;
+    apr_thread_mutex_unlock(ag->lock);
+}
+
+//**********************************************************************************
+// arc_stream_small - Appends a small file to the stream's shared container
+//**********************************************************************************
+
+int arc_stream_small(arc_stream_t *s, arc_work_t *w)
+{
+    arc_aggregate_t *ag = s->ag;
+    FILE *fd;
+    int64_t n;
+
+    if (s->fd == NULL) {
+        if (arc_container_open(s) != 0) return(1);
+    }
+
+    if ((s->pos - s->flushed + w->size) > ag->bufsize) {
+        if (arc_stream_flush(s) != 0) return(1);
+    }
+
+    fd = fopen(w->fname, "r");
+    if (fd == NULL) {
+        printf("ERROR: Unable to open %s\n", w->fname);
+        return(1);
+    }
+    n = fread(s->buffer + s->pos - s->flushed, 1, w->size, fd);
+    fclose(fd);
+    if (n != w->size) {
+        printf("ERROR: Short read on %s got=%" PRId64 " expected=%" PRId64 "\n", w->fname, n, w->size);
+        return(1);
+    }
+
+    arc_member_add(ag, w->member, s->container, s->pos, w->size);
+    s->pos += w->size;
+
+    if (s->pos >= ag->container_size) return(arc_container_close(s));
+    return(0);
+}
+
+//**********************************************************************************
+// arc_stream_large - Streams a large file into its own container
+//**********************************************************************************
+
+int arc_stream_large(arc_stream_t *s, arc_work_t *w)
+{
+    arc_stream_t ls;
+    FILE *fd;
+    int64_t n;
+    int err;
+
+    fd = fopen(w->fname, "r");
+    if (fd == NULL) {
+        printf("ERROR: Unable to open %s\n", w->fname);
+        return(1);
+    }
+
+    //** The buffer is shared with the small file container so drain it first
+    if ((s->fd != NULL) && (arc_stream_flush(s) != 0)) {
+        fclose(fd);
+        return(1);
+    }
+
+    ls = *s;  //** Leave the stream's small file container alone
+    if (arc_container_open(&ls) != 0) {
+        fclose(fd);
+        return(1);
+    }
+
+    err = 0;
+    while ((n = fread(ls.buffer, 1, ls.ag->bufsize, fd)) > 0) {
+        ls.pos += n;
+        if (arc_stream_flush(&ls) != 0) {
+            err = 1;
+            break;
+        }
+    }
+    fclose(fd);
+
+    if ((err == 0) && (ls.pos != w->size)) {
+        printf("ERROR: Short read on %s got=%" PRId64 " expected=%" PRId64 "\n", w->fname, ls.pos, w->size);
+        err = 1;
+    }
+    if (arc_container_close(&ls) != 0) err = 1;
+    if (err == 0) arc_member_add(ls.ag, w->member, ls.container, 0, w->size);
+
+    return(err);
+}
+
+//**********************************************************************************
+// arc_stream_thread - Pulls files off the work list until it's empty
+//**********************************************************************************
+
+void *arc_stream_thread(apr_thread_t *th, void *arg)
+{
+    arc_stream_t *s = (arc_stream_t *)arg;
+    arc_aggregate_t *ag = s->ag;
+    arc_work_t *w;
+    int i, nerr;
+
+    nerr = 0;
+    type_malloc(s->buffer, char, ag->bufsize);
+
+    for (;;) {
+        apr_thread_mutex_lock(ag->lock);
+        i = ag->next_work;
+        ag->next_work++;
+        apr_thread_mutex_unlock(ag->lock);
+        if (i >= ag->n_work) break;
+
+        w = &(ag->work[i]);
+        if (w->size > ag->aggregate_size) {
+            nerr += arc_stream_large(s, w);
+        } else {
+            nerr += arc_stream_small(s, w);
+        }
+    }
+
+    nerr += arc_container_close(s);
+    free(s->buffer);
+
+    apr_thread_mutex_lock(ag->lock);
+    ag->n_errors += nerr;
+    apr_thread_mutex_unlock(ag->lock);
+
+    return(NULL);
+}
+
+//**********************************************************************************
+// arc_index_write - Stores the member index in the archive directory
+//**********************************************************************************
+
+int arc_index_write(arc_aggregate_t *ag)
+{
+    lio_fd_t *fd;
+    char *text, *iname;
+    int64_t used, max;
+    int i, n, err;
+
+    max = 1024*1024;
+    used = 0;
+    type_malloc(text, char, max);
+    for (i=0; i<ag->n_members; i++) {
+        n = arc_index_format(text + used, max - used, &(ag->members[i]));
+        if (used + n >= max) {
+            max = 2*max + n;
+            type_realloc(text, char, max);
+            n = arc_index_format(text + used, max - used, &(ag->members[i]));
+        }
+        used += n;
+    }
+
+    iname = path_concat(ag->dest, ARCHIVE_INDEX_NAME);
+    err = gop_sync_exec(gop_lio_open_object(lio_gc, lio_gc->creds, iname, lio_fopen_flags("w"), NULL, &fd, 60));
+    if (err != OP_STATE_SUCCESS) {
+        printf("ERROR: Failed to create the archive index %s\n", iname);
+        err = 1;
+    } else {
+        err = (lio_write(fd, text, used, 0, NULL) == used) ? 0 : 1;
+        if (gop_sync_exec(gop_lio_close_object(fd)) != OP_STATE_SUCCESS) err = 1;
+        if (err != 0) printf("ERROR: Failed writing the archive index %s\n", iname);
+    }
+
+    free(iname);
+    free(text);
+    return(err);
+}
+
+//**********************************************************************************
+// run_lstore_aggregate - Packs the local data into containers using parallel streams
+//**********************************************************************************
+
+int run_lstore_aggregate(char *dest, char *path, char *regex_path, char *regex_object, int obj_types, int recurse_depth, int64_t aggregate_size, int64_t container_size, int n_streams)
+{
+    arc_aggregate_t ag;
+    arc_stream_t *streams;
+    apr_thread_t **thread;
+    apr_pool_t *mpool;
+    apr_status_t value;
+    lio_path_tuple_t stuple;
+    os_regex_table_t *path_regex, *obj_regex;
+    unified_object_iter_t *it;
+    struct stat sbuf;
+    char *fname;
+    int i, ftype, prefix_len, max_work;
+
+    memset(&ag, 0, sizeof(ag));
+    ag.dest = dest;
+    ag.aggregate_size = aggregate_size;
+    ag.container_size = container_size;
+    ag.bufsize = 1024 * 1024 * 20;
+    if (ag.bufsize < aggregate_size) ag.bufsize = aggregate_size;  //** A small file always fits in the buffer
+    if (n_streams <= 0) n_streams = 1;
+
+    //** Make the work list
+    stuple = lio_path_resolve(lio_gc->auto_translate, path);
+    if (stuple.is_lio == 1) {
+        printf("ERROR: Aggregation requires a local source path: %s\n", path);
+        lio_path_release(&stuple);
+        return(5);
+    }
+
+    //** Only regular files are packed into the containers
+    if ((obj_types & OS_OBJECT_FILE) == 0) {
+        printf("ERROR: Aggregation only archives files but object_types=%d excludes them\n", obj_types);
+        lio_path_release(&stuple);
+        return(5);
+    }
+
+    path_regex = (regex_path != NULL) ? os_regex2table(regex_path) : os_path_glob2regex(stuple.path);
+    obj_regex = (regex_object != NULL) ? os_regex2table(regex_object) : NULL;
+    it = unified_create_object_iter(stuple, path_regex, obj_regex, OS_OBJECT_FILE, recurse_depth);
+    if (it == NULL) {
+        printf("ERROR: Failed with object_iter creation src_path=%s\n", stuple.path);
+        os_regex_table_destroy(path_regex);
+        if (obj_regex != NULL) os_regex_table_destroy(obj_regex);
+        lio_path_release(&stuple);
+        return(5);
+    }
+
+    max_work = 0;
+    while ((ftype = unified_next_object(it, &fname, &prefix_len)) > 0) {
+        if (stat(fname, &sbuf) != 0) {
+            printf("ERROR: Unable to stat %s.  Skipping.\n", fname);
+            ag.n_errors++;
+            free(fname);
+            continue;
+        }
+        if (arc_member_path_valid(&(fname[prefix_len+1])) == 0) {
+            printf("ERROR: Can't store %s in the archive index.  Skipping.\n", fname);
+            ag.n_errors++;
+            free(fname);
+            continue;
+        }
+        if (ag.n_work == max_work) {
+            max_work = (max_work == 0) ? 1024 : 2*max_work;
+            type_realloc(ag.work, arc_work_t, max_work);
+        }
+        ag.work[ag.n_work].fname = fname;
+        ag.work[ag.n_work].member = &(fname[prefix_len+1]);
+        ag.work[ag.n_work].size = sbuf.st_size;
+        ag.n_work++;
+    }
+    unified_destroy_object_iter(it);
+    os_regex_table_destroy(path_regex);
+    if (obj_regex != NULL) os_regex_table_destroy(obj_regex);
+    lio_path_release(&stuple);
+
+    //** Launch the streams
+    assert_result(apr_pool_create(&mpool, NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(ag.lock), APR_THREAD_MUTEX_DEFAULT, mpool);
+    type_malloc_clear(streams, arc_stream_t, n_streams);
+    type_malloc(thread, apr_thread_t *, n_streams);
+    for (i=0; i<n_streams; i++) {
+        streams[i].ag = &ag;
+        thread_create_assert(&(thread[i]), NULL, arc_stream_thread, (void *)&(streams[i]), mpool);
+    }
+    for (i=0; i<n_streams; i++) {
+        apr_thread_join(&value, thread[i]);
+    }
+
+    if (arc_index_write(&ag) != 0) ag.n_errors++;
+
+    printf("Archived %d files into %d containers with %d errors\n", ag.n_members, ag.next_container, ag.n_errors);
+
+    //** Clean up
+    for (i=0; i<ag.n_work; i++) free(ag.work[i].fname);
+    if (ag.work != NULL) free(ag.work);
+    for (i=0; i<ag.n_members; i++) free(ag.members[i].path);
+    if (ag.members != NULL) free(ag.members);
+    free(streams);
+    free(thread);
+    apr_thread_mutex_destroy(ag.lock);
+    apr_pool_destroy(mpool);
+
+    return((ag.n_errors == 0) ? 0 : 5);
+}
+
 //**********************************************************************************
 // Copies the data from L-Store to tape.
 //**********************************************************************************
@@ -259,7 +661,8 @@ int process_tag_file(char *tag_file, char *tag_name)
     char *regex_path = NULL;
     char *regex_object = NULL;
     char *dest = NULL;
-    int recurse_depth, obj_types, err;
+    int recurse_depth, obj_types, err, streams;
+    int64_t aggregate_size, container_size;
     inip_file_t *ini_fd;
     inip_group_t *ini_g;
     inip_element_t *ele;
@@ -278,6 +681,9 @@ int process_tag_file(char *tag_file, char *tag_name)
         obj_types = OS_OBJECT_ANY;
         while (ini_g != NULL) {
             if (strcmp(inip_get_group(ini_g), "TAG") == 0) {
+                aggregate_size = 0;
+                container_size = 1024LL * 1024LL * 1024LL;
+                streams = lio_parallel_task_count;
                 ele = inip_first_element(ini_g);
                 while (ele != NULL) {
                     key = inip_get_element_key(ele);
@@ -296,14 +702,24 @@ int process_tag_file(char *tag_file, char *tag_name)
                         obj_types = atoi(value);
                     } else if (strcmp(key, "arc_server") == 0) {
                         arc_server = value;
+                    } else if (strcmp(key, "aggregate_size") == 0) {
+                        aggregate_size = string_get_integer(value);
+                    } else if (strcmp(key, "container_size") == 0) {
+                        container_size = string_get_integer(value);
+                    } else if (strcmp(key, "streams") == 0) {
+                        streams = atoi(value);
                     }
                     ele = inip_next_element(ele);
                 }
                 if ((tag_name == NULL) || (strcmp(tag_name, name) == 0)) {
                     // create destination
                     dest = prepare_lstore_destination(name);
-                    // copy the data into L-Store
-                    res = run_lstore_copy(dest, path, regex_path, regex_object, obj_types, recurse_depth);
+                    // copy the data into L-Store packing small files into containers if requested
+                    if (aggregate_size > 0) {
+                        res = run_lstore_aggregate(dest, path, regex_path, regex_object, obj_types, recurse_depth, aggregate_size, container_size, streams);
+                    } else {
+                        res = run_lstore_copy(dest, path, regex_path, regex_object, obj_types, recurse_depth);
+                    }
                     if (res != 0) {
                         printf("ERROR: Data ingestion has failed...skipping %s\n", dest);
                         err = 1;
@@ -338,6 +754,10 @@ void print_usage()
     printf("\nUsage: arc_create [-t tag file] [-n tag name]\n");
     printf("\t-t\ttag file to use (default if not specified: ~./arc_tag_file.txt)\n");
     printf("\t\n\ttag name to archive (if none, all tags will be archived)");
+    printf("\n\nTag keys for aggregated archives:\n");
+    printf("\taggregate_size\tFiles at or below this size are packed into shared containers (default 0 disables)\n");
+    printf("\tcontainer_size\tTarget container size (default 1gi)\n");
+    printf("\tstreams\t\tNumber of parallel container streams (default lio_parallel_task_count)\n");
     printf("\nExamples to come soon\n");
     exit(0);
 }
@@ -38,12 +38,15 @@ http://www.accre.vanderbilt.edu
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
 #include "iniparse.h"
 #include "lio.h"
 #include "type_malloc.h"
 #include "thread_pool.h"
 #include "apr_time.h"
 #include "archive.h"
+#include "apr_wrapper.h"
 
 
 int restore_path(char *path, char *tape_id)
@@ -137,10 +140,231 @@ finally:
     return(res);
 }
 
-void process_restore(char *spath, char *dpath)
+//**********************************************************************************
+// Indexed restores.  Aggregated archives are restored by reading the member
+// index and streaming each container sequentially.  The containers are spread
+// over parallel streams and members can be selected with a glob.
+//**********************************************************************************
+
+typedef struct {
+    char *spath;
+    char *dpath;
+    char *pattern;          // Optional member glob
+    arc_member_t *m;        // Sorted by container and offset
+    int n;
+    int *start;             // First member of each container
+    int n_containers;
+    int next;
+    int n_restored;
+    int n_errors;
+    int64_t bufsize;
+    apr_thread_mutex_t *lock;
+} arc_restore_t;
+
+//**********************************************************************************
+// make_local_dirs - Creates the parent directories of the local file
+//**********************************************************************************
+
+void make_local_dirs(char *fname)
+{
+    char *p;
+
+    for (p = strchr(fname+1, '/'); p != NULL; p = strchr(p+1, '/')) {
+        *p = '\0';
+        mkdir(fname, S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH);
+        *p = '/';
+    }
+}
+
+//**********************************************************************************
+// restore_member - Copies a single member from the open container
+//**********************************************************************************
+
+int restore_member(arc_restore_t *ar, lio_fd_t *cfd, arc_member_t *m, char *buffer)
+{
+    char fname[OS_PATH_MAX];
+    FILE *fd;
+    int64_t off, n;
+    int err;
+
+    //** Never let a member escape the restore directory
+    if (arc_member_path_valid(m->path) == 0) {
+        printf("ERROR: Refusing unsafe member path %s\n", m->path);
+        return(1);
+    }
+
+    if (snprintf(fname, sizeof(fname), "%s/%s", ar->dpath, m->path) >= (int)sizeof(fname)) {
+        printf("ERROR: Member path too long %s\n", m->path);
+        return(1);
+    }
+    make_local_dirs(fname);
+    fd = fopen(fname, "w");
+    if (fd == NULL) {
+        printf("ERROR: Unable to create %s\n", fname);
+        return(1);
+    }
+
+    err = 0;
+    for (off = 0; off < m->len; off += n) {
+        n = m->len - off;
+        if (n > ar->bufsize) n = ar->bufsize;
+        if (lio_read(cfd, buffer, n, m->offset + off, NULL) != n) {
+            printf("ERROR: Failed reading container %d for %s\n", m->container, m->path);
+            err = 1;
+            break;
+        }
+        if (fwrite(buffer, 1, n, fd) != n) {
+            printf("ERROR: Failed writing %s\n", fname);
+            err = 1;
+            break;
+        }
+    }
+
+    fclose(fd);
+    return(err);
+}
+
+//**********************************************************************************
+// restore_stream_thread - Restores containers until there are none left
+//**********************************************************************************
+
+void *restore_stream_thread(apr_thread_t *th, void *arg)
+{
+    arc_restore_t *ar = (arc_restore_t *)arg;
+    lio_fd_t *cfd;
+    char *buffer, *cname;
+    int c, i, end, nerr, ndone;
+
+    type_malloc(buffer, char, ar->bufsize);
+
+    for (;;) {
+        apr_thread_mutex_lock(ar->lock);
+        c = ar->next;
+        ar->next++;
+        apr_thread_mutex_unlock(ar->lock);
+        if (c >= ar->n_containers) break;
+
+        //** See if anything in the container was selected
+        end = (c == ar->n_containers-1) ? ar->n : ar->start[c+1];
+        for (i=ar->start[c]; i<end; i++) {
+            if ((ar->pattern == NULL) || (fnmatch(ar->pattern, ar->m[i].path, 0) == 0)) break;
+        }
+        if (i == end) continue;
+
+        nerr = 0;
+        ndone = 0;
+        cname = arc_container_name(ar->spath, ar->m[i].container);
+        if (gop_sync_exec(gop_lio_open_object(lio_gc, lio_gc->creds, cname, LIO_READ_MODE, NULL, &cfd, 60)) != OP_STATE_SUCCESS) {
+            printf("ERROR: Failed opening container %s\n", cname);
+            nerr = end - i;
+        } else {
+            for (; i<end; i++) {
+                if ((ar->pattern != NULL) && (fnmatch(ar->pattern, ar->m[i].path, 0) != 0)) continue;
+                if (restore_member(ar, cfd, &(ar->m[i]), buffer) == 0) {
+                    ndone++;
+                } else {
+                    nerr++;
+                }
+            }
+            gop_sync_exec(gop_lio_close_object(cfd));
+        }
+        free(cname);
+
+        apr_thread_mutex_lock(ar->lock);
+        ar->n_restored += ndone;
+        ar->n_errors += nerr;
+        apr_thread_mutex_unlock(ar->lock);
+    }
+
+    free(buffer);
+    return(NULL);
+}
+
+//**********************************************************************************
+// run_index_restore - Restores the selected members of an aggregated archive
+//**********************************************************************************
+
+int run_index_restore(char *spath, char *dpath, char *pattern, int n_streams)
+{
+    arc_restore_t ar;
+    apr_thread_t **thread;
+    apr_pool_t *mpool;
+    apr_status_t value;
+    lio_fd_t *fd;
+    char *iname, *text;
+    int64_t size;
+    int i;
+
+    if (dpath == NULL) {
+        printf("ERROR: No local restore path given!\n");
+        return(1);
+    }
+
+    //** Load the index
+    iname = path_concat(spath, ARCHIVE_INDEX_NAME);
+    if (gop_sync_exec(gop_lio_open_object(lio_gc, lio_gc->creds, iname, LIO_READ_MODE, NULL, &fd, 60)) != OP_STATE_SUCCESS) {
+        printf("ERROR: Failed opening the archive index %s\n", iname);
+        free(iname);
+        return(1);
+    }
+    size = lio_size(fd);
+    type_malloc(text, char, size+1);
+    if (lio_read(fd, text, size, 0, NULL) != size) {
+        printf("ERROR: Failed reading the archive index %s\n", iname);
+        gop_sync_exec(gop_lio_close_object(fd));
+        free(text);
+        free(iname);
+        return(1);
+    }
+    text[size] = '\0';
+    gop_sync_exec(gop_lio_close_object(fd));
+    free(iname);
+
+    memset(&ar, 0, sizeof(ar));
+    ar.spath = spath;
+    ar.dpath = dpath;
+    ar.pattern = pattern;
+    ar.bufsize = 1024 * 1024 * 20;
+    ar.m = arc_index_parse(text, &(ar.n));
+    free(text);
+
+    //** Find where each container starts
+    type_malloc(ar.start, int, ar.n + 1);
+    for (i=0; i<ar.n; i++) {
+        if ((i == 0) || (ar.m[i].container != ar.m[i-1].container)) {
+            ar.start[ar.n_containers] = i;
+            ar.n_containers++;
+        }
+    }
+
+    //** Launch the streams
+    if (n_streams <= 0) n_streams = 1;
+    if (n_streams > ar.n_containers) n_streams = ar.n_containers;
+    assert_result(apr_pool_create(&mpool, NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(ar.lock), APR_THREAD_MUTEX_DEFAULT, mpool);
+    type_malloc(thread, apr_thread_t *, n_streams + 1);
+    for (i=0; i<n_streams; i++) {
+        thread_create_assert(&(thread[i]), NULL, restore_stream_thread, (void *)&ar, mpool);
+    }
+    for (i=0; i<n_streams; i++) {
+        apr_thread_join(&value, thread[i]);
+    }
+
+    printf("Restored %d of %d archived files with %d errors\n", ar.n_restored, ar.n, ar.n_errors);
+
+    free(thread);
+    free(ar.start);
+    arc_index_destroy(ar.m, ar.n);
+    apr_thread_mutex_destroy(ar.lock);
+    apr_pool_destroy(mpool);
+
+    return((ar.n_errors == 0) ? 0 : 5);
+}
+
+void process_restore(char *spath, char *dpath, char *pattern, int n_streams)
 {
     int res = EXIT_SUCCESS;
-    char *tape_id, *dir;
+    char *tape_id, *dir, *iname;
     int attr_size = -lio_gc->max_attr;
     tape_id = NULL;
 
@@ -152,15 +376,23 @@ void process_restore(char *spath, char *dpath)
         //run restore
         res = restore_path(spath, tape_id);
     }
-    // copy files from L-Store
-    run_lstore_copy(spath, dpath);
+    // copy files from L-Store using the index if it's an aggregated archive
+    iname = path_concat(spath, ARCHIVE_INDEX_NAME);
+    if (lioc_exists(lio_gc, lio_gc->creds, iname) != 0) {
+        run_index_restore(spath, dpath, pattern, n_streams);
+    } else {
+        run_lstore_copy(spath, dpath);
+    }
+    free(iname);
 }
 
 void print_usage()
 {
     printf("\nUsage: arc_restore -s SOURCE_PATH -d DESTINATION_PATH\n");
     printf("\t-s\tL-Store path to restore\n");
-    printf("\t-l\tLocal path to restore files to");
+    printf("\t-l\tLocal path to restore files to\n");
+    printf("\t-m\tOnly restore members matching the glob (aggregated archives only)\n");
+    printf("\t-n\tNumber of parallel container streams (default lio_parallel_task_count)");
     printf("\nExamples to come soon\n");
     exit(0);
 }
@@ -173,11 +405,14 @@ int main(int argc, char** argv)
     int i = 1, start_option = 0;
     char *spath = NULL;
     char *dpath = NULL;
+    char *pattern = NULL;
+    int n_streams;
 
     lio_init(&argc, &argv);
+    n_streams = lio_parallel_task_count;
 
     /*** Parse the args ***/
-    if (argc > 5) {
+    if (argc > 9) {
         print_usage();
     } else if (argc > 1) {
         do {
@@ -192,10 +427,18 @@ int main(int argc, char** argv)
                 i++;
                 dpath = argv[i];
                 i++;
+            } else if (strcmp(argv[i], "-m") == 0) {
+                i++;
+                pattern = argv[i];
+                i++;
+            } else if (strcmp(argv[i], "-n") == 0) {
+                i++;
+                n_streams = atoi(argv[i]);
+                i++;
             }
         } while ((start_option < i) && (i < argc));
     }
-    process_restore(spath, dpath);
+    process_restore(spath, dpath, pattern, n_streams);
     lio_shutdown();
 
     return(EXIT_SUCCESS);
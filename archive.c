@@ -27,6 +27,7 @@ Nashville, TN 37203
 http://www.accre.vanderbilt.edu
 */
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -51,3 +52,101 @@ char* path_concat(char *str1, char *str2)
     strcat(res, str2);
     return res;
 }
+
+// returns the name of container n in the archive directory
+char* arc_container_name(char *dir, int n)
+{
+    int len = strlen(dir) + 32;
+    char *res = malloc(len);
+    snprintf(res, len, ARCHIVE_CONTAINER_FMT, dir, n);
+    return res;
+}
+
+// checks the member path is safe to join with the restore directory.  The
+// path must be relative, free of "." and ".." components, and since the
+// index is line based it can't hold a newline either.
+int arc_member_path_valid(char *path)
+{
+    char *p, *end;
+    int n;
+
+    if ((path == NULL) || (path[0] == '\0') || (path[0] == '/')) return(0);
+    if (strchr(path, '\n') != NULL) return(0);
+
+    for (p = path; *p != '\0'; p = end) {
+        end = strchr(p, '/');
+        if (end == NULL) end = p + strlen(p);
+        n = end - p;
+        if (n == 0) return(0);
+        if ((n == 1) && (p[0] == '.')) return(0);
+        if ((n == 2) && (p[0] == '.') && (p[1] == '.')) return(0);
+        if (*end == '/') end++;
+    }
+
+    return(1);
+}
+
+// formats an index line: container offset length path
+int arc_index_format(char *buf, int bufsize, arc_member_t *m)
+{
+    return snprintf(buf, bufsize, "%d %" PRId64 " %" PRId64 " %s\n", m->container, m->offset, m->len, m->path);
+}
+
+// sorts members so each container is read sequentially
+static int arc_member_compare(const void *a, const void *b)
+{
+    const arc_member_t *ma = (const arc_member_t *)a;
+    const arc_member_t *mb = (const arc_member_t *)b;
+
+    if (ma->container != mb->container) return (ma->container < mb->container) ? -1 : 1;
+    if (ma->offset != mb->offset) return (ma->offset < mb->offset) ? -1 : 1;
+    return 0;
+}
+
+// parses the index text.  Malformed lines and unsafe paths are skipped.
+arc_member_t *arc_index_parse(char *text, int *n_members)
+{
+    arc_member_t *m;
+    char *line, *next;
+    int n, max, pos;
+
+    max = 1024;
+    n = 0;
+    m = malloc(sizeof(arc_member_t) * max);
+
+    for (line = text; (line != NULL) && (*line != '\0'); line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next = '\0';
+            next++;
+        }
+
+        if (n == max) {
+            max = 2 * max;
+            m = realloc(m, sizeof(arc_member_t) * max);
+        }
+
+        pos = -1;
+        if (sscanf(line, "%d %" SCNd64 " %" SCNd64 " %n", &(m[n].container), &(m[n].offset), &(m[n].len), &pos) != 3) continue;
+        if ((pos < 0) || (line[pos] == '\0')) continue;
+        if (arc_member_path_valid(line + pos) == 0) {
+            fprintf(stderr, "WARN: Skipping unsafe archive member path: %s\n", line + pos);
+            continue;
+        }
+        m[n].path = strdup(line + pos);
+        n++;
+    }
+
+    qsort(m, n, sizeof(arc_member_t), arc_member_compare);
+    *n_members = n;
+    return m;
+}
+
+// frees the member array
+void arc_index_destroy(arc_member_t *m, int n)
+{
+    int i;
+
+    for (i=0; i<n; i++) free(m[i].path);
+    free(m);
+}
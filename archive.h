@@ -27,6 +27,8 @@ Nashville, TN 37203
 http://www.accre.vanderbilt.edu
 */
 
+#include <stdint.h>
+
 #define ARCHIVE_TAPE_ATTRIBUTE "user.tapeid"
 
 // concatenate two strings together
@@ -34,3 +36,30 @@ char* concat(char *str1, char *str2);
 
 // concatenate two paths together with added separator
 char* path_concat(char *str1, char *str2);
+
+//** Aggregated archives pack files into large container objects.  Each
+//** member is located via the index stored alongside the containers.
+#define ARCHIVE_INDEX_NAME "archive.idx"
+#define ARCHIVE_CONTAINER_FMT "%s/container.%06d"
+
+typedef struct {
+    char *path;        // member path relative to the archive root
+    int container;     // container number holding the data
+    int64_t offset;    // offset of the member in the container
+    int64_t len;       // member length
+} arc_member_t;
+
+// returns the name of container n in the archive directory
+char* arc_container_name(char *dir, int n);
+
+// returns 1 if the member path is relative with no "..", "." or empty components and no newline
+int arc_member_path_valid(char *path);
+
+// formats an index line for the member.  Returns the number of bytes used
+int arc_index_format(char *buf, int bufsize, arc_member_t *m);
+
+// parses the index text into a member array sorted by container and offset
+arc_member_t *arc_index_parse(char *text, int *n_members);
+
+// frees the member array
+void arc_index_destroy(arc_member_t *m, int n);
@@ -49,15 +49,26 @@ typedef struct {
     apr_time_t recheck_time;
 } blacklist_rid_t;
 
+typedef struct {
+    char *rid;
+    double bandwidth;        //** Running average of the observed bandwidth in bytes/sec
+    apr_time_t last_update;
+} blacklist_ioperf_t;
+
 typedef struct {
     apr_pool_t *mpool;
     apr_thread_mutex_t *lock;
     apr_hash_t *table;
+    apr_hash_t *ioperf;      //** Observed I/O performance for each RID.  Used for data placement
     ex_off_t  min_bandwidth;
     apr_time_t min_io_time;
     apr_time_t timeout;
+    int ref_count;           //** Users sharing the blacklist.  Protected by lock
 } blacklist_t;
 
+blacklist_t *blacklist_ref(blacklist_t *bl);
+void blacklist_destroy(blacklist_t *bl);
+
 #ifdef __cplusplus
 }
 #endif
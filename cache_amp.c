@@ -339,6 +339,7 @@ cache_page_t *_amp_new_page(cache_t *c, segment_t *seg)
     type_malloc_clear(p->curr_data->ptr, char, s->page_size);
 
     cp->bytes_used += s->page_size;
+    cache_page_account(c, seg, s->page_size);
 
     p->priv = (void *)lp;
     p->seg = seg;
@@ -630,8 +631,7 @@ int _amp_pages_release(cache_t *c, cache_page_t **page, int n_pages)
             if (p->offset > -1) {
                 list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
             }
-            if (p->data[0].ptr) free(p->data[0].ptr);
-            if (p->data[1].ptr) free(p->data[1].ptr);
+            cache_page_free_data(c, p);
             free(lp);
         }
     }
@@ -682,8 +682,7 @@ void _amp_pages_destroy(cache_t *c, cache_page_t **page, int n_pages, int remove
                 list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
             }
 
-            if (p->data[0].ptr) free(p->data[0].ptr);
-            if (p->data[1].ptr) free(p->data[1].ptr);
+            cache_page_free_data(c, p);
             free(lp);
         } else {  //** Someone is listening so trigger them and also clear the bits so it will be released
             p->bit_fields = C_TORELEASE;
@@ -701,20 +700,23 @@ void _amp_pages_destroy(cache_t *c, cache_page_t **page, int n_pages, int remove
 //    NOTE: Cache lock should be owned by calling thread!
 //*************************************************************************
 
-int _amp_page_access(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_len)
+int _amp_page_access(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_len, int request_id, ex_off_t offset)
 {
     cache_amp_t *cp = (cache_amp_t *)c->fn.priv;
     cache_segment_t *s = (cache_segment_t *)p->seg->priv;
     page_amp_t *lp = (page_amp_t *)p->priv;
     amp_page_stream_t *ps, *pse;
     ex_off_t lo, hi, psize, last_offset;
-    int prefetch_pages, trigger_distance, tag;
+    int prefetch_pages, trigger_distance, tag, reref;
 
     if (rw_mode == CACHE_FLUSH) return(0);  //** Nothing to do for a flush
 
     //** Only update the position if the page is linked.
     //** Otherwise the page is destined to be dropped
     if (lp->ele != NULL) {
+        cache_segment_touch(c, p->seg);
+        reref = cache_page_reref(p, request_id, offset);
+
         //** Move to the MRU position
         if ((lp->bit_fields & CAMP_ACCESSED) > 0) {
             log_printf(_amp_logging, "seg=" XIDT " MRU offset=" XOT "\n", segment_id(p->seg), p->offset);
@@ -722,6 +724,7 @@ int _amp_page_access(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_
             stack_unlink_current(cp->stack, 1);
             move_to_top(cp->stack);
             insert_link_above(cp->stack, lp->ele);
+            if (reref == 1) lp->bit_fields |= CAMP_REREF;
         }
 
         if (rw_mode == CACHE_WRITE) {  //** Write update so return
@@ -800,14 +803,20 @@ int _amp_free_mem(cache_t *c, segment_t *pseg, ex_off_t bytes_to_free)
         if ((p->bit_fields & C_TORELEASE) == 0) { //** Skip it if already flagged for removal
             count = p->access_pending[CACHE_READ] + p->access_pending[CACHE_WRITE] + p->access_pending[CACHE_FLUSH];
             if (count == 0) { //** No one is using it
-                if (((p->bit_fields & C_ISDIRTY) == 0) && ((lp->bit_fields & (CAMP_OLD|CAMP_ACCESSED)) > 0)) {  //** Don't have to flush it
+                if ((c->scan_resistance == 1) && ((lp->bit_fields & CAMP_REREF) > 0)) {  //** Re-referenced so give it a 2nd chance
+                    lp->bit_fields ^= CAMP_REREF;
+                    move_to_ptr(cp->stack, lp->ele);
+                    stack_unlink_current(cp->stack, 1);
+                    move_to_top(cp->stack);
+                    insert_link_above(cp->stack, lp->ele);
+                    move_to_bottom(cp->stack);
+                } else if (((p->bit_fields & C_ISDIRTY) == 0) && ((lp->bit_fields & (CAMP_OLD|CAMP_ACCESSED)) > 0)) {  //** Don't have to flush it
                     s = (cache_segment_t *)p->seg->priv;
                     total_bytes += s->page_size;
                     log_printf(_amp_logging, "amp_free_mem: freeing page seg=" XIDT " p->offset=" XOT " bits=%d\n", segment_id(p->seg), p->offset, p->bit_fields);
                     list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
                     delete_current(cp->stack, 1, 0);
-                    if (p->data[0].ptr) free(p->data[0].ptr);
-                    if (p->data[1].ptr) free(p->data[1].ptr);
+                    cache_page_evict_data(c, p);
                     free(lp);
                 } else {         //** Got to flush the page first
                     err = 1;
@@ -829,6 +838,57 @@ int _amp_free_mem(cache_t *c, segment_t *pseg, ex_off_t bytes_to_free)
     return(pending_bytes);
 }
 
+//*************************************************************************
+//  _amp_free_mem_seg - Frees the segment's own clean pages, oldest first.
+//   Used when the segment is over its share so it recycles its own pages
+//   instead of evicting everyone else's.  The scan stops once all the
+//   segment's resident pages have been passed or after CACHE_SEG_FREE_SCAN_MAX
+//   pages so it's bounded when nothing of its own can be freed.
+//   Returns the pending bytes to free.
+//*************************************************************************
+
+ex_off_t _amp_free_mem_seg(cache_t *c, segment_t *seg, ex_off_t bytes_to_free)
+{
+    cache_amp_t *cp = (cache_amp_t *)c->fn.priv;
+    cache_segment_t *s = (cache_segment_t *)seg->priv;
+    cache_page_t *p;
+    page_amp_t *lp;
+    Stack_ele_t *ele;
+    ex_off_t total_bytes, seg_bytes, seen_bytes;
+    int count, n_scanned;
+
+    total_bytes = 0;
+    seen_bytes = 0;
+    seg_bytes = s->stats.resident_bytes;
+    n_scanned = 0;
+
+    move_to_bottom(cp->stack);
+    ele = get_ptr(cp->stack);
+    while ((total_bytes < bytes_to_free) && (ele != NULL) && (seen_bytes < seg_bytes) && (n_scanned < CACHE_SEG_FREE_SCAN_MAX)) {
+        n_scanned++;
+        p = (cache_page_t *)get_stack_ele_data(ele);
+        if (p->seg == seg) seen_bytes += s->page_size;
+        lp = (page_amp_t *)p->priv;
+        count = p->access_pending[CACHE_READ] + p->access_pending[CACHE_WRITE] + p->access_pending[CACHE_FLUSH];
+        if ((p->seg == seg) && (count == 0) && ((p->bit_fields & (C_TORELEASE|C_ISDIRTY|C_EMPTY)) == 0) && ((lp->bit_fields & (CAMP_OLD|CAMP_ACCESSED)) > 0)) {
+            total_bytes += s->page_size;
+            log_printf(_amp_logging, "freeing own page seg=" XIDT " p->offset=" XOT " resident=" XOT "\n", segment_id(seg), p->offset, s->stats.resident_bytes);
+            list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
+            delete_current(cp->stack, 1, 0);
+            cache_page_evict_data(c, p);
+            free(lp);
+        } else {
+            move_up(cp->stack);
+        }
+
+        ele = get_ptr(cp->stack);
+    }
+
+    cp->bytes_used -= total_bytes;
+
+    return(bytes_to_free - total_bytes);
+}
+
 //*************************************************************************
 // amp_attempt_free_mem - Attempts to forcefully Free page memory
 //   Returns the total number of bytes freed
@@ -886,8 +946,7 @@ ex_off_t _amp_attempt_free_mem(cache_t *c, segment_t *page_seg, ex_off_t bytes_t
                         log_printf(_amp_logging, "freeing page seg=" XIDT " p->offset=" XOT " bits=%d\n", segment_id(p->seg), p->offset, p->bit_fields);
                         list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
                         delete_current(cp->stack, 1, 0);
-                        if (p->data[0].ptr) free(p->data[0].ptr);
-                        if (p->data[1].ptr) free(p->data[1].ptr);
+                        cache_page_evict_data(c, p);
                         free(lp);
                         n = 1;
                     }
@@ -1084,6 +1143,9 @@ void _amp_wait_for_page(cache_t *c, segment_t *seg, int ontop)
         n = _amp_force_free_mem(c, seg, bytes_needed, check_waiters_first);
 
         if (n < bytes_needed) { //** Didn't make it so wait
+            if (c->fair_share == 1) {  //** Segments within their share are served ahead of the heavy users
+                ontop = (cache_segment_over_share(c, seg, _amp_max_bytes(c)) == 1) ? 0 : 1;
+            }
             if (ontop == 0) {
                 move_to_bottom(cp->waiting_stack);
                 insert_below(cp->waiting_stack, &pw);
@@ -1127,7 +1189,8 @@ cache_page_t *_amp_create_empty_page(cache_t *c, segment_t *seg, int doblock)
         bytes_to_free = s->page_size + cp->bytes_used - max_bytes;
         log_printf(15, "amp_create_empty_page: max_bytes=" XOT " used=" XOT " bytes_to_free=" XOT " doblock=%d\n", max_bytes, cp->bytes_used, bytes_to_free, doblock);
         if (bytes_to_free > 0) {
-            bytes_to_free = _amp_free_mem(c, seg, bytes_to_free);
+            if (cache_segment_over_share(c, seg, max_bytes) == 1) bytes_to_free = _amp_free_mem_seg(c, seg, bytes_to_free);
+            if (bytes_to_free > 0) bytes_to_free = _amp_free_mem(c, seg, bytes_to_free);
             if ((doblock==1) && (bytes_to_free>0)) _amp_wait_for_page(c, seg, qend);
             qend = 1;
         }
@@ -1443,6 +1506,7 @@ cache_t *amp_cache_load(void *arg, inip_file_t *fd, char *grp, data_attr_t *da,
     c->write_temp_overflow_fraction = inip_get_double(fd, grp, "write_temp_overflow_fraction", c->write_temp_overflow_fraction);
     c->write_temp_overflow_size = c->write_temp_overflow_fraction * cp->max_bytes;
     c->n_ppages = inip_get_integer(fd, grp, "ppages", c->n_ppages);
+    cache_base_load(c, fd, grp);
 
     cache_unlock(c);
 
@@ -43,6 +43,7 @@ extern "C" {
 #define CAMP_ACCESSED 1  //** Page has been accessed
 #define CAMP_TAG      2  //** Tag page for pretech
 #define CAMP_OLD      4  //** Page has been recycled without a hit
+#define CAMP_REREF    8  //** Page was hit again after its first access
  
 typedef struct {
 cache_page_t page;  //** Actual page
@@ -56,6 +56,7 @@ cache_t *cache_base_handle(cache_t *c)
 
 void cache_base_destroy(cache_t *c)
 {
+    if (c->victim != NULL) cache_victim_destroy(c->victim);
     list_destroy(c->segments);
     destroy_pigeon_coop(c->cond_coop);
     apr_thread_mutex_destroy(c->lock);
@@ -75,6 +76,187 @@ void cache_base_create(cache_t *c, data_attr_t *da, int timeout)
     c->da = da;
     c->timeout = timeout;
     c->default_page_size = 16*1024;
+    c->segment_max_fraction = 1.0;
+    c->fair_share = 1;
+    c->scan_resistance = 1;
+    c->n_resident_segments = 0;
+    c->n_active_segments = 0;
+    c->active_window = apr_time_from_sec(10);
+    c->active_check = 0;
+}
+
+//*************************************************************************
+// cache_base_load - Loads the options common to all cache types
+//*************************************************************************
+
+void cache_base_load(cache_t *c, inip_file_t *fd, char *grp)
+{
+    c->segment_max_fraction = inip_get_double(fd, grp, "segment_max_fraction", c->segment_max_fraction);
+    c->fair_share = inip_get_integer(fd, grp, "fair_share", c->fair_share);
+    c->scan_resistance = inip_get_integer(fd, grp, "scan_resistance", c->scan_resistance);
+    c->active_window = apr_time_from_sec(inip_get_integer(fd, grp, "fair_share_window", apr_time_sec(c->active_window)));
+    c->victim = cache_victim_load(fd, grp, c->default_page_size);
+}
+
+//*************************************************************************
+// cache_page_account - Tracks the page memory held by each segment
+//    NOTE: Cache lock should be held by the calling thread
+//*************************************************************************
+
+void cache_page_account(cache_t *c, segment_t *seg, ex_off_t nbytes)
+{
+    cache_segment_t *s = (cache_segment_t *)seg->priv;
+
+    if ((s->stats.resident_bytes == 0) && (nbytes > 0)) c->n_resident_segments++;
+    s->stats.resident_bytes += nbytes;
+    if ((s->stats.resident_bytes == 0) && (nbytes < 0)) {
+        c->n_resident_segments--;
+        if (s->is_active == 1) {  //** Nothing left to share
+            s->is_active = 0;
+            c->n_active_segments--;
+        }
+    }
+
+    if (nbytes > 0) cache_segment_touch(c, seg);
+}
+
+//*************************************************************************
+// cache_segment_touch - Marks the segment as actively using the cache
+//    NOTE: Cache lock should be held by the calling thread
+//*************************************************************************
+
+void cache_segment_touch(cache_t *c, segment_t *seg)
+{
+    cache_segment_t *s = (cache_segment_t *)seg->priv;
+
+    s->last_active = apr_time_now();
+    if (s->is_active == 0) {
+        s->is_active = 1;
+        c->n_active_segments++;
+    }
+}
+
+//*************************************************************************
+// _cache_active_age - Drops segments that haven't used a page within the
+//    active window from the active count.  Their pages are still resident
+//    but they no longer dilute everyone else's share.
+//    NOTE: Cache lock should be held by the calling thread
+//*************************************************************************
+
+void _cache_active_age(cache_t *c)
+{
+    cache_segment_t *s;
+    list_iter_t it;
+    segment_t *seg;
+    ex_id_t *sid;
+    apr_time_t now;
+
+    now = apr_time_now();
+    if ((now - c->active_check) < c->active_window) return;
+    c->active_check = now;
+
+    it = list_iter_search(c->segments, NULL, 0);
+    while (list_next(&it, (list_key_t **)&sid, (list_data_t **)&seg) == 0) {
+        s = (cache_segment_t *)seg->priv;
+        if ((s->is_active == 1) && ((now - s->last_active) > c->active_window)) {
+            s->is_active = 0;
+            c->n_active_segments--;
+        }
+    }
+}
+
+//*************************************************************************
+// cache_page_reref - Returns 1 if the access re-references the page.  That
+//    takes a different request starting at or before where the last one
+//    did in the page.  Sequential I/O smaller than a page walks forward
+//    through it so it doesn't count.
+//    NOTE: Cache lock should be held by the calling thread
+//*************************************************************************
+
+int cache_page_reref(cache_page_t *p, int request_id, ex_off_t offset)
+{
+    ex_off_t poff;
+    int reref;
+
+    poff = offset - p->offset;
+    if (poff < 0) poff = 0;
+
+    reref = ((p->last_request != 0) && (request_id != p->last_request) && (poff <= p->last_access)) ? 1 : 0;
+    p->last_request = request_id;
+    p->last_access = poff;
+
+    return(reref);
+}
+
+//*************************************************************************
+// cache_segment_share - Returns how much of the cache the segment is
+//    entitled to when there's contention.  This is the smaller of the
+//    per-segment cap and an even split between the active segments.
+//    Idle segments don't count so their pages are fair game.
+//*************************************************************************
+
+ex_off_t cache_segment_share(cache_t *c, segment_t *seg, ex_off_t max_bytes)
+{
+    cache_segment_t *s = (cache_segment_t *)seg->priv;
+    ex_off_t share, quota;
+    int n;
+
+    share = max_bytes;
+    if (c->fair_share == 1) {
+        _cache_active_age(c);
+        n = c->n_active_segments;
+        if (s->is_active == 0) n++;  //** Count the requester
+        if (n > 1) share = max_bytes / n;
+    }
+
+    quota = c->segment_max_fraction * max_bytes;
+    if (quota < share) share = quota;
+
+    return(share);
+}
+
+//*************************************************************************
+// cache_segment_over_share - Returns 1 if another page would put the
+//    segment over its share
+//*************************************************************************
+
+int cache_segment_over_share(cache_t *c, segment_t *seg, ex_off_t max_bytes)
+{
+    cache_segment_t *s = (cache_segment_t *)seg->priv;
+
+    return(((s->stats.resident_bytes + s->page_size) > cache_segment_share(c, seg, max_bytes)) ? 1 : 0);
+}
+
+//*************************************************************************
+// cache_page_free_data - Frees the page data and drops it from the
+//    segment's usage
+//*************************************************************************
+
+void cache_page_free_data(cache_t *c, cache_page_t *p)
+{
+    cache_segment_t *s = (cache_segment_t *)p->seg->priv;
+
+    cache_page_account(c, p->seg, -s->page_size);
+
+    if (p->data[0].ptr) free(p->data[0].ptr);
+    if (p->data[1].ptr) free(p->data[1].ptr);
+}
+
+//*************************************************************************
+// cache_page_evict_data - Frees the data for a clean page being evicted.
+//    If a victim tier is configured the current data is handed to it.
+//*************************************************************************
+
+void cache_page_evict_data(cache_t *c, cache_page_t *p)
+{
+    cache_segment_t *s = (cache_segment_t *)p->seg->priv;
+
+    if ((c->victim != NULL) && (p->offset > -1) && (p->curr_data->ptr != NULL) && ((p->bit_fields & (C_ISDIRTY|C_EMPTY)) == 0)) {
+        cache_victim_put(c->victim, segment_id(p->seg), s->data_version, p->offset, p->curr_data->ptr, s->page_size);
+        p->curr_data->ptr = NULL;
+    }
+
+    cache_page_free_data(c, p);
 }
 
 //*************************************************************
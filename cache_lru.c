@@ -178,6 +178,7 @@ cache_page_t *_lru_new_page(cache_t *c, segment_t *seg)
     type_malloc_clear(p->curr_data->ptr, char, s->page_size);
 
     cp->bytes_used += s->page_size;
+    cache_page_account(c, seg, s->page_size);
 
     p->priv = (void *)lp;
     p->seg = seg;
@@ -269,8 +270,7 @@ int lru_pages_release(cache_t *c, cache_page_t **page, int n_pages)
             if (p->offset > -1) {
                 list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
             }
-            if (p->data[0].ptr) free(p->data[0].ptr);
-            if (p->data[1].ptr) free(p->data[1].ptr);
+            cache_page_free_data(c, p);
             free(lp);
         }
     }
@@ -329,8 +329,7 @@ void lru_pages_destroy(cache_t *c, cache_page_t **page, int n_pages, int remove_
                 list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
             }
 
-            if (p->data[0].ptr) free(p->data[0].ptr);
-            if (p->data[1].ptr) free(p->data[1].ptr);
+            cache_page_free_data(c, p);
             free(lp);
         } else {  //** Someone is listening so trigger them and also clear the bits so it will be released
             atomic_set(p->bit_fields, C_TORELEASE);
@@ -349,7 +348,7 @@ void lru_pages_destroy(cache_t *c, cache_page_t **page, int n_pages, int remove_
 //  lru_page_access - Updates the access time for the cache block
 //*************************************************************************
 
-int lru_page_access(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_len)
+int lru_page_access(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_len, int request_id, ex_off_t offset)
 {
     cache_lru_t *cp = (cache_lru_t *)c->fn.priv;
     page_lru_t *lp = (page_lru_t *)p->priv;
@@ -365,6 +364,9 @@ int lru_page_access(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_l
             stack_unlink_current(cp->stack, 1);
             move_to_top(cp->stack);
             insert_link_above(cp->stack, lp->ele);
+            if ((cache_page_reref(p, request_id, offset) == 1) && ((lp->bit_fields & CLRU_ACCESSED) > 0)) lp->bit_fields |= CLRU_REREF;
+            lp->bit_fields |= CLRU_ACCESSED;
+            cache_segment_touch(c, p->seg);
         }
         cache_unlock(c);
     }
@@ -407,13 +409,19 @@ int _lru_free_mem(cache_t *c, segment_t *pseg, ex_off_t bytes_to_free)
                 count = atomic_get(p->access_pending[CACHE_READ]) + atomic_get(p->access_pending[CACHE_WRITE]) + atomic_get(p->access_pending[CACHE_FLUSH]);
                 if (count == 0) { //** No one is using it
                     s = (cache_segment_t *)p->seg->priv;
-                    if ((bits & C_ISDIRTY) == 0) {  //** Don't have to flush it
+                    if ((c->scan_resistance == 1) && ((lp->bit_fields & CLRU_REREF) > 0)) {  //** Re-referenced so give it a 2nd chance
+                        lp->bit_fields ^= CLRU_REREF;
+                        move_to_ptr(cp->stack, lp->ele);
+                        stack_unlink_current(cp->stack, 1);
+                        move_to_top(cp->stack);
+                        insert_link_above(cp->stack, lp->ele);
+                        move_to_bottom(cp->stack);
+                    } else if ((bits & C_ISDIRTY) == 0) {  //** Don't have to flush it
                         total_bytes += s->page_size;
                         log_printf(15, "lru_free_mem: freeing page seg=" XIDT " p->offset=" XOT " bits=%d\n", segment_id(p->seg), p->offset, bits);
                         list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
                         delete_current(cp->stack, 1, 0);
-                        if (p->data[0].ptr) free(p->data[0].ptr);
-                        if (p->data[1].ptr) free(p->data[1].ptr);
+                        cache_page_evict_data(c, p);
                         free(lp);
                     } else {         //** Got to flush the page first
                         err = 1;
@@ -437,6 +445,59 @@ int _lru_free_mem(cache_t *c, segment_t *pseg, ex_off_t bytes_to_free)
     return(pending_bytes);
 }
 
+//*************************************************************************
+//  _lru_free_mem_seg - Frees the segment's own clean pages, oldest first.
+//   Used when the segment is over its share so it recycles its own pages
+//   instead of evicting everyone else's.  The scan stops once all the
+//   segment's resident pages have been passed or after CACHE_SEG_FREE_SCAN_MAX
+//   pages so it's bounded when nothing of its own can be freed.
+//   Returns the pending bytes to free.
+//   NOTE: The caller holds the segment lock
+//*************************************************************************
+
+ex_off_t _lru_free_mem_seg(cache_t *c, segment_t *seg, ex_off_t bytes_to_free)
+{
+    cache_lru_t *cp = (cache_lru_t *)c->fn.priv;
+    cache_segment_t *s = (cache_segment_t *)seg->priv;
+    cache_page_t *p;
+    page_lru_t *lp;
+    Stack_ele_t *ele;
+    ex_off_t total_bytes, seg_bytes, seen_bytes;
+    int count, n_scanned, bits;
+
+    total_bytes = 0;
+    seen_bytes = 0;
+    seg_bytes = s->stats.resident_bytes;
+    n_scanned = 0;
+
+    move_to_bottom(cp->stack);
+    ele = get_ptr(cp->stack);
+    while ((total_bytes < bytes_to_free) && (ele != NULL) && (seen_bytes < seg_bytes) && (n_scanned < CACHE_SEG_FREE_SCAN_MAX)) {
+        n_scanned++;
+        p = (cache_page_t *)get_stack_ele_data(ele);
+        if (p->seg == seg) seen_bytes += s->page_size;
+        lp = (page_lru_t *)p->priv;
+        bits = atomic_get(p->bit_fields);
+        count = atomic_get(p->access_pending[CACHE_READ]) + atomic_get(p->access_pending[CACHE_WRITE]) + atomic_get(p->access_pending[CACHE_FLUSH]);
+        if ((p->seg == seg) && (count == 0) && ((bits & (C_TORELEASE|C_ISDIRTY|C_EMPTY)) == 0) && ((lp->bit_fields & CLRU_ACCESSED) > 0)) {
+            total_bytes += s->page_size;
+            log_printf(15, "freeing own page seg=" XIDT " p->offset=" XOT " resident=" XOT "\n", segment_id(seg), p->offset, s->stats.resident_bytes);
+            list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
+            delete_current(cp->stack, 1, 0);
+            cache_page_evict_data(c, p);
+            free(lp);
+        } else {
+            move_up(cp->stack);
+        }
+
+        ele = get_ptr(cp->stack);
+    }
+
+    cp->bytes_used -= total_bytes;
+
+    return(bytes_to_free - total_bytes);
+}
+
 //*************************************************************************
 // lru_attempt_free_mem - Attempts to forcefully Free page memory
 //   Returns the total number of bytes freed
@@ -563,8 +624,7 @@ ex_off_t _lru_attempt_free_mem(cache_t *c, segment_t *page_seg, ex_off_t bytes_t
                         cp->limbo_pages--;
                         log_printf(15, "FREEING page seg=" XIDT " p->offset=" XOT " bits=%d limbo=%d\n", segment_id(p->seg), p->offset, bits, cp->limbo_pages);
                         list_remove(s->pages, &(p->offset), p);  //** Have to do this here cause p->offset is the key var
-                        if (p->data[0].ptr) free(p->data[0].ptr);
-                        if (p->data[1].ptr) free(p->data[1].ptr);
+                        cache_page_evict_data(c, p);
                         lp = (page_lru_t *)p->priv;
                         free(lp);
                         freed_bytes += s->page_size;
@@ -720,6 +780,9 @@ void _lru_wait_for_page(cache_t *c, segment_t *seg, int ontop)
         n = _lru_force_free_mem(c, seg, bytes_needed, check_waiters_first);
 
         if (n > 0) { //** Didn't make it so wait
+            if (c->fair_share == 1) {  //** Segments within their share are served ahead of the heavy users
+                ontop = (cache_segment_over_share(c, seg, _lru_max_bytes(c)) == 1) ? 0 : 1;
+            }
             if (ontop == 0) {
                 move_to_bottom(cp->waiting_stack);
                 insert_below(cp->waiting_stack, &pw);
@@ -768,7 +831,8 @@ cache_page_t *lru_create_empty_page(cache_t *c, segment_t *seg, int doblock)
         bytes_to_free = s->page_size + cp->bytes_used - max_bytes;
         log_printf(15, "lru_create_empty_page: max_bytes=" XOT " used=" XOT " bytes_to_free=" XOT " doblock=%d\n", max_bytes, cp->bytes_used, bytes_to_free, doblock);
         if (bytes_to_free > 0) {
-            bytes_to_free = _lru_free_mem(c, seg, bytes_to_free);
+            if (cache_segment_over_share(c, seg, max_bytes) == 1) bytes_to_free = _lru_free_mem_seg(c, seg, bytes_to_free);
+            if (bytes_to_free > 0) bytes_to_free = _lru_free_mem(c, seg, bytes_to_free);
             if ((doblock==1) && (bytes_to_free>0)) _lru_wait_for_page(c, seg, qend);
             qend = 1;
         }
@@ -935,6 +999,7 @@ cache_t *lru_cache_load(void *arg, inip_file_t *fd, char *grp, data_attr_t *da,
     c->write_temp_overflow_fraction = inip_get_double(fd, grp, "write_temp_overflow_fraction", c->write_temp_overflow_fraction);
     c->write_temp_overflow_size = c->write_temp_overflow_fraction * cp->max_bytes;
     c->n_ppages = inip_get_integer(fd, grp, "ppages", c->n_ppages);
+    cache_base_load(c, fd, grp);
 
     log_printf(0, "COP size=" XOT "\n", c->write_temp_overflow_size);
 
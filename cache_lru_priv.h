@@ -40,9 +40,13 @@ extern "C" {
 
 #include "cache.h"
 
+#define CLRU_ACCESSED 1  //** Page has been accessed
+#define CLRU_REREF    2  //** Page was hit again after its first access
+
 typedef struct {
     cache_page_t page;  //** Actual page
     Stack_ele_t *ele;   //** LRU position
+    int bit_fields;
 } page_lru_t;
 
 typedef struct {
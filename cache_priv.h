@@ -37,12 +37,14 @@ http://www.accre.vanderbilt.edu
 #include "pigeon_coop.h"
 #include "ex3_abstract.h"
 #include "atomic_counter.h"
+#include "cache_victim.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define CACHE_MAX_PAGES_RETURNED 1000
+#define CACHE_SEG_FREE_SCAN_MAX  4096   //** Max pages checked when a segment recycles its own pages
 
 #define CACHE_NONBLOCK  0
 #define CACHE_DOBLOCK   1
@@ -77,6 +79,7 @@ typedef struct {
     cache_counters_t user;
     cache_counters_t system;
     ex_off_t dirty_bytes;
+    ex_off_t resident_bytes;
     ex_off_t hit_bytes;
     ex_off_t miss_bytes;
     ex_off_t unused_bytes;
@@ -125,6 +128,9 @@ typedef struct {
     ex_off_t page_size;
     ex_off_t child_last_page;
     ex_off_t total_size;
+    apr_time_t last_active;  //** Last time one of the pages was used
+    int is_active;           //** Counted in the cache's active segments
+    uint32_t data_version;   //** Tags pages handed to the victim tier
     cache_stats_t stats;
 } cache_segment_t;
 
@@ -144,6 +150,8 @@ typedef struct {
     int access_pending[3];
     int used_count;
     int current_index;
+    int last_request;       //** Request that last used the page
+    ex_off_t last_access;   //** Where in the page that request started
 }  cache_page_t;
 
 typedef struct {
@@ -170,7 +178,7 @@ struct cache_fn_s {
     void (*destroy_pages)(cache_t *c, cache_page_t **p, int n_pages, int remove_from_segment);
     void (*cache_update)(cache_t *c, segment_t *seg, int rw_mode, ex_off_t lo, ex_off_t hi, void *miss);
     void (*cache_miss_tag)(cache_t *c, segment_t *seg, int rw_mode, ex_off_t lo, ex_off_t hi, ex_off_t missing_offset, void **miss);
-    int (*s_page_access)(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_len);
+    int (*s_page_access)(cache_t *c, cache_page_t *p, int rw_mode, ex_off_t request_len, int request_id, ex_off_t offset);
     int (*s_pages_release)(cache_t *c, cache_page_t **p, int n_pages);
     cache_t *(*get_handle)(cache_t *);
     int (*destroy)(cache_t *c);
@@ -183,6 +191,7 @@ struct cache_s {
     list_t *segments;
     pigeon_coop_t *cond_coop;
     data_attr_t *da;
+    cache_victim_t *victim;   //** Optional local disk tier for evicted pages
     ex_off_t default_page_size;
     cache_stats_t stats;
     ex_off_t max_fetch_size;
@@ -190,14 +199,23 @@ struct cache_s {
     ex_off_t write_temp_overflow_used;
     double   max_fetch_fraction;
     double   write_temp_overflow_fraction;
+    double   segment_max_fraction;  //** Soft cap on any one segment's share of the cache
+    int fair_share;                 //** Split the cache evenly between segments under pressure
+    int scan_resistance;            //** Give re-referenced pages a second chance on eviction
+    int n_resident_segments;
+    int n_active_segments;          //** Segments holding pages that were used within the active window
+    apr_time_t active_window;
+    apr_time_t active_check;
     int n_ppages;
     int timeout;
     int  shutdown_request;
 };
 
 extern atomic_int_t _cache_count;
+extern atomic_int_t _cache_request_count;
 
 #define unique_cache_id() atomic_inc(_cache_count);
+#define unique_cache_request_id() (atomic_inc(_cache_request_count) + 1)
 #define cache_lock(c) apr_thread_mutex_lock((c)->lock)
 #define cache_unlock(c) apr_thread_mutex_unlock((c)->lock)
 #define cache_get_handle(c) (c)->fn.get_handle(c)
@@ -207,10 +225,19 @@ cache_stats_t get_cache_stats(cache_t *c);
 cache_t *cache_base_handle(cache_t *);
 void cache_base_destroy(cache_t *c);
 void cache_base_create(cache_t *c, data_attr_t *da, int timeout);
+void cache_base_load(cache_t *c, inip_file_t *fd, char *grp);
+void cache_page_account(cache_t *c, segment_t *seg, ex_off_t nbytes);
+void cache_segment_touch(cache_t *c, segment_t *seg);
+int cache_page_reref(cache_page_t *p, int request_id, ex_off_t offset);
+void cache_page_free_data(cache_t *c, cache_page_t *p);
+void cache_page_evict_data(cache_t *c, cache_page_t *p);
+ex_off_t cache_segment_share(cache_t *c, segment_t *seg, ex_off_t max_bytes);
+int cache_segment_over_share(cache_t *c, segment_t *seg, ex_off_t max_bytes);
 void *cache_cond_new(void *arg, int size);
 void cache_cond_free(void *arg, int size, void *data);
 op_generic_t *cache_flush_range(segment_t *seg, data_attr_t *da, ex_off_t lo, ex_off_t hi, int timeout);
 int cache_drop_pages(segment_t *seg, ex_off_t lo, ex_off_t hi);
+void cache_segment_set_data_version(segment_t *seg, uint32_t version);
 int cache_release_pages(int n_pages, page_handle_t *page, int rw_mode);
 void _cache_drain_writes(segment_t *seg, cache_page_t *p);
 void cache_advise(segment_t *seg, segment_rw_hints_t *rw_hints, int rw_mode, ex_off_t lo, ex_off_t hi, page_handle_t *page, int *n_pages, int force_load);
@@ -0,0 +1,708 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//***********************************************************************
+// Local disk victim tier.  Clean pages evicted from the in-memory cache
+// are handed to this tier and written asynchronously to a slot file on
+// local storage.  Cache misses check it before going to the child segment.
+// A hit moves the page back into memory so the tiers stay exclusive.
+//
+// Every slot carries a header with the owning segment ID, offset, length,
+// the segment's data version and a CRC of the data, which is checked on
+// every read.  The data version is set by the caller when the object is
+// opened (the exnode and modify time hash) so a copy made before the
+// object changed elsewhere misses and is dropped.  Local truncates, removes
+// and writes invalidate the affected range directly.  Closing a segment
+// leaves its pages in place.  The contents are discarded at startup unless
+// victim_persist is set.  Then the slot index is written at shutdown and
+// reloaded on startup so the contents survive restarts.  The index is
+// removed once loaded so a crash starts cold.
+//***********************************************************************
+
+#define _log_module_index 228
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_proc.h>
+#include "cache_victim.h"
+#include "ex3_fmttypes.h"
+#include "list.h"
+#include "type_malloc.h"
+#include "log.h"
+#include "apr_wrapper.h"
+
+#define CVC_MAGIC         0x4c564332
+#define CVC_INDEX_MAGIC   0x4c564349
+#define CVC_INDEX_VERSION 2
+
+#define CVC_QUEUED  0
+#define CVC_WRITING 1
+#define CVC_VALID   2
+#define CVC_DEAD    3
+
+typedef struct {
+    ex_id_t sid;
+    ex_off_t offset;
+} cache_victim_key_t;
+
+typedef struct cache_victim_entry_s cache_victim_entry_t;
+
+struct cache_victim_entry_s {
+    cache_victim_key_t key;
+    ex_off_t len;
+    uint32_t version;            //** Segment data version the page was taken from
+    char *data;                  //** Page data while queued for writing
+    int slot;
+    int state;
+    cache_victim_entry_t *prev;  //** LRU links when valid.  Only next is used for the write queue
+    cache_victim_entry_t *next;
+};
+
+typedef struct {     //** On disk slot header
+    uint32_t magic;
+    uint32_t crc;
+    ex_id_t sid;
+    ex_off_t offset;
+    ex_off_t len;
+    uint32_t version;
+} cache_victim_header_t;
+
+typedef struct {     //** Persistent index header
+    uint32_t magic;
+    uint32_t version;
+    int64_t page_size;
+    int64_t n_slots;
+    int64_t n_entries;
+} cache_victim_index_header_t;
+
+typedef struct {     //** Persistent index record
+    ex_id_t sid;
+    ex_off_t offset;
+    ex_off_t len;
+    int64_t slot;
+    uint32_t version;
+} cache_victim_index_record_t;
+
+struct cache_victim_s {
+    char *data_fname;
+    char *index_fname;
+    int fd;
+    int n_slots;
+    int n_free;
+    int *free_slot;
+    int shutdown;
+    int persist;
+    ex_off_t page_size;
+    ex_off_t slot_size;
+    ex_off_t pending_bytes;
+    ex_off_t max_pending_bytes;
+    ex_off_t hits;
+    ex_off_t misses;
+    ex_off_t writes;
+    ex_off_t dropped;
+    ex_off_t corrupt;
+    list_t *index;
+    cache_victim_entry_t *lru_head;  //** Most recently written
+    cache_victim_entry_t *lru_tail;
+    cache_victim_entry_t *q_head;    //** Pending writes
+    cache_victim_entry_t *q_tail;
+    apr_pool_t *mpool;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    apr_thread_t *writer;
+};
+
+int _cvc_compare_fn(void *arg, skiplist_key_t *k1, skiplist_key_t *k2);
+skiplist_compare_t _cvc_compare = {_cvc_compare_fn, NULL};
+
+//*************************************************************************
+// _cvc_compare_fn - Orders entries by segment and then offset
+//*************************************************************************
+
+int _cvc_compare_fn(void *arg, skiplist_key_t *k1, skiplist_key_t *k2)
+{
+    cache_victim_key_t *a = (cache_victim_key_t *)k1;
+    cache_victim_key_t *b = (cache_victim_key_t *)k2;
+
+    if (a->sid < b->sid) return(-1);
+    if (a->sid > b->sid) return(1);
+    if (a->offset < b->offset) return(-1);
+    if (a->offset > b->offset) return(1);
+    return(0);
+}
+
+//*************************************************************************
+// _cvc_lru_unlink - Removes the entry from the LRU
+//*************************************************************************
+
+void _cvc_lru_unlink(cache_victim_t *vc, cache_victim_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        vc->lru_head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        vc->lru_tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+//*************************************************************************
+// _cvc_lru_push - Adds the entry to the head of the LRU
+//*************************************************************************
+
+void _cvc_lru_push(cache_victim_t *vc, cache_victim_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = vc->lru_head;
+    if (vc->lru_head) vc->lru_head->prev = e;
+    vc->lru_head = e;
+    if (vc->lru_tail == NULL) vc->lru_tail = e;
+}
+
+//*************************************************************************
+// _cvc_kill - Removes the entry from the index.  Entries still queued or
+//    being written are flagged and cleaned up by the writer.
+//    NOTE: vc->lock must be held
+//*************************************************************************
+
+void _cvc_kill(cache_victim_t *vc, cache_victim_entry_t *e)
+{
+    list_remove(vc->index, &(e->key), e);
+
+    if (e->state == CVC_VALID) {
+        _cvc_lru_unlink(vc, e);
+        vc->free_slot[vc->n_free++] = e->slot;
+        free(e);
+    } else {
+        e->state = CVC_DEAD;
+    }
+}
+
+//*************************************************************************
+// _cvc_slot_get - Returns a free slot evicting the LRU entry if needed
+//    NOTE: vc->lock must be held
+//*************************************************************************
+
+int _cvc_slot_get(cache_victim_t *vc)
+{
+    if (vc->n_free == 0) {
+        if (vc->lru_tail == NULL) return(-1);  //** Everything is in flight
+        _cvc_kill(vc, vc->lru_tail);
+    }
+
+    vc->n_free--;
+    return(vc->free_slot[vc->n_free]);
+}
+
+//*************************************************************************
+// _cvc_slot_write - Stores the page in the slot
+//*************************************************************************
+
+int _cvc_slot_write(cache_victim_t *vc, int slot, cache_victim_key_t *key, uint32_t version, char *data, ex_off_t len)
+{
+    cache_victim_header_t hdr;
+    struct iovec iov[2];
+    ssize_t n;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CVC_MAGIC;
+    hdr.sid = key->sid;
+    hdr.offset = key->offset;
+    hdr.len = len;
+    hdr.version = version;
+    hdr.crc = crc32(0L, Z_NULL, 0);
+    hdr.crc = crc32(hdr.crc, (const Bytef *)data, len);
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = data;
+    iov[1].iov_len = len;
+
+    n = pwritev(vc->fd, iov, 2, (off_t)slot * vc->slot_size);
+    if (n != (ssize_t)(sizeof(hdr) + len)) {
+        log_printf(1, "ERROR writing slot=%d sid=" XIDT " off=" XOT " n=" XOT " errno=%d\n", slot, key->sid, key->offset, (ex_off_t)n, errno);
+        return(1);
+    }
+
+    return(0);
+}
+
+//*************************************************************************
+// _cvc_slot_read - Loads the page from the slot and verifies it belongs
+//    to the requested segment, range and data version and is intact
+//*************************************************************************
+
+int _cvc_slot_read(cache_victim_t *vc, int slot, cache_victim_key_t *key, uint32_t version, char *buf, ex_off_t len)
+{
+    cache_victim_header_t hdr;
+    struct iovec iov[2];
+    uint32_t crc;
+    ssize_t n;
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+
+    n = preadv(vc->fd, iov, 2, (off_t)slot * vc->slot_size);
+    if (n != (ssize_t)(sizeof(hdr) + len)) {
+        log_printf(1, "ERROR reading slot=%d sid=" XIDT " off=" XOT " n=" XOT " errno=%d\n", slot, key->sid, key->offset, (ex_off_t)n, errno);
+        return(1);
+    }
+
+    if ((hdr.magic != CVC_MAGIC) || (hdr.sid != key->sid) || (hdr.offset != key->offset) || (hdr.len != len) || (hdr.version != version)) {
+        log_printf(1, "ERROR slot=%d header mismatch wanted sid=" XIDT " off=" XOT " got sid=" XIDT " off=" XOT "\n", slot, key->sid, key->offset, hdr.sid, hdr.offset);
+        return(1);
+    }
+
+    crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *)buf, len);
+    if (crc != hdr.crc) {
+        log_printf(1, "ERROR slot=%d sid=" XIDT " off=" XOT " CRC mismatch\n", slot, key->sid, key->offset);
+        return(1);
+    }
+
+    return(0);
+}
+
+//*************************************************************************
+// cache_victim_writer_thread - Drains the queue of evicted pages
+//*************************************************************************
+
+void *cache_victim_writer_thread(apr_thread_t *th, void *data)
+{
+    cache_victim_t *vc = (cache_victim_t *)data;
+    cache_victim_entry_t *e;
+    char *buf;
+    int slot, err;
+
+    apr_thread_mutex_lock(vc->lock);
+    for (;;) {
+        while ((vc->q_head == NULL) && (vc->shutdown == 0)) {
+            apr_thread_cond_wait(vc->cond, vc->lock);
+        }
+        if (vc->q_head == NULL) break;  //** Shutting down and the queue is drained
+
+        e = vc->q_head;
+        vc->q_head = e->next;
+        if (vc->q_head == NULL) vc->q_tail = NULL;
+        e->next = NULL;
+        vc->pending_bytes -= e->len;
+
+        if (e->state == CVC_DEAD) {  //** Invalidated while queued
+            free(e->data);
+            free(e);
+            continue;
+        }
+
+        slot = _cvc_slot_get(vc);
+        if (slot < 0) {
+            list_remove(vc->index, &(e->key), e);
+            vc->dropped++;
+            free(e->data);
+            free(e);
+            continue;
+        }
+
+        e->slot = slot;
+        e->state = CVC_WRITING;
+        buf = e->data;
+        e->data = NULL;
+        apr_thread_mutex_unlock(vc->lock);
+
+        err = _cvc_slot_write(vc, slot, &(e->key), e->version, buf, e->len);
+        free(buf);
+
+        apr_thread_mutex_lock(vc->lock);
+        if ((e->state == CVC_DEAD) || (err != 0)) {
+            if (e->state != CVC_DEAD) list_remove(vc->index, &(e->key), e);
+            vc->free_slot[vc->n_free++] = slot;
+            free(e);
+        } else {
+            e->state = CVC_VALID;
+            _cvc_lru_push(vc, e);
+            vc->writes++;
+        }
+    }
+    apr_thread_mutex_unlock(vc->lock);
+
+    return(NULL);
+}
+
+//*************************************************************************
+// cache_victim_put - Queues an evicted clean page for writing.  The tier
+//    takes ownership of data.  version is the segment's data version and
+//    must match on the later get.
+//*************************************************************************
+
+void cache_victim_put(cache_victim_t *vc, ex_id_t sid, uint32_t version, ex_off_t offset, char *data, ex_off_t len)
+{
+    cache_victim_entry_t *e;
+    cache_victim_key_t key;
+
+    if (len > vc->page_size) {
+        free(data);
+        return;
+    }
+
+    key.sid = sid;
+    key.offset = offset;
+
+    apr_thread_mutex_lock(vc->lock);
+    if ((vc->shutdown != 0) || ((vc->pending_bytes + len) > vc->max_pending_bytes)) {
+        vc->dropped++;
+        apr_thread_mutex_unlock(vc->lock);
+        free(data);
+        return;
+    }
+
+    e = list_search(vc->index, (skiplist_key_t *)&key);
+    if (e != NULL) _cvc_kill(vc, e);  //** Replace any older copy
+
+    type_malloc_clear(e, cache_victim_entry_t, 1);
+    e->key = key;
+    e->len = len;
+    e->version = version;
+    e->data = data;
+    e->slot = -1;
+    e->state = CVC_QUEUED;
+    list_insert(vc->index, &(e->key), e);
+
+    if (vc->q_tail) {
+        vc->q_tail->next = e;
+    } else {
+        vc->q_head = e;
+    }
+    vc->q_tail = e;
+    vc->pending_bytes += len;
+
+    apr_thread_cond_signal(vc->cond);
+    apr_thread_mutex_unlock(vc->lock);
+}
+
+//*************************************************************************
+// cache_victim_get - Loads the page into buf if it's stored in the tier.
+//    The entry is removed on a hit since the page is back in memory.  A
+//    copy from a different data version is stale and is dropped.
+//    Returns 0 on a hit and 1 otherwise.
+//*************************************************************************
+
+int cache_victim_get(cache_victim_t *vc, ex_id_t sid, uint32_t version, ex_off_t offset, char *buf, ex_off_t len)
+{
+    cache_victim_entry_t *e;
+    cache_victim_key_t key;
+    int slot, err;
+
+    key.sid = sid;
+    key.offset = offset;
+
+    apr_thread_mutex_lock(vc->lock);
+    e = list_search(vc->index, (skiplist_key_t *)&key);
+    if ((e != NULL) && (e->version != version)) {  //** The object changed since the page was stored
+        _cvc_kill(vc, e);
+        e = NULL;
+    }
+    if ((e == NULL) || (e->state != CVC_VALID) || (e->len != len)) {
+        vc->misses++;
+        apr_thread_mutex_unlock(vc->lock);
+        return(1);
+    }
+
+    //** Pull it out so no one else can touch the slot until we're done
+    list_remove(vc->index, &(e->key), e);
+    _cvc_lru_unlink(vc, e);
+    slot = e->slot;
+    free(e);
+    apr_thread_mutex_unlock(vc->lock);
+
+    err = _cvc_slot_read(vc, slot, &key, version, buf, len);
+
+    apr_thread_mutex_lock(vc->lock);
+    vc->free_slot[vc->n_free++] = slot;
+    if (err == 0) {
+        vc->hits++;
+    } else {
+        vc->corrupt++;
+    }
+    apr_thread_mutex_unlock(vc->lock);
+
+    return(err);
+}
+
+//*************************************************************************
+// cache_victim_invalidate - Drops any pages overlapping the byte range
+//*************************************************************************
+
+void cache_victim_invalidate(cache_victim_t *vc, ex_id_t sid, ex_off_t lo, ex_off_t hi)
+{
+    cache_victim_entry_t *e;
+    cache_victim_key_t key, *k;
+    list_iter_t it;
+    Stack_t *stack;
+
+    key.sid = sid;
+    key.offset = lo - vc->page_size + 1;  //** Catch pages starting before lo
+    if (key.offset < 0) key.offset = 0;
+
+    stack = new_stack();
+
+    apr_thread_mutex_lock(vc->lock);
+    it = list_iter_search(vc->index, (list_key_t *)&key, 0);
+    while (list_next(&it, (list_key_t **)&k, (list_data_t **)&e) == 0) {
+        if ((e->key.sid != sid) || (e->key.offset > hi)) break;
+        if ((e->key.offset + e->len - 1) >= lo) push(stack, e);
+    }
+
+    while ((e = pop(stack)) != NULL) {
+        _cvc_kill(vc, e);
+    }
+    apr_thread_mutex_unlock(vc->lock);
+
+    free_stack(stack, 0);
+}
+
+//*************************************************************************
+// _cvc_index_load - Loads the persistent index if enabled and it matches
+//    the current layout.  The index file is removed afterwards.
+//*************************************************************************
+
+void _cvc_index_load(cache_victim_t *vc)
+{
+    cache_victim_index_header_t hdr;
+    cache_victim_index_record_t r;
+    cache_victim_entry_t *e;
+    char *used;
+    FILE *fd;
+    int64_t i;
+    int n;
+
+    type_malloc_clear(used, char, vc->n_slots);
+
+    fd = (vc->persist) ? fopen(vc->index_fname, "r") : NULL;
+    if (fd != NULL) {
+        if ((fread(&hdr, sizeof(hdr), 1, fd) == 1) && (hdr.magic == CVC_INDEX_MAGIC) && (hdr.version == CVC_INDEX_VERSION) &&
+                (hdr.page_size == vc->page_size) && (hdr.n_slots == vc->n_slots)) {
+            for (i=0; i<hdr.n_entries; i++) {  //** Stored from the LRU tail to the head
+                if (fread(&r, sizeof(r), 1, fd) != 1) break;
+                if ((r.slot < 0) || (r.slot >= vc->n_slots) || (used[r.slot] != 0) || (r.len > vc->page_size)) continue;
+                if (list_search(vc->index, (skiplist_key_t *)&r) != NULL) continue;
+
+                type_malloc_clear(e, cache_victim_entry_t, 1);
+                e->key.sid = r.sid;
+                e->key.offset = r.offset;
+                e->len = r.len;
+                e->version = r.version;
+                e->slot = r.slot;
+                e->state = CVC_VALID;
+                used[r.slot] = 1;
+                list_insert(vc->index, &(e->key), e);
+                _cvc_lru_push(vc, e);
+            }
+        } else {
+            log_printf(1, "Ignoring index with a different layout fname=%s\n", vc->index_fname);
+        }
+        fclose(fd);
+    }
+    unlink(vc->index_fname);  //** Always removed so an old index can't be picked up by a later run
+
+    n = 0;
+    for (i=0; i<vc->n_slots; i++) {
+        if (used[i] == 0) vc->free_slot[n++] = i;
+    }
+    vc->n_free = n;
+
+    log_printf(1, "fname=%s loaded=%d free=%d\n", vc->data_fname, vc->n_slots - n, n);
+    free(used);
+}
+
+//*************************************************************************
+// _cvc_index_save - Writes the index so the contents survive a restart
+//*************************************************************************
+
+void _cvc_index_save(cache_victim_t *vc)
+{
+    cache_victim_index_header_t hdr;
+    cache_victim_index_record_t r;
+    cache_victim_entry_t *e;
+    FILE *fd;
+
+    fd = fopen(vc->index_fname, "w");
+    if (fd == NULL) {
+        log_printf(0, "ERROR opening index fname=%s errno=%d\n", vc->index_fname, errno);
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CVC_INDEX_MAGIC;
+    hdr.version = CVC_INDEX_VERSION;
+    hdr.page_size = vc->page_size;
+    hdr.n_slots = vc->n_slots;
+    hdr.n_entries = vc->n_slots - vc->n_free;
+    fwrite(&hdr, sizeof(hdr), 1, fd);
+
+    memset(&r, 0, sizeof(r));
+    for (e = vc->lru_tail; e != NULL; e = e->prev) {
+        r.sid = e->key.sid;
+        r.offset = e->key.offset;
+        r.len = e->len;
+        r.version = e->version;
+        r.slot = e->slot;
+        fwrite(&r, sizeof(r), 1, fd);
+    }
+
+    if (fclose(fd) != 0) {
+        log_printf(0, "ERROR writing index fname=%s errno=%d\n", vc->index_fname, errno);
+        unlink(vc->index_fname);
+    }
+}
+
+//*************************************************************************
+// cache_victim_destroy - Flushes pending writes, saves the index if
+//    persistent and tears down the tier
+//*************************************************************************
+
+void cache_victim_destroy(cache_victim_t *vc)
+{
+    cache_victim_entry_t *e;
+    apr_status_t value;
+
+    apr_thread_mutex_lock(vc->lock);
+    vc->shutdown = 1;
+    apr_thread_cond_signal(vc->cond);
+    apr_thread_mutex_unlock(vc->lock);
+
+    apr_thread_join(&value, vc->writer);  //** Wait for the queue to drain
+
+    log_printf(1, "fname=%s hits=" XOT " misses=" XOT " writes=" XOT " dropped=" XOT " corrupt=" XOT "\n", vc->data_fname,
+               vc->hits, vc->misses, vc->writes, vc->dropped, vc->corrupt);
+
+    if (vc->persist) {
+        fsync(vc->fd);
+        _cvc_index_save(vc);
+    }
+
+    while ((e = vc->lru_head) != NULL) {
+        _cvc_lru_unlink(vc, e);
+        free(e);
+    }
+    list_destroy(vc->index);
+
+    close(vc->fd);
+    apr_thread_mutex_destroy(vc->lock);
+    apr_thread_cond_destroy(vc->cond);
+    apr_pool_destroy(vc->mpool);
+
+    free(vc->free_slot);
+    free(vc->data_fname);
+    free(vc->index_fname);
+    free(vc);
+}
+
+//*************************************************************************
+// cache_victim_load - Creates the victim tier from the cache section.
+//    Returns NULL if no victim_dir is configured or it can't be used.
+//*************************************************************************
+
+cache_victim_t *cache_victim_load(inip_file_t *fd, char *grp, ex_off_t default_page_size)
+{
+    cache_victim_t *vc;
+    char *dir;
+    char fname[4096];
+    ex_off_t max_bytes;
+
+    dir = inip_get_string(fd, grp, "victim_dir", NULL);
+    if (dir == NULL) return(NULL);
+
+    type_malloc_clear(vc, cache_victim_t, 1);
+    max_bytes = inip_get_integer(fd, grp, "victim_max_bytes", 1024*1024*1024);
+    vc->page_size = inip_get_integer(fd, grp, "victim_page_size", default_page_size);
+    vc->max_pending_bytes = inip_get_integer(fd, grp, "victim_max_pending", 64*1024*1024);
+    vc->persist = inip_get_integer(fd, grp, "victim_persist", 0);
+    vc->slot_size = sizeof(cache_victim_header_t) + vc->page_size;
+    vc->n_slots = max_bytes / vc->slot_size;
+
+    mkdir(dir, S_IRWXU);
+    snprintf(fname, sizeof(fname), "%s/victim.pages", dir);
+    vc->data_fname = strdup(fname);
+    snprintf(fname, sizeof(fname), "%s/victim.index", dir);
+    vc->index_fname = strdup(fname);
+    free(dir);
+
+    if (vc->n_slots <= 0) {
+        log_printf(0, "ERROR victim_max_bytes too small fname=%s\n", vc->data_fname);
+        goto fail;
+    }
+
+    vc->fd = open(vc->data_fname, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
+    if (vc->fd == -1) {
+        log_printf(0, "ERROR opening fname=%s errno=%d\n", vc->data_fname, errno);
+        goto fail;
+    }
+
+    //** Only one process can own the tier at a time
+    if (flock(vc->fd, LOCK_EX|LOCK_NB) != 0) {
+        log_printf(0, "ERROR victim tier already in use fname=%s\n", vc->data_fname);
+        close(vc->fd);
+        goto fail;
+    }
+
+    if (ftruncate(vc->fd, (off_t)vc->n_slots * vc->slot_size) != 0) {
+        log_printf(0, "ERROR sizing fname=%s errno=%d\n", vc->data_fname, errno);
+        close(vc->fd);
+        goto fail;
+    }
+
+    vc->index = list_create(0, &_cvc_compare, NULL, NULL, NULL);
+    type_malloc(vc->free_slot, int, vc->n_slots);
+    _cvc_index_load(vc);
+
+    apr_pool_create(&(vc->mpool), NULL);
+    apr_thread_mutex_create(&(vc->lock), APR_THREAD_MUTEX_DEFAULT, vc->mpool);
+    apr_thread_cond_create(&(vc->cond), vc->mpool);
+    thread_create_assert(&(vc->writer), NULL, cache_victim_writer_thread, (void *)vc, vc->mpool);
+
+    return(vc);
+
+fail:
+    free(vc->data_fname);
+    free(vc->index_fname);
+    free(vc);
+    return(NULL);
+}
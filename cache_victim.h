@@ -0,0 +1,58 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//*************************************************************************
+// Local disk victim tier used beneath the in-memory page caches
+//*************************************************************************
+
+#ifndef __CACHE_VICTIM_H_
+#define __CACHE_VICTIM_H_
+
+#include "ex3_types.h"
+#include "iniparse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct cache_victim_s;
+typedef struct cache_victim_s cache_victim_t;
+
+cache_victim_t *cache_victim_load(inip_file_t *fd, char *grp, ex_off_t default_page_size);
+void cache_victim_destroy(cache_victim_t *vc);
+void cache_victim_put(cache_victim_t *vc, ex_id_t sid, uint32_t version, ex_off_t offset, char *data, ex_off_t len);
+int cache_victim_get(cache_victim_t *vc, ex_id_t sid, uint32_t version, ex_off_t offset, char *buf, ex_off_t len);
+void cache_victim_invalidate(cache_victim_t *vc, ex_id_t sid, ex_off_t lo, ex_off_t hi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,1310 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//***********************************************************************
+// Mock depot data service.  Allocations are kept in memory or in local
+// files.  Each depot (ds_key) can be given a per op latency, a shared
+// link bandwidth, and a failure rate so cache, erasure and copy paths can
+// be benchmarked on a single box without IBP.
+//***********************************************************************
+
+#define _log_module_index 223
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "assert_result.h"
+#include "ds_mock.h"
+#include "ex3_abstract.h"
+#include "ex3_system.h"
+#include "thread_pool.h"
+#include "iniparse.h"
+#include "opque.h"
+#include "log.h"
+#include "random.h"
+#include "string_token.h"
+#include "type_malloc.h"
+#include "apr_wrapper.h"
+
+#define DS_MOCK_CAP_PREFIX "mock://"
+
+typedef struct {
+    char *ds_key;
+    char *dir;                //** Backing directory when using files
+    double latency;           //** Per op latency in seconds
+    double bandwidth;         //** Link bandwidth in bytes/sec.  0 means unlimited
+    double fail_rate;         //** Fraction of ops that fail
+    int down;                 //** If set every op fails
+    ds_int_t total_space;
+    ds_int_t used_space;
+    apr_time_t busy_until;    //** When the depot link is free again
+    apr_thread_mutex_t *lock;
+} ds_mock_depot_t;
+
+typedef struct {
+    char *key;                //** ds_key#id.  Used for the alloc table
+    char *id;
+    ds_mock_depot_t *depot;
+    char *data;               //** Memory backing
+    int fd;                   //** File backing
+    ds_int_t data_size;       //** Size of the data buffer
+    ds_int_t curr_size;
+    ds_int_t max_size;
+    ds_int_t read_count;
+    ds_int_t write_count;
+    ds_int_t duration;
+    int refs;                 //** Ops currently using the allocation.  Protected by ds->lock
+    int removed;              //** Set once the read count hits 0.  Freed when the last op releases it
+    apr_pool_t *mpool;        //** Own pool so the lock is released with the allocation
+    apr_thread_mutex_t *lock;
+} ds_mock_alloc_t;
+
+typedef struct {
+    int backing;
+    char *directory;
+    double latency;           //** Defaults for depots without their own section
+    double bandwidth;
+    double fail_rate;
+    ds_int_t total_space;
+    ds_mock_attr_t attr_default;
+    thread_pool_context_t *tpc;
+    apr_pool_t *mpool;
+    apr_thread_mutex_t *lock;
+    apr_hash_t *depots;
+    apr_hash_t *allocs;
+} ds_mock_priv_t;
+
+typedef struct {
+    data_service_fn_t *dsf;
+    ds_mock_attr_t *attr;
+    char *res;
+    data_cap_set_t *caps;
+    data_cap_t *cap;
+    data_cap_t *dest_cap;
+    void *result;
+    ds_int_t off;
+    ds_int_t dest_off;
+    ds_int_t len;
+    int mode;
+    int captype;
+    int n_iov;
+    ex_iovec_t iov_single;
+    ex_iovec_t *iov;
+    tbuffer_t *buffer;
+    ex_off_t boff;
+} ds_mock_op_t;
+
+//***********************************************************************
+// ds_mock_destroy_* - Simple destroy routines
+//***********************************************************************
+
+void ds_mock_destroy_probe(data_service_fn_t *arg, data_probe_t *probe)
+{
+    free(probe);
+}
+
+void ds_mock_destroy_attr(data_service_fn_t *arg, data_attr_t *attr)
+{
+    free(attr);
+}
+
+void ds_mock_destroy_inquire(data_service_fn_t *arg, data_inquire_t *di)
+{
+    free(di);
+}
+
+//***********************************************************************
+// ds_mock_new_cap_set - Creates a new capability set
+//***********************************************************************
+
+data_cap_set_t *ds_mock_new_cap_set(data_service_fn_t *arg)
+{
+    ds_mock_capset_t *cs;
+
+    type_malloc_clear(cs, ds_mock_capset_t, 1);
+    return((data_cap_set_t *)cs);
+}
+
+//***********************************************************************
+// ds_mock_destroy_cap_set - Destroys a cap set
+//***********************************************************************
+
+void ds_mock_destroy_cap_set(data_service_fn_t *arg, data_cap_set_t *dcs, int free_caps)
+{
+    ds_mock_capset_t *cs = (ds_mock_capset_t *)dcs;
+
+    if (free_caps > 0) {
+        if (cs->readCap != NULL) free(cs->readCap);
+        if (cs->writeCap != NULL) free(cs->writeCap);
+        if (cs->manageCap != NULL) free(cs->manageCap);
+    }
+    free(cs);
+}
+
+//***********************************************************************
+// ds_mock_cap_auto_warm - Mock allocations never expire so nothing to do
+//***********************************************************************
+
+void *ds_mock_cap_auto_warm(data_service_fn_t *arg, data_cap_set_t *dcs)
+{
+    return(NULL);
+}
+
+void ds_mock_cap_stop_warm(data_service_fn_t *arg, void *dcs)
+{
+    return;
+}
+
+//***********************************************************************
+// ds_mock_get_cap - Returns a specific cap from the set
+//***********************************************************************
+
+data_cap_t *ds_mock_get_cap(data_service_fn_t *arg, data_cap_set_t *dcs, int key)
+{
+    ds_mock_capset_t *cs = (ds_mock_capset_t *)dcs;
+    char *cap = NULL;
+
+    switch (key) {
+    case DS_CAP_READ:
+        cap = cs->readCap;
+        break;
+    case DS_CAP_WRITE:
+        cap = cs->writeCap;
+        break;
+    case DS_CAP_MANAGE:
+        cap = cs->manageCap;
+        break;
+    }
+
+    return((void *)cap);
+}
+
+//***********************************************************************
+// ds_mock_set_cap - Sets a particular cap
+//***********************************************************************
+
+int ds_mock_set_cap(data_service_fn_t *arg, data_cap_set_t *dcs, int key, data_cap_t *cap)
+{
+    ds_mock_capset_t *cs = (ds_mock_capset_t *)dcs;
+    int err = 0;
+
+    switch (key) {
+    case DS_CAP_READ:
+        cs->readCap = cap;
+        break;
+    case DS_CAP_WRITE:
+        cs->writeCap = cap;
+        break;
+    case DS_CAP_MANAGE:
+        cs->manageCap = cap;
+        break;
+    default:
+        err = 1;
+    }
+
+    return(err);
+}
+
+//***********************************************************************
+// ds_mock_translate_one - Replaces the ds_key portion of a single cap
+//***********************************************************************
+
+char *ds_mock_translate_one(char *cap, char *ds_key)
+{
+    char *hash, *ncap;
+    int n, plen;
+
+    plen = strlen(DS_MOCK_CAP_PREFIX);
+    if ((cap == NULL) || (strncmp(cap, DS_MOCK_CAP_PREFIX, plen) != 0)) return(cap);
+    hash = strchr(cap + plen, '#');
+    if (hash == NULL) return(cap);
+    if (((hash - cap - plen) == strlen(ds_key)) && (strncmp(cap + plen, ds_key, strlen(ds_key)) == 0)) return(cap);
+
+    n = plen + strlen(ds_key) + strlen(hash) + 1;
+    type_malloc(ncap, char, n);
+    snprintf(ncap, n, "%s%s%s", DS_MOCK_CAP_PREFIX, ds_key, hash);
+    free(cap);
+    return(ncap);
+}
+
+//***********************************************************************
+//  ds_mock_translate_cap_set - Translates the capability if needed
+//***********************************************************************
+
+void ds_mock_translate_cap_set(data_service_fn_t *ds, char *rid_key, char *ds_key, data_cap_set_t *dcs)
+{
+    ds_mock_capset_t *cs = (ds_mock_capset_t *)dcs;
+
+    cs->readCap = ds_mock_translate_one(cs->readCap, ds_key);
+    cs->writeCap = ds_mock_translate_one(cs->writeCap, ds_key);
+    cs->manageCap = ds_mock_translate_one(cs->manageCap, ds_key);
+}
+
+//***********************************************************************
+// ds_mock_new_attr - Creates a new attributes structure
+//***********************************************************************
+
+data_attr_t *ds_mock_new_attr(data_service_fn_t *arg)
+{
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)arg->priv;
+    ds_mock_attr_t *a;
+
+    type_malloc(a, ds_mock_attr_t, 1);
+    *a = ds->attr_default;
+
+    return((data_attr_t *)a);
+}
+
+//***********************************************************************
+// ds_mock_get_attr - Returns a specific attribute
+//***********************************************************************
+
+int ds_mock_get_attr(data_service_fn_t *arg, data_attr_t *dsa, int key, void *val, int size)
+{
+    ds_mock_attr_t *a = (ds_mock_attr_t *)dsa;
+
+    if (key != DS_ATTR_DURATION) return(-1);
+    if (size < sizeof(ds_int_t)) return(sizeof(ds_int_t));
+
+    *(ds_int_t *)val = a->duration;
+    return(0);
+}
+
+//***********************************************************************
+// ds_mock_set_attr - Sets a specific attribute
+//***********************************************************************
+
+int ds_mock_set_attr(data_service_fn_t *arg, data_attr_t *dsa, int key, void *val)
+{
+    ds_mock_attr_t *a = (ds_mock_attr_t *)dsa;
+
+    if (key != DS_ATTR_DURATION) return(-1);
+
+    a->duration = *(ds_int_t *)val;
+    return(0);
+}
+
+//***********************************************************************
+// ds_mock_set_default_attr/get_default_attr - Default attribute handling
+//***********************************************************************
+
+int ds_mock_set_default_attr(data_service_fn_t *dsf, data_attr_t *da)
+{
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)dsf->priv;
+
+    ds->attr_default = *(ds_mock_attr_t *)da;
+    return(0);
+}
+
+int ds_mock_get_default_attr(data_service_fn_t *dsf, data_attr_t *da)
+{
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)dsf->priv;
+
+    *(ds_mock_attr_t *)da = ds->attr_default;
+    return(0);
+}
+
+//***********************************************************************
+// ds_mock_new_probe - Creates a new probe structure
+//***********************************************************************
+
+data_probe_t *ds_mock_new_probe(data_service_fn_t *arg)
+{
+    ds_mock_probe_t *p;
+
+    type_malloc_clear(p, ds_mock_probe_t, 1);
+    return((data_probe_t *)p);
+}
+
+//***********************************************************************
+// ds_mock_get_probe - Returns a specific probe value
+//***********************************************************************
+
+int ds_mock_get_probe(data_service_fn_t *arg, data_probe_t *probe, int key, void *val, int size)
+{
+    ds_mock_probe_t *p = (ds_mock_probe_t *)probe;
+    ds_int_t *n = (ds_int_t *)val;
+    int err = 0;
+
+    if (size < sizeof(ds_int_t))  return(sizeof(ds_int_t));
+
+    switch (key) {
+    case DS_PROBE_DURATION:
+        *n = p->duration;
+        break;
+    case DS_PROBE_READ_COUNT:
+        *n = p->read_count;
+        break;
+    case DS_PROBE_WRITE_COUNT:
+        *n = p->write_count;
+        break;
+    case DS_PROBE_CURR_SIZE:
+        *n = p->curr_size;
+        break;
+    case DS_PROBE_MAX_SIZE:
+        *n = p->max_size;
+        break;
+    default:
+        err = -1;
+    }
+
+    return(err);
+}
+
+//***********************************************************************
+//  ds_mock_res2rid - The RID is the last component of the ds_key
+//***********************************************************************
+
+char *ds_mock_res2rid(data_service_fn_t *dsf, char *res)
+{
+    char *rid;
+
+    rid = strrchr(res, '/');
+    if (rid == NULL) rid = strrchr(res, ':');
+    return(strdup((rid == NULL) ? res : rid+1));
+}
+
+//***********************************************************************
+// ds_mock_new_inquire - Creates a new inquire structure
+//***********************************************************************
+
+data_inquire_t *ds_mock_new_inquire(data_service_fn_t *arg)
+{
+    ds_mock_inquire_t *d;
+
+    type_malloc_clear(d, ds_mock_inquire_t, 1);
+    return(d);
+}
+
+//***********************************************************************
+//  ds_mock_res_inquire_get - Returns the space value
+//***********************************************************************
+
+ds_int_t ds_mock_res_inquire_get(data_service_fn_t *dsf, int type, data_inquire_t *space)
+{
+    ds_mock_inquire_t *d = (ds_mock_inquire_t *)space;
+
+    switch(type) {
+    case DS_INQUIRE_USED:
+        return(d->used);
+    case DS_INQUIRE_FREE:
+        return(d->free);
+    case DS_INQUIRE_TOTAL:
+        return(d->total);
+    }
+
+    return(-1);
+}
+
+//***********************************************************************
+// ds_mock_depot_get - Returns the depot creating it with the defaults
+//     if needed.  Called with ds->lock held.
+//***********************************************************************
+
+ds_mock_depot_t *ds_mock_depot_get(ds_mock_priv_t *ds, char *ds_key)
+{
+    ds_mock_depot_t *d;
+    char dir[4096];
+    int i, n;
+
+    d = apr_hash_get(ds->depots, ds_key, APR_HASH_KEY_STRING);
+    if (d != NULL) return(d);
+
+    type_malloc_clear(d, ds_mock_depot_t, 1);
+    d->ds_key = strdup(ds_key);
+    d->latency = ds->latency;
+    d->bandwidth = ds->bandwidth;
+    d->fail_rate = ds->fail_rate;
+    d->total_space = ds->total_space;
+    apr_thread_mutex_create(&(d->lock), APR_THREAD_MUTEX_DEFAULT, ds->mpool);
+
+    if (ds->backing == DS_MOCK_BACKING_FILE) {  //** Each depot gets its own directory
+        n = snprintf(dir, sizeof(dir), "%s/", ds->directory);
+        for (i=0; (ds_key[i] != '\0') && (n < sizeof(dir)-1); i++, n++) {
+            dir[n] = ((ds_key[i] == '/') || (ds_key[i] == ':')) ? '_' : ds_key[i];
+        }
+        dir[n] = '\0';
+        mkdir(dir, S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH);
+        d->dir = strdup(dir);
+    }
+
+    apr_hash_set(ds->depots, d->ds_key, APR_HASH_KEY_STRING, d);
+    return(d);
+}
+
+//***********************************************************************
+// ds_mock_delay - Applies the depot's latency and bandwidth to the op and
+//     returns non-zero if the op should fail
+//***********************************************************************
+
+int ds_mock_delay(ds_mock_depot_t *d, ds_int_t nbytes)
+{
+    apr_time_t now, done;
+    int fail;
+
+    now = apr_time_now();
+    apr_thread_mutex_lock(d->lock);
+    fail = d->down;
+    if ((fail == 0) && (d->fail_rate > 0)) fail = (random_double(0, 1) < d->fail_rate) ? 1 : 0;
+
+    //** The link is shared so transfers are serialized
+    done = (d->busy_until > now) ? d->busy_until : now;
+    if ((d->bandwidth > 0) && (nbytes > 0)) done += (apr_time_t)((APR_USEC_PER_SEC * (double)nbytes) / d->bandwidth);
+    d->busy_until = done;
+    apr_thread_mutex_unlock(d->lock);
+
+    //** The latency isn't so ops overlap
+    done += d->latency * APR_USEC_PER_SEC;
+    now = apr_time_now();
+    if (done > now) apr_sleep(done - now);
+
+    return(fail);
+}
+
+//***********************************************************************
+// ds_mock_meta_save - Stores the allocation metadata for file backing
+//***********************************************************************
+
+void ds_mock_meta_save(ds_mock_alloc_t *a)
+{
+    char fname[4096];
+    FILE *fd;
+
+    if (a->depot->dir == NULL) return;
+
+    snprintf(fname, sizeof(fname), "%s/%s.meta", a->depot->dir, a->id);
+    fd = fopen(fname, "w");
+    if (fd == NULL) {
+        log_printf(0, "ERROR: Unable to write metadata %s\n", fname);
+        return;
+    }
+    fprintf(fd, XOT " " XOT " " XOT " " XOT "\n", a->max_size, a->read_count, a->write_count, a->duration);
+    fclose(fd);
+}
+
+//***********************************************************************
+// ds_mock_alloc_new - Makes a new allocation.  Called with ds->lock held.
+//***********************************************************************
+
+ds_mock_alloc_t *ds_mock_alloc_new(ds_mock_priv_t *ds, ds_mock_depot_t *d, char *id)
+{
+    ds_mock_alloc_t *a;
+    char key[4096];
+    int n;
+
+    n = snprintf(key, sizeof(key), "%s#%s", d->ds_key, id);
+    type_malloc_clear(a, ds_mock_alloc_t, 1);
+    a->key = strdup(key);
+    a->id = &(a->key[n - strlen(id)]);
+    a->depot = d;
+    a->fd = -1;
+    assert_result(apr_pool_create(&(a->mpool), NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(a->lock), APR_THREAD_MUTEX_DEFAULT, a->mpool);
+
+    if (d->dir != NULL) {
+        snprintf(key, sizeof(key), "%s/%s", d->dir, id);
+        a->fd = open(key, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
+        if (a->fd == -1) log_printf(0, "ERROR: Unable to open backing file %s\n", key);
+    }
+
+    apr_hash_set(ds->allocs, a->key, APR_HASH_KEY_STRING, a);
+    return(a);
+}
+
+//***********************************************************************
+// ds_mock_alloc_free - Releases the allocation.  Called with ds->lock held.
+//***********************************************************************
+
+void ds_mock_alloc_free(ds_mock_priv_t *ds, ds_mock_alloc_t *a, int remove_data)
+{
+    char fname[4096];
+
+    apr_hash_set(ds->allocs, a->key, APR_HASH_KEY_STRING, NULL);
+
+    if (a->fd != -1) close(a->fd);
+    if ((remove_data == 1) && (a->depot->dir != NULL)) {
+        snprintf(fname, sizeof(fname), "%s/%s", a->depot->dir, a->id);
+        unlink(fname);
+        snprintf(fname, sizeof(fname), "%s/%s.meta", a->depot->dir, a->id);
+        unlink(fname);
+    }
+
+    if (a->data != NULL) free(a->data);
+    apr_thread_mutex_destroy(a->lock);
+    apr_pool_destroy(a->mpool);
+    free(a->key);
+    free(a);
+}
+
+//***********************************************************************
+// ds_mock_cap_lookup - Returns the allocation referenced by the cap or NULL.
+//     A reference is taken on the allocation so it can't be freed out from
+//     under the op.  It has to be dropped with ds_mock_alloc_release().
+//     With file backing allocations made by other processes are loaded
+//     from their metadata.
+//***********************************************************************
+
+ds_mock_alloc_t *ds_mock_cap_lookup(ds_mock_priv_t *ds, char *cap, int captype)
+{
+    ds_mock_alloc_t *a;
+    ds_mock_depot_t *d;
+    char key[4096], fname[4096];
+    char *id, *type;
+    int plen, n;
+    struct stat sbuf;
+    FILE *fd;
+
+    plen = strlen(DS_MOCK_CAP_PREFIX);
+    if ((cap == NULL) || (strncmp(cap, DS_MOCK_CAP_PREFIX, plen) != 0)) return(NULL);
+
+    //** Cap format is mock://ds_key#id/type
+    snprintf(key, sizeof(key), "%s", cap + plen);
+    type = strrchr(key, '/');
+    id = strchr(key, '#');
+    if ((type == NULL) || (id == NULL) || (type < id)) return(NULL);
+    *type = '\0';
+    type++;
+    if ((captype == DS_CAP_READ) && (*type != 'R')) return(NULL);
+    if ((captype == DS_CAP_WRITE) && (*type != 'W')) return(NULL);
+    if ((captype == DS_CAP_MANAGE) && (*type != 'M')) return(NULL);
+
+    apr_thread_mutex_lock(ds->lock);
+    a = apr_hash_get(ds->allocs, key, APR_HASH_KEY_STRING);
+    if (a != NULL) {
+        if (a->removed == 1) a = NULL;  //** On it's way out
+    } else if (ds->backing == DS_MOCK_BACKING_FILE) {
+        *id = '\0';
+        id++;
+        d = ds_mock_depot_get(ds, key);
+        snprintf(fname, sizeof(fname), "%s/%s.meta", d->dir, id);
+        fd = fopen(fname, "r");
+        if (fd != NULL) {
+            a = ds_mock_alloc_new(ds, d, id);
+            n = fscanf(fd, XOT " " XOT " " XOT " " XOT, &(a->max_size), &(a->read_count), &(a->write_count), &(a->duration));
+            fclose(fd);
+            if ((n != 4) || (a->fd == -1)) {
+                ds_mock_alloc_free(ds, a, 0);
+                a = NULL;
+            } else {
+                fstat(a->fd, &sbuf);
+                a->curr_size = sbuf.st_size;
+                d->used_space += a->max_size;
+            }
+        }
+    }
+    if (a != NULL) a->refs++;
+    apr_thread_mutex_unlock(ds->lock);
+
+    return(a);
+}
+
+//***********************************************************************
+// ds_mock_alloc_release - Drops the reference from ds_mock_cap_lookup().
+//     If the allocation was removed and this is the last user it's freed.
+//***********************************************************************
+
+void ds_mock_alloc_release(ds_mock_priv_t *ds, ds_mock_alloc_t *a)
+{
+    if (a == NULL) return;
+
+    apr_thread_mutex_lock(ds->lock);
+    a->refs--;
+    if ((a->refs == 0) && (a->removed == 1)) ds_mock_alloc_free(ds, a, 1);
+    apr_thread_mutex_unlock(ds->lock);
+}
+
+//***********************************************************************
+// ds_mock_xfer - Moves data between the allocation and the buffer.
+//     Called with the allocation lock held.
+//***********************************************************************
+
+int ds_mock_xfer(ds_mock_alloc_t *a, int is_write, ds_int_t off, tbuffer_t *buf, ex_off_t boff, ds_int_t len)
+{
+    tbuffer_t tb;
+    char *tmp;
+    ds_int_t n, end;
+
+    end = off + len;
+    if ((off < 0) || (end > a->max_size)) return(1);
+
+    if (a->fd != -1) {  //** File backing goes through a bounce buffer
+        type_malloc(tmp, char, len);
+        tbuffer_single(&tb, len, tmp);
+        if (is_write) {
+            tbuffer_copy(buf, boff, &tb, 0, len, 0);
+            n = pwrite(a->fd, tmp, len, off);
+            if (n == len) {
+                if (end > a->curr_size) a->curr_size = end;
+            }
+        } else {
+            n = (off < a->curr_size) ? pread(a->fd, tmp, len, off) : 0;
+            if (n < 0) n = 0;
+            if (n < len) memset(tmp + n, 0, len - n);
+            n = len;
+            tbuffer_copy(&tb, 0, buf, boff, len, 0);
+        }
+        free(tmp);
+        return((n == len) ? 0 : 1);
+    }
+
+    if (is_write) {
+        if (end > a->data_size) {  //** Grow the buffer
+            n = (2*a->data_size > end) ? 2*a->data_size : end;
+            if (n > a->max_size) n = a->max_size;
+            type_realloc(a->data, char, n);
+            memset(a->data + a->data_size, 0, n - a->data_size);
+            a->data_size = n;
+        }
+        tbuffer_single(&tb, len, a->data + off);
+        tbuffer_copy(buf, boff, &tb, 0, len, 0);
+        if (end > a->curr_size) a->curr_size = end;
+    } else {
+        n = (a->curr_size > off) ? a->curr_size - off : 0;
+        if (n > len) n = len;
+        if (n > 0) {
+            tbuffer_single(&tb, n, a->data + off);
+            tbuffer_copy(&tb, 0, buf, boff, n, 0);
+        }
+        if (n < len) {  //** Unwritten space reads back as zeros
+            type_malloc_clear(tmp, char, len - n);
+            tbuffer_single(&tb, len - n, tmp);
+            tbuffer_copy(&tb, 0, buf, boff + n, len - n, 0);
+            free(tmp);
+        }
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// ds_mock_op_create - Creates a new op structure
+//***********************************************************************
+
+ds_mock_op_t *ds_mock_op_create(data_service_fn_t *dsf, data_attr_t *attr)
+{
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)dsf->priv;
+    ds_mock_op_t *op;
+
+    type_malloc_clear(op, ds_mock_op_t, 1);
+    op->dsf = dsf;
+    op->attr = (attr == NULL) ? &(ds->attr_default) : (ds_mock_attr_t *)attr;
+    return(op);
+}
+
+//***********************************************************************
+// ds_mock_op_free - Frees the op
+//***********************************************************************
+
+void ds_mock_op_free(void *arg)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+
+    if (op->res != NULL) free(op->res);
+    free(op);
+}
+
+//***********************************************************************
+// ds_mock_op_submit - Wraps the op in a thread pool task
+//***********************************************************************
+
+op_generic_t *ds_mock_op_submit(ds_mock_op_t *op, op_status_t (*fn)(void *arg, int id))
+{
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+
+    return(new_thread_pool_op(ds->tpc, NULL, fn, (void *)op, ds_mock_op_free, 1));
+}
+
+//***********************************************************************
+// ds_mock_res_inquire - Returns the depot space
+//***********************************************************************
+
+op_status_t ds_mock_res_inquire_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_inquire_t *space = (ds_mock_inquire_t *)op->result;
+    ds_mock_depot_t *d;
+
+    apr_thread_mutex_lock(ds->lock);
+    d = ds_mock_depot_get(ds, op->res);
+    space->total = d->total_space;
+    space->used = d->used_space;
+    space->free = d->total_space - d->used_space;
+    apr_thread_mutex_unlock(ds->lock);
+
+    return((ds_mock_delay(d, 0) == 0) ? op_success_status : op_failure_status);
+}
+
+op_generic_t *ds_mock_res_inquire(data_service_fn_t *dsf, char *res, data_attr_t *dattr, data_inquire_t *space, int timeout)
+{
+    ds_mock_op_t *op = ds_mock_op_create(dsf, dattr);
+
+    op->res = strdup(res);
+    op->result = space;
+    return(ds_mock_op_submit(op, ds_mock_res_inquire_fn));
+}
+
+//***********************************************************************
+// ds_mock_allocate - Makes a new allocation on the depot
+//***********************************************************************
+
+op_status_t ds_mock_allocate_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_capset_t *cs = (ds_mock_capset_t *)op->caps;
+    ds_mock_depot_t *d;
+    ds_mock_alloc_t *a;
+    ex_id_t aid;
+    char sid[64], cap[4096];
+
+    apr_thread_mutex_lock(ds->lock);
+    d = ds_mock_depot_get(ds, op->res);
+    apr_thread_mutex_unlock(ds->lock);
+
+    if (ds_mock_delay(d, 0) != 0) return(op_failure_status);
+
+    apr_thread_mutex_lock(ds->lock);
+    if (d->used_space + op->len > d->total_space) {
+        apr_thread_mutex_unlock(ds->lock);
+        log_printf(5, "ds_key=%s out of space size=" XOT " used=" XOT "\n", d->ds_key, op->len, d->used_space);
+        return(op_failure_status);
+    }
+
+    do {
+        generate_ex_id(&aid);
+        snprintf(sid, sizeof(sid), XIDT, aid);
+        snprintf(cap, sizeof(cap), "%s#%s", d->ds_key, sid);
+    } while (apr_hash_get(ds->allocs, cap, APR_HASH_KEY_STRING) != NULL);
+
+    a = ds_mock_alloc_new(ds, d, sid);
+    a->max_size = op->len;
+    a->read_count = 1;
+    a->duration = op->attr->duration;
+    d->used_space += a->max_size;
+    ds_mock_meta_save(a);
+    apr_thread_mutex_unlock(ds->lock);
+
+    snprintf(cap, sizeof(cap), "%s%s#%s/R", DS_MOCK_CAP_PREFIX, d->ds_key, sid);
+    cs->readCap = strdup(cap);
+    snprintf(cap, sizeof(cap), "%s%s#%s/W", DS_MOCK_CAP_PREFIX, d->ds_key, sid);
+    cs->writeCap = strdup(cap);
+    snprintf(cap, sizeof(cap), "%s%s#%s/M", DS_MOCK_CAP_PREFIX, d->ds_key, sid);
+    cs->manageCap = strdup(cap);
+
+    return(op_success_status);
+}
+
+op_generic_t *ds_mock_allocate(data_service_fn_t *dsf, char *res, data_attr_t *dattr, ds_int_t size, data_cap_set_t *caps, int timeout)
+{
+    ds_mock_op_t *op = ds_mock_op_create(dsf, dattr);
+
+    op->res = strdup(res);
+    op->len = size;
+    op->caps = caps;
+    return(ds_mock_op_submit(op, ds_mock_allocate_fn));
+}
+
+//***********************************************************************
+// ds_mock_modify_count - Adjusts the allocation's reference counts.  The
+//     allocation is destroyed when the read count drops to 0.
+//***********************************************************************
+
+op_status_t ds_mock_modify_count_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_alloc_t *a;
+    ds_int_t *count;
+    int delta;
+
+    a = ds_mock_cap_lookup(ds, (char *)op->cap, DS_CAP_MANAGE);
+    if (a == NULL) return(op_failure_status);
+    if (ds_mock_delay(a->depot, 0) != 0) {
+        ds_mock_alloc_release(ds, a);
+        return(op_failure_status);
+    }
+
+    delta = (op->mode == DS_MODE_INCR) ? 1 : -1;
+    count = (op->captype == DS_CAP_WRITE) ? &(a->write_count) : &(a->read_count);
+
+    apr_thread_mutex_lock(ds->lock);
+    if (a->removed == 1) {  //** Lost a race with another remove
+        apr_thread_mutex_unlock(ds->lock);
+        ds_mock_alloc_release(ds, a);
+        return(op_failure_status);
+    }
+    *count += delta;
+    if (*count < 0) *count = 0;
+    if (a->read_count == 0) {  //** Other ops may still be using it so it's freed on the last release
+        a->depot->used_space -= a->max_size;
+        a->removed = 1;
+    } else {
+        ds_mock_meta_save(a);
+    }
+    apr_thread_mutex_unlock(ds->lock);
+
+    ds_mock_alloc_release(ds, a);
+
+    return(op_success_status);
+}
+
+op_generic_t *ds_mock_modify_count(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *mcap, int mode, int captype, int timeout)
+{
+    ds_mock_op_t *op;
+
+    if (((mode != DS_MODE_INCR) && (mode != DS_MODE_DECR)) || ((captype != DS_CAP_READ) && (captype != DS_CAP_WRITE))) {
+        log_printf(0, "invalid mode=%d or captype=%d\n", mode, captype);
+        return(NULL);
+    }
+
+    op = ds_mock_op_create(dsf, dattr);
+    op->cap = mcap;
+    op->mode = mode;
+    op->captype = captype;
+    return(ds_mock_op_submit(op, ds_mock_modify_count_fn));
+}
+
+//***********************************************************************
+// ds_mock_remove - Decrements the allocation's read count
+//***********************************************************************
+
+op_generic_t *ds_mock_remove(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *cap, int timeout)
+{
+    return(ds_mock_modify_count(dsf, dattr, cap, DS_MODE_DECR, DS_CAP_READ, timeout));
+}
+
+//***********************************************************************
+// ds_mock_truncate - Changes the allocation's max size
+//***********************************************************************
+
+op_status_t ds_mock_truncate_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_alloc_t *a;
+    ds_mock_depot_t *d;
+    int err;
+
+    a = ds_mock_cap_lookup(ds, (char *)op->cap, DS_CAP_MANAGE);
+    if (a == NULL) return(op_failure_status);
+    d = a->depot;
+    if (ds_mock_delay(d, 0) != 0) {
+        ds_mock_alloc_release(ds, a);
+        return(op_failure_status);
+    }
+
+    err = 0;
+    apr_thread_mutex_lock(ds->lock);
+    if (a->removed == 1) {
+        err = 1;
+    } else if (d->used_space - a->max_size + op->len > d->total_space) {
+        err = 1;
+    } else {
+        apr_thread_mutex_lock(a->lock);
+        d->used_space += op->len - a->max_size;
+        a->max_size = op->len;
+        if (a->curr_size > a->max_size) {
+            a->curr_size = a->max_size;
+            if (a->fd != -1) err = ftruncate(a->fd, a->curr_size);
+        }
+        if (a->data_size > a->max_size) {
+            a->data_size = a->max_size;
+            type_realloc(a->data, char, (a->data_size > 0) ? a->data_size : 1);
+        }
+        apr_thread_mutex_unlock(a->lock);
+        ds_mock_meta_save(a);
+    }
+    apr_thread_mutex_unlock(ds->lock);
+
+    ds_mock_alloc_release(ds, a);
+
+    return((err == 0) ? op_success_status : op_failure_status);
+}
+
+op_generic_t *ds_mock_truncate(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *mcap, ex_off_t new_size, int timeout)
+{
+    ds_mock_op_t *op = ds_mock_op_create(dsf, dattr);
+
+    op->cap = mcap;
+    op->len = new_size;
+    return(ds_mock_op_submit(op, ds_mock_truncate_fn));
+}
+
+//***********************************************************************
+// ds_mock_probe - Returns the allocation's state
+//***********************************************************************
+
+op_status_t ds_mock_probe_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_probe_t *p = (ds_mock_probe_t *)op->result;
+    ds_mock_alloc_t *a;
+
+    a = ds_mock_cap_lookup(ds, (char *)op->cap, DS_CAP_MANAGE);
+    if (a == NULL) return(op_failure_status);
+    if (ds_mock_delay(a->depot, 0) != 0) {
+        ds_mock_alloc_release(ds, a);
+        return(op_failure_status);
+    }
+
+    apr_thread_mutex_lock(a->lock);
+    p->duration = a->duration;
+    p->read_count = a->read_count;
+    p->write_count = a->write_count;
+    p->curr_size = a->curr_size;
+    p->max_size = a->max_size;
+    apr_thread_mutex_unlock(a->lock);
+
+    ds_mock_alloc_release(ds, a);
+
+    return(op_success_status);
+}
+
+op_generic_t *ds_mock_probe(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *mcap, data_probe_t *probe, int timeout)
+{
+    ds_mock_op_t *op = ds_mock_op_create(dsf, dattr);
+
+    op->cap = mcap;
+    op->result = probe;
+    return(ds_mock_op_submit(op, ds_mock_probe_fn));
+}
+
+//***********************************************************************
+// ds_mock_rw_fn - Handles all the read, write, and append variants
+//***********************************************************************
+
+op_status_t ds_mock_rw_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_alloc_t *a;
+    ex_off_t boff;
+    int i, err, is_write;
+
+    is_write = (op->captype == DS_CAP_WRITE) ? 1 : 0;
+    a = ds_mock_cap_lookup(ds, (char *)op->cap, op->captype);
+    if (a == NULL) return(op_failure_status);
+    if (ds_mock_delay(a->depot, op->len) != 0) {
+        ds_mock_alloc_release(ds, a);
+        return(op_failure_status);
+    }
+
+    err = 0;
+    boff = op->boff;
+    apr_thread_mutex_lock(a->lock);
+    if (op->mode == 1) op->iov[0].offset = a->curr_size;  //** Append
+    for (i=0; (i<op->n_iov) && (err == 0); i++) {
+        err = ds_mock_xfer(a, is_write, op->iov[i].offset, op->buffer, boff, op->iov[i].len);
+        boff += op->iov[i].len;
+    }
+    apr_thread_mutex_unlock(a->lock);
+
+    ds_mock_alloc_release(ds, a);
+
+    return((err == 0) ? op_success_status : op_failure_status);
+}
+
+//***********************************************************************
+// ds_mock_rw_op - Creates a generic R/W op
+//***********************************************************************
+
+op_generic_t *ds_mock_rw_op(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *cap, int captype, int append, int n_iov, ex_iovec_t *iov, ds_int_t off, tbuffer_t *buffer, ex_off_t boff, ds_int_t len)
+{
+    ds_mock_op_t *op = ds_mock_op_create(dsf, dattr);
+
+    op->cap = cap;
+    op->captype = captype;
+    op->mode = append;
+    op->buffer = buffer;
+    op->boff = boff;
+    op->len = len;
+    if (iov == NULL) {
+        ex_iovec_single(&(op->iov_single), off, len);
+        op->iov = &(op->iov_single);
+        op->n_iov = 1;
+    } else {
+        op->iov = iov;
+        op->n_iov = n_iov;
+    }
+
+    return(ds_mock_op_submit(op, ds_mock_rw_fn));
+}
+
+//***********************************************************************
+// ds_mock_read/write/readv/writev/append - R/W entry points
+//***********************************************************************
+
+op_generic_t *ds_mock_read(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *rcap, ds_int_t off, tbuffer_t *dread, ds_int_t droff, ds_int_t size, int timeout)
+{
+    return(ds_mock_rw_op(dsf, dattr, rcap, DS_CAP_READ, 0, 1, NULL, off, dread, droff, size));
+}
+
+op_generic_t *ds_mock_write(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *wcap, ds_int_t off, tbuffer_t *dwrite, ds_int_t boff, ds_int_t size, int timeout)
+{
+    return(ds_mock_rw_op(dsf, dattr, wcap, DS_CAP_WRITE, 0, 1, NULL, off, dwrite, boff, size));
+}
+
+op_generic_t *ds_mock_readv(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *rcap, int n_iov, ex_iovec_t *iov, tbuffer_t *dread, ds_int_t droff, ds_int_t size, int timeout)
+{
+    return(ds_mock_rw_op(dsf, dattr, rcap, DS_CAP_READ, 0, n_iov, iov, 0, dread, droff, size));
+}
+
+op_generic_t *ds_mock_writev(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *wcap, int n_iov, ex_iovec_t *iov, tbuffer_t *dwrite, ds_int_t boff, ds_int_t size, int timeout)
+{
+    return(ds_mock_rw_op(dsf, dattr, wcap, DS_CAP_WRITE, 0, n_iov, iov, 0, dwrite, boff, size));
+}
+
+op_generic_t *ds_mock_append(data_service_fn_t *dsf, data_attr_t *dattr, data_cap_t *wcap, tbuffer_t *dwrite, ds_int_t boff, ds_int_t size, int timeout)
+{
+    return(ds_mock_rw_op(dsf, dattr, wcap, DS_CAP_WRITE, 1, 1, NULL, 0, dwrite, boff, size));
+}
+
+//***********************************************************************
+// ds_mock_copy - Depot to depot copy.  The transfer is charged to the
+//     source depot's link.
+//***********************************************************************
+
+op_status_t ds_mock_copy_fn(void *arg, int id)
+{
+    ds_mock_op_t *op = (ds_mock_op_t *)arg;
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)op->dsf->priv;
+    ds_mock_alloc_t *src, *dest;
+    tbuffer_t tb;
+    char *tmp;
+    int err;
+
+    src = ds_mock_cap_lookup(ds, (char *)op->cap, DS_CAP_READ);
+    dest = ds_mock_cap_lookup(ds, (char *)op->dest_cap, DS_CAP_WRITE);
+    err = ((src == NULL) || (dest == NULL)) ? 1 : 0;
+    if (err == 0) err = ds_mock_delay(src->depot, op->len);
+    if ((err == 0) && (dest->depot != src->depot)) err = ds_mock_delay(dest->depot, 0);
+    if (err != 0) {
+        ds_mock_alloc_release(ds, src);
+        ds_mock_alloc_release(ds, dest);
+        return(op_failure_status);
+    }
+
+    type_malloc(tmp, char, (op->len > 0) ? op->len : 1);
+    tbuffer_single(&tb, op->len, tmp);
+
+    //** Never hold both locks so opposing copies can't deadlock
+    apr_thread_mutex_lock(src->lock);
+    err = ds_mock_xfer(src, 0, op->off, &tb, 0, op->len);
+    apr_thread_mutex_unlock(src->lock);
+
+    if (err == 0) {
+        apr_thread_mutex_lock(dest->lock);
+        err = ds_mock_xfer(dest, 1, op->dest_off, &tb, 0, op->len);
+        apr_thread_mutex_unlock(dest->lock);
+    }
+
+    free(tmp);
+    ds_mock_alloc_release(ds, src);
+    ds_mock_alloc_release(ds, dest);
+
+    return((err == 0) ? op_success_status : op_failure_status);
+}
+
+op_generic_t *ds_mock_copy(data_service_fn_t *dsf, data_attr_t *dattr, int mode, int ns_type, char *ppath, data_cap_t *src_cap, ds_int_t src_off,
+                           data_cap_t *dest_cap, ds_int_t dest_off, ds_int_t len, int timeout)
+{
+    ds_mock_op_t *op = ds_mock_op_create(dsf, dattr);
+
+    op->cap = src_cap;
+    op->off = src_off;
+    op->dest_cap = dest_cap;
+    op->dest_off = dest_off;
+    op->len = len;
+    return(ds_mock_op_submit(op, ds_mock_copy_fn));
+}
+
+//***********************************************************************
+// ds_mock_load_depots - Loads the per depot overrides.  Each is a
+//     [mock_depot] section with a ds_key and any of latency, bandwidth,
+//     fail_rate, down, and total_space.
+//***********************************************************************
+
+void ds_mock_load_depots(ds_mock_priv_t *ds, inip_file_t *ifd)
+{
+    inip_group_t *g;
+    inip_element_t *ele;
+    ds_mock_depot_t *d;
+    char *key, *val, *ds_key;
+
+    for (g = inip_first_group(ifd); g != NULL; g = inip_next_group(g)) {
+        if (strcmp(inip_get_group(g), "mock_depot") != 0) continue;
+
+        //** Find the ds_key first
+        ds_key = NULL;
+        for (ele = inip_first_element(g); ele != NULL; ele = inip_next_element(ele)) {
+            if (strcmp(inip_get_element_key(ele), "ds_key") == 0) ds_key = inip_get_element_value(ele);
+        }
+        if (ds_key == NULL) {
+            log_printf(0, "ERROR: mock_depot section missing ds_key!\n");
+            continue;
+        }
+
+        d = ds_mock_depot_get(ds, ds_key);
+        for (ele = inip_first_element(g); ele != NULL; ele = inip_next_element(ele)) {
+            key = inip_get_element_key(ele);
+            val = inip_get_element_value(ele);
+            if (strcmp(key, "latency") == 0) {
+                d->latency = atof(val);
+            } else if (strcmp(key, "bandwidth") == 0) {
+                d->bandwidth = string_get_integer(val);
+            } else if (strcmp(key, "fail_rate") == 0) {
+                d->fail_rate = atof(val);
+            } else if (strcmp(key, "down") == 0) {
+                d->down = atoi(val);
+            } else if (strcmp(key, "total_space") == 0) {
+                d->total_space = string_get_integer(val);
+            }
+        }
+        log_printf(5, "ds_key=%s latency=%lf bandwidth=%lf fail_rate=%lf down=%d\n", d->ds_key, d->latency, d->bandwidth, d->fail_rate, d->down);
+    }
+}
+
+//***********************************************************************
+//  ds_mock_destroy - Destroys the mock data service
+//***********************************************************************
+
+void ds_mock_destroy(data_service_fn_t *dsf)
+{
+    ds_mock_priv_t *ds = (ds_mock_priv_t *)dsf->priv;
+    apr_hash_index_t *hi;
+    ds_mock_alloc_t *a;
+    ds_mock_depot_t *d;
+
+    //** Memory allocations go away with us.  File ones are left for the next run unless removed.
+    for (hi = apr_hash_first(NULL, ds->allocs); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&a);
+        ds_mock_alloc_free(ds, a, a->removed);
+    }
+
+    for (hi = apr_hash_first(NULL, ds->depots); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&d);
+        apr_thread_mutex_destroy(d->lock);
+        if (d->dir != NULL) free(d->dir);
+        free(d->ds_key);
+        free(d);
+    }
+
+    apr_thread_mutex_destroy(ds->lock);
+    apr_pool_destroy(ds->mpool);
+
+    if (ds->directory != NULL) free(ds->directory);
+    free(ds);
+    free(dsf);
+}
+
+//***********************************************************************
+//  ds_mock_create - Creates the mock data service
+//***********************************************************************
+
+data_service_fn_t *ds_mock_create(void *arg, inip_file_t *ifd, char *section)
+{
+    service_manager_t *ess = (service_manager_t *)arg;
+    data_service_fn_t *dsf;
+    ds_mock_priv_t *ds;
+    char *str;
+
+    type_malloc_clear(dsf, data_service_fn_t, 1);
+    type_malloc_clear(ds, ds_mock_priv_t , 1);
+
+    ds->attr_default.duration = inip_get_integer(ifd, section, "duration", 3600);
+    ds->latency = inip_get_double(ifd, section, "latency", 0);
+    ds->bandwidth = inip_get_integer(ifd, section, "bandwidth", 0);
+    ds->fail_rate = inip_get_double(ifd, section, "fail_rate", 0);
+    ds->total_space = inip_get_integer(ifd, section, "total_space", 1024LL*1024LL*1024LL*1024LL);
+
+    str = inip_get_string(ifd, section, "backing", "memory");
+    if (strcmp(str, "file") == 0) {
+        ds->backing = DS_MOCK_BACKING_FILE;
+        ds->directory = inip_get_string(ifd, section, "directory", "/tmp/ds_mock");
+        mkdir(ds->directory, S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH);
+    } else {
+        ds->backing = DS_MOCK_BACKING_MEMORY;
+    }
+    free(str);
+
+    ds->tpc = lookup_service(ess, ESS_RUNNING, ESS_TPC_UNLIMITED);
+    assert_result(apr_pool_create(&(ds->mpool), NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(ds->lock), APR_THREAD_MUTEX_DEFAULT, ds->mpool);
+    ds->depots = apr_hash_make(ds->mpool);
+    ds->allocs = apr_hash_make(ds->mpool);
+
+    ds_mock_load_depots(ds, ifd);
+
+    dsf->type = DS_TYPE_MOCK;
+    dsf->priv = (void *)ds;
+    dsf->destroy_service = ds_mock_destroy;
+    dsf->new_cap_set = ds_mock_new_cap_set;
+    dsf->cap_auto_warm = ds_mock_cap_auto_warm;
+    dsf->cap_stop_warm = ds_mock_cap_stop_warm;
+    dsf->get_cap = ds_mock_get_cap;
+    dsf->set_cap = ds_mock_set_cap;
+    dsf->translate_cap_set = ds_mock_translate_cap_set;
+    dsf->destroy_cap_set = ds_mock_destroy_cap_set;
+    dsf->new_probe = ds_mock_new_probe;
+    dsf->destroy_probe = ds_mock_destroy_probe;
+    dsf->get_probe = ds_mock_get_probe;
+    dsf->new_attr = ds_mock_new_attr;
+    dsf->destroy_attr = ds_mock_destroy_attr;
+    dsf->set_attr = ds_mock_set_attr;
+    dsf->get_attr = ds_mock_get_attr;
+    dsf->set_default_attr = ds_mock_set_default_attr;
+    dsf->get_default_attr = ds_mock_get_default_attr;
+    dsf->res2rid = ds_mock_res2rid;
+    dsf->new_inquire = ds_mock_new_inquire;
+    dsf->destroy_inquire = ds_mock_destroy_inquire;
+    dsf->res_inquire_get = ds_mock_res_inquire_get;
+    dsf->res_inquire = ds_mock_res_inquire;
+    dsf->allocate = ds_mock_allocate;
+    dsf->remove = ds_mock_remove;
+    dsf->modify_count = ds_mock_modify_count;
+    dsf->read = ds_mock_read;
+    dsf->write = ds_mock_write;
+    dsf->readv = ds_mock_readv;
+    dsf->writev = ds_mock_writev;
+    dsf->append = ds_mock_append;
+    dsf->copy = ds_mock_copy;
+    dsf->probe = ds_mock_probe;
+    dsf->truncate = ds_mock_truncate;
+
+    log_printf(5, "section=%s backing=%d latency=%lf bandwidth=%lf fail_rate=%lf\n", section, ds->backing, ds->latency, ds->bandwidth, ds->fail_rate);
+
+    return(dsf);
+}
@@ -0,0 +1,82 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//***********************************************************************
+// Mock depot data service.  Allocations live in memory or local files
+// and each "depot" can be given a latency, bandwidth and failure rate so
+// the rest of the stack can be exercised without IBP depots.
+//***********************************************************************
+
+
+#ifndef _DS_MOCK_H_
+#define _DS_MOCK_H_
+
+#include "data_service_abstract.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DS_TYPE_MOCK "mock"
+
+#define DS_MOCK_BACKING_MEMORY 0
+#define DS_MOCK_BACKING_FILE   1
+
+typedef struct {
+    ds_int_t duration;
+} ds_mock_attr_t;
+
+typedef struct {
+    char *readCap;
+    char *writeCap;
+    char *manageCap;
+} ds_mock_capset_t;
+
+typedef struct {
+    ds_int_t duration;
+    ds_int_t read_count;
+    ds_int_t write_count;
+    ds_int_t curr_size;
+    ds_int_t max_size;
+} ds_mock_probe_t;
+
+typedef struct {
+    ds_int_t used;
+    ds_int_t free;
+    ds_int_t total;
+} ds_mock_inquire_t;
+
+data_service_fn_t *ds_mock_create(void *arg, inip_file_t *ifd, char *section);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
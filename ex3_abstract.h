@@ -80,6 +80,7 @@ extern "C" {
 #define INSPECT_WRITE_ERRORS 10
 #define CLONE_STRUCTURE       0
 #define CLONE_STRUCT_AND_DATA 1
+#define CLONE_DEDUP           3    //** Copy the data but share allocations with matching content
  
 #define INSPECT_RESULT_FULL_CHECK      512    //** Full byte-level check performed
 #define INSPECT_RESULT_SOFT_ERROR     1024   //** Soft errors found
@@ -104,12 +105,19 @@ rid_change_entry_t *rid;
 apr_hash_t *pick_pool;
 } rid_inspect_tweak_t;
  
+typedef struct {     //** Optional pacing of the depot-to-depot copies made during an inspect
+void *arg;
+void (*acquire)(void *arg, int n, char **src_rid, char **dest_rid, ex_off_t *bytes);  //** Blocks until the copies can start
+void (*release)(void *arg, int n, char **src_rid, char **dest_rid, ex_off_t *bytes, int *success);
+} rid_transfer_throttle_t;
+ 
 typedef struct {
 rs_query_t *query;   //** Generic extra query
 opque_t *qs;         //** Cleanup Que on success
 opque_t *qf;         //** Cleanup Que for failure
 apr_hash_t *rid_changes;  //** List of RID space changes
 apr_thread_mutex_t *rid_lock;     //** Lock for manipulating the rid_changes table
+rid_transfer_throttle_t *throttle;  //** Copy throttle.  Can be NULL
 int n_dev_rows;
 int dev_row_replaced[128];
 } inspect_args_t;
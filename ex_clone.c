@@ -39,6 +39,43 @@ http://www.accre.vanderbilt.edu
 #include "lio.h"
 
 
+//*************************************************************************
+// load_dedup_ref - Adds the fingerprinted allocations in the reference exnode
+//     to the dedup catalog
+//*************************************************************************
+
+int load_dedup_ref(seglun_dedup_t *dd, char *fname)
+{
+    exnode_exchange_t *exp;
+    exnode_t *ex;
+    list_iter_t it;
+    segment_t *seg;
+    ex_id_t *id;
+    int n;
+
+    exp = exnode_exchange_load_file(fname);
+    ex = exnode_create();
+    if (exnode_deserialize(ex, exp, lio_gc->ess) != 0) {
+        printf("Unable to parse the dedup reference %s\n", fname);
+        exnode_destroy(ex);
+        exnode_exchange_destroy(exp);
+        return(0);
+    }
+
+    n = 0;
+    it = list_iter_search(ex->view, NULL, 0);
+    list_next(&it, (list_key_t **)&id, (list_data_t **)&seg);
+    while (seg != NULL) {
+        n += seglun_dedup_add_segment(dd, seg);
+        list_next(&it, (list_key_t **)&id, (list_data_t **)&seg);
+    }
+
+    exnode_destroy(ex);
+    exnode_exchange_destroy(exp);
+
+    return(n);
+}
+
 //*************************************************************************
 //*************************************************************************
 
@@ -47,6 +84,9 @@ int main(int argc, char **argv)
     int i, start_option;
     int mode;
     char *clone_arg = NULL;
+    seglun_dedup_t *dd = NULL;
+    int n_shared;
+    ex_off_t bytes_shared;
     char *sfname = NULL;
     char *cfname = NULL;
     exnode_t *ex, *cex;
@@ -58,10 +98,13 @@ int main(int argc, char **argv)
 //printf("argc=%d\n", argc);
     if (argc < 3) {
         printf("\n");
-        printf("ex_clone LIO_COMMON_OPTIONS [-structure|-data] [-a clone_attr] source_file.ex3 clone_file.ex3\n");
+        printf("ex_clone LIO_COMMON_OPTIONS [-structure|-data|-dedup] [-ref ref.ex3] [-a clone_attr] source_file.ex3 clone_file.ex3\n");
         lio_print_options(stdout);
         printf("    -structure      - Clone the structure only [default mode]\n");
         printf("    -data           - Clone the structure and copy the data\n");
+        printf("    -dedup          - Clone the data but share allocations whose contents match instead of copying them.\n");
+        printf("                      Shared allocations are reference counted on the depot so their write caps are blanked making the clone read-only.\n");
+        printf("    -ref ref.ex3    - Also share allocations with a previous dedup clone.  Can be repeated.\n");
         printf("    -a clone_attr   - Segment specific attribute passed to the clone routine. Not used for all Segment types.\n");
         printf("    source_file.ex3 - File to clone\n");
         printf("    clone_file.ex3  - DEstination cloned file\n");
@@ -83,6 +126,16 @@ int main(int argc, char **argv)
         } else if (strcmp(argv[i], "-data") == 0) { //** Clone the structure and the data
             i++;
             mode = CLONE_STRUCT_AND_DATA;
+        } else if (strcmp(argv[i], "-dedup") == 0) { //** Clone the data sharing identical allocations
+            i++;
+            mode = CLONE_DEDUP;
+            if (dd == NULL) dd = seglun_dedup_create();
+        } else if (strcmp(argv[i], "-ref") == 0) { //** Seed the dedup catalog
+            i++;
+            if (dd == NULL) dd = seglun_dedup_create();
+            n_shared = load_dedup_ref(dd, argv[i]);
+            printf("Loaded %d fingerprints from %s\n", n_shared, argv[i]);
+            i++;
         } else if (strcmp(argv[i], "-a") == 0) { //** Alternate query attribute
             i++;
             clone_arg = argv[i];
@@ -117,6 +170,12 @@ int main(int argc, char **argv)
 //  printf("===================================================\n");
 
 
+    //** Make the dedup catalog visible to the segments
+    if (dd != NULL) {
+        mode = CLONE_DEDUP;
+        add_service(lio_gc->ess, ESS_RUNNING, SEGMENT_LUN_DEDUP_SERVICE, dd);
+    }
+
     //** Execute the clone operation
     gop = exnode_clone(lio_gc->tpc_unlimited, ex, lio_gc->da, &cex, (void *)clone_arg, mode, lio_gc->timeout);
 
@@ -129,6 +188,13 @@ int main(int argc, char **argv)
         abort();
     }
 
+    if (dd != NULL) {
+        seglun_dedup_stats(dd, &n_shared, &bytes_shared);
+        printf("Shared %d allocations (" XOT " bytes) instead of copying them\n", n_shared, bytes_shared);
+        remove_service(lio_gc->ess, ESS_RUNNING, SEGMENT_LUN_DEDUP_SERVICE);
+        seglun_dedup_destroy(dd);
+    }
+
     //** Store the updated exnode back to disk
     exp_out = exnode_exchange_create(EX_TEXT);
     exnode_serialize(cex, exp_out);
@@ -41,6 +41,7 @@ http://www.accre.vanderbilt.edu
 #include "type_malloc.h"
 #include "random.h"
 #include "opque.h"
+#include "thread_pool.h"
 #include "lio.h"
 
 typedef struct {
@@ -85,8 +86,77 @@ typedef struct {
     char *buffer;
 } task_slot_t;
 
+#define BENCH_VERIFY     0   //** Original tiled R/W test with data verification
+#define BENCH_SEQ        1   //** Sequential streaming write then read
+#define BENCH_RAND4K     2   //** Random small aligned R/W
+#define BENCH_STRIDED    3   //** Strided reads
+#define BENCH_CREATE     4   //** Small file create/remove storm through the OS
+#define BENCH_CHECKPOINT 5   //** Write bursts each followed by a flush and a pause
+
+#define BENCH_OP_READ   0
+#define BENCH_OP_WRITE  1
+#define BENCH_OP_FLUSH  2
+#define BENCH_OP_CREATE 3
+#define BENCH_OP_REMOVE 4
+#define BENCH_N_OPS     5
+
+char *bench_profile_name[] = { "verify", "seq", "rand4k", "strided", "create", "checkpoint" };
+char *bench_op_name[] = { "read", "write", "flush", "create", "remove" };
+
+typedef struct {
+    char *profile;
+    int type;
+    int n_threads;
+    int n_segments;
+    int n_ops;           //** Ops (or bursts) per thread
+    ex_off_t io_size;
+    ex_off_t stride;
+    ex_off_t burst_size;
+    double burst_pause;
+    char *create_path;
+    char *json_file;
+} bench_config_t;
+
+typedef struct {
+    apr_time_t *lat;
+    int n;
+    int max;
+    int failed;
+    ex_off_t bytes;
+} bench_lat_t;
+
+typedef struct bench_thread_s bench_thread_t;
+
+typedef struct {
+    int type;
+    ex_iovec_t iov;
+    tbuffer_t tbuf;
+    char *fname;
+    apr_time_t submit_time;
+    apr_time_t end_time;
+} bench_slot_t;
+
+struct bench_thread_s {
+    int id;
+    int rank;            //** Position among the threads sharing the segment
+    int n_share;         //** Number of threads sharing the segment
+    segment_t *seg;
+    ex_off_t base;       //** Start and size of the thread's region in the segment
+    ex_off_t region;
+    uint64_t seed;
+    char *wbuf;
+    char *rbuf;
+    opque_t *q;
+    int n_free;
+    int *free_slot;
+    bench_slot_t *slot;
+    apr_thread_t *thread;
+    bench_lat_t stats[BENCH_N_OPS];
+};
+
 //*** Globals used in the test
 rw_config_t rwc;
+bench_config_t bc;
 task_slot_t *task_list;
 char *tile_data;
 tile_t *base_tile;
@@ -846,6 +916,7 @@ void rw_test()
     cache_stats(lio_gc->cache, &cs);
     i = 0;
     cache_stats_print(&cs, text_buffer, &i, tbufsize);
+    cache_shares_print(lio_gc->cache, text_buffer, &i, tbufsize);
     printf("%s", text_buffer);
     printf("----------------------------------------------------------\n");
 
@@ -887,6 +958,583 @@ void rw_test()
     free_stack(free_slots, 0);
 }
 
+//*************************************************************************
+//  Benchmark profiles.  These reuse the config and segment handling from
+//  the verification test above but issue fixed workload patterns from
+//  multiple threads and segments and record per-op latencies.  Data is not
+//  verified in these modes.  Use profile=verify for that.
+//*************************************************************************
+
+//*************************************************************************
+// bench_random - Per thread xorshift generator so runs are reproducible
+//     regardless of how the threads interleave
+//*************************************************************************
+
+uint64_t bench_random(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return(x);
+}
+
+//*************************************************************************
+// bench_op_cb - Records the completion time of an op
+//*************************************************************************
+
+void bench_op_cb(void *arg, int state)
+{
+    bench_slot_t *slot = (bench_slot_t *)arg;
+
+    slot->end_time = apr_time_now();
+}
+
+//*************************************************************************
+// bench_lat_add - Adds a latency sample
+//*************************************************************************
+
+void bench_lat_add(bench_lat_t *s, apr_time_t dt, ex_off_t bytes)
+{
+    if (s->n >= s->max) {
+        s->max = (s->max == 0) ? 1024 : 2*s->max;
+        type_realloc(s->lat, apr_time_t, s->max);
+    }
+    s->lat[s->n] = dt;
+    s->n++;
+    s->bytes += bytes;
+}
+
+//*************************************************************************
+// bench_reap - Waits for an op to complete and records it
+//*************************************************************************
+
+void bench_reap(bench_thread_t *bt)
+{
+    op_generic_t *gop;
+    bench_slot_t *slot;
+    int slot_index;
+
+    gop = opque_waitany(bt->q);
+    slot_index = gop_get_myid(gop);
+    slot = &(bt->slot[slot_index]);
+    if (slot->end_time == 0) slot->end_time = apr_time_now();
+
+    if (gop_completed_successfully(gop) != OP_STATE_SUCCESS) {
+        log_printf(0, "bench: thread=%d ERROR op=%s off=" XOT " len=" XOT "\n", bt->id, bench_op_name[slot->type], slot->iov.offset, slot->iov.len);
+        bt->stats[slot->type].failed++;
+    } else {
+        bench_lat_add(&(bt->stats[slot->type]), slot->end_time - slot->submit_time, slot->iov.len);
+    }
+    gop_free(gop, OP_DESTROY);
+
+    if (slot->fname != NULL) {
+        free(slot->fname);
+        slot->fname = NULL;
+    }
+
+    bt->free_slot[bt->n_free] = slot_index;
+    bt->n_free++;
+}
+
+//*************************************************************************
+// bench_drain - Waits for all the thread's outstanding ops
+//*************************************************************************
+
+void bench_drain(bench_thread_t *bt)
+{
+    while (opque_tasks_left(bt->q) > 0) bench_reap(bt);
+}
+
+//*************************************************************************
+// bench_get_slot - Returns a free slot waiting for an op if needed
+//*************************************************************************
+
+bench_slot_t *bench_get_slot(bench_thread_t *bt, int *slot_index)
+{
+    bench_slot_t *slot;
+
+    if (bt->n_free == 0) bench_reap(bt);
+
+    bt->n_free--;
+    *slot_index = bt->free_slot[bt->n_free];
+    slot = &(bt->slot[*slot_index]);
+    slot->end_time = 0;
+    return(slot);
+}
+
+//*************************************************************************
+// bench_submit - Adds the op to the thread's queue
+//*************************************************************************
+
+void bench_submit(bench_thread_t *bt, bench_slot_t *slot, int slot_index, op_generic_t *gop)
+{
+    callback_t *cb;
+
+    gop_set_myid(gop, slot_index);
+    type_malloc_clear(cb, callback_t, 1);  //** Freed along with the gop
+    callback_set(cb, bench_op_cb, slot);
+    gop_callback_append(gop, cb);
+    slot->submit_time = apr_time_now();
+    opque_add(bt->q, gop);
+}
+
+//*************************************************************************
+// bench_rw - Issues a single segment read or write
+//*************************************************************************
+
+void bench_rw(bench_thread_t *bt, int type, ex_off_t offset, ex_off_t len)
+{
+    bench_slot_t *slot;
+    op_generic_t *gop;
+    int slot_index;
+
+    slot = bench_get_slot(bt, &slot_index);
+    slot->type = type;
+    ex_iovec_single(&(slot->iov), offset, len);
+    if (type == BENCH_OP_READ) {
+        tbuffer_single(&(slot->tbuf), len, bt->rbuf);
+        gop = segment_read(bt->seg, da, NULL, 1, &(slot->iov), &(slot->tbuf), 0, rwc.timeout);
+    } else {
+        tbuffer_single(&(slot->tbuf), len, bt->wbuf);
+        gop = segment_write(bt->seg, da, NULL, 1, &(slot->iov), &(slot->tbuf), 0, rwc.timeout);
+    }
+
+    bench_submit(bt, slot, slot_index, gop);
+}
+
+//*************************************************************************
+// bench_seq - Streams through the thread's region writing and then reading
+//*************************************************************************
+
+void bench_seq(bench_thread_t *bt)
+{
+    ex_off_t off, len;
+    int type;
+
+    for (type=BENCH_OP_WRITE; type>=BENCH_OP_READ; type--) {
+        for (off=0; off<bt->region; off += bc.io_size) {
+            len = (off + bc.io_size > bt->region) ? bt->region - off : bc.io_size;
+            bench_rw(bt, type, bt->base + off, len);
+        }
+        bench_drain(bt);
+    }
+}
+
+//*************************************************************************
+// bench_rand4k - Random aligned small ops over the whole segment
+//*************************************************************************
+
+void bench_rand4k(bench_thread_t *bt)
+{
+    ex_off_t nblocks, off, len;
+    int i, type;
+    double d;
+
+    len = (bc.io_size > bt->region) ? bt->region : bc.io_size;  //** Don't go past the region
+    nblocks = bt->region / len;
+
+    for (i=0; i<bc.n_ops; i++) {
+        off = (bench_random(&(bt->seed)) % nblocks) * len;
+        d = (bench_random(&(bt->seed)) >> 11) * (1.0 / 9007199254740992.0);
+        type = (d < rwc.read_fraction) ? BENCH_OP_READ : BENCH_OP_WRITE;
+        bench_rw(bt, type, bt->base + off, len);
+    }
+    bench_drain(bt);
+}
+
+//*************************************************************************
+// bench_strided - Analysis style strided reads.  Threads sharing a segment
+//     interleave their strides.  The I/O size is clamped to the region so
+//     every read stays inside it.
+//*************************************************************************
+
+void bench_strided(bench_thread_t *bt)
+{
+    ex_off_t off, span, len;
+    int i;
+
+    len = (bc.io_size > bt->region) ? bt->region : bc.io_size;
+    span = bt->region - len + 1;  //** Number of valid starting offsets
+
+    for (i=0; i<bc.n_ops; i++) {
+        off = (((ex_off_t)i * bt->n_share + bt->rank) * bc.stride) % span;
+        bench_rw(bt, BENCH_OP_READ, bt->base + off, len);
+    }
+    bench_drain(bt);
+}
+
+//*************************************************************************
+// bench_checkpoint - Write bursts followed by a flush and an idle period
+//*************************************************************************
+
+void bench_checkpoint(bench_thread_t *bt)
+{
+    bench_slot_t *slot;
+    op_generic_t *gop;
+    ex_off_t off, pos, len;
+    int i, slot_index;
+
+    pos = 0;
+    for (i=0; i<bc.n_ops; i++) {
+        for (off=0; off<bc.burst_size; off += len) {
+            if (pos >= bt->region) pos = 0;
+            len = bc.io_size;
+            if (pos + len > bt->region) len = bt->region - pos;
+            if (off + len > bc.burst_size) len = bc.burst_size - off;
+            bench_rw(bt, BENCH_OP_WRITE, bt->base + pos, len);
+            pos += len;
+        }
+        bench_drain(bt);
+
+        slot = bench_get_slot(bt, &slot_index);
+        slot->type = BENCH_OP_FLUSH;
+        ex_iovec_single(&(slot->iov), bt->base, bc.burst_size);
+        gop = segment_flush(bt->seg, da, bt->base, bt->base + bt->region, rwc.timeout);
+        bench_submit(bt, slot, slot_index, gop);
+        bench_drain(bt);
+
+        if (bc.burst_pause > 0) apr_sleep(bc.burst_pause * APR_USEC_PER_SEC);
+    }
+}
+
+//*************************************************************************
+// bench_create - Small file create storm followed by removal through the
+//     object service
+//*************************************************************************
+
+void bench_create(bench_thread_t *bt)
+{
+    bench_slot_t *slot;
+    op_generic_t *gop;
+    char fname[OS_PATH_MAX];
+    int i, type, slot_index;
+
+    for (type=BENCH_OP_CREATE; type<=BENCH_OP_REMOVE; type++) {
+        for (i=0; i<bc.n_ops; i++) {
+            snprintf(fname, sizeof(fname), "%s/bench-%d-%d", bc.create_path, bt->id, i);
+            slot = bench_get_slot(bt, &slot_index);
+            slot->type = type;
+            slot->fname = strdup(fname);
+            ex_iovec_single(&(slot->iov), 0, 0);
+            if (type == BENCH_OP_CREATE) {
+                gop = gop_lio_create_object(lio_gc, lio_gc->creds, slot->fname, OS_OBJECT_FILE, NULL, NULL);
+            } else {
+                gop = gop_lio_remove_object(lio_gc, lio_gc->creds, slot->fname, NULL, OS_OBJECT_FILE);
+            }
+            bench_submit(bt, slot, slot_index, gop);
+        }
+        bench_drain(bt);
+    }
+}
+
+//*************************************************************************
+// bench_thread - Runs the profile for a single thread
+//*************************************************************************
+
+void *bench_thread(apr_thread_t *th, void *data)
+{
+    bench_thread_t *bt = (bench_thread_t *)data;
+    int i;
+
+    bt->q = new_opque();
+    opque_start_execution(bt->q);
+    type_malloc_clear(bt->slot, bench_slot_t, rwc.n_parallel);
+    type_malloc(bt->free_slot, int, rwc.n_parallel);
+    for (i=0; i<rwc.n_parallel; i++) bt->free_slot[i] = i;
+    bt->n_free = rwc.n_parallel;
+
+    switch (bc.type) {
+    case BENCH_SEQ:
+        bench_seq(bt);
+        break;
+    case BENCH_RAND4K:
+        bench_rand4k(bt);
+        break;
+    case BENCH_STRIDED:
+        bench_strided(bt);
+        break;
+    case BENCH_CHECKPOINT:
+        bench_checkpoint(bt);
+        break;
+    case BENCH_CREATE:
+        bench_create(bt);
+        break;
+    }
+
+    opque_free(bt->q, OP_DESTROY);
+    free(bt->slot);
+    free(bt->free_slot);
+
+    return(NULL);
+}
+
+//*************************************************************************
+// bench_lat_compare - qsort comparison for latencies
+//*************************************************************************
+
+int bench_lat_compare(const void *p1, const void *p2)
+{
+    apr_time_t t1 = *(apr_time_t *)p1;
+    apr_time_t t2 = *(apr_time_t *)p2;
+
+    if (t1 < t2) return(-1);
+    if (t1 > t2) return(1);
+    return(0);
+}
+
+//*************************************************************************
+// bench_percentile - Returns the latency for the percentile from the
+//     sorted latency array
+//*************************************************************************
+
+apr_time_t bench_percentile(bench_lat_t *s, double pct)
+{
+    int i;
+
+    if (s->n == 0) return(0);
+
+    i = ceil(pct / 100.0 * s->n) - 1;
+    if (i < 0) i = 0;
+    if (i >= s->n) i = s->n - 1;
+    return(s->lat[i]);
+}
+
+//*************************************************************************
+// bench_json_string - Writes the string as a quoted and escaped JSON string
+//*************************************************************************
+
+void bench_json_string(FILE *fd, const char *str)
+{
+    const unsigned char *c;
+
+    fputc('"', fd);
+    for (c = (const unsigned char *)str; *c != 0; c++) {
+        switch (*c) {
+        case '"':
+            fputs("\\\"", fd);
+            break;
+        case '\\':
+            fputs("\\\\", fd);
+            break;
+        case '\n':
+            fputs("\\n", fd);
+            break;
+        case '\r':
+            fputs("\\r", fd);
+            break;
+        case '\t':
+            fputs("\\t", fd);
+            break;
+        default:
+            if (*c < 0x20) {
+                fprintf(fd, "\\u%04x", *c);
+            } else {
+                fputc(*c, fd);
+            }
+        }
+    }
+    fputc('"', fd);
+}
+
+//*************************************************************************
+// bench_report - Prints the results and optionally writes them as JSON
+//*************************************************************************
+
+void bench_report(bench_lat_t *total, double dsec)
+{
+    FILE *fd;
+    bench_lat_t *s;
+    double mb, avg, sum;
+    int i, j, first;
+
+    printf("-------------- Benchmark Results: %s (%lf s) -----------------\n", bc.profile, dsec);
+    for (i=0; i<BENCH_N_OPS; i++) {
+        s = &(total[i]);
+        if ((s->n == 0) && (s->failed == 0)) continue;
+        mb = s->bytes / (1024.0*1024.0);
+        sum = 0;
+        for (j=0; j<s->n; j++) sum += s->lat[j];
+        avg = (s->n > 0) ? sum / s->n : 0;
+        printf("%-6s -- ops: %d  failed: %d  %lf ops/s  %lf MB/s\n", bench_op_name[i], s->n, s->failed, s->n / dsec, mb / dsec);
+        printf("%-6s -- latency(us) min: " TT "  avg: %lf  p50: " TT "  p90: " TT "  p99: " TT "  p99.9: " TT "  max: " TT "\n",
+               bench_op_name[i], bench_percentile(s, 0), avg, bench_percentile(s, 50), bench_percentile(s, 90),
+               bench_percentile(s, 99), bench_percentile(s, 99.9), bench_percentile(s, 100));
+    }
+    printf("----------------------------------------------------------\n");
+
+    if (bc.json_file == NULL) return;
+
+    fd = (strcmp(bc.json_file, "-") == 0) ? stdout : fopen(bc.json_file, "w");
+    if (fd == NULL) {
+        printf("bench_report: ERROR opening JSON output file: %s\n", bc.json_file);
+        return;
+    }
+
+    fprintf(fd, "{\n");
+    fprintf(fd, "  \"profile\": ");
+    bench_json_string(fd, bc.profile);
+    fprintf(fd, ",\n  \"segment_type\": ");
+    bench_json_string(fd, (seg != NULL) ? segment_type(seg) : "none");
+    fprintf(fd, ",\n");
+    fprintf(fd, "  \"threads\": %d,\n", bc.n_threads);
+    fprintf(fd, "  \"segments\": %d,\n", bc.n_segments);
+    fprintf(fd, "  \"parallel\": %d,\n", rwc.n_parallel);
+    fprintf(fd, "  \"io_size\": " XOT ",\n", bc.io_size);
+    fprintf(fd, "  \"file_size\": " XOT ",\n", rwc.file_size);
+    fprintf(fd, "  \"seed\": %d,\n", rwc.seed);
+    fprintf(fd, "  \"elapsed\": %lf,\n", dsec);
+    fprintf(fd, "  \"ops\": {");
+    first = 1;
+    for (i=0; i<BENCH_N_OPS; i++) {
+        s = &(total[i]);
+        if ((s->n == 0) && (s->failed == 0)) continue;
+        sum = 0;
+        for (j=0; j<s->n; j++) sum += s->lat[j];
+        avg = (s->n > 0) ? sum / s->n : 0;
+        mb = s->bytes / (1024.0*1024.0);
+        fprintf(fd, "%s\n    ", (first) ? "" : ",");
+        bench_json_string(fd, bench_op_name[i]);
+        fprintf(fd, ": {\n");
+        fprintf(fd, "      \"count\": %d, \"failed\": %d, \"bytes\": " XOT ",\n", s->n, s->failed, s->bytes);
+        fprintf(fd, "      \"ops_per_sec\": %lf, \"mb_per_sec\": %lf,\n", s->n / dsec, mb / dsec);
+        fprintf(fd, "      \"latency_us\": { \"min\": " TT ", \"avg\": %lf, \"p50\": " TT ", \"p90\": " TT ", \"p99\": " TT ", \"p999\": " TT ", \"max\": " TT " }\n",
+                bench_percentile(s, 0), avg, bench_percentile(s, 50), bench_percentile(s, 90),
+                bench_percentile(s, 99), bench_percentile(s, 99.9), bench_percentile(s, 100));
+        fprintf(fd, "    }");
+        first = 0;
+    }
+    fprintf(fd, "\n  }\n}\n");
+
+    if (fd != stdout) fclose(fd);
+}
+
+//*************************************************************************
+// bench_run - Runs the benchmark profile
+//*************************************************************************
+
+void bench_run()
+{
+    bench_thread_t *bt;
+    bench_lat_t total[BENCH_N_OPS];
+    apr_pool_t *mpool;
+    apr_status_t value;
+    apr_time_t dt;
+    segment_t **slist;
+    double dsec;
+    int i, j, n_segs, err;
+
+    //** Make the extra segments by cloning the structure of the default one
+    n_segs = (seg == NULL) ? 0 : bc.n_segments;
+    type_malloc_clear(slist, segment_t *, bc.n_segments);
+    for (i=0; i<n_segs; i++) {
+        if (i == 0) {
+            slist[i] = seg;
+        } else {
+            err = gop_sync_exec(segment_clone(seg, da, &(slist[i]), CLONE_STRUCTURE, NULL, rwc.timeout));
+            if (err != OP_STATE_SUCCESS) {
+                printf("bench_run: ERROR cloning segment %d!\n", i);
+                flush_log();
+                fflush(stdout);
+                abort();
+            }
+        }
+
+        //** Profiles that start with reads need the space to exist
+        if ((bc.type == BENCH_RAND4K) || (bc.type == BENCH_STRIDED)) {
+            err = gop_sync_exec(segment_truncate(slist[i], da, rwc.file_size, rwc.timeout));
+            if (err != OP_STATE_SUCCESS) {
+                printf("bench_run: ERROR preallocating segment %d!\n", i);
+                flush_log();
+                fflush(stdout);
+                abort();
+            }
+        }
+    }
+
+    //** Set up the threads.  Threads are assigned to segments round robin.
+    type_malloc_clear(bt, bench_thread_t, bc.n_threads);
+    for (i=0; i<bc.n_threads; i++) {
+        bt[i].id = i;
+        bt[i].seed = ((uint64_t)rwc.seed << 32) + i + 1;
+        if (n_segs > 0) {
+            j = i % n_segs;
+            bt[i].seg = slist[j];
+            bt[i].rank = i / n_segs;
+            bt[i].n_share = (bc.n_threads - j + n_segs - 1) / n_segs;
+            if ((bc.type == BENCH_SEQ) || (bc.type == BENCH_CHECKPOINT)) {
+                bt[i].region = rwc.file_size / bt[i].n_share;
+                bt[i].base = bt[i].rank * bt[i].region;
+            } else {
+                bt[i].region = rwc.file_size;
+                bt[i].base = 0;
+            }
+            if (bt[i].region <= 0) {
+                printf("bench_run: ERROR file_size=" XOT " is too small to give thread %d any space!\n", rwc.file_size, i);
+                flush_log();
+                fflush(stdout);
+                abort();
+            }
+        }
+        type_malloc(bt[i].wbuf, char, bc.io_size);
+        type_malloc(bt[i].rbuf, char, bc.io_size);
+        my_get_random(bt[i].wbuf, bc.io_size);
+    }
+
+    log_printf(0,"-------------- Starting benchmark profile %s -----------------------\n", bc.profile);
+    flush_log();
+
+    assert_result(apr_pool_create(&mpool, NULL), APR_SUCCESS);
+    dt = apr_time_now();
+    for (i=0; i<bc.n_threads; i++) {
+        thread_create_assert(&(bt[i].thread), NULL, bench_thread, (void *)&(bt[i]), mpool);
+    }
+    for (i=0; i<bc.n_threads; i++) {
+        apr_thread_join(&value, bt[i].thread);
+    }
+    dt = apr_time_now() - dt;
+    apr_pool_destroy(mpool);
+
+    log_printf(0,"-------------- Completed benchmark profile %s -----------------------\n", bc.profile);
+
+    //** Merge the thread stats
+    memset(total, 0, sizeof(total));
+    for (i=0; i<bc.n_threads; i++) {
+        for (j=0; j<BENCH_N_OPS; j++) {
+            if (bt[i].stats[j].n > 0) {
+                type_realloc(total[j].lat, apr_time_t, total[j].n + bt[i].stats[j].n);
+                memcpy(&(total[j].lat[total[j].n]), bt[i].stats[j].lat, sizeof(apr_time_t)*bt[i].stats[j].n);
+                total[j].n += bt[i].stats[j].n;
+                free(bt[i].stats[j].lat);
+            }
+            total[j].failed += bt[i].stats[j].failed;
+            total[j].bytes += bt[i].stats[j].bytes;
+        }
+        free(bt[i].wbuf);
+        free(bt[i].rbuf);
+    }
+    for (j=0; j<BENCH_N_OPS; j++) {
+        if (total[j].n > 0) qsort(total[j].lat, total[j].n, sizeof(apr_time_t), bench_lat_compare);
+    }
+
+    dsec = (1.0*dt) / APR_USEC_PER_SEC;
+    bench_report(total, dsec);
+
+    for (j=0; j<BENCH_N_OPS; j++) {
+        if (total[j].lat != NULL) free(total[j].lat);
+    }
+    free(bt);
+
+    //** Clean up the cloned segments
+    for (i=1; i<n_segs; i++) {
+        gop_sync_exec(segment_remove(slist[i], da, rwc.timeout));
+        segment_destroy(slist[i]);
+    }
+    free(slist);
+}
+
 //*************************************************************************
 // rw_load_options - Loads the test options form the config file
 //*************************************************************************
@@ -943,6 +1591,40 @@ void rw_load_options(char *cfgname, char *group)
     rwc.read_sigma = inip_get_integer(fd, group, "read_sigma", 50);
     rwc.write_sigma = inip_get_integer(fd, group, "write_sigma", 50);
 
+    //** Benchmark options
+    if (bc.profile == NULL) bc.profile = inip_get_string(fd, group, "profile", "verify");
+    bc.n_threads = inip_get_integer(fd, group, "threads", 1);
+    if (bc.n_threads < 1) bc.n_threads = 1;
+    bc.n_segments = inip_get_integer(fd, group, "segments", 1);
+    if (bc.n_segments < 1) bc.n_segments = 1;
+    bc.n_ops = inip_get_integer(fd, group, "ops", 10000);
+    bc.io_size = inip_get_integer(fd, group, "io_size", 0);
+    bc.stride = inip_get_integer(fd, group, "stride", 1024*1024);
+    bc.burst_size = inip_get_integer(fd, group, "burst_size", 64*1024*1024);
+    bc.burst_pause = inip_get_double(fd, group, "burst_pause", 1.0);
+    bc.create_path = inip_get_string(fd, group, "create_path", "/bench");
+    if (bc.json_file == NULL) {
+        bc.json_file = inip_get_string(fd, group, "json", "");
+        if (strcmp(bc.json_file, "") == 0) {
+            free(bc.json_file);
+            bc.json_file = NULL;
+        }
+    }
+
+    for (bc.type=0; bc.type<=BENCH_CHECKPOINT; bc.type++) {
+        if (strcasecmp(bc.profile, bench_profile_name[bc.type]) == 0) break;
+    }
+    if (bc.type > BENCH_CHECKPOINT) {
+        printf("rw_load_options: ERROR unknown profile=%s\n", bc.profile);
+        printf("rw_load_options: Should be one of verify, seq, rand4k, strided, create, or checkpoint.\n");
+        flush_log();
+        fflush(stdout);
+        abort();
+    }
+
+    if (bc.io_size <= 0) bc.io_size = (bc.type == BENCH_RAND4K) ? 4096 : 1024*1024;
+    if (bc.burst_size < bc.io_size) bc.burst_size = bc.io_size;
+
     inip_destroy(fd);
 }
 
@@ -984,6 +1666,19 @@ void rw_print_options(FILE *fd)
     fprintf(fd, "read_sigma=%d\n", rwc.read_sigma);
     fprintf(fd, "write_sigma=%d\n", rwc.write_sigma);
 
+    fprintf(fd, "profile=%s\n", bench_profile_name[bc.type]);
+    if (bc.type != BENCH_VERIFY) {
+        fprintf(fd, "threads=%d\n", bc.n_threads);
+        fprintf(fd, "segments=%d\n", bc.n_segments);
+        fprintf(fd, "ops=%d\n", bc.n_ops);
+        fprintf(fd, "io_size=%s\n", pretty_print_int_with_scale(bc.io_size, ppbuf));
+        fprintf(fd, "stride=%s\n", pretty_print_int_with_scale(bc.stride, ppbuf));
+        fprintf(fd, "burst_size=%s\n", pretty_print_int_with_scale(bc.burst_size, ppbuf));
+        fprintf(fd, "burst_pause=%lf\n", bc.burst_pause);
+        fprintf(fd, "create_path=%s\n", bc.create_path);
+        fprintf(fd, "json=%s\n", (bc.json_file) ? bc.json_file : "");
+    }
+
     fprintf(fd, "\n");
 }
 
@@ -1002,10 +1697,18 @@ int main(int argc, char **argv)
 //printf("argc=%d\n", argc);
     if (argc < 2) {
         printf("\n");
-        printf("ex_rw_test LIO_COMMON_OPTIONS [-ex] [-s section]\n");
+        printf("ex_rw_test LIO_COMMON_OPTIONS [-ex] [-s section] [-p profile] [-json file]\n");
         lio_print_options(stdout);
         printf("     -ex        Print the final exnode to the screen before truncation\n");
         printf("     -s section SEction in the config file to usse.  Defaults to %s.\n", section);
+        printf("     -p profile Workload profile overriding the config.  One of:\n");
+        printf("                  verify     - Tiled R/W test with data verification (default)\n");
+        printf("                  seq        - Sequential streaming write then read\n");
+        printf("                  rand4k     - Random small aligned R/W using read_fraction\n");
+        printf("                  strided    - Strided reads\n");
+        printf("                  create     - Small file create/remove storm under create_path\n");
+        printf("                  checkpoint - Write bursts each followed by a flush and pause\n");
+        printf("     -json file Write the benchmark results as JSON to file.  Use - for stdout.\n");
         printf("\n");
         return(1);
     }
@@ -1029,6 +1732,14 @@ int main(int argc, char **argv)
                 i++;
                 section = argv[i];
                 i++;
+            } else if (strcmp(argv[i], "-p") == 0) { //** Benchmark profile
+                i++;
+                bc.profile = strdup(argv[i]);
+                i++;
+            } else if (strcmp(argv[i], "-json") == 0) { //** JSON results file
+                i++;
+                bc.json_file = strdup(argv[i]);
+                i++;
             }
         } while ((start_option < i) && (i<argc));
     }
@@ -1050,6 +1761,11 @@ int main(int argc, char **argv)
     rw_print_options(stdout);
     printf("------------------------------------------------------------------\n\n");
 
+    if (bc.type == BENCH_CREATE) {  //** Only uses the object service so no segment is needed
+        bench_run();
+        goto finished;
+    }
+
     //** Open the file
     exp = exnode_exchange_load_file(rwc.filename);
     //** and parse it
@@ -1077,7 +1793,11 @@ int main(int argc, char **argv)
     }
 
     //** Now do the test
-    rw_test();
+    if (bc.type == BENCH_VERIFY) {
+        rw_test();
+    } else {
+        bench_run();
+    }
 
 
     if (print_exnode == 1) {
@@ -1123,6 +1843,11 @@ int main(int argc, char **argv)
 
     printf("tpc_unlimited=%d\n", lio_gc->tpc_unlimited->n_ops);
 
+finished:
+    free(bc.profile);
+    if (bc.json_file != NULL) free(bc.json_file);
+    free(bc.create_path);
+
     lio_shutdown();
 
     return(0);
@@ -43,6 +43,7 @@ http://www.accre.vanderbilt.edu
 #include "segment_cache.h"
 
 #include "ds_ibp.h"
+#include "ds_mock.h"
 
 #include "rs_simple.h"
 #include "rs_remote.h"
@@ -51,6 +52,7 @@ http://www.accre.vanderbilt.edu
 #include "os_file.h"
 #include "os_remote.h"
 #include "os_timecache.h"
+#include "os_shard.h"
 
 #include "osaz_fake.h"
 #include "authn_fake.h"
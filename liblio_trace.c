@@ -35,6 +35,10 @@ http://www.accre.vanderbilt.edu
 #include <assert.h>
 #include "assert_result.h"
 #include <dlfcn.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -48,18 +52,26 @@ http://www.accre.vanderbilt.edu
 #include "iniparse.h"
 #include "append_printf.h"
 #include "atomic_counter.h"
+#include "thread_pool.h"
 
 lt_config_t ltc;
 lt_fn_t lt_fn;
 
 atomic_int_t _trace_count = 0;
 
-fd_trace_t *fd_table = NULL;
-fd_trace_t *fd_stats = NULL;
+lt_fd_table_t fd_table;
+lt_fd_table_t fd_stats;
 
 apr_time_t start_time;
+uint64_t start_ns;
 atomic_int_t curr_fd_slot = 0;
 
+lt_ring_t *ring_list = NULL;
+__thread lt_ring_t *my_ring = NULL;
+volatile int flush_shutdown = 0;
+apr_thread_t *flush_thread = NULL;
+apr_pool_t *flush_pool = NULL;
+
 //*************************************************************
 //*************************************************************
 
@@ -68,18 +80,229 @@ atomic_int_t curr_fd_slot = 0;
 void  __attribute__ ((constructor)) liblio_trace_init(void);
 void  __attribute__ ((destructor)) liblio_trace_fini(void);
 
+//*************************************************************
+// lt_now_ns - Returns the monotonic time in ns
+//*************************************************************
+
+static inline uint64_t lt_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+//*************************************************************
+// lt_fd_get - Returns the fd table entry, adding the chunk if
+//    needed and create=1.  Chunks are installed with a CAS so
+//    lookups never need a lock.
+//*************************************************************
+
+fd_trace_t *lt_fd_get(lt_fd_table_t *t, int n, int create)
+{
+    fd_trace_t *chunk;
+    int c, i;
+
+    if (n < 0) return(NULL);
+    c = n / LT_FD_CHUNK;
+    if (c >= t->n_chunks) return(NULL);
+
+    chunk = t->chunk[c];
+    if (chunk == NULL) {
+        if (create == 0) return(NULL);
+        type_malloc_clear(chunk, fd_trace_t, LT_FD_CHUNK);
+        for (i=0; i<LT_FD_CHUNK; i++) chunk[i].fd = -1;
+        if (__sync_bool_compare_and_swap(&(t->chunk[c]), NULL, chunk) == 0) {  //** Someone else beat us to it
+            free(chunk);
+            chunk = t->chunk[c];
+        }
+    }
+
+    return(&(chunk[n % LT_FD_CHUNK]));
+}
+
+//*************************************************************
+// lt_fd_table_init/destroy - Manages an fd table
+//*************************************************************
+
+void lt_fd_table_init(lt_fd_table_t *t, int max_fd)
+{
+    t->n_chunks = (max_fd + LT_FD_CHUNK - 1) / LT_FD_CHUNK;
+    if (t->n_chunks < 1) t->n_chunks = 1;
+    type_malloc_clear(t->chunk, fd_trace_t *, t->n_chunks);
+}
+
+void lt_fd_table_destroy(lt_fd_table_t *t)
+{
+    int i;
+
+    for (i=0; i<t->n_chunks; i++) {
+        if (t->chunk[i] != NULL) free(t->chunk[i]);
+    }
+    free(t->chunk);
+}
+
+//*************************************************************
+// lt_ring_get - Returns the calling thread's ring, making it if needed
+//*************************************************************
+
+lt_ring_t *lt_ring_get()
+{
+    lt_ring_t *r;
+    uint64_t n;
+
+    if (my_ring != NULL) return(my_ring);
+
+    for (n=1; n < (uint64_t)ltc.ring_size; n <<= 1) {}
+
+    type_malloc_clear(r, lt_ring_t, 1);
+    type_malloc(r->rec, lt_bin_record_t, n);
+    r->mask = n - 1;
+
+    do {  //** Add it to the list the flush thread scans
+        r->next = ring_list;
+    } while (__sync_bool_compare_and_swap(&ring_list, r->next, r) == 0);
+
+    my_ring = r;
+    return(r);
+}
+
+//*************************************************************
+// lt_record - Adds a record to the thread's ring.  If the ring is
+//    full we yield until the flush thread catches up rather than
+//    dropping the record.  Once the flush thread has shut down
+//    nothing will drain the ring so the record is dropped instead.
+//    A failed call is recorded with len=0 and its errno in err.
+//*************************************************************
+
+void lt_record(int fd_slot, long int offset, long int len, int err, int cmd)
+{
+    lt_ring_t *r;
+    lt_bin_record_t *rec;
+    uint64_t h;
+
+    if (flush_shutdown == 1) return;  //** Nothing is draining the rings anymore
+
+    r = lt_ring_get();
+    h = r->head;
+    while ((h - r->tail) > r->mask) {
+        if (flush_shutdown == 1) {
+            r->dropped++;
+            return;
+        }
+        r->stalls++;
+        sched_yield();
+    }
+
+    rec = &(r->rec[h & r->mask]);
+    rec->time_ns = lt_now_ns() - start_ns;
+    rec->offset = offset;
+    rec->len = (len < 0) ? 0 : len;
+    rec->fd = fd_slot;
+    rec->cmd = cmd;
+    rec->err = err;
+    rec->pad = 0;
+
+    __sync_synchronize();   //** Make sure the record is visible before the head moves
+    r->head = h + 1;
+}
+
+//*************************************************************
+// lt_write_all - Writes the whole buffer retrying short writes.
+//    Returns the number of bytes written.
+//*************************************************************
+
+size_t lt_write_all(int fd, char *buf, size_t nbytes)
+{
+    size_t done;
+    ssize_t n;
+
+    done = 0;
+    while (done < nbytes) {
+        n = lt_fn.write(fd, buf + done, nbytes - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        } else if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+
+    return(done);
+}
+
+//*************************************************************
+// lt_ring_drain - Writes any pending records to the trace file.
+//    Records that can't be written are counted as lost.
+//*************************************************************
+
+uint64_t lt_ring_drain(lt_ring_t *r)
+{
+    uint64_t h, t, n, start, len, nbytes, done;
+
+    t = r->tail;
+    h = r->head;
+    __sync_synchronize();
+
+    n = h - t;
+    while (t < h) {
+        start = t & r->mask;
+        len = r->mask + 1 - start;
+        if (len > (h - t)) len = h - t;
+        nbytes = len*sizeof(lt_bin_record_t);
+        done = lt_write_all(ltc.fd, (char *)&(r->rec[start]), nbytes);
+        if (done < nbytes) r->lost += len - done / sizeof(lt_bin_record_t);
+        t += len;
+    }
+
+    __sync_synchronize();
+    r->tail = h;
+
+    return(n);
+}
+
+//*************************************************************
+// lt_flush_thread - Periodically drains the thread rings
+//*************************************************************
+
+void *lt_flush_thread(apr_thread_t *th, void *data)
+{
+    lt_ring_t *r;
+    uint64_t n;
+
+    while (flush_shutdown == 0) {
+        n = 0;
+        for (r = ring_list; r != NULL; r = r->next) {
+            n += lt_ring_drain(r);
+        }
+
+        if (n == 0) apr_sleep(ltc.flush_interval * 1000);
+    }
+
+    //** Final pass to get any stragglers
+    for (r = ring_list; r != NULL; r = r->next) {
+        lt_ring_drain(r);
+    }
+
+    return(NULL);
+}
+
 //*************************************************************
 // lt_default_config - sets the default config
 //*************************************************************
 
 void lt_default_config()
 {
-    set_log_level(15);
+    set_log_level(0);
     open_log("trace.log");
 
     ltc.trace_name = "output.trace";
     ltc.trace_header = "output.trh";
-    ltc.max_fd = 100;
+    ltc.max_fd = 1024*1024;
+    ltc.format = LT_FORMAT_BINARY;
+    ltc.ring_size = 65536;
+    ltc.flush_interval = 100;
 }
 
 //*************************************************************
@@ -106,7 +329,17 @@ void lt_load_config(char *fname)
     str = inip_get_string(fd, LIBLIO_TRACE_SECTION, "header", NULL);
     if (str != NULL) ltc.trace_header = str;
 
+    str = inip_get_string(fd, LIBLIO_TRACE_SECTION, "format", NULL);
+    if (str != NULL) {
+        ltc.format = (strcasecmp(str, "text") == 0) ? LT_FORMAT_TEXT : LT_FORMAT_BINARY;
+        free(str);
+    }
+
     ltc.max_fd = inip_get_integer(fd, LIBLIO_TRACE_SECTION, "max_fd", ltc.max_fd);
+    ltc.ring_size = inip_get_integer(fd, LIBLIO_TRACE_SECTION, "ring_size", ltc.ring_size);
+    ltc.flush_interval = inip_get_integer(fd, LIBLIO_TRACE_SECTION, "flush_interval_ms", ltc.flush_interval);
+    if (ltc.ring_size < 16) ltc.ring_size = 16;
+    if (ltc.flush_interval < 1) ltc.flush_interval = 1;
 
     ltc.logfd = STDERR_FILENO;
 
@@ -119,9 +352,10 @@ void lt_load_config(char *fname)
 
 void __attribute__((constructor)) liblio_trace_init()
 {
-    int i;
     char *config = NULL;
     void *handle;
+    lt_bin_header_t hdr;
+
     apr_wrapper_start();
 
     log_printf(10, "_liblio_trace_init: Initializing system\n");
@@ -153,12 +387,8 @@ void __attribute__((constructor)) liblio_trace_init()
     lt_fn.lseek = dlsym(handle, "lseek");
     log_printf(10, "liblio_trace_init: lseek=%p\n",lt_fn.lseek);
 
-
-    type_malloc_clear(fd_stats, fd_trace_t, ltc.max_fd);
-    type_malloc_clear(fd_table, fd_trace_t, ltc.max_fd);
-    for (i=0; i<ltc.max_fd; i++) {
-        fd_table[i].fd = -1;
-    }
+    lt_fd_table_init(&fd_stats, ltc.max_fd);
+    lt_fd_table_init(&fd_table, ltc.max_fd);
 
     ltc.fd = lt_fn.open(ltc.trace_name, O_WRONLY|O_TRUNC);
     if (ltc.fd == -1) {
@@ -168,6 +398,19 @@ void __attribute__((constructor)) liblio_trace_init()
 //  lt_fn.write(ltc.logfd, logstr, strlen(logstr));
 
     start_time = apr_time_now();
+    start_ns = lt_now_ns();
+
+    if (ltc.format == LT_FORMAT_BINARY) {
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = LT_BIN_MAGIC;
+        hdr.version = LT_BIN_VERSION;
+        hdr.record_size = sizeof(lt_bin_record_t);
+        hdr.start_ns = start_ns;
+        lt_fn.write(ltc.fd, &hdr, sizeof(hdr));
+
+        assert_result(apr_pool_create(&flush_pool, NULL), APR_SUCCESS);
+        thread_create_assert(&flush_thread, NULL, lt_flush_thread, NULL, flush_pool);
+    }
 
     log_printf(10, "liblio_trace_init: LOG END\n");
 
@@ -185,10 +428,33 @@ void __attribute__((destructor)) liblio_trace_fini()
     char header[bufsize+1];
     int used, n, i;
     fd_trace_t *fdt;
-    int n_ops;
+    lt_ring_t *r;
+    apr_status_t value;
+    uint64_t n_ops, stalls, dropped, lost;
 
     log_printf(10, "liblio_trace_destroy: LOG Shutting down system fd=%d\n", ltc.fd);
 
+    //** Shut down the flush thread which drains everything on exit
+    stalls = 0;
+    dropped = 0;
+    lost = 0;
+    if (ltc.format == LT_FORMAT_BINARY) {
+        flush_shutdown = 1;
+        apr_thread_join(&value, flush_thread);
+        apr_pool_destroy(flush_pool);
+
+        //** The rings aren't freed since other threads may still be running
+        n_ops = 0;
+        for (r = ring_list; r != NULL; r = r->next) {
+            n_ops += r->tail - r->lost;
+            stalls += r->stalls;
+            dropped += r->dropped;
+            lost += r->lost;
+        }
+    } else {
+        n_ops = atomic_get(_trace_count);
+    }
+
     lt_fn.close(ltc.fd);
 
     //** Construct the header
@@ -198,13 +464,19 @@ void __attribute__((destructor)) liblio_trace_fini()
     append_printf(header, &used, bufsize, "[trace]\n");
     append_printf(header, &used, bufsize, "n_files=%d\n", curr_fd_slot);
     append_printf(header, &used, bufsize, "trace=%s\n", ltc.trace_name);
-    n_ops = atomic_get(_trace_count);
-    append_printf(header, &used, bufsize, "n_ops=%d\n", n_ops);
+    append_printf(header, &used, bufsize, "format=%s\n", (ltc.format == LT_FORMAT_BINARY) ? "binary" : "text");
+    append_printf(header, &used, bufsize, "n_ops=" LU "\n", n_ops);
+    if (ltc.format == LT_FORMAT_BINARY) {
+        append_printf(header, &used, bufsize, "ring_stalls=" LU "\n", stalls);
+        append_printf(header, &used, bufsize, "ring_dropped=" LU "\n", dropped);
+        append_printf(header, &used, bufsize, "write_lost=" LU "\n", lost);
+    }
     append_printf(header, &used, bufsize, "\n");
 
     n = atomic_get(curr_fd_slot);
     for (i=0; i<n; i++) {
-        fdt = &(fd_stats[i]);
+        fdt = lt_fd_get(&fd_stats, i, 0);
+        if ((fdt == NULL) || (fdt->fd < 0)) continue;  //** Never closed
 
         append_printf(header, &used, bufsize, "[file-%d]\n", fdt->fd);
         append_printf(header, &used, bufsize, "path=%s\n", fdt->fname);
@@ -224,8 +496,8 @@ void __attribute__((destructor)) liblio_trace_fini()
     lt_fn.write(n, header, strlen(header));
     lt_fn.close(n);
 
-    free(fd_table);
-    free(fd_stats);
+    lt_fd_table_destroy(&fd_table);
+    lt_fd_table_destroy(&fd_stats);
 
     apr_wrapper_stop();
 
@@ -241,22 +513,34 @@ int open(const char *pathname, int flags, ...)
 {
     va_list args;
     int fd;
+    mode_t mode = 0;
+    fd_trace_t *fdt;
 
-    va_start(args, flags);
-    fd = lt_fn.open(pathname, flags, args);
-    va_end(args);
+    if (flags & O_CREAT) {
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+
+    fd = lt_fn.open(pathname, flags, mode);
 
     log_printf(10, "liblio_trace: LOG open(%s,%d)=%d\n", pathname, flags, fd);
 
     if (fd == -1) return(-1);
 
-    fd_table[fd].fd = atomic_inc(curr_fd_slot);
-    fd_table[fd].init_size = lt_fn.lseek(fd, 0L, SEEK_END);
+    fdt = lt_fd_get(&fd_table, fd, 1);
+    if (fdt == NULL) {
+        log_printf(0, "liblio_trace: fd=%d exceeds max_fd=%d.  Not tracing %s\n", fd, ltc.max_fd, pathname);
+        return(fd);
+    }
+
+    fdt->fd = atomic_inc(curr_fd_slot);
+    fdt->init_size = lt_fn.lseek(fd, 0L, SEEK_END);
     lt_fn.lseek(fd, 0L, SEEK_SET);  //** Reposition to the beginning
-    fd_table[fd].pos = 0;
-    fd_table[fd].max_size = 0;
-    fd_table[fd].block_size = 1;
-    fd_table[fd].fname = strdup(pathname);
+    fdt->pos = 0;
+    fdt->max_size = 0;
+    fdt->block_size = 1;
+    fdt->fname = strdup(pathname);
 
     return(fd);
 
@@ -269,10 +553,16 @@ int open(const char *pathname, int flags, ...)
 int close(int fd)
 {
     int err;
+    fd_trace_t *fdt, *fds;
 
-    fd_table[fd].max_size = lt_fn.lseek(fd, 0L, SEEK_END);
+    fdt = lt_fd_get(&fd_table, fd, 0);
+    if ((fdt != NULL) && (fdt->fd >= 0)) {
+        fdt->max_size = lt_fn.lseek(fd, 0L, SEEK_END);
 
-    fd_stats[fd_table[fd].fd] = fd_table[fd]; //** Store the stats
+        fds = lt_fd_get(&fd_stats, fdt->fd, 1);
+        if (fds != NULL) *fds = *fdt; //** Store the stats
+        fdt->fd = -1;
+    }
 
     err = lt_fn.close(fd);
     log_printf(10, "liblio_trace: LOG close(%d)=%d\n", fd, err);
@@ -282,35 +572,51 @@ int close(int fd)
 }
 
 //*************************************************************
-// read - read stub call
+// lt_text_record - Appends a text record to the trace
 //*************************************************************
 
-ssize_t read(int fd, void *buf, size_t count)
+void lt_text_record(fd_trace_t *fdt, long int err, char cmd)
 {
-    ssize_t result;
-    long int nbytes=count;
-    long int err;
     int n;
     char text[1024];
     double dt;
 
     atomic_inc(_trace_count);
 
-    result = lt_fn.read(fd, buf, count);
-    if (fd_table[fd].fd < 0) return(result);
-
-    err = result;
-
     dt = apr_time_now() - start_time;
     dt = dt / APR_USEC_PER_SEC;
 
-    n = sprintf(text, "%d, %ld, %ld, R, %lf\n", fd_table[fd].fd, fd_table[fd].pos, err, dt);
+    n = sprintf(text, "%d, %ld, %ld, %c, %lf\n", fdt->fd, fdt->pos, err, cmd, dt);
     lt_fn.write(ltc.fd, text, n);
+}
 
-    fd_table[fd].pos += result;
+//*************************************************************
+// read - read stub call
+//*************************************************************
 
-    log_printf(10, "liblio_trace: read(%d, buf, %ld)=%ld\n", fd, nbytes, err);
+ssize_t read(int fd, void *buf, size_t count)
+{
+    ssize_t result;
+    fd_trace_t *fdt;
+    int err;
 
+    result = lt_fn.read(fd, buf, count);
+    err = (result < 0) ? errno : 0;
+
+    fdt = lt_fd_get(&fd_table, fd, 0);
+    if ((fdt == NULL) || (fdt->fd < 0)) return(result);
+
+    if (ltc.format == LT_FORMAT_BINARY) {
+        lt_record(fdt->fd, fdt->pos, result, err, LT_CMD_READ);
+    } else {
+        lt_text_record(fdt, result, 'R');
+    }
+
+    if (result > 0) fdt->pos += result;
+
+    log_printf(10, "liblio_trace: read(%d, buf, %ld)=%ld\n", fd, (long int)count, (long int)result);
+
+    if (result < 0) errno = err;  //** Don't let the tracing clobber it
     return(result);
 
 }
@@ -323,32 +629,26 @@ ssize_t read(int fd, void *buf, size_t count)
 ssize_t write(int fd, const void *buf, size_t count)
 {
     ssize_t result;
-    long int nbytes=count;
-    long int err;
-    int n;
-    char text[1024];
-    double dt;
-
-    atomic_inc(_trace_count);
+    fd_trace_t *fdt;
+    int err;
 
     result = lt_fn.write(fd, buf, count);
-    err = result;
-
-    log_printf(10, "liblio_trace: LOG EARLY write(%d, buf, %ld)=%ld\n", fd, nbytes, err);
-
-    if (fd_table[fd].fd < 0) return(result);
+    err = (result < 0) ? errno : 0;
 
+    fdt = lt_fd_get(&fd_table, fd, 0);
+    if ((fdt == NULL) || (fdt->fd < 0)) return(result);
 
-    dt = apr_time_now() - start_time;
-    dt = dt / APR_USEC_PER_SEC;
-
-    n = sprintf(text, "%d, %ld, %ld, W, %lf\n", fd_table[fd].fd, fd_table[fd].pos, err, dt);
-    lt_fn.write(ltc.fd, text, n);
+    if (ltc.format == LT_FORMAT_BINARY) {
+        lt_record(fdt->fd, fdt->pos, result, err, LT_CMD_WRITE);
+    } else {
+        lt_text_record(fdt, result, 'W');
+    }
 
-    fd_table[fd].pos += result;
+    if (result > 0) fdt->pos += result;
 
-    log_printf(10, "liblio_trace: LOG write(%d, buf, %ld)=%ld\n", fd, nbytes, err);
+    log_printf(10, "liblio_trace: LOG write(%d, buf, %ld)=%ld\n", fd, (long int)count, (long int)result);
 
+    if (result < 0) errno = err;  //** Don't let the tracing clobber it
     return(result);
 
 }
@@ -360,8 +660,12 @@ ssize_t write(int fd, const void *buf, size_t count)
 off_t lseek(int fd, off_t offset, int whence)
 {
     off_t result;
+    fd_trace_t *fdt;
 
     result = lt_fn.lseek(fd, offset, whence);
 
+    fdt = lt_fd_get(&fd_table, fd, 0);
+    if ((fdt != NULL) && (fdt->fd >= 0) && (result >= 0)) fdt->pos = result;
+
     return(result);
 }
@@ -32,7 +32,10 @@ http://www.accre.vanderbilt.edu
 //*************************************************************
 
 #ifndef __LIBLIO_TRACE_H_
-#define __LILIO_TRACE_H_
+#define __LIBLIO_TRACE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,12 +49,18 @@ typedef struct {
     off_t (*lseek)(int fd, off_t offset, int whence);
 } lt_fn_t;
 
+#define LT_FORMAT_TEXT   0
+#define LT_FORMAT_BINARY 1
+
 typedef struct {
     char *trace_name;
     char *trace_header;
     int fd;
     int max_fd;
     int logfd;
+    int format;
+    int ring_size;          //** Records per thread ring buffer.  Rounded up to a power of 2
+    int flush_interval;     //** How often the flush thread drains the rings in ms
 } lt_config_t;
 
 typedef struct {
@@ -63,6 +72,52 @@ typedef struct {
     long int pos;
 } fd_trace_t;
 
+//** The fd tables are grown a chunk at a time so existing entries never move
+#define LT_FD_CHUNK 1024
+
+typedef struct {
+    int n_chunks;
+    fd_trace_t **chunk;
+} lt_fd_table_t;
+
+//** Binary trace format.  The data file is an lt_bin_header_t followed by
+//** lt_bin_record_t's.  Records from different threads are not time ordered.
+#define LT_BIN_MAGIC   0x4252544c   //** "LTRB"
+#define LT_BIN_VERSION 2
+#define LT_CMD_READ    0
+#define LT_CMD_WRITE   1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t pad;
+    uint64_t start_ns;     //** CLOCK_MONOTONIC time the trace started
+} lt_bin_header_t;
+
+typedef struct {
+    uint64_t time_ns;      //** Nanoseconds since the trace started
+    int64_t offset;
+    int64_t len;           //** Bytes transferred.  0 if the call failed
+    uint32_t fd;           //** Trace file id
+    uint32_t cmd;
+    int32_t err;           //** errno if the call failed otherwise 0
+    uint32_t pad;
+} lt_bin_record_t;
+
+typedef struct lt_ring_s lt_ring_t;
+
+struct lt_ring_s {   //** Single producer/consumer ring.  One per traced thread
+    volatile uint64_t head;   //** Only modified by the owning thread
+    volatile uint64_t tail;   //** Only modified by the flush thread
+    uint64_t mask;
+    uint64_t stalls;          //** Number of times the ring was full
+    uint64_t dropped;         //** Records dropped after the flush thread exited.  Owning thread only
+    uint64_t lost;            //** Records that couldn't be written to the trace.  Flush thread only
+    lt_bin_record_t *rec;
+    lt_ring_t *next;
+};
+
 extern lt_config_t ltc;
 
 #define LIBLIO_TRACE_SECTION "liblio_trace"
@@ -73,4 +128,3 @@ extern lt_config_t ltc;
 
 
 #endif
-
@@ -58,12 +58,18 @@ extern "C" {
 #define LIO_FSCK_SIZE_REPAIR 8
 
 extern char *_lio_stat_keys[];
-#define  _lio_stat_key_size 7
+#define  _lio_stat_key_size 1
 
 typedef struct lio_config_s lio_config_t;
 typedef struct lio_fn_s lio_fn_t;
 typedef struct lio_fsck_iter_s lio_fsck_iter_t;
 
+typedef struct {  //** Slice of the open file table.  Handles are spread across them by view ID
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    list_t *index;
+} lio_fh_shard_t;
+
 extern FILE *_lio_ifd;  //** Default information log device
 extern char *_lio_exe_name;  //** Executable name
 
@@ -80,7 +86,10 @@ struct lio_config_s {
     cache_t *cache;
     data_attr_t *da;
     inip_file_t *ifd;
-    list_t *open_index;
+    lio_fh_shard_t *open_shard;
+    apr_thread_mutex_t *ex_cache_lock;  //** Recently closed exnodes kept around for reuse
+    list_t *ex_cache_index;
+    Stack_t *ex_cache_lru;
     creds_t *creds;
     apr_thread_mutex_t *lock;
     apr_pool_t *mpool;
@@ -98,11 +107,14 @@ struct lio_config_s {
     ex_off_t readahead;
     ex_off_t readahead_trigger;
     int calc_adler32;
+    ex_off_t cksum_block_size;  //** Block size for the checksum map.  0 disables it
     int timeout;
     int max_attr;
     int anonymous_creation;
     int auto_translate;
     int ref_cnt;
+    int n_open_shards;
+    int ex_cache_max;
 };
 
 typedef struct {
@@ -123,6 +135,7 @@ typedef struct {
     lio_path_tuple_t src_tuple;
     lio_path_tuple_t dest_tuple;
     ex_off_t bufsize;
+    char *buffer;     //** Optional transfer buffer of bufsize+1 bytes.  If NULL one is allocated
     int slow;
 } lio_cp_file_t;
 
@@ -155,17 +168,26 @@ extern int lio_parallel_task_count;
 
 #define lio_lock(s) apr_thread_mutex_lock((s)->lock)
 #define lio_unlock(s) apr_thread_mutex_unlock((s)->lock)
+#define lio_fh_shard(lc, vid) (&((lc)->open_shard[(vid) % (lc)->n_open_shards]))
+#define lio_fh_shard_lock(fs) apr_thread_mutex_lock((fs)->lock)
+#define lio_fh_shard_unlock(fs) apr_thread_mutex_unlock((fs)->lock)
 
 struct lio_file_handle_s {  //** Shared file handle
     exnode_t *ex;
     segment_t *seg;
     lio_config_t *lc;
     ex_id_t vid;
-    int ref_count;
+    ex_id_t ino;
+    unsigned int ex_hash;  //** Hash of the exnode and modify time it was loaded from
+    int ref_count;    //** Protected by the shard lock
+    int in_flight;    //** Still being loaded by the 1st opener
     int remove_on_close;
     ex_off_t readahead_end;
     atomic_int_t modified;
     list_t *write_table;
+    list_t *cksum_table;  //** Blocks written since the checksum map was last updated
+    ex_off_t cksum_trunc;  //** Smallest size truncated to since the last update or -1
+    int cksum_drop;        //** A write failed so the map is removed instead of updated
 };
 
 typedef struct lio_file_handle_s lio_file_handle_t;
@@ -219,13 +241,17 @@ int lio_writev(lio_fd_t *fd, iovec_t *iov, int n_iov, ex_off_t size, off_t off,
 int lio_write_ex(lio_fd_t *fd, int n_iov, ex_iovec_t *iov, tbuffer_t *buffer, ex_off_t boff, segment_rw_hints_t *rw_hints);
 
 mode_t ftype_lio2posix(int ftype);
-void _lio_parse_stat_vals(char *fname, struct stat *stat, char **val, int *v_size, char *mount_prefix, char **flink);
+int lio_stat_record(lio_config_t *lc, creds_t *creds, char *fname, char **val, int *v_size, os_stat_t *st);
+void _lio_parse_stat_vals(lio_config_t *lc, creds_t *creds, char *fname, struct stat *stat, char **val, int *v_size, char *mount_prefix, char **flink);
 int lio_stat(lio_config_t *lc, creds_t *creds, char *fname, struct stat *stat, char *mount_prefix, char **readlink);
 
 ex_off_t lio_seek(lio_fd_t *fd, ex_off_t offset, int whence);
 ex_off_t lio_tell(lio_fd_t *fd);
 ex_off_t lio_size(lio_fd_t *fd);
+lio_file_handle_t *_lio_get_file_handle(lio_config_t *lc, ex_id_t vid);
+void lio_exnode_cache_purge(lio_config_t *lc);
 op_generic_t *gop_lio_truncate(lio_fd_t *fd, ex_off_t new_size);
+op_generic_t *gop_lio_snapshot(lio_config_t *lc, creds_t *creds, char *path, char *name);
 // NOT IMPLEMENTED op_generic_t *gop_lio_stat(lio_t *lc, const char *fname, struct stat *stat);
 
 op_generic_t *gop_lio_cp_local2lio(FILE *sfd, lio_fd_t *dfd, ex_off_t bufsize, char *buffer, segment_rw_hints_t *rw_hints);
@@ -257,6 +283,16 @@ void lio_get_error_counts(lio_config_t *lc, segment_t *seg, segment_errors_t *se
 int lio_update_error_counts(lio_config_t *lc, creds_t *creds, char *path, segment_t *seg, int mode);
 int lio_update_exnode_attrs(lio_config_t *lc, creds_t *creds, exnode_t *ex, segment_t *seg, char *fname, segment_errors_t *serr);
 
+#define LIO_CKSUM_ATTR "system.block_cksum"
+
+void lio_crc32c_init();
+uint32_t lio_crc32c(uint32_t crc, const void *buf, ex_off_t len);
+void lio_cksum_note_write(lio_file_handle_t *fh, int n_iov, ex_iovec_t *iov, tbuffer_t *buffer, ex_off_t boff);
+void lio_cksum_note_truncate(lio_file_handle_t *fh, ex_off_t new_size);
+void lio_cksum_note_failed(lio_file_handle_t *fh);
+int lio_cksum_update(lio_fd_t *fd);
+int lio_cksum_verify(lio_fd_t *fd, ex_off_t off, ex_off_t len, int n_parallel, ex_off_t *bad_block);
+
 int lio_next_fsck(lio_config_t *lc, lio_fsck_iter_t *oit, char **bad_fname, int *bad_atype);
 lio_fsck_iter_t *lio_create_fsck_iter(lio_config_t *lc, creds_t *creds, char *path, int owner_mode, char *owner, int exnode_mode);
 void lio_destroy_fsck_iter(lio_config_t *lc, lio_fsck_iter_t *oit);
@@ -285,12 +321,14 @@ op_generic_t *lioc_remove_object(lio_config_t *lc, creds_t *creds, char *path, c
 unified_object_iter_t *unified_create_object_iter(lio_path_tuple_t tuple, os_regex_table_t *path_regex, os_regex_table_t *obj_regex, int obj_types, int rd);
 void unified_destroy_object_iter(unified_object_iter_t *it);
 int unified_next_object(unified_object_iter_t *it, char **fname, int *prefix_len);
+int lio_cp_direct(lio_config_t *lc, segment_rw_hints_t *rw_hints, segment_t *sseg, segment_t *dseg, ex_off_t bufsize, char *buffer, op_status_t *status);
 op_status_t cp_lio2lio(lio_cp_file_t *cp);
 op_status_t cp_local2lio(lio_cp_file_t *cp);
 op_status_t cp_lio2local(lio_cp_file_t *cp);
 op_status_t lio_cp_file_fn(void *arg, int id);
 int lio_cp_create_dir(list_t *table, lio_path_tuple_t tuple);
 op_status_t lio_cp_path_fn(void *arg, int id);
+op_status_t lio_cp_paths(lio_cp_path_t *cp, int n_paths, int max_spawn);
 op_generic_t *lioc_truncate(lio_path_tuple_t *tuple, ex_off_t new_size);
 
 void lc_object_remove_unused(int remove_all_unused);
@@ -646,7 +646,24 @@ void lc_object_remove_unused(int remove_all_unused)
 }
 
 //***************************************************************
-// blacklist_destroy - Destroys a blacklist structure
+// blacklist_ref - Adds a reference to the blacklist.  Used by anything
+//    that can outlive the LIO context that created it.
+//***************************************************************
+
+blacklist_t *blacklist_ref(blacklist_t *bl)
+{
+    if (bl == NULL) return(NULL);
+
+    apr_thread_mutex_lock(bl->lock);
+    bl->ref_count++;
+    apr_thread_mutex_unlock(bl->lock);
+
+    return(bl);
+}
+
+//***************************************************************
+// blacklist_destroy - Releases a reference to the blacklist and destroys
+//    it once the last one is gone
 //***************************************************************
 
 void blacklist_destroy(blacklist_t *bl)
@@ -654,6 +671,14 @@ void blacklist_destroy(blacklist_t *bl)
     apr_ssize_t hlen;
     apr_hash_index_t *hi;
     blacklist_rid_t *r;
+    blacklist_ioperf_t *p;
+    int n;
+
+    apr_thread_mutex_lock(bl->lock);
+    bl->ref_count--;
+    n = bl->ref_count;
+    apr_thread_mutex_unlock(bl->lock);
+    if (n > 0) return;
 
     //** Destroy all the blacklist RIDs
     for (hi=apr_hash_first(NULL, bl->table); hi != NULL; hi = apr_hash_next(hi)) {
@@ -662,8 +687,15 @@ void blacklist_destroy(blacklist_t *bl)
         free(r);
     }
 
-    apr_pool_destroy(bl->mpool);
+    //** And the I/O performance table
+    for (hi=apr_hash_first(NULL, bl->ioperf); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, &hlen, (void **)&p);
+        free(p->rid);
+        free(p);
+    }
+
     apr_thread_mutex_destroy(bl->lock);
+    apr_pool_destroy(bl->mpool);
     free(bl);
 }
 
@@ -680,6 +712,8 @@ blacklist_t *blacklist_load(inip_file_t *ifd, char *section)
     assert_result(apr_pool_create(&(bl->mpool), NULL), APR_SUCCESS);
     apr_thread_mutex_create(&(bl->lock), APR_THREAD_MUTEX_DEFAULT, bl->mpool);
     bl->table = apr_hash_make(bl->mpool);
+    bl->ioperf = apr_hash_make(bl->mpool);
+    bl->ref_count = 1;
 
     bl->timeout = inip_get_integer(ifd, section, "timeout", apr_time_from_sec(120));
     bl->min_bandwidth = inip_get_integer(ifd, section, "min_bandwidth", 5*1024*1024);  //** default ro 5MB
@@ -719,6 +753,7 @@ void lio_destroy_nl(lio_config_t *lio)
     lc_object_container_t *lcc;
     lio_path_tuple_t *tuple;
     char buffer[128];
+    int i;
 
     //** The creds is a little tricky cause we need to get the tuple first
     lcc = list_search(_lc_object_list, lio->creds_name);
@@ -745,6 +780,12 @@ void lio_destroy_nl(lio_config_t *lio)
 
     log_printf(15, "removing lio=%s\n", lio->section_name);
 
+    //** Dump the parked exnodes while all the services are still around
+    lio_exnode_cache_purge(lio);
+    list_destroy(lio->ex_cache_index);
+    free_stack(lio->ex_cache_lru, 0);
+    apr_thread_mutex_destroy(lio->ex_cache_lock);
+
     if (_lc_object_destroy(lio->rs_section) <= 0) {
         rs_destroy_service(lio->rs);
     }
@@ -793,7 +834,12 @@ void lio_destroy_nl(lio_config_t *lio)
     inip_destroy(lio->ifd);
 
     //** Table of open files
-    list_destroy(lio->open_index);
+    for (i=0; i<lio->n_open_shards; i++) {
+        list_destroy(lio->open_shard[i].index);
+        apr_thread_mutex_destroy(lio->open_shard[i].lock);
+        apr_thread_cond_destroy(lio->open_shard[i].cond);
+    }
+    free(lio->open_shard);
 
     //** Blacklist if used
     if (lio->blacklist != NULL) blacklist_destroy(lio->blacklist);
@@ -826,7 +872,7 @@ void lio_destroy(lio_config_t *lio)
 lio_config_t *lio_create_nl(char *fname, char *section, char *user, char *exe_name)
 {
     lio_config_t *lio;
-    int n, cores, max_recursion;
+    int i, n, cores, max_recursion;
     char buffer[1024];
     char *cred_args[2];
     char *ctype, *stype;
@@ -867,6 +913,8 @@ lio_config_t *lio_create_nl(char *fname, char *section, char *user, char *exe_na
     lio->timeout = inip_get_integer(lio->ifd, section, "timeout", 120);
     lio->max_attr = inip_get_integer(lio->ifd, section, "max_attr_size", 10*1024*1024);
     lio->calc_adler32 = inip_get_integer(lio->ifd, section, "calc_adler32", 0);
+    lio->cksum_block_size = inip_get_integer(lio->ifd, section, "checksum_block_size", 0);
+    if (lio->cksum_block_size > 0) lio_crc32c_init();
     lio->readahead = inip_get_integer(lio->ifd, section, "readahead", 0);
     lio->readahead_trigger = lio->readahead * inip_get_double(lio->ifd, section, "readahead_trigger", 1.0);
 
@@ -1055,12 +1103,25 @@ lio_config_t *lio_create_nl(char *fname, char *section, char *user, char *exe_na
     lio->cache = _lio_cache;
     add_service(lio->ess, ESS_RUNNING, ESS_CACHE, lio->cache);
 
-    //** Table of open files
-    lio->open_index = create_skiplist_full(10, 0.5, 0, &ex_id_compare, NULL, NULL, NULL);
-
     assert_result(apr_pool_create(&(lio->mpool), NULL), APR_SUCCESS);
     apr_thread_mutex_create(&(lio->lock), APR_THREAD_MUTEX_DEFAULT, lio->mpool);
 
+    //** Table of open files.  It's sharded so opens/closes of different files don't contend
+    lio->n_open_shards = inip_get_integer(lio->ifd, section, "open_file_shards", 64);
+    if (lio->n_open_shards < 1) lio->n_open_shards = 1;
+    type_malloc_clear(lio->open_shard, lio_fh_shard_t, lio->n_open_shards);
+    for (i=0; i<lio->n_open_shards; i++) {
+        apr_thread_mutex_create(&(lio->open_shard[i].lock), APR_THREAD_MUTEX_DEFAULT, lio->mpool);
+        apr_thread_cond_create(&(lio->open_shard[i].cond), lio->mpool);
+        lio->open_shard[i].index = create_skiplist_full(10, 0.5, 0, &ex_id_compare, NULL, NULL, NULL);
+    }
+
+    //** Recently closed exnodes are kept parsed so reopening them is cheap
+    lio->ex_cache_max = inip_get_integer(lio->ifd, section, "exnode_cache_size", 32);
+    apr_thread_mutex_create(&(lio->ex_cache_lock), APR_THREAD_MUTEX_DEFAULT, lio->mpool);
+    lio->ex_cache_index = create_skiplist_full(10, 0.5, 0, &ex_id_compare, NULL, NULL, NULL);
+    lio->ex_cache_lru = new_stack();
+
     return(lio);
 }
 
@@ -1177,9 +1177,16 @@ op_status_t cp_lio2lio(lio_cp_file_t *cp)
         gop = segment_clone(sseg, cp->dest_tuple.lc->da, &dseg, CLONE_STRUCT_AND_DATA, NULL, cp->dest_tuple.lc->timeout);
         log_printf(5, "src=%s  clone gid=%d\n", cp->src_tuple.path, gop_id(gop));
     } else {
-        info_printf(lio_ifd, 1, "Slow copy:( %s->%s\n", cp->src_tuple.path, cp->dest_tuple.path);
         type_malloc(buffer, char, cp->bufsize+1);
-        gop = segment_copy(cp->dest_tuple.lc->tpc_unlimited, cp->dest_tuple.lc->da, cp->rw_hints, sseg, dseg, 0, 0, -1, cp->bufsize, buffer, 1, cp->dest_tuple.lc->timeout);
+        err = (cp->slow == 0) ? lio_cp_direct(cp->dest_tuple.lc, cp->rw_hints, sseg, dseg, cp->bufsize, buffer, &status) : 1;
+        if (err == 0) {
+            info_printf(lio_ifd, 1, "Direct copy %s->%s\n", cp->src_tuple.path, cp->dest_tuple.path);
+            gop = gop_dummy(status);
+            status = op_failure_status;
+        } else {
+            info_printf(lio_ifd, 1, "Slow copy:( %s->%s\n", cp->src_tuple.path, cp->dest_tuple.path);
+            gop = segment_copy(cp->dest_tuple.lc->tpc_unlimited, cp->dest_tuple.lc->da, cp->rw_hints, sseg, dseg, 0, 0, -1, cp->bufsize, buffer, 1, cp->dest_tuple.lc->timeout);
+        }
     }
     err = gop_waitall(gop);
 
@@ -1423,9 +1430,9 @@ op_status_t lioc_truncate_fn(void *arg, int tid)
     exnode_t *ex;
     exnode_exchange_t *exp;
     segment_t *seg;
-    char *key[] = {"system.exnode", "system.exnode.size", "os.timestamp.system.modify_data"};
-    char *val[3];
-    int v_size[3], err, hard_errors, ftype;
+    char *key[] = {"system.exnode", "system.exnode.size", "os.timestamp.system.modify_data", LIO_CKSUM_ATTR};
+    char *val[4];
+    int v_size[4], err, hard_errors, ftype;
     op_status_t status;
 
     status = op_failure_status;
@@ -1481,7 +1488,9 @@ op_status_t lioc_truncate_fn(void *arg, int tid)
     v_size[1] = strlen(val[1]);
     val[2] = NULL;
     v_size[2] = 0;
-    lioc_set_multiple_attrs(op->tuple.lc, op->tuple.creds, op->tuple.path, NULL, key, (void **)val, v_size, 3);
+    val[3] = NULL;  //** The checksum map no longer matches so remove it
+    v_size[3] = -1;
+    lioc_set_multiple_attrs(op->tuple.lc, op->tuple.creds, op->tuple.path, NULL, key, (void **)val, v_size, 4);
 
     //**Update the error counts if needed
     hard_errors = lioc_update_error_counts(op->tuple.lc, op->tuple.creds, op->tuple.path, seg, 0);
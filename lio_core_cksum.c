@@ -0,0 +1,591 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+#define _log_module_index 227
+
+#include <stdio.h>
+#include <stdint.h>
+#include "type_malloc.h"
+#include "lio.h"
+#include "log.h"
+#include "ex3_compare.h"
+
+//***********************************************************************
+// Per block CRC32C checksum map
+//
+//  The map is stored in the LIO_CKSUM_ATTR attribute as
+//     crc32c:block_size:file_size:root:leaf_0leaf_1...leaf_n-1
+//  where each leaf is the CRC32C of a block as 8 hex digits.  The root
+//  is a Merkle style hash of the leaves using a fixed fanout so the map
+//  itself can be checked before it's used.
+//***********************************************************************
+
+#define LIO_CKSUM_FANOUT 64     //** Number of children hashed into each interior node
+#define LIO_CKSUM_PARALLEL 8    //** Max blocks being read at once when recalculating
+
+typedef struct {  //** Block written since the last map update
+    ex_off_t block;
+    uint32_t crc;
+    int n_writes;   //** The crc is only usable if there was a single full block write
+} lio_cksum_block_t;
+
+typedef struct {
+    ex_off_t block_size;
+    ex_off_t size;
+    ex_off_t n;
+    uint32_t root;
+    uint32_t *crc;
+} lio_cksum_map_t;
+
+static uint32_t _crc32c_table[256];
+static int _crc32c_ready = 0;
+
+//***********************************************************************
+// lio_crc32c_init - Makes the CRC32C (Castagnoli) lookup table
+//***********************************************************************
+
+void lio_crc32c_init()
+{
+    uint32_t c;
+    int i, j;
+
+    if (_crc32c_ready == 1) return;
+
+    for (i=0; i<256; i++) {
+        c = i;
+        for (j=0; j<8; j++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+        _crc32c_table[i] = c;
+    }
+
+    _crc32c_ready = 1;
+}
+
+//***********************************************************************
+// lio_crc32c - Adds the buffer to the running CRC32C.  Start with crc=0.
+//***********************************************************************
+
+uint32_t lio_crc32c(uint32_t crc, const void *buf, ex_off_t len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    ex_off_t i;
+
+    crc = ~crc;
+    for (i=0; i<len; i++) crc = _crc32c_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+
+    return(~crc);
+}
+
+//***********************************************************************
+// _cksum_root - Returns the root hash for the leaves
+//***********************************************************************
+
+uint32_t _cksum_root(uint32_t *leaf, ex_off_t n)
+{
+    uint32_t *level, *next;
+    unsigned char b[4];
+    uint32_t c;
+    ex_off_t i, j, nnext;
+
+    if (n == 0) return(0);
+    if (n == 1) return(leaf[0]);
+
+    level = leaf;
+    while (n > 1) {
+        nnext = (n + LIO_CKSUM_FANOUT - 1) / LIO_CKSUM_FANOUT;
+        type_malloc(next, uint32_t, nnext);
+        for (i=0; i<nnext; i++) {
+            c = 0;
+            for (j=i*LIO_CKSUM_FANOUT; (j<n) && (j<(i+1)*LIO_CKSUM_FANOUT); j++) {
+                b[0] = level[j] & 0xFF;  //** Fixed byte order so the root is portable
+                b[1] = (level[j] >> 8) & 0xFF;
+                b[2] = (level[j] >> 16) & 0xFF;
+                b[3] = (level[j] >> 24) & 0xFF;
+                c = lio_crc32c(c, b, 4);
+            }
+            next[i] = c;
+        }
+
+        if (level != leaf) free(level);
+        level = next;
+        n = nnext;
+    }
+
+    c = level[0];
+    free(level);
+    return(c);
+}
+
+//***********************************************************************
+// _cksum_map_load - Loads the object's checksum map.  Returns 0 on success
+//***********************************************************************
+
+int _cksum_map_load(lio_config_t *lc, creds_t *creds, char *path, lio_cksum_map_t *m)
+{
+    char *val, *p;
+    unsigned int root, crc;
+    char hex[9];
+    ex_off_t i;
+    int v_size, n;
+
+    memset(m, 0, sizeof(lio_cksum_map_t));
+
+    val = NULL;
+    v_size = -lc->max_attr;
+    if (lio_get_attr(lc, creds, path, NULL, LIO_CKSUM_ATTR, (void **)&val, &v_size) != OP_STATE_SUCCESS) return(1);
+    if (val == NULL) return(1);
+
+    n = 0;
+    if (sscanf(val, "crc32c:" XOT ":" XOT ":%x:%n", &(m->block_size), &(m->size), &root, &n) != 3) goto bad;
+    if ((n == 0) || (m->block_size <= 0)) goto bad;
+
+    m->n = (m->size + m->block_size - 1) / m->block_size;
+    if ((v_size - n) != 8*m->n) goto bad;
+
+    type_malloc(m->crc, uint32_t, m->n+1);
+    p = val + n;
+    hex[8] = 0;
+    for (i=0; i<m->n; i++) {
+        memcpy(hex, p + 8*i, 8);
+        if (sscanf(hex, "%x", &crc) != 1) goto bad;
+        m->crc[i] = crc;
+    }
+    m->root = root;
+    free(val);
+
+    if (_cksum_root(m->crc, m->n) != m->root) {
+        log_printf(0, "ERROR: Checksum map is corrupt! path=%s\n", path);
+        free(m->crc);
+        memset(m, 0, sizeof(lio_cksum_map_t));
+        return(1);
+    }
+
+    return(0);
+
+bad:
+    log_printf(1, "Unable to parse the checksum map. path=%s\n", path);
+    if (m->crc != NULL) free(m->crc);
+    memset(m, 0, sizeof(lio_cksum_map_t));
+    free(val);
+    return(1);
+}
+
+//***********************************************************************
+// _cksum_map_store - Stores the checksum map
+//***********************************************************************
+
+int _cksum_map_store(lio_config_t *lc, creds_t *creds, char *path, lio_cksum_map_t *m)
+{
+    char *val;
+    ex_off_t i;
+    int n, err;
+
+    m->root = _cksum_root(m->crc, m->n);
+
+    type_malloc(val, char, 128 + 8*m->n + 1);
+    n = sprintf(val, "crc32c:" XOT ":" XOT ":%08x:", m->block_size, m->size, m->root);
+    for (i=0; i<m->n; i++) {
+        n += sprintf(val + n, "%08x", m->crc[i]);
+    }
+
+    err = lio_set_attr(lc, creds, path, NULL, LIO_CKSUM_ATTR, val, n);
+    free(val);
+
+    return((err == OP_STATE_SUCCESS) ? 0 : 1);
+}
+
+//***********************************************************************
+// _cksum_blocks - Reads the blocks and calculates their CRCs.  Up to
+//    n_parallel blocks are read at once.  Returns the number of blocks
+//    that couldn't be read.  Those are flagged in bad[] if provided.
+//***********************************************************************
+
+int _cksum_blocks(lio_file_handle_t *fh, ex_off_t block_size, ex_off_t size, ex_off_t *block, uint32_t *crc, char *bad, ex_off_t n, int n_parallel)
+{
+    lio_config_t *lc = fh->lc;
+    opque_t *q;
+    op_generic_t *gop;
+    tbuffer_t *tb;
+    ex_iovec_t *iov;
+    char **buf;
+    ex_off_t *slot_index;
+    ex_off_t i, off, len;
+    int slot, nfailed;
+
+    if (n == 0) return(0);
+    if (n_parallel <= 0) n_parallel = LIO_CKSUM_PARALLEL;
+    if (n_parallel > n) n_parallel = n;
+
+    type_malloc_clear(tb, tbuffer_t, n_parallel);
+    type_malloc_clear(iov, ex_iovec_t, n_parallel);
+    type_malloc_clear(buf, char *, n_parallel);
+    type_malloc_clear(slot_index, ex_off_t, n_parallel);
+    for (slot=0; slot<n_parallel; slot++) type_malloc(buf[slot], char, block_size);
+
+    nfailed = 0;
+    q = new_opque();
+    opque_start_execution(q);
+
+    for (i=0; i<n; i++) {
+        if (i < n_parallel) {
+            slot = i;
+        } else {  //** Wait for a free buffer
+            gop = opque_waitany(q);
+            slot = gop_get_myid(gop);
+            if (gop_completed_successfully(gop) == OP_STATE_SUCCESS) {
+                crc[slot_index[slot]] = lio_crc32c(0, buf[slot], iov[slot].len);
+            } else {
+                nfailed++;
+                if (bad != NULL) bad[slot_index[slot]] = 1;
+            }
+            gop_free(gop, OP_DESTROY);
+        }
+
+        off = block[i] * block_size;
+        len = size - off;
+        if (len > block_size) len = block_size;
+        slot_index[slot] = i;
+        ex_iovec_single(&(iov[slot]), off, len);
+        tbuffer_single(&(tb[slot]), len, buf[slot]);
+        gop = segment_read(fh->seg, lc->da, NULL, 1, &(iov[slot]), &(tb[slot]), 0, lc->timeout);
+        gop_set_myid(gop, slot);
+        opque_add(q, gop);
+    }
+
+    while ((gop = opque_waitany(q)) != NULL) {
+        slot = gop_get_myid(gop);
+        if (gop_completed_successfully(gop) == OP_STATE_SUCCESS) {
+            crc[slot_index[slot]] = lio_crc32c(0, buf[slot], iov[slot].len);
+        } else {
+            nfailed++;
+            if (bad != NULL) bad[slot_index[slot]] = 1;
+        }
+        gop_free(gop, OP_DESTROY);
+    }
+    opque_free(q, OP_DESTROY);
+
+    for (slot=0; slot<n_parallel; slot++) free(buf[slot]);
+    free(buf);
+    free(slot_index);
+    free(iov);
+    free(tb);
+
+    return(nfailed);
+}
+
+//***********************************************************************
+// lio_cksum_note_write - Records the blocks touched by a write.  Blocks
+//    completely covered by the write have their CRC calculated from the
+//    write buffer.  The rest are recalculated when the map is updated.
+//***********************************************************************
+
+void lio_cksum_note_write(lio_file_handle_t *fh, int n_iov, ex_iovec_t *iov, tbuffer_t *buffer, ex_off_t boff)
+{
+    ex_off_t bs = fh->lc->cksum_block_size;
+    lio_cksum_block_t *b;
+    tbuffer_t tb;
+    ex_off_t bpos, b0, b1, k, off, end;
+    uint32_t crc;
+    char *buf;
+    int i, full;
+
+    buf = NULL;
+    bpos = boff;
+    for (i=0; i<n_iov; i++) {
+        if (iov[i].len <= 0) continue;
+        end = iov[i].offset + iov[i].len;
+        b0 = iov[i].offset / bs;
+        b1 = (end - 1) / bs;
+        for (k=b0; k<=b1; k++) {
+            off = k * bs;
+            full = ((off >= iov[i].offset) && ((off + bs) <= end)) ? 1 : 0;
+            crc = 0;
+            if (full == 1) {
+                if (buf == NULL) type_malloc(buf, char, bs);
+                tbuffer_single(&tb, bs, buf);
+                tbuffer_copy(buffer, bpos + off - iov[i].offset, &tb, 0, bs, 1);
+                crc = lio_crc32c(0, buf, bs);
+            }
+
+            segment_lock(fh->seg);
+            b = list_search(fh->cksum_table, &k);
+            if (b == NULL) {
+                type_malloc_clear(b, lio_cksum_block_t, 1);
+                b->block = k;
+                list_insert(fh->cksum_table, &(b->block), b);
+            }
+            b->n_writes += (full == 1) ? 1 : 2;  //** A partial write always forces a recalculation
+            b->crc = crc;
+            segment_unlock(fh->seg);
+        }
+
+        bpos += iov[i].len;
+    }
+
+    if (buf != NULL) free(buf);
+}
+
+//***********************************************************************
+// lio_cksum_note_truncate - Flags the new last block and everything after
+//    it for recalculation
+//***********************************************************************
+
+void lio_cksum_note_truncate(lio_file_handle_t *fh, ex_off_t new_size)
+{
+    ex_off_t bs = fh->lc->cksum_block_size;
+    lio_cksum_block_t *b;
+    list_iter_t it;
+    ex_off_t k, *bkey;
+
+    k = new_size / bs;
+    segment_lock(fh->seg);
+    if ((fh->cksum_trunc < 0) || (new_size < fh->cksum_trunc)) fh->cksum_trunc = new_size;
+
+    //** Any CRCs we have from earlier writes past the new end are now useless
+    it = list_iter_search(fh->cksum_table, &k, 0);
+    while (list_next(&it, (list_key_t **)&bkey, (list_data_t **)&b) == 0) {
+        b->n_writes += 2;
+    }
+    segment_unlock(fh->seg);
+}
+
+//***********************************************************************
+// lio_cksum_note_failed - A write failed part way so the blocks it covered
+//    are unknown.  The map is removed on the next update.
+//***********************************************************************
+
+void lio_cksum_note_failed(lio_file_handle_t *fh)
+{
+    segment_lock(fh->seg);
+    fh->cksum_drop = 1;
+    segment_unlock(fh->seg);
+}
+
+//***********************************************************************
+// _cksum_map_drop - Removes the map marking the object as unchecksummed
+//***********************************************************************
+
+int _cksum_map_drop(lio_config_t *lc, creds_t *creds, char *path)
+{
+    return((lio_set_attr(lc, creds, path, NULL, LIO_CKSUM_ATTR, NULL, -1) == OP_STATE_SUCCESS) ? 0 : 1);
+}
+
+//***********************************************************************
+// lio_cksum_update - Folds the blocks written since the last update into
+//    the object's checksum map.  Only the blocks touched through this
+//    handle are ever re-read.  If the map is missing, has a different
+//    block size, or would be too big for an attribute and untouched blocks
+//    are needed the object is left unchecksummed instead.
+//    Returns 0 on success.
+//***********************************************************************
+
+int lio_cksum_update(lio_fd_t *fd)
+{
+    lio_file_handle_t *fh = fd->fh;
+    lio_config_t *lc = fh->lc;
+    ex_off_t bs = lc->cksum_block_size;
+    list_t *table;
+    list_iter_t it;
+    lio_cksum_block_t *b;
+    lio_cksum_map_t old, m;
+    ex_off_t *bkey, *redo;
+    ex_off_t i, n_redo, trunc;
+    uint32_t *rcrc;
+    char *valid, *touched;
+    int err, drop, have_old;
+
+    //** Swap in an empty table so any new writes are tracked for the next update
+    segment_lock(fh->seg);
+    table = fh->cksum_table;
+    trunc = fh->cksum_trunc;
+    drop = fh->cksum_drop;
+    if ((list_key_count(table) == 0) && (trunc < 0) && (drop == 0)) {
+        segment_unlock(fh->seg);
+        return(0);
+    }
+    fh->cksum_table = list_create(0, &skiplist_compare_ex_off, NULL, NULL, list_simple_free);
+    fh->cksum_trunc = -1;
+    fh->cksum_drop = 0;
+    segment_unlock(fh->seg);
+
+    m.block_size = bs;
+    m.size = segment_size(fh->seg);
+    m.n = (m.size + bs - 1) / bs;
+
+    //** A map that won't fit in an attribute could never be loaded again
+    if ((drop == 1) || ((128 + 8*m.n) > lc->max_attr)) {
+        log_printf(5, "Leaving the file unchecksummed fname=%s write_failed=%d blocks=" XOT "\n", fd->path, drop, m.n);
+        list_destroy(table);
+        return(_cksum_map_drop(lc, fd->creds, fd->path));
+    }
+
+    type_malloc_clear(m.crc, uint32_t, m.n+1);
+    type_malloc_clear(valid, char, m.n+1);
+    type_malloc_clear(touched, char, m.n+1);
+
+    //** Start with the existing map if it's usable
+    have_old = 0;
+    if ((_cksum_map_load(lc, fd->creds, fd->path, &old) == 0) && (old.block_size == bs)) {
+        have_old = 1;
+        for (i=0; (i<old.n) && (i<m.n); i++) {
+            m.crc[i] = old.crc[i];
+            valid[i] = 1;
+        }
+        if (old.size != m.size) {  //** The old and new last blocks may be partial
+            if ((old.n > 0) && (old.n <= m.n)) valid[old.n-1] = 0;
+            if (m.n > 0) valid[m.n-1] = 0;
+        }
+    }
+    if (trunc >= 0) {  //** Anything past a truncate could have been refilled without a write
+        for (i=trunc/bs; i<m.n; i++) {
+            valid[i] = 0;
+            touched[i] = 1;
+        }
+    }
+    if (old.crc != NULL) free(old.crc);
+
+    //** Now merge in what was written
+    it = list_iter_search(table, NULL, 0);
+    while (list_next(&it, (list_key_t **)&bkey, (list_data_t **)&b) == 0) {
+        if (b->block >= m.n) continue;
+        touched[b->block] = 1;
+        if ((b->n_writes == 1) && (((b->block+1)*bs) <= m.size)) {
+            m.crc[b->block] = b->crc;
+            valid[b->block] = 1;
+        } else {
+            valid[b->block] = 0;
+        }
+    }
+    list_destroy(table);
+
+    //** Recalculate everything else from the data
+    type_malloc(redo, ex_off_t, m.n+1);
+    n_redo = 0;
+    for (i=0; i<m.n; i++) {
+        if (valid[i] == 0) redo[n_redo++] = i;
+    }
+
+    //** Without a usable map we only know the blocks we touched.  Rather than
+    //** re-read the whole file on every close leave it unchecksummed.
+    if (have_old == 0) {
+        for (i=0; i<n_redo; i++) {
+            if (touched[redo[i]] == 0) break;
+        }
+        if (i < n_redo) {
+            log_printf(5, "No usable map and untouched blocks.  Leaving the file unchecksummed fname=%s\n", fd->path);
+            free(redo);
+            free(touched);
+            free(valid);
+            free(m.crc);
+            return(_cksum_map_drop(lc, fd->creds, fd->path));
+        }
+    }
+
+    type_malloc_clear(rcrc, uint32_t, n_redo+1);
+    err = _cksum_blocks(fh, bs, m.size, redo, rcrc, NULL, n_redo, LIO_CKSUM_PARALLEL);
+    for (i=0; i<n_redo; i++) m.crc[redo[i]] = rcrc[i];
+    free(rcrc);
+
+    log_printf(5, "fname=%s size=" XOT " blocks=" XOT " recalculated=" XOT " failed=%d\n", fd->path, m.size, m.n, n_redo, err);
+
+    if (err == 0) {
+        err = _cksum_map_store(lc, fd->creds, fd->path, &m);
+    } else {  //** Don't leave a map around that we know is wrong
+        log_printf(0, "ERROR: Unable to read all the blocks for the checksum map! fname=%s\n", fd->path);
+        _cksum_map_drop(lc, fd->creds, fd->path);
+    }
+
+    free(redo);
+    free(touched);
+    free(valid);
+    free(m.crc);
+
+    return(err);
+}
+
+//***********************************************************************
+// lio_cksum_verify - Verifies the range against the checksum map reading
+//    up to n_parallel blocks at a time.  Use len < 0 to go to the end of
+//    the file.  Returns the number of bad blocks and the first one in
+//    bad_block or -1 if there isn't a usable map.
+//***********************************************************************
+
+int lio_cksum_verify(lio_fd_t *fd, ex_off_t off, ex_off_t len, int n_parallel, ex_off_t *bad_block)
+{
+    lio_file_handle_t *fh = fd->fh;
+    lio_cksum_map_t m;
+    ex_off_t b0, b1, i, n;
+    ex_off_t *block;
+    uint32_t *crc;
+    char *bad;
+    int nbad;
+
+    if (bad_block != NULL) *bad_block = -1;
+
+    lio_crc32c_init();  //** Checking can be done even if we don't make the maps
+    if (_cksum_map_load(fh->lc, fd->creds, fd->path, &m) != 0) return(-1);
+    if (m.size != segment_size(fh->seg)) {  //** Changed since the map was made
+        log_printf(1, "Stale checksum map fname=%s map_size=" XOT " size=" XOT "\n", fd->path, m.size, segment_size(fh->seg));
+        free(m.crc);
+        return(-1);
+    }
+
+    if (off < 0) off = 0;
+    if ((len < 0) || ((off + len) > m.size)) len = m.size - off;
+    if ((len <= 0) || (m.n == 0)) {
+        if (m.crc != NULL) free(m.crc);
+        return(0);
+    }
+
+    b0 = off / m.block_size;
+    b1 = (off + len - 1) / m.block_size;
+    n = b1 - b0 + 1;
+
+    type_malloc(block, ex_off_t, n);
+    type_malloc_clear(crc, uint32_t, n);
+    type_malloc_clear(bad, char, n);
+    for (i=0; i<n; i++) block[i] = b0 + i;
+
+    _cksum_blocks(fh, m.block_size, m.size, block, crc, bad, n, n_parallel);
+
+    nbad = 0;
+    for (i=0; i<n; i++) {
+        if ((bad[i] == 1) || (crc[i] != m.crc[block[i]])) {
+            log_printf(1, "Bad block fname=%s block=" XOT " crc=%08x expected=%08x read_error=%d\n", fd->path, block[i], crc[i], m.crc[block[i]], bad[i]);
+            if ((nbad == 0) && (bad_block != NULL)) *bad_block = block[i];
+            nbad++;
+        }
+    }
+
+    free(block);
+    free(crc);
+    free(bad);
+    free(m.crc);
+
+    return(nbad);
+}
@@ -43,9 +43,10 @@ http://www.accre.vanderbilt.edu
 
 #define LFH_KEY_INODE  0
 #define LFH_KEY_EXNODE 1
-#define LFH_NKEYS      2
+#define LFH_KEY_MODIFY 2
+#define LFH_NKEYS      3
 
-static char *_lio_fh_keys[] = { "system.inode", "system.exnode" };
+static char *_lio_fh_keys[] = { "system.inode", "system.exnode", "system.modify_data" };
 
 typedef struct {
     ex_off_t offset;
@@ -53,6 +54,14 @@ typedef struct {
     uLong adler32;
 } lfs_adler32_t;
 
+typedef struct {  //** Parked exnode from a closed file
+    ex_id_t ino;
+    ex_id_t vid;
+    unsigned int hash;
+    exnode_t *ex;
+    segment_t *seg;
+} lio_ex_cache_t;
+
 //***********************************************************************
 // Core LIO R/W functionality
 //***********************************************************************
@@ -288,18 +297,21 @@ void lio_store_and_release_adler32(lio_config_t *lc, creds_t *creds, list_t *wri
 //  lio_load_file_handle_attrs - Loads the attributes for a file handle
 //***********************************************************************
 
-int lio_load_file_handle_attrs(lio_config_t *lc, creds_t *creds, char *fname, ex_id_t *inode, char **exnode)
+int lio_load_file_handle_attrs(lio_config_t *lc, creds_t *creds, char *fname, ex_id_t *inode, char **exnode, unsigned int *ex_hash)
 {
     char *myfname;
-    char vino[256];
-    int err, v_size[2];
-    char *val[2];
+    char vino[256], vmod[256];
+    int err, v_size[LFH_NKEYS];
+    char *val[LFH_NKEYS];
+    uLong crc;
 
     //** Get the attributes
-    v_size[0] = sizeof(vino);
-    val[0] = vino;
-    v_size[1] = -lc->max_attr;
-    val[1] = NULL;
+    v_size[LFH_KEY_INODE] = sizeof(vino);
+    val[LFH_KEY_INODE] = vino;
+    v_size[LFH_KEY_EXNODE] = -lc->max_attr;
+    val[LFH_KEY_EXNODE] = NULL;
+    v_size[LFH_KEY_MODIFY] = sizeof(vmod);
+    val[LFH_KEY_MODIFY] = vmod;
 
     myfname = (strcmp(fname, "") == 0) ? "/" : (char *)fname;
     err = lio_get_multiple_attrs(lc, creds, myfname, NULL, _lio_fh_keys, (void **)val, v_size, LFH_NKEYS);
@@ -309,7 +321,13 @@ int lio_load_file_handle_attrs(lio_config_t *lc, creds_t *creds, char *fname, ex
         return(-1);
     }
 
-    *exnode = val[1];
+    *exnode = val[LFH_KEY_EXNODE];
+
+    //** The exnode and modify time are hashed so a parked copy can be validated
+    crc = crc32(0L, Z_NULL, 0);
+    if (v_size[LFH_KEY_EXNODE] > 0) crc = crc32(crc, (const Bytef *)val[LFH_KEY_EXNODE], v_size[LFH_KEY_EXNODE]);
+    if (v_size[LFH_KEY_MODIFY] > 0) crc = crc32(crc, (const Bytef *)vmod, v_size[LFH_KEY_MODIFY]);
+    *ex_hash = crc;
 
     if (v_size[LFH_KEY_INODE] > 0) {
         *inode = 0;
@@ -326,34 +344,144 @@ int lio_load_file_handle_attrs(lio_config_t *lc, creds_t *creds, char *fname, ex
 //***********************************************************************
 //  _lio_get_file_handle - Returns the file handle associated with the view ID
 //     number if the file is already open.  Otherwise NULL is returned
-//  ****NOTE: assumes that lio_lock(lfs) has been called ****
+//  ****NOTE: assumes that lio_fh_shard_lock(lio_fh_shard(lc, vid)) has been called ****
 //***********************************************************************
 
 lio_file_handle_t *_lio_get_file_handle(lio_config_t *lc, ex_id_t vid)
 {
-    return(list_search(lc->open_index, (list_key_t *)&vid));
+    return(list_search(lio_fh_shard(lc, vid)->index, (list_key_t *)&vid));
 
 }
 
 //***********************************************************************
 // _lio_add_file_handle - Adds the file handle to the table
-//  ****NOTE: assumes that lio_lock(lfs) has been called ****
+//  ****NOTE: assumes that the handle's shard is locked ****
 //***********************************************************************
 
 void _lio_add_file_handle(lio_config_t *lc, lio_file_handle_t *fh)
 {
-    list_insert(lc->open_index, (list_key_t *)&(fh->vid), (list_data_t *)fh);
+    list_insert(lio_fh_shard(lc, fh->vid)->index, (list_key_t *)&(fh->vid), (list_data_t *)fh);
 }
 
 
 //***********************************************************************
 // _lio_remove_file_handle - Removes the file handle from the open table
-//  ****NOTE: assumes that lio_lock(lfs) has been called ****
+//  ****NOTE: assumes that the handle's shard is locked ****
 //***********************************************************************
 
 void _lio_remove_file_handle(lio_config_t *lc, lio_file_handle_t *fh)
 {
-    list_remove(lc->open_index, (list_key_t *)&(fh->vid), (list_data_t *)fh);
+    list_remove(lio_fh_shard(lc, fh->vid)->index, (list_key_t *)&(fh->vid), (list_data_t *)fh);
+}
+
+//***********************************************************************
+// _lio_exnode_cache_drop - Removes the entry from the parked exnode cache
+//     and destroys it.
+//  ****NOTE: assumes that ex_cache_lock has been acquired ****
+//***********************************************************************
+
+void _lio_exnode_cache_drop(lio_config_t *lc, Stack_ele_t *ele)
+{
+    lio_ex_cache_t *ce = (lio_ex_cache_t *)get_stack_ele_data(ele);
+
+    list_remove(lc->ex_cache_index, (list_key_t *)&(ce->ino), (list_data_t *)ele);
+    move_to_ptr(lc->ex_cache_lru, ele);
+    delete_current(lc->ex_cache_lru, 1, 0);
+
+    exnode_destroy(ce->ex);
+    free(ce);
+}
+
+//***********************************************************************
+// _lio_exnode_cache_get - Pulls the parked exnode for the inode out of the
+//     cache if it's still current.  A stale entry is destroyed and NULL
+//     is returned.
+//     The stale exnode is destroyed in the lock so a fresh copy can't be
+//     loaded while the old one still exists.
+//  ****NOTE: assumes that the vid's shard is locked ****
+//***********************************************************************
+
+lio_ex_cache_t *_lio_exnode_cache_get(lio_config_t *lc, ex_id_t ino, ex_id_t vid, unsigned int hash)
+{
+    Stack_ele_t *ele;
+    lio_ex_cache_t *ce;
+
+    if (lc->ex_cache_max <= 0) return(NULL);
+
+    apr_thread_mutex_lock(lc->ex_cache_lock);
+    ele = list_search(lc->ex_cache_index, (list_key_t *)&ino);
+    if (ele == NULL) {
+        apr_thread_mutex_unlock(lc->ex_cache_lock);
+        return(NULL);
+    }
+
+    ce = (lio_ex_cache_t *)get_stack_ele_data(ele);
+    if ((ce->vid != vid) || (ce->hash != hash)) {  //** It's been changed since we parked it
+        log_printf(5, "Stale exnode ino=" XIDT " vid=" XIDT "\n", ino, vid);
+        _lio_exnode_cache_drop(lc, ele);
+        apr_thread_mutex_unlock(lc->ex_cache_lock);
+        return(NULL);
+    }
+
+    list_remove(lc->ex_cache_index, (list_key_t *)&(ce->ino), (list_data_t *)ele);
+    move_to_ptr(lc->ex_cache_lru, ele);
+    delete_current(lc->ex_cache_lru, 1, 0);
+    apr_thread_mutex_unlock(lc->ex_cache_lock);
+
+    log_printf(5, "Reusing exnode ino=" XIDT " vid=" XIDT "\n", ino, vid);
+    return(ce);
+}
+
+//***********************************************************************
+// _lio_exnode_cache_put - Parks the closed file's exnode for reuse.  The
+//     oldest entries are destroyed to make room.  Returns 0 if the exnode
+//     was taken and 1 if the caller should destroy it.
+//  ****NOTE: assumes that the handle's shard is locked ****
+//***********************************************************************
+
+int _lio_exnode_cache_put(lio_config_t *lc, lio_file_handle_t *fh)
+{
+    Stack_ele_t *ele;
+    lio_ex_cache_t *ce;
+
+    if ((lc->ex_cache_max <= 0) || (fh->ino == 0)) return(1);
+
+    type_malloc(ce, lio_ex_cache_t, 1);
+    ce->ino = fh->ino;
+    ce->vid = fh->vid;
+    ce->hash = fh->ex_hash;
+    ce->ex = fh->ex;
+    ce->seg = fh->seg;
+
+    apr_thread_mutex_lock(lc->ex_cache_lock);
+    ele = list_search(lc->ex_cache_index, (list_key_t *)&(ce->ino));
+    if (ele != NULL) _lio_exnode_cache_drop(lc, ele);  //** Replace the older copy
+
+    while (stack_size(lc->ex_cache_lru) >= lc->ex_cache_max) {
+        move_to_bottom(lc->ex_cache_lru);
+        _lio_exnode_cache_drop(lc, get_ptr(lc->ex_cache_lru));
+    }
+
+    push(lc->ex_cache_lru, ce);
+    ele = get_ptr(lc->ex_cache_lru);
+    list_insert(lc->ex_cache_index, (list_key_t *)&(ce->ino), (list_data_t *)ele);
+    apr_thread_mutex_unlock(lc->ex_cache_lock);
+
+    return(0);
+}
+
+//***********************************************************************
+// lio_exnode_cache_purge - Destroys all the parked exnodes
+//***********************************************************************
+
+void lio_exnode_cache_purge(lio_config_t *lc)
+{
+    apr_thread_mutex_lock(lc->ex_cache_lock);
+    while (stack_size(lc->ex_cache_lru) > 0) {
+        move_to_top(lc->ex_cache_lru);
+        _lio_exnode_cache_drop(lc, get_ptr(lc->ex_cache_lru));
+    }
+    apr_thread_mutex_unlock(lc->ex_cache_lock);
 }
 
 //*************************************************************************
@@ -377,9 +505,12 @@ op_status_t lio_myopen_fn(void *arg, int id)
     lio_fd_op_t *op = (lio_fd_op_t *)arg;
     lio_config_t *lc = op->lc;
     lio_file_handle_t *fh;
+    lio_fh_shard_t *shard;
+    lio_ex_cache_t *ce;
     lio_fd_t *fd;
     char *exnode;
     ex_id_t ino, vid;
+    unsigned int ex_hash;
     exnode_exchange_t *exp;
     op_status_t status;
     int dtype, err;
@@ -422,7 +553,7 @@ op_status_t lio_myopen_fn(void *arg, int id)
     fd->lc = lc;
 
     exnode = NULL;
-    if (lio_load_file_handle_attrs(lc, op->creds, op->path, &ino, &exnode) != 0) {
+    if (lio_load_file_handle_attrs(lc, op->creds, op->path, &ino, &exnode, &ex_hash) != 0) {
         log_printf(1, "ERROR loading attributes! fname=%s\n", op->path);
         free(fd);
         *op->fd = NULL;
@@ -442,24 +573,48 @@ op_status_t lio_myopen_fn(void *arg, int id)
         return(op_failure_status);
     }
 
-    lio_lock(lc);
-    fh = _lio_get_file_handle(lc, vid);
+    //** See if it's already open or someone else is in the middle of opening it
+    shard = lio_fh_shard(lc, vid);
+    lio_fh_shard_lock(shard);
+    while (((fh = _lio_get_file_handle(lc, vid)) != NULL) && (fh->in_flight == 1)) {
+        apr_thread_cond_wait(shard->cond, shard->lock);
+    }
     log_printf(2, "fname=%s fh=%p\n", op->path, fh);
 
     if (fh != NULL) { //** Already open so just increment the ref count and return a new fd
         fh->ref_count++;
         fd->fh = fh;
-        lio_unlock(lc);
+        lio_fh_shard_unlock(shard);
         *op->fd = fd;
         exnode_exchange_destroy(exp);
         return(op_success_status);
     }
 
-    //** New file to open
+    //** New file to open.  Add a placeholder so anyone else opening it waits on us
+    //** instead of loading the exnode a 2nd time.  The load is done without the lock.
     type_malloc_clear(fh, lio_file_handle_t, 1);
     fh->vid = vid;
+    fh->ino = ino;
+    fh->ex_hash = ex_hash;
     fh->ref_count++;
+    fh->in_flight = 1;
     fh->lc = lc;
+    if (lc->calc_adler32) fh->write_table = list_create(0, &skiplist_compare_ex_off, NULL, NULL, NULL);
+    if (lc->cksum_block_size > 0) fh->cksum_table = list_create(0, &skiplist_compare_ex_off, NULL, NULL, list_simple_free);
+    fh->cksum_trunc = -1;
+
+    //** See if we still have it parsed from a recent close
+    ce = _lio_exnode_cache_get(lc, ino, vid, ex_hash);
+    if (ce != NULL) {
+        fh->ex = ce->ex;
+        fh->seg = ce->seg;
+        fh->in_flight = 0;
+        free(ce);
+    }
+    _lio_add_file_handle(lc, fh);
+    lio_fh_shard_unlock(shard);
+
+    if (ce != NULL) goto ready;
 
     //** Load it
     fh->ex = exnode_create();
@@ -474,14 +629,19 @@ op_status_t lio_myopen_fn(void *arg, int id)
     fh->seg = exnode_get_default(fh->ex);
     if (fh->seg == NULL) {
         log_printf(0, "ERROR: No default segment!  Aborting! fname=%s\n", fd->path);
+        status = op_failure_status;
         goto cleanup;
     }
+    cache_segment_set_data_version(fh->seg, ex_hash);  //** Victim pages from an older copy are ignored
 
-    if (lc->calc_adler32) fh->write_table = list_create(0, &skiplist_compare_ex_off, NULL, NULL, NULL);
+    //** It's ready so let everyone waiting on it in
+    lio_fh_shard_lock(shard);
+    fh->in_flight = 0;
+    apr_thread_cond_broadcast(shard->cond);
+    lio_fh_shard_unlock(shard);
 
-    //Add it to the file open table
-    _lio_add_file_handle(lc, fh);
-    lio_unlock(lc);  //** Now we can release the lock
+ready:
+    exnode_exchange_destroy(exp);  //** Clean up
 
     fd->fh = fh;
     *op->fd = fd;
@@ -489,7 +649,12 @@ op_status_t lio_myopen_fn(void *arg, int id)
     if ((op->mode & LIO_WRITE_MODE) > 0) {  //** For write mode we check for a few more flags
         if ((op->mode & LIO_TRUNCATE_MODE) > 0) { //** See if they want the file truncated also
             status = gop_sync_exec_status(gop_lio_truncate(fd, 0));
-            if (status.op_status != OP_STATE_SUCCESS) goto cleanup;
+            if (status.op_status != OP_STATE_SUCCESS) {
+                log_printf(1, "ERROR truncating file! fname=%s\n", op->path);
+                gop_sync_exec(gop_lio_close_object(fd));
+                *op->fd = NULL;
+                return(status);
+            }
         }
 
         if ((op->mode & LIO_APPEND_MODE) > 0) { //** Append to the end of the file
@@ -499,20 +664,25 @@ op_status_t lio_myopen_fn(void *arg, int id)
         }
     }
 
-    exnode_exchange_destroy(exp);  //** Clean up
-
     return(status);
 
 cleanup:  //** We only make it here on a failure
     log_printf(1, "ERROR in cleanup! fname=%s\n", op->path);
 
+    //** Pull the placeholder.  Anyone waiting on it will retry the load themselves
+    lio_fh_shard_lock(shard);
+    _lio_remove_file_handle(lc, fh);
+    apr_thread_cond_broadcast(shard->cond);
+    lio_fh_shard_unlock(shard);
+
     exnode_destroy(fh->ex);
+    if (fh->write_table != NULL) list_destroy(fh->write_table);
+    if (fh->cksum_table != NULL) list_destroy(fh->cksum_table);
     exnode_exchange_destroy(exp);
     free(fd->path);
     free(fh);
     free(fd);
     *op->fd = NULL;
-    lio_unlock(lc);
 
     return(status);
 }
@@ -549,6 +719,7 @@ op_status_t lio_myclose_fn(void *arg, int id)
     lio_fd_t *fd = (lio_fd_t *)arg;
     lio_config_t *lc = fd->lc;
     lio_file_handle_t *fh;
+    lio_fh_shard_t *shard;
     op_status_t status;
     char *key[6] = {"system.exnode", "system.exnode.size", "os.timestamp.system.modify_data", NULL, NULL, NULL };
     char *val[6];
@@ -567,14 +738,15 @@ op_status_t lio_myclose_fn(void *arg, int id)
 
     //** Get the handles
     fh = fd->fh;
+    shard = lio_fh_shard(lc, fh->vid);
 
-    lio_lock(lc);
+    lio_fh_shard_lock(shard);
     fh->ref_count--;
     if (fh->ref_count > 0) {  //** Somebody else has it open as well
-        lio_unlock(lc);
+        lio_fh_shard_unlock(shard);
         return(status);
     }
-    lio_unlock(lc);
+    lio_fh_shard_unlock(shard);
 
     final_size = segment_size(fh->seg);
 
@@ -611,20 +783,21 @@ op_status_t lio_myclose_fn(void *arg, int id)
         }
 
         //** Check again that no one else has opened the file
-        lio_lock(lc);
+        lio_fh_shard_lock(shard);
         if (fh->ref_count > 0) {  //** Somebody else opened it while we were flushing buffers
             if (fd->path != NULL) free(fd->path);
             free(fd);
-            lio_unlock(lc);
+            lio_fh_shard_unlock(shard);
             return(status);
         }
 
-        //** Tear everything down
-        exnode_destroy(fh->ex);
+        //** Tear everything down.  Unless it's being removed the exnode is parked for reuse
         _lio_remove_file_handle(lc, fh);
-        lio_unlock(lc);
+        if ((fh->remove_on_close == 1) || (_lio_exnode_cache_put(lc, fh) != 0)) exnode_destroy(fh->ex);
+        lio_fh_shard_unlock(shard);
 
         if (fh->write_table != NULL) lio_store_and_release_adler32(lc, fd->creds, fh->write_table, fd->path);
+        if (fh->cksum_table != NULL) list_destroy(fh->cksum_table);
         if (fh->remove_on_close == 1) status = gop_sync_exec_status(gop_lio_remove_object(lc, fd->creds, fd->path, NULL, lio_exists(lc, fd->creds, fd->path)));
 
         free(fh);
@@ -636,6 +809,9 @@ op_status_t lio_myclose_fn(void *arg, int id)
     //** Get any errors that may have occured
     lio_get_error_counts(lc, fh->seg, &serr);
 
+    //** Fold the writes into the checksum map while we still have the segment
+    if ((fh->cksum_table != NULL) && (fh->remove_on_close == 0)) lio_cksum_update(fd);
+
     now = apr_time_now();
 
     //** Update the exnode and misc attributes
@@ -652,13 +828,13 @@ op_status_t lio_myclose_fn(void *arg, int id)
     dt /= APR_USEC_PER_SEC;
     log_printf(1, "ATTR_UPDATE fname=%s dt=%lf\n", fd->path, dt);
 
-    lio_lock(lc);  //** MAke sure no one else has opened the file while we were trying to close
+    lio_fh_shard_lock(shard);  //** MAke sure no one else has opened the file while we were trying to close
     log_printf(1, "fname=%s ref_count=%d\n", fd->path, fh->ref_count);
 
     if (fh->ref_count > 0) {  //** Somebody else opened it while we were flushing buffers
         if (fd->path != NULL) free(fd->path);
         free(fd);
-        lio_unlock(lc);
+        lio_fh_shard_unlock(shard);
         return(status);
     }
 
@@ -667,12 +843,13 @@ op_status_t lio_myclose_fn(void *arg, int id)
     exnode_destroy(fh->ex); //** This is done in the lock to make sure the exnode isn't loaded twice
     _lio_remove_file_handle(lc, fh);
 
-    lio_unlock(lc);
+    lio_fh_shard_unlock(shard);
 
     dt = apr_time_now() - now;
     dt /= APR_USEC_PER_SEC;
     log_printf(1, "exnode_destroy fname=%s dt=%lf\n", fd->path, dt);
     if (fh->write_table != NULL) lio_store_and_release_adler32(lc, fd->creds, fh->write_table, fd->path);
+    if (fh->cksum_table != NULL) list_destroy(fh->cksum_table);
 
 
     if (fh->remove_on_close) status = gop_sync_exec_status(gop_lio_remove_object(lc, fd->creds, fd->path, NULL, lio_exists(lc, fd->creds, fd->path)));
@@ -1049,10 +1226,13 @@ op_status_t lio_write_ex_fn(void *arg, int id)
     if (err != OP_STATE_SUCCESS) {
         log_printf(1, "ERROR with write! fname=%s\n", fd->path);
         printf("got value %d\n", err);
+        if (fd->fh->cksum_table != NULL) lio_cksum_note_failed(fd->fh);  //** No telling what made it out
         _op_set_status(status, OP_STATE_FAILURE, -EIO);
         return(status);
     }
 
+    if (fd->fh->cksum_table != NULL) lio_cksum_note_write(fd->fh, op->n_iov, iov, buffer, op->boff);
+
     size = iov[0].len;
     for (i=1; i< op->n_iov; i++) size += iov[i].len;
     _op_set_status(status, OP_STATE_SUCCESS, size);
@@ -1290,6 +1470,51 @@ op_generic_t *gop_lio_cp_lio2local(lio_fd_t *sfd, FILE *dfd, ex_off_t bufsize, c
 }
 
 
+//***********************************************************************
+// _lio_lun_seg - Returns the LUN segment underneath any cache layer or NULL
+//***********************************************************************
+
+segment_t *_lio_lun_seg(segment_t *seg)
+{
+    if (strcmp(segment_type(seg), SEGMENT_TYPE_CACHE) == 0) {
+        seg = ((cache_segment_t *)seg->priv)->child_seg;
+    }
+
+    return((strcmp(segment_type(seg), SEGMENT_TYPE_LUN) == 0) ? seg : NULL);
+}
+
+//***********************************************************************
+// lio_cp_direct - Attempts a depot-to-depot copy between the LUNs under
+//    the source and destination segments even if their layouts differ.
+//    Returns 1 if it can't be used and the caller should stream the data
+//    instead.  Otherwise the copy status is stored in status.
+//***********************************************************************
+
+int lio_cp_direct(lio_config_t *lc, segment_rw_hints_t *rw_hints, segment_t *sseg, segment_t *dseg, ex_off_t bufsize, char *buffer, op_status_t *status)
+{
+    segment_t *slun, *dlun;
+    ex_off_t size;
+
+    slun = _lio_lun_seg(sseg);
+    dlun = _lio_lun_seg(dseg);
+    if ((slun == NULL) || (dlun == NULL) || (slun == dlun)) return(1);
+
+    size = segment_size(sseg);
+
+    //** Make sure the source LUN has everything and size the destination
+    //** through the top level so the cache knows about it.
+    if (sseg != slun) gop_sync_exec(segment_flush(sseg, lc->da, 0, size+1, lc->timeout));
+    *status = gop_sync_exec_status(segment_truncate(dseg, lc->da, size, lc->timeout));
+    if (status->op_status != OP_STATE_SUCCESS) return(0);
+
+    *status = gop_sync_exec_status(seglun_copy_direct(lc->da, rw_hints, slun, dlun, bufsize, buffer, lc->timeout));
+
+    //** Don't want any stale pages hanging around
+    if (dseg != dlun) cache_drop_pages(dseg, 0, size+1);
+
+    return(0);
+}
+
 //***********************************************************************
 // lio_cp_lio2lio - Copies a LIO file to another LIO file
 //***********************************************************************
@@ -1302,7 +1527,7 @@ op_status_t lio_cp_lio2lio_fn(void *arg, int id)
     lio_file_handle_t *dfh = op->dlfd->fh;
     char *buffer;
     ex_off_t bufsize;
-    int used;
+    int used, err;
     const int sigsize = 10*1024;
     char sig1[sigsize], sig2[sigsize];
 
@@ -1322,12 +1547,18 @@ op_status_t lio_cp_lio2lio_fn(void *arg, int id)
         if (buffer == NULL) { //** Need to make it ourself
             type_malloc(buffer, char, bufsize+1);
         }
-        status = gop_sync_exec_status(segment_copy(dfh->lc->tpc_unlimited, dfh->lc->da, op->rw_hints, sfh->seg, dfh->seg, 0, 0, -1, bufsize, buffer, 1, dfh->lc->timeout));
+
+        //** Layouts differ so see if we can still copy most of it depot->depot
+        err = ((op->hints & LIO_COPY_INDIRECT) == 0) ? lio_cp_direct(dfh->lc, op->rw_hints, sfh->seg, dfh->seg, bufsize, buffer, &status) : 1;
+        if (err != 0) {
+            status = gop_sync_exec_status(segment_copy(dfh->lc->tpc_unlimited, dfh->lc->da, op->rw_hints, sfh->seg, dfh->seg, 0, 0, -1, bufsize, buffer, 1, dfh->lc->timeout));
+        }
 
         //** Clean up
         if (op->buffer == NULL) free(buffer);
     }
 
+    if (dfh->cksum_table != NULL) lio_cksum_note_truncate(dfh, 0);  //** Copied underneath us so redo it all
     dfh->modified = 1; //** Flag it as modified so the new exnode gets stored
 
     return(status);
@@ -1371,7 +1602,7 @@ op_status_t lio_cp_file_fn(void *arg, int id)
 //info_printf(lio_ifd, 0, "copy src_lio=%d sfname=%s  dest_lio=%d dfname=%s\n", cp->src_tuple.is_lio, cp->src_tuple.path, cp->dest_tuple.is_lio, cp->dest_t$
 //return(op_success_status);
 
-    buffer = NULL;
+    buffer = cp->buffer;
 
     if ((cp->src_tuple.is_lio == 0) && (cp->dest_tuple.is_lio == 0)) {  //** Not allowed to both go to disk
         info_printf(lio_ifd, 0, "Both source(%s) and destination(%s) are local files!\n", cp->src_tuple.path, cp->dest_tuple.path);
@@ -1391,7 +1622,7 @@ op_status_t lio_cp_file_fn(void *arg, int id)
             if (dlfd == NULL) info_printf(lio_ifd, 0, "ERROR: Failed opening destination file!  path=%s\n", cp->dest_tuple.path);
             status = op_failure_status;
         } else {
-            type_malloc(buffer, char, cp->bufsize+1);
+            if (buffer == NULL) type_malloc(buffer, char, cp->bufsize+1);
             status = gop_sync_exec_status(gop_lio_cp_local2lio(sffd, dlfd, cp->bufsize, buffer, cp->rw_hints));
         }
         if (dlfd != NULL) {
@@ -1409,7 +1640,7 @@ op_status_t lio_cp_file_fn(void *arg, int id)
             if (dffd == NULL) info_printf(lio_ifd, 0, "ERROR: Failed opening destination file!  path=%s\n", cp->dest_tuple.path);
             status = op_failure_status;
         } else {
-            type_malloc(buffer, char, cp->bufsize+1);
+            if (buffer == NULL) type_malloc(buffer, char, cp->bufsize+1);
             status = gop_sync_exec_status(gop_lio_cp_lio2local(slfd, dffd, cp->bufsize, buffer, cp->rw_hints));
         }
         if (slfd != NULL) gop_sync_exec(gop_lio_close_object(slfd));
@@ -1423,7 +1654,7 @@ op_status_t lio_cp_file_fn(void *arg, int id)
             if (dlfd == NULL) info_printf(lio_ifd, 0, "ERROR: Failed opening destination file!  path=%s\n", cp->dest_tuple.path);
             status = op_failure_status;
         } else {
-            type_malloc(buffer, char, cp->bufsize+1);
+            if (buffer == NULL) type_malloc(buffer, char, cp->bufsize+1);
             status = gop_sync_exec_status(gop_lio_cp_lio2lio(slfd, dlfd, cp->bufsize, buffer, cp->slow, cp->rw_hints));
         }
         if (slfd != NULL) gop_sync_exec(gop_lio_close_object(slfd));
@@ -1433,7 +1664,7 @@ op_status_t lio_cp_file_fn(void *arg, int id)
         }
     }
 
-    if (buffer != NULL) free(buffer);
+    if ((buffer != NULL) && (buffer != cp->buffer)) free(buffer);
 
     return(status);
 }
@@ -1486,133 +1717,241 @@ int lio_cp_create_dir(list_t *table, lio_path_tuple_t tuple)
 }
 
 //*************************************************************************
-// lio_cp_path_fn - Copies a regex to a dest *dir*
+//  Multi-file copy engine
+//
+//  All the paths feed a single pool of copy slots so a slot never sits
+//  idle while there are files left, no matter how they are spread across
+//  the paths.  Each slot keeps its buffer for the next file.  LIO
+//  destinations are created in a separate pipeline ahead of the copies
+//  so the create round trip is off the copy's critical path.
 //*************************************************************************
 
-op_status_t lio_cp_path_fn(void *arg, int id)
+typedef struct {
+    lio_cp_file_t *cplist;  //** Copy slots.  Each keeps its buffer for reuse
+    lio_cp_file_t *clist;   //** Files whose destination is being created
+    opque_t *q;             //** Copies in flight
+    opque_t *cq;            //** Creates in flight
+    int max_spawn;
+    int n_copy;             //** Copy slots handed out so far
+    int n_create;           //** Create slots handed out so far
+    int nerr;
+    ex_off_t bufsize;
+} lio_cp_engine_t;
+
+//*************************************************************************
+// _lio_cp_reap - Waits for a copy to complete and returns the free slot
+//    or -1 if nothing is left.
+//*************************************************************************
+
+int _lio_cp_reap(lio_cp_engine_t *eng)
 {
-    lio_cp_path_t *cp = (lio_cp_path_t *)arg;
+    op_generic_t *gop;
+    op_status_t status;
+    lio_cp_file_t *c;
+    int slot;
+
+    gop = opque_waitany(eng->q);
+    if (gop == NULL) return(-1);
+
+    slot = gop_get_myid(gop);
+    c = &(eng->cplist[slot]);
+    status = gop_get_status(gop);
+    log_printf(15, "slot=%d fname=%s\n", slot, c->src_tuple.path);
+    if (status.op_status != OP_STATE_SUCCESS) {
+        eng->nerr++;
+        info_printf(lio_ifd, 0, "Failed with path %s\n", c->src_tuple.path);
+    }
+    free(c->src_tuple.path);
+    free(c->dest_tuple.path);
+    c->src_tuple.path = NULL;
+    c->dest_tuple.path = NULL;
+    gop_free(gop, OP_DESTROY);
+
+    return(slot);
+}
+
+//*************************************************************************
+// _lio_cp_dispatch - Starts the copy in the next free slot.  The paths in
+//    f are owned by the slot afterwards.
+//*************************************************************************
+
+void _lio_cp_dispatch(lio_cp_engine_t *eng, lio_cp_file_t *f)
+{
+    op_generic_t *gop;
+    lio_cp_file_t *c;
+    char *buffer;
+    int slot;
+
+    slot = (eng->n_copy < eng->max_spawn) ? eng->n_copy++ : _lio_cp_reap(eng);
+
+    c = &(eng->cplist[slot]);
+    buffer = c->buffer;
+    *c = *f;
+    if (buffer == NULL) type_malloc(buffer, char, eng->bufsize+1);
+    c->buffer = buffer;
+    c->bufsize = eng->bufsize;
+
+    gop = new_thread_pool_op(lio_gc->tpc_unlimited, NULL, lio_cp_file_fn, (void *)c, NULL, 1);
+    gop_set_myid(gop, slot);
+    log_printf(1, "gid=%d i=%d sname=%s dname=%s\n", gop_id(gop), slot, c->src_tuple.path, c->dest_tuple.path);
+    opque_add(eng->q, gop);
+}
+
+//*************************************************************************
+// _lio_cp_created - Waits for a create to complete and hands the file off
+//    to be copied.  Returns the free create slot or -1 if nothing is left.
+//*************************************************************************
+
+int _lio_cp_created(lio_cp_engine_t *eng)
+{
+    op_generic_t *gop;
+    int slot;
+
+    gop = opque_waitany(eng->cq);
+    if (gop == NULL) return(-1);
+    slot = gop_get_myid(gop);
+
+    //** A failure is either an existing file, which is fine, or a real
+    //** problem that the open in the copy will report.
+    log_printf(15, "slot=%d dname=%s status=%d\n", slot, eng->clist[slot].dest_tuple.path, gop_completed_successfully(gop));
+    gop_free(gop, OP_DESTROY);
+
+    _lio_cp_dispatch(eng, &(eng->clist[slot]));
+
+    return(slot);
+}
+
+//*************************************************************************
+// _lio_cp_add - Queues a file to be copied
+//*************************************************************************
+
+void _lio_cp_add(lio_cp_engine_t *eng, lio_cp_file_t *f)
+{
+    op_generic_t *gop;
+    int slot;
+
+    if (f->dest_tuple.is_lio == 0) {  //** Local files are created by the copy itself
+        _lio_cp_dispatch(eng, f);
+        return;
+    }
+
+    slot = (eng->n_create < eng->max_spawn) ? eng->n_create++ : _lio_cp_created(eng);
+    eng->clist[slot] = *f;
+    gop = gop_lio_create_object(f->dest_tuple.lc, f->dest_tuple.creds, f->dest_tuple.path, OS_OBJECT_FILE, NULL, NULL);
+    gop_set_myid(gop, slot);
+    opque_add(eng->cq, gop);
+}
+
+//*************************************************************************
+// lio_cp_paths - Copies the regex paths to their dest *dir* using up to
+//    max_spawn copies at once across all the paths
+//*************************************************************************
+
+op_status_t lio_cp_paths(lio_cp_path_t *cp, int n_paths, int max_spawn)
+{
+    lio_cp_engine_t eng;
     unified_object_iter_t *it;
     lio_path_tuple_t create_tuple;
-    int ftype, prefix_len, slot, count, nerr;
+    lio_cp_file_t f;
+    int i, ftype, prefix_len;
     char *dstate;
     char dname[OS_PATH_MAX];
     char *fname, *dir, *file;
     list_t *dir_table;
-    lio_cp_file_t *cplist, *c;
-    op_generic_t *gop;
-    opque_t *q;
     op_status_t status;
 
-    log_printf(15, "START src=%s dest=%s max_spawn=%d bufsize=" XOT "\n", cp->src_tuple.path, cp->dest_tuple.path, cp->max_spawn, cp->bufsize);
-    flush_log();
-
-    it = unified_create_object_iter(cp->src_tuple, cp->path_regex, cp->obj_regex, cp->obj_types, cp->recurse_depth);
-    if (it == NULL) {
-        info_printf(lio_ifd, 0, "ERROR: Failed with object_iter creation src_path=%s\n", cp->src_tuple.path);
-        return(op_failure_status);
+    memset(&eng, 0, sizeof(eng));
+    eng.max_spawn = (max_spawn > 0) ? max_spawn : 1;
+    for (i=0; i<n_paths; i++) {
+        if (cp[i].bufsize > eng.bufsize) eng.bufsize = cp[i].bufsize;
     }
+    type_malloc_clear(eng.cplist, lio_cp_file_t, eng.max_spawn);
+    type_malloc_clear(eng.clist, lio_cp_file_t, eng.max_spawn);
+    eng.q = new_opque();
+    eng.cq = new_opque();
 
-    type_malloc_clear(cplist, lio_cp_file_t, cp->max_spawn);
     dir_table = list_create(0, &list_string_compare, list_string_dup, list_simple_free, NULL);
 
-    q = new_opque();
-    nerr = 0;
-    slot = 0;
-    count = 0;
-    while ((ftype = unified_next_object(it, &fname, &prefix_len)) > 0) {
-        snprintf(dname, OS_PATH_MAX, "%s/%s", cp->dest_tuple.path, &(fname[prefix_len+1]));
-//info_printf(lio_ifd, 0, "copy dtuple=%s sfname=%s  dfname=%s plen=%d\n", cp->dest_tuple.path, fname, dname, prefix_len);
-
-        if ((ftype & OS_OBJECT_DIR) > 0) { //** Got a directory
-            dstate = list_search(dir_table, fname);
-            if (dstate == NULL) { //** New dir so have to check and possibly create it
-                create_tuple = cp->dest_tuple;
-                create_tuple.path = fname;
-                lio_cp_create_dir(dir_table, create_tuple);
-            }
+    for (i=0; i<n_paths; i++) {
+        log_printf(15, "START src=%s dest=%s max_spawn=%d bufsize=" XOT "\n", cp[i].src_tuple.path, cp[i].dest_tuple.path, eng.max_spawn, cp[i].bufsize);
+        flush_log();
 
-            free(fname);  //** Clean up
-            continue;  //** Nothing else to do so go to the next file.
+        it = unified_create_object_iter(cp[i].src_tuple, cp[i].path_regex, cp[i].obj_regex, cp[i].obj_types, cp[i].recurse_depth);
+        if (it == NULL) {
+            info_printf(lio_ifd, 0, "ERROR: Failed with object_iter creation src_path=%s\n", cp[i].src_tuple.path);
+            eng.nerr++;
+            continue;
         }
 
-        os_path_split(dname, &dir, &file);
-        dstate = list_search(dir_table, dir);
-        if (dstate == NULL) { //** New dir so have to check and possibly create it
-            create_tuple = cp->dest_tuple;
-            create_tuple.path = dir;
-            lio_cp_create_dir(dir_table, create_tuple);
-        }
-        if (dir) {
-            free(dir);
-            dir = NULL;
-        }
-        if (file) {
-            free(file);
-            file = NULL;
-        }
+        while ((ftype = unified_next_object(it, &fname, &prefix_len)) > 0) {
+            snprintf(dname, OS_PATH_MAX, "%s/%s", cp[i].dest_tuple.path, &(fname[prefix_len+1]));
 
-        c = &(cplist[slot]);
-        c->src_tuple = cp->src_tuple;
-        c->src_tuple.path = fname;
-        c->dest_tuple = cp->dest_tuple;
-        c->dest_tuple.path = strdup(dname);
-        c->bufsize = cp->bufsize;
-        c->slow = cp->slow;
-
-        gop = new_thread_pool_op(lio_gc->tpc_unlimited, NULL, lio_cp_file_fn, (void *)c, NULL, 1);
-        gop_set_myid(gop, slot);
-        log_printf(1, "gid=%d i=%d sname=%s dname=%s\n", gop_id(gop), slot, fname, dname);
-        opque_add(q, gop);
-
-        count++;
-
-        if (count >= cp->max_spawn) {
-            gop = opque_waitany(q);
-            slot = gop_get_myid(gop);
-            c = &(cplist[slot]);
-            status = gop_get_status(gop);
-            if (status.op_status != OP_STATE_SUCCESS) {
-                nerr++;
-                info_printf(lio_ifd, 0, "Failed with path %s\n", c->src_tuple.path);
-            }
-            free(c->src_tuple.path);
-            free(c->dest_tuple.path);
-            gop_free(gop, OP_DESTROY);
-        } else {
-            slot = count;
-        }
-    }
+            if ((ftype & OS_OBJECT_DIR) > 0) { //** Got a directory
+                dstate = list_search(dir_table, dname);
+                if (dstate == NULL) { //** New dir so have to check and possibly create it
+                    create_tuple = cp[i].dest_tuple;
+                    create_tuple.path = dname;
+                    lio_cp_create_dir(dir_table, create_tuple);
+                }
 
-    unified_destroy_object_iter(it);
+                free(fname);  //** Clean up
+                continue;  //** Nothing else to do so go to the next file.
+            }
 
-    while ((gop = opque_waitany(q)) != NULL) {
-        status = gop_get_status(gop);
-        slot = gop_get_myid(gop);
-        c = &(cplist[slot]);
-        log_printf(15, "slot=%d fname=%s\n", slot, c->src_tuple.path);
-        if (status.op_status != OP_STATE_SUCCESS) {
-            nerr++;
-            info_printf(lio_ifd, 0, "Failed with path %s\n", c->src_tuple.path);
+            os_path_split(dname, &dir, &file);
+            dstate = list_search(dir_table, dir);
+            if (dstate == NULL) { //** New dir so have to check and possibly create it
+                create_tuple = cp[i].dest_tuple;
+                create_tuple.path = dir;
+                lio_cp_create_dir(dir_table, create_tuple);
+            }
+            if (dir) free(dir);
+            if (file) free(file);
+
+            memset(&f, 0, sizeof(f));
+            f.src_tuple = cp[i].src_tuple;
+            f.src_tuple.path = fname;
+            f.dest_tuple = cp[i].dest_tuple;
+            f.dest_tuple.path = strdup(dname);
+            f.slow = cp[i].slow;
+            _lio_cp_add(&eng, &f);
         }
-        free(c->src_tuple.path);
-        free(c->dest_tuple.path);
-        gop_free(gop, OP_DESTROY);
+
+        unified_destroy_object_iter(it);
     }
 
-    opque_free(q, OP_DESTROY);
+    //** Flush the create pipeline and wait for the copies to finish
+    while (_lio_cp_created(&eng) >= 0) {}
+    while (_lio_cp_reap(&eng) >= 0) {}
 
-    free(cplist);
+    for (i=0; i<eng.n_copy; i++) {
+        if (eng.cplist[i].buffer != NULL) free(eng.cplist[i].buffer);
+    }
+    free(eng.cplist);
+    free(eng.clist);
+    opque_free(eng.cq, OP_DESTROY);
+    opque_free(eng.q, OP_DESTROY);
     list_destroy(dir_table);
 
     status = op_success_status;
-    if (nerr > 0) {
+    if (eng.nerr > 0) {
         status.op_status = OP_STATE_FAILURE;
-        status.error_code = nerr;
+        status.error_code = eng.nerr;
     }
     return(status);
 }
 
+//*************************************************************************
+// lio_cp_path_fn - Copies a regex to a dest *dir*
+//*************************************************************************
+
+op_status_t lio_cp_path_fn(void *arg, int id)
+{
+    lio_cp_path_t *cp = (lio_cp_path_t *)arg;
+
+    return(lio_cp_paths(cp, 1, cp->max_spawn));
+}
+
 
 //***********************************************************************
 // The misc I/O routines: lio_seek, lio_tell, lio_size
@@ -1690,6 +2029,7 @@ op_status_t lio_truncate_fn(void *arg, int id)
 
     if (op->bufsize != segment_size(fh->seg)) {
         status = gop_sync_exec_status(segment_truncate(fh->seg, fh->lc->da, op->bufsize, fh->lc->timeout));
+        if (fh->cksum_table != NULL) lio_cksum_note_truncate(fh, op->bufsize);
         segment_lock(fh->seg);
         fh->modified = 1;
         op->slfd->curr_offset = op->bufsize;
@@ -1720,3 +2060,136 @@ op_generic_t *gop_lio_truncate(lio_fd_t *fd, ex_off_t newsize)
 }
 
 
+
+//***********************************************************************
+// lio_snapshot_fn - Takes a snapshot of a closed file.
+//    NOTE: The open file check is best effort.  It only sees handles in
+//    this process and the exnode update isn't transactional so another
+//    client can still race us.  The exnode is compared again right before
+//    it's stored which narrows the window but can't close it.
+//***********************************************************************
+
+typedef struct {
+    lio_config_t *lc;
+    creds_t *creds;
+    char *path;
+    char *name;
+} lio_snapshot_op_t;
+
+op_status_t lio_snapshot_fn(void *arg, int id)
+{
+    lio_snapshot_op_t *op = (lio_snapshot_op_t *)arg;
+    char *ex_data, *ex_now;
+    exnode_t *ex;
+    exnode_exchange_t *exp;
+    segment_t *seg, *top;
+    lio_file_handle_t *fh;
+    ex_id_t vid;
+    int v_size, err, ftype;
+    op_status_t status;
+
+    status = op_failure_status;
+
+    ftype = lioc_exists(op->lc, op->creds, op->path);
+    if ((ftype & OS_OBJECT_FILE) == 0) { //** Doesn't exist or is a dir
+        log_printf(1, "ERROR file(%s) doesn't exist or is a dir ftype=%d!\n", op->path, ftype);
+        return(status);
+    }
+
+    //** Get the exnode
+    v_size = -op->lc->max_attr;
+    err = lioc_get_attr(op->lc, op->creds, op->path, NULL, "system.exnode", (void **)&ex_data, &v_size);
+    if (err != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR retrieving exnode! path=%s\n", op->path);
+        return(status);
+    }
+
+    exp = exnode_exchange_text_parse(ex_data);
+    ex = exnode_create();
+    if (exnode_deserialize(ex, exp, op->lc->ess) != 0) {
+        log_printf(1, "ERROR parsing exnode! path=%s\n", op->path);
+        goto finished;
+    }
+
+    seg = exnode_get_default(ex);
+    if (seg == NULL) {
+        log_printf(1, "ERROR No default segment! path=%s\n", op->path);
+        goto finished;
+    }
+
+    //** An open file has its own copy of the exnode which would clobber ours on close.
+    //** This only catches files open locally.
+    vid = segment_id(seg);
+    lio_fh_shard_lock(lio_fh_shard(op->lc, vid));
+    fh = _lio_get_file_handle(op->lc, vid);
+    lio_fh_shard_unlock(lio_fh_shard(op->lc, vid));
+    if (fh != NULL) {
+        log_printf(1, "ERROR file is open! path=%s\n", op->path);
+        goto finished;
+    }
+
+    //** Freeze the current view and stack a new log on it
+    top = NULL;
+    err = gop_sync_exec(slog_snapshot(seg, op->lc->da, op->name, &top, op->lc->timeout));
+    if (err != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR creating snapshot! path=%s name=%s\n", op->path, op->name);
+        goto finished;
+    }
+
+    //** Make sure no one replaced the exnode while the new log was being made
+    ex_now = NULL;
+    v_size = -op->lc->max_attr;
+    err = lioc_get_attr(op->lc, op->creds, op->path, NULL, "system.exnode", (void **)&ex_now, &v_size);
+    if ((err != OP_STATE_SUCCESS) || (ex_now == NULL) || (strcmp(ex_now, ex_data) != 0)) {
+        log_printf(1, "ERROR exnode changed while taking the snapshot! path=%s name=%s\n", op->path, op->name);
+        if (ex_now != NULL) free(ex_now);
+        gop_sync_exec(slog_snapshot_abort(top, op->lc->da, op->lc->timeout));
+        segment_destroy(top);
+        goto finished;
+    }
+    free(ex_now);
+
+    //** Swap the view.  The old one is now referenced by the new top
+    list_remove(ex->view, &vid, seg);
+    atomic_dec(seg->ref_count);
+    atomic_inc(top->ref_count);
+    list_insert(ex->view, &segment_id(top), top);
+    exnode_set_default(ex, top);
+
+    //** and store it
+    exnode_exchange_free(exp);
+    exnode_serialize(ex, exp);
+    err = lioc_set_attr(op->lc, op->creds, op->path, NULL, "system.exnode", exp->text.text, strlen(exp->text.text));
+    if (err == OP_STATE_SUCCESS) {
+        status = op_success_status;
+    } else {  //** Nothing references the new level so clean it up.  top is destroyed with the exnode
+        log_printf(1, "ERROR storing the exnode! path=%s name=%s\n", op->path, op->name);
+        gop_sync_exec(slog_snapshot_abort(top, op->lc->da, op->lc->timeout));
+    }
+
+finished:
+    exnode_destroy(ex);
+    exnode_exchange_destroy(exp);
+    return(status);
+}
+
+//***********************************************************************
+// gop_lio_snapshot - Takes a named, read only snapshot of the file.  The
+//    current contents are frozen and all future writes go to a new log
+//    level stacked on top so no data is copied.  The file must be closed
+//    everywhere but only local opens can be detected.
+//***********************************************************************
+
+op_generic_t *gop_lio_snapshot(lio_config_t *lc, creds_t *creds, char *path, char *name)
+{
+    lio_snapshot_op_t *op;
+
+    type_malloc_clear(op, lio_snapshot_op_t, 1);
+
+    op->lc = lc;
+    op->creds = creds;
+    op->path = path;
+    op->name = name;
+
+    return(new_thread_pool_op(lc->tpc_unlimited, NULL, lio_snapshot_fn, (void *)op, free, 1));
+}
@@ -45,7 +45,10 @@ static char *_lio_create_keys[] = { "system.owner", "os.timestamp.system.create"
                                     "os.timestamp.system.modify_attr", "system.inode", "system.exnode", "system.exnode.size"
                                   };
 
-char *_lio_stat_keys[] = { "system.inode", "system.modify_data", "system.modify_attr", "system.exnode.size", "os.type", "os.link_count", "os.link" };
+char *_lio_stat_keys[] = { OS_STAT_ATTR };
+
+#define _n_lio_stat_legacy_keys 7
+static char *_lio_stat_legacy_keys[] = { "system.inode", "system.modify_data", "system.modify_attr", "system.exnode.size", "os.type", "os.link_count", "os.link" };
 
 typedef struct {
     lio_config_t *lc;
@@ -1102,73 +1105,113 @@ mode_t ftype_lio2posix(int ftype)
     return(mode);
 }
 
+//*************************************************************************
+// lio_stat_record - Unpacks the OS_STAT_ATTR record in val.  If it's
+//   missing, which happens with an older object service, the individual
+//   attributes are fetched instead and val is replaced with an equivalent
+//   record.  Either way st->link points into val.  Returns 0 on success.
+//*************************************************************************
+
+int lio_stat_record(lio_config_t *lc, creds_t *creds, char *fname, char **val, int *v_size, os_stat_t *st)
+{
+    char *lval[_n_lio_stat_legacy_keys];
+    int lv_size[_n_lio_stat_legacy_keys];
+    unsigned char *record;
+    int i, n, ts, err;
+
+    if (os_stat_unpack((unsigned char *)*val, *v_size, st) == 0) return(0);
+
+    log_printf(5, "No stat record so using the separate attributes fname=%s\n", fname);
+    for (i=0; i<_n_lio_stat_legacy_keys; i++) lv_size[i] = -lc->max_attr;
+    err = lio_get_multiple_attrs(lc, creds, fname, NULL, _lio_stat_legacy_keys, (void **)lval, lv_size, _n_lio_stat_legacy_keys);
+    if (err != OP_STATE_SUCCESS) return(1);
+
+    memset(st, 0, sizeof(os_stat_t));
+    if (lval[0] != NULL) sscanf(lval[0], XIDT, &(st->inode));
+    ts = 0;
+    if (lval[1] != NULL) lio_get_timestamp(lval[1], &ts, NULL);
+    st->modify_data = ts;
+    ts = 0;
+    if (lval[2] != NULL) lio_get_timestamp(lval[2], &ts, NULL);
+    st->modify_attr = ts;
+    if (lval[3] != NULL) sscanf(lval[3], XOT, &(st->size));
+    if (lval[4] != NULL) sscanf(lval[4], "%d", &(st->ftype));
+    if (lval[5] != NULL) sscanf(lval[5], "%d", &(st->nlink));
+    if (lval[6] != NULL) {
+        st->link = lval[6];
+        st->link_len = strlen(lval[6]);
+    }
+
+    n = OS_STAT_RECORD_SIZE + st->link_len;
+    type_malloc(record, unsigned char, n+1);
+    os_stat_pack(st, record, n);
+    record[n] = 0;
+    st->link = (st->link_len > 0) ? (char *)&(record[OS_STAT_RECORD_SIZE]) : NULL;
+
+    for (i=0; i<_n_lio_stat_legacy_keys; i++) {
+        if (lval[i] != NULL) free(lval[i]);
+    }
+
+    if (*val != NULL) free(*val);
+    *val = (char *)record;
+    *v_size = n;
+
+    return(0);
+}
+
 //*************************************************************************
 // _lio_parse_stat_vals - Parses the stat values received
 //   NOTE: All the val[*] strings are free'ed!
 //*************************************************************************
 
-void _lio_parse_stat_vals(char *fname, struct stat *stat, char **val, int *v_size, char *mount_prefix, char **flink)
+void _lio_parse_stat_vals(lio_config_t *lc, creds_t *creds, char *fname, struct stat *stat, char **val, int *v_size, char *mount_prefix, char **flink)
 {
-    int i, n, readlink;
-    char *link;
+    int i, readlink;
+    os_stat_t st;
     ex_id_t ino;
-    ex_off_t len;
-    int ts;
 
-    ino = 0;
-    if (val[0] != NULL) {
-        sscanf(val[0], XIDT, &ino);
-    } else {
+    if (lio_stat_record(lc, creds, fname, &(val[0]), &(v_size[0]), &st) != 0) memset(&st, 0, sizeof(st));
+
+    ino = st.inode;
+    if (ino == 0) {
         generate_ex_id(&ino);
         log_printf(0, "Missing inode generating a temp fake one! ino=" XIDT "\n", ino);
     }
     stat->st_ino = ino;
 
     //** Modify TS's
-    ts = 0;
-    if (val[1] != NULL) lio_get_timestamp(val[1], &ts, NULL);
-    stat->st_mtime = ts;
-    ts = 0;
-    if (val[1] != NULL) lio_get_timestamp(val[2], &ts, NULL);
-    stat->st_ctime = ts;
+    stat->st_mtime = st.modify_data;
+    stat->st_ctime = st.modify_attr;
     stat->st_atime = stat->st_ctime;
 
     //** Get the symlink if it exists and optionally store it
     readlink = 0;
-    if (val[6] != NULL) {
-        link = val[6];
-        readlink = strlen(link);
-        log_printf(15, "inode->link=%s mount_point=%s moun_point_len=%d\n", link, mount_prefix, strlen(mount_prefix));
-        if (link[0] == '/') { //** If an absolute link then we need to add the mount prefix back
+    if (st.link_len > 0) {
+        readlink = st.link_len;
+        log_printf(15, "inode->link=%.*s mount_point=%s moun_point_len=%d\n", st.link_len, st.link, mount_prefix, strlen(mount_prefix));
+        if (st.link[0] == '/') { //** If an absolute link then we need to add the mount prefix back
             readlink += strlen(mount_prefix) + 1;
             if (flink != NULL) {
                 type_malloc(*flink, char, readlink+1);
-                snprintf(*flink, readlink+1, "%s%s", mount_prefix, link);
+                snprintf(*flink, readlink+1, "%s%.*s", mount_prefix, st.link_len, st.link);
             }
         } else if (flink != NULL) {
-            *flink = link;
-            val[6] = NULL;  //** Don't want to delete it on cleanup
+            type_malloc(*flink, char, st.link_len+1);
+            memcpy(*flink, st.link, st.link_len);
+            (*flink)[st.link_len] = 0;
         }
-
     }
 
     //** File types
-    n = 0;
-    if (val[4] != NULL) sscanf(val[4], "%d", &n);
-    stat->st_mode = ftype_lio2posix(n);
-
-    len = 0;
-    if (val[3] != NULL) sscanf(val[3], XOT, &len);
+    stat->st_mode = ftype_lio2posix(st.ftype);
 
-    stat->st_size = (n & OS_OBJECT_SYMLINK) ? readlink : len;
+    stat->st_size = (st.ftype & OS_OBJECT_SYMLINK) ? readlink : st.size;
     stat->st_blksize = 4096;
     stat->st_blocks = stat->st_size / 512;
     if (stat->st_size < 1024) stat->st_blksize = 1024;
 
     //** N-links
-    n = 0;
-    if (val[5] != NULL) sscanf(val[5], "%d", &n);
-    stat->st_nlink = n;
+    stat->st_nlink = st.nlink;
 
     //** Clean up
     for (i=0; i<_lio_stat_key_size; i++) {
@@ -1194,7 +1237,7 @@ int lio_stat(lio_config_t *lc, creds_t *creds, char *fname, struct stat *stat, c
     if (err != OP_STATE_SUCCESS) {
         return(-ENOENT);
     }
-    _lio_parse_stat_vals(fname, stat, val, v_size, mount_prefix, readlink);
+    _lio_parse_stat_vals(lc, creds, fname, stat, val, v_size, mount_prefix, readlink);
 
     log_printf(1, "END fname=%s err=%d\n", fname, err);
     flush_log();
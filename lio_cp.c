@@ -55,10 +55,8 @@ int main(int argc, char **argv)
     char ppbuf[64];
     lio_cp_path_t *flist;
     lio_cp_file_t cpf;
-    op_generic_t *gop;
-    opque_t *q;
     lio_path_tuple_t dtuple;
-    int err, dtype, recurse_depth, slow;
+    int dtype, recurse_depth, slow;
     op_status_t status;
 
     recurse_depth = 10000;
@@ -145,7 +143,7 @@ int main(int argc, char **argv)
 
     type_malloc_clear(flist, lio_cp_path_t, n_paths);
 
-    max_spawn = lio_parallel_task_count / n_paths;
+    max_spawn = lio_parallel_task_count;  //** Shared by all the paths
     if (max_spawn <= 0) max_spawn = 1;
 
     for (i=0; i<n_paths; i++) {
@@ -189,6 +187,7 @@ int main(int argc, char **argv)
             cpf.src_tuple = flist[0].src_tuple; //c->src_tuple.path = fname;
             cpf.dest_tuple = flist[0].dest_tuple; //c->dest_tuple.path = strdup(dname);
             cpf.bufsize = flist[0].bufsize;
+            cpf.buffer = NULL;
             cpf.slow = flist[0].slow;
             cpf.rw_hints = NULL;
             status = lio_cp_file_fn(&cpf, 0);
@@ -205,35 +204,9 @@ int main(int argc, char **argv)
         }
     }
 
-    q = new_opque();
-    opque_start_execution(q);
-    for (i=0; i<n_paths; i++) {
-        gop = new_thread_pool_op(lio_gc->tpc_unlimited, NULL, lio_cp_path_fn, (void *)&(flist[i]), NULL, 1);
-        gop_set_myid(gop, i);
-        log_printf(0, "gid=%d i=%d fname=%s\n", gop_id(gop), i, flist[i].src_tuple.path);
-
-        opque_add(q, gop);
-        log_printf(0, "bufsize=" XOT "\n", flist[i].bufsize);
-
-        if (opque_tasks_left(q) > lio_parallel_task_count) {
-            gop = opque_waitany(q);
-            status = gop_get_status(gop);
-            if (status.op_status != OP_STATE_SUCCESS) n_errors++;
-
-            gop_free(gop, OP_DESTROY);
-        }
-    }
-
-    err = opque_waitall(q);
-    if (err != OP_STATE_SUCCESS) {
-        while ((gop = opque_get_next_failed(q)) != NULL) {
-            status = gop_get_status(gop);
-            if (status.op_status != OP_STATE_SUCCESS) n_errors++;
-        }
-    }
-
-    opque_free(q, OP_DESTROY);
-
+    //** Copy all the paths sharing the same pool of transfers
+    status = lio_cp_paths(flist, n_paths, max_spawn);
+    if (status.op_status != OP_STATE_SUCCESS) n_errors += status.error_code;
 
 finished:
     lio_path_release(&dtuple);
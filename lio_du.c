@@ -44,6 +44,7 @@ typedef struct {
     int64_t bytes;
     int64_t count;
     int ftype;
+    int have_agg;   //** Totals came from the directory usage aggregate
 } du_entry_t;
 
 lio_path_tuple_t tuple;
@@ -87,7 +88,7 @@ void du_format_entry(info_fd_t *ifd, du_entry_t *de, int sumonly)
 
 int main(int argc, char **argv)
 {
-    int i, j, ftype, rg_mode, start_index, start_option, nosort, prefix_len, plen;
+    int i, j, k, ftype, rg_mode, start_index, start_option, nosort, prefix_len, plen;
     char *fname;
     du_entry_t *de;
     list_t *table, *sum_table, *lt;
@@ -95,10 +96,13 @@ int main(int argc, char **argv)
     os_object_iter_t *it;
     list_iter_t lit;
     char *key = "system.exnode.size";
+    char *sum_key[2] = { "system.exnode.size", "os.du" };
+    char *sum_val[2];
     char *val, *file;
-    int64_t bytes;
+    int64_t bytes, ndirs;
     ex_off_t total_files, total_bytes;
-    int v_size, sumonly, ignoreln;
+    int v_size, sumonly, ignoreln, aggregate, need_walk;
+    int sum_vsize[2];
     int recurse_depth = 10000;
     int return_code = 0;
     du_entry_t du_total;
@@ -106,7 +110,7 @@ int main(int argc, char **argv)
 //printf("argc=%d\n", argc);
     if (argc < 2) {
         printf("\n");
-        printf("lio_du LIO_COMMON_OPTIONS [-rd recurse_depth] [-ns] [-h|-hi] [-s] [-ln] LIO_PATH_OPTIONS\n");
+        printf("lio_du LIO_COMMON_OPTIONS [-rd recurse_depth] [-ns] [-h|-hi] [-s] [-a] [-ln] LIO_PATH_OPTIONS\n");
         lio_print_options(stdout);
         lio_print_path_options(stdout);
         printf("\n");
@@ -115,6 +119,8 @@ int main(int argc, char **argv)
         printf("    -h                 - Print using base 1000\n");
         printf("    -hi                - Print using base 1024\n");
         printf("    -s                 - Print directory summaries only\n");
+        printf("    -a                 - Use the directory usage aggregates instead of walking the tree.  Implies -s.\n");
+        printf("                         Directories without an aggregate are still walked.  Use lio_fsck -du to build them.\n");
         printf("    -ln                - Follow links.  Otherwise they are ignored\n");
         return(1);
     }
@@ -130,6 +136,7 @@ int main(int argc, char **argv)
     base = 1;
     ignoreln = 1;
     sumonly = 0;
+    aggregate = 0;
 
     i=1;
     do {
@@ -145,6 +152,10 @@ int main(int argc, char **argv)
         } else if (strcmp(argv[i], "-s") == 0) {  //** Summary only
             i++;
             sumonly = 1;
+        } else if (strcmp(argv[i], "-a") == 0) {  //** Use the usage aggregates
+            i++;
+            aggregate = 1;
+            sumonly = 1;
         } else if (strcmp(argv[i], "-h") == 0) {  //** Use base 10
             i++;
             base = 1000;
@@ -200,11 +211,15 @@ int main(int argc, char **argv)
         }
 
         //** Make the toplevel list
+        need_walk = 1;
         if (sumonly == 1) {
             log_printf(15, "MAIN SUMONLY=1\n");
-            v_size = -1024;
-            val = NULL;
-            it = lio_create_object_iter_alist(tuple.lc, tuple.creds, rp_single, ro_single, OS_OBJECT_ANY, 0, &key, (void **)&val, &v_size, 1);
+            need_walk = 0;
+            for (k=0; k<2; k++) {
+                sum_vsize[k] = -1024;
+                sum_val[k] = NULL;
+            }
+            it = lio_create_object_iter_alist(tuple.lc, tuple.creds, rp_single, ro_single, OS_OBJECT_ANY, 0, sum_key, (void **)sum_val, sum_vsize, (aggregate == 1) ? 2 : 1);
             if (it == NULL) {
                 log_printf(0, "ERROR: Failed with object_iter creation\n");
                 return_code = EIO;
@@ -224,12 +239,22 @@ int main(int argc, char **argv)
                 free(fname);
                 de->ftype = ftype;
 
-                if (val != NULL) sscanf(val, I64T, &(de->bytes));
+                if (sum_val[0] != NULL) sscanf(sum_val[0], I64T, &(de->bytes));
+                if ((ftype & OS_OBJECT_DIR) > 0) {
+                    if ((aggregate == 1) && (sum_val[1] != NULL) &&
+                            (sscanf(sum_val[1], I64T " " I64T " " I64T, &(de->bytes), &(de->count), &ndirs) == 3)) {
+                        de->have_agg = 1;
+                    } else {
+                        need_walk = 1;
+                    }
+                }
                 list_insert(sum_table, de->fname, de);
 
-                v_size = -1024;
-                free(val);
-                val = NULL;
+                for (k=0; k<2; k++) {
+                    sum_vsize[k] = -1024;
+                    if (sum_val[k] != NULL) free(sum_val[k]);
+                    sum_val[k] = NULL;
+                }
             }
 
             lio_destroy_object_iter(tuple.lc, it);
@@ -237,7 +262,8 @@ int main(int argc, char **argv)
             log_printf(15, "sum_table=%d\n", list_key_count(sum_table));
         }
 
-        log_printf(15, "MAIN LOOP\n");
+        log_printf(15, "MAIN LOOP need_walk=%d\n", need_walk);
+        if (need_walk == 0) goto next_path;  //** Everything came from the aggregates
 
         v_size = -1024;
         val = NULL;
@@ -259,7 +285,7 @@ int main(int argc, char **argv)
 
                 lit = list_iter_search(sum_table, NULL, 0);
                 while ((list_next(&lit, (list_key_t **)&file, (list_data_t **)&de)) == 0) {
-                    if ((strncmp(de->fname, fname, strlen(de->fname)) == 0) && ((de->ftype & OS_OBJECT_DIR) > 0)) {
+                    if ((strncmp(de->fname, fname, strlen(de->fname)) == 0) && ((de->ftype & OS_OBJECT_DIR) > 0) && (de->have_agg == 0)) {
                         log_printf(15, "accum de->fname=%s fname=%s\n", de->fname, fname);
                         de->bytes += bytes;
                         de->count++;
@@ -290,6 +316,7 @@ int main(int argc, char **argv)
 
         lio_destroy_object_iter(tuple.lc, it);
 
+next_path:
         lio_path_release(&tuple);
         if (rp_single != NULL) {
             os_regex_table_destroy(rp_single);
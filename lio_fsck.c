@@ -30,6 +30,9 @@ http://www.accre.vanderbilt.edu
 #define _log_module_index 209
 
 #include <assert.h>
+#include <unistd.h>
+#include <apr_hash.h>
+#include <apr_thread_mutex.h>
 #include "assert_result.h"
 #include "exnode.h"
 #include "log.h"
@@ -40,22 +43,738 @@ http://www.accre.vanderbilt.edu
 #include "object_service_abstract.h"
 #include "iniparse.h"
 #include "string_token.h"
+#include "random.h"
 
-int main(int argc, char **argv)
+#define FSCK_PART_SELF 'S'   //** Directory itself and its non-directory children
+#define FSCK_PART_TREE 'T'   //** Full recursive subtree
+
+typedef struct {
+    lio_path_tuple_t *tuple;
+    char *path;
+    int type;
+    ex_off_t problems;
+    ex_off_t failed;
+    ex_off_t checked;
+} fsck_part_t;
+
+typedef struct {
+    fsck_part_t *p;
+    opque_t *q;
+    char **sname;    //** Objects being checked in a SELF partition
+    int *stype;
+    int n_slots;
+    int n_used;
+    char **bname;    //** Pending repair batch
+    int *btype;
+    int n_batch;
+} fsck_work_t;
+
+typedef struct {   //** Usage aggregate being rebuilt for a directory
+    int64_t bytes;
+    int64_t files;
+    int64_t dirs;
+    char val[128];
+} fsck_du_t;
+
+typedef struct {
+    FILE *fd;
+    apr_pool_t *mpool;
+    apr_thread_mutex_t *lock;
+    apr_hash_t *done;
+} fsck_ckpt_t;
+
+static int owner_mode, exnode_mode, batch_size;
+static char *owner;
+static fsck_ckpt_t *ckpt = NULL;
+
+//*************************************************************************
+// fsck_repair_batch - Submits all the pending repairs as a single batch
+//*************************************************************************
+
+void fsck_repair_batch(fsck_work_t *w)
+{
+    opque_t *q;
+    op_generic_t *gop;
+    op_status_t status;
+    int i;
+
+    if (w->n_batch == 0) return;
+
+    q = new_opque();
+    opque_start_execution(q);
+    for (i=0; i<w->n_batch; i++) {
+        gop = lio_fsck_object(w->p->tuple->lc, w->p->tuple->creds, w->bname[i], w->btype[i], owner_mode, owner, exnode_mode);
+        gop_set_myid(gop, i);
+        opque_add(q, gop);
+    }
+
+    while ((gop = opque_waitany(q)) != NULL) {
+        i = gop_get_myid(gop);
+        status = gop_get_status(gop);
+        gop_free(gop, OP_DESTROY);
+        if (status.error_code != OS_FSCK_GOOD) w->p->failed++;
+        info_printf(lio_ifd, 0, "    resolve:%d  object:%s\n", status.error_code, w->bname[i]);
+    }
+    opque_free(q, OP_DESTROY);
+
+    for (i=0; i<w->n_batch; i++) free(w->bname[i]);
+    w->n_batch = 0;
+}
+
+//*************************************************************************
+// fsck_problem - Records a problem object and queues it for repair if needed.
+//     Takes ownership of fname.
+//*************************************************************************
+
+void fsck_problem(fsck_work_t *w, char *fname, int ftype, int err)
+{
+    info_printf(lio_ifd, 0, "err:%d  type:%d  object:%s\n", err, ftype, fname);
+    w->p->problems++;
+
+    if ((owner_mode == LIO_FSCK_MANUAL) && (exnode_mode == LIO_FSCK_MANUAL)) {
+        free(fname);
+        return;
+    }
+
+    w->bname[w->n_batch] = fname;
+    w->btype[w->n_batch] = ftype;
+    w->n_batch++;
+    if (w->n_batch >= batch_size) fsck_repair_batch(w);
+}
+
+//*************************************************************************
+// fsck_self_result - Processes a completed check and returns the freed slot
+//*************************************************************************
+
+int fsck_self_result(fsck_work_t *w, op_generic_t *gop)
+{
+    op_status_t status;
+    int slot;
+
+    slot = gop_get_myid(gop);
+    status = gop_get_status(gop);
+    gop_free(gop, OP_DESTROY);
+
+    w->p->checked++;
+    if (status.error_code != LIO_FSCK_GOOD) {
+        fsck_problem(w, w->sname[slot], w->stype[slot], status.error_code);
+    } else {
+        free(w->sname[slot]);
+    }
+    w->sname[slot] = NULL;
+
+    return(slot);
+}
+
+//*************************************************************************
+// fsck_self_submit - Launches a check-only task for the object.
+//     Takes ownership of fname.
+//*************************************************************************
+
+void fsck_self_submit(fsck_work_t *w, char *fname, int ftype)
+{
+    op_generic_t *gop;
+    int slot;
+
+    if (w->n_used < w->n_slots) {
+        slot = w->n_used++;
+    } else {
+        slot = fsck_self_result(w, opque_waitany(w->q));
+    }
+
+    w->sname[slot] = fname;
+    w->stype[slot] = ftype;
+    gop = lio_fsck_object(w->p->tuple->lc, w->p->tuple->creds, fname, ftype, LIO_FSCK_MANUAL, NULL, LIO_FSCK_MANUAL);
+    gop_set_myid(gop, slot);
+    opque_add(w->q, gop);
+}
+
+//*************************************************************************
+// fsck_self_scan - Checks the directory and its immediate non-directory
+//     children.  Sub-directories are covered by their own partitions.
+//*************************************************************************
+
+void fsck_self_scan(fsck_work_t *w)
+{
+    lio_path_tuple_t *tuple = w->p->tuple;
+    os_regex_table_t *rp;
+    os_object_iter_t *it;
+    op_generic_t *gop;
+    char path[OS_PATH_MAX];
+    char *fname;
+    int ftype, prefix_len;
+
+    w->n_slots = lio_parallel_task_count;
+    w->n_used = 0;
+    type_malloc_clear(w->sname, char *, w->n_slots);
+    type_malloc(w->stype, int, w->n_slots);
+    w->q = new_opque();
+    opque_start_execution(w->q);
+
+    ftype = lio_exists(tuple->lc, tuple->creds, w->p->path);
+    if (ftype > 0) fsck_self_submit(w, strdup(w->p->path), ftype);
+
+    snprintf(path, sizeof(path), "%s/*", w->p->path);
+    rp = os_path_glob2regex(path);
+    it = lio_create_object_iter(tuple->lc, tuple->creds, rp, NULL, OS_OBJECT_ANY, NULL, 0, NULL, 0);
+    if (it == NULL) {
+        log_printf(0, "ERROR: Failed with object_iter creation %s\n", path);
+    } else {
+        while ((ftype = lio_next_object(tuple->lc, it, &fname, &prefix_len)) > 0) {
+            if ((ftype & OS_OBJECT_DIR) && ((ftype & OS_OBJECT_SYMLINK) == 0)) {
+                free(fname);
+            } else {
+                fsck_self_submit(w, fname, ftype);
+            }
+        }
+        lio_destroy_object_iter(tuple->lc, it);
+    }
+    os_regex_table_destroy(rp);
+
+    while ((gop = opque_waitany(w->q)) != NULL) {
+        fsck_self_result(w, gop);
+    }
+    opque_free(w->q, OP_DESTROY);
+
+    free(w->sname);
+    free(w->stype);
+}
+
+//*************************************************************************
+// fsck_tree_scan - Checks the full subtree using the fsck iterator
+//*************************************************************************
+
+void fsck_tree_scan(fsck_work_t *w)
 {
-    int i, owner_mode, exnode_mode, size_mode, start_option, start_index;
+    lio_path_tuple_t *tuple = w->p->tuple;
     lio_fsck_iter_t *it;
-    char *owner;
     char *fname;
+    int ftype, err;
+
+    it = lio_create_fsck_iter(tuple->lc, tuple->creds, w->p->path, LIO_FSCK_MANUAL, NULL, LIO_FSCK_MANUAL);
+    if (it == NULL) {
+        info_printf(lio_ifd, 0, "ERROR: Unable to create fsck iterator for %s\n", w->p->path);
+        w->p->failed++;
+        return;
+    }
+
+    while ((err = lio_next_fsck(tuple->lc, it, &fname, &ftype)) != LIO_FSCK_FINISHED) {
+        fsck_problem(w, fname, ftype, err);
+    }
+
+    w->p->checked += lio_fsck_visited_count(tuple->lc, it);
+    lio_destroy_fsck_iter(tuple->lc, it);
+}
+
+//*************************************************************************
+// ckpt_key - Makes the checkpoint key for the partition
+//*************************************************************************
+
+char *ckpt_key(int type, char *path)
+{
+    char *key;
+    int n;
+
+    n = strlen(path) + 3;
+    type_malloc(key, char, n);
+    snprintf(key, n, "%c %s", type, path);
+    return(key);
+}
+
+//*************************************************************************
+// ckpt_open - Loads any existing checkpoint and opens it for appending.
+//     Each completed partition is a single line of the form
+//         type problems failed checked path
+//*************************************************************************
+
+fsck_ckpt_t *ckpt_open(char *fname)
+{
+    fsck_ckpt_t *ck;
+    fsck_part_t *p;
+    FILE *fd;
+    char line[OS_PATH_MAX + 128];
+    char type;
+    char *path;
+    int i, n, len;
+
+    type_malloc_clear(ck, fsck_ckpt_t, 1);
+    assert_result(apr_pool_create(&(ck->mpool), NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(ck->lock), APR_THREAD_MUTEX_DEFAULT, ck->mpool);
+    ck->done = apr_hash_make(ck->mpool);
+
+    fd = fopen(fname, "r");
+    if (fd != NULL) {
+        n = 0;
+        while (fgets(line, sizeof(line), fd) != NULL) {
+            if (line[0] == '#') continue;
+            len = strlen(line);
+            if ((len == 0) || (line[len-1] != '\n')) continue;  //** Partial record from a crash
+            line[len-1] = 0;
+
+            type_malloc_clear(p, fsck_part_t, 1);
+            if (sscanf(line, "%c " XOT " " XOT " " XOT, &type, &(p->problems), &(p->failed), &(p->checked)) != 4) {
+                free(p);
+                continue;
+            }
+
+            //** Path is everything after the 4th space
+            path = line;
+            for (i=0; (i<4) && (path != NULL); i++) {
+                path = strchr(path, ' ');
+                if (path != NULL) path++;
+            }
+            if (path == NULL) {
+                free(p);
+                continue;
+            }
+
+            p->type = type;
+            p->path = ckpt_key(type, path);
+            apr_hash_set(ck->done, p->path, APR_HASH_KEY_STRING, p);
+            n++;
+        }
+        fclose(fd);
+        info_printf(lio_ifd, 0, "Loaded %d completed partitions from checkpoint %s\n", n, fname);
+    }
+
+    ck->fd = fopen(fname, "a");
+    if (ck->fd == NULL) {
+        info_printf(lio_ifd, 0, "ERROR: Unable to open checkpoint file %s\n", fname);
+        apr_pool_destroy(ck->mpool);
+        free(ck);
+        return(NULL);
+    }
+
+    return(ck);
+}
+
+//*************************************************************************
+// ckpt_lookup - Returns the checkpoint record if the partition was completed
+//*************************************************************************
+
+fsck_part_t *ckpt_lookup(fsck_ckpt_t *ck, int type, char *path)
+{
+    fsck_part_t *p;
+    char *key;
+
+    key = ckpt_key(type, path);
+    p = apr_hash_get(ck->done, key, APR_HASH_KEY_STRING);
+    free(key);
+    return(p);
+}
+
+//*************************************************************************
+// ckpt_save - Durably records the partition as completed
+//*************************************************************************
+
+void ckpt_save(fsck_ckpt_t *ck, fsck_part_t *p)
+{
+    apr_thread_mutex_lock(ck->lock);
+    fprintf(ck->fd, "%c " XOT " " XOT " " XOT " %s\n", p->type, p->problems, p->failed, p->checked, p->path);
+    fflush(ck->fd);
+    fsync(fileno(ck->fd));
+    apr_thread_mutex_unlock(ck->lock);
+}
+
+//*************************************************************************
+// ckpt_close - Closes the checkpoint and releases the resume table
+//*************************************************************************
+
+void ckpt_close(fsck_ckpt_t *ck)
+{
+    apr_hash_index_t *hi;
+    fsck_part_t *p;
+
+    fclose(ck->fd);
+
+    for (hi = apr_hash_first(NULL, ck->done); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&p);
+        free(p->path);
+        free(p);
+    }
+
+    apr_pool_destroy(ck->mpool);
+    free(ck);
+}
+
+//*************************************************************************
+// fsck_partition_task - Checks and repairs a single partition
+//*************************************************************************
+
+op_status_t fsck_partition_task(void *arg, int id)
+{
+    fsck_part_t *p = (fsck_part_t *)arg;
+    fsck_work_t w;
+
+    memset(&w, 0, sizeof(w));
+    w.p = p;
+    type_malloc(w.bname, char *, batch_size);
+    type_malloc(w.btype, int, batch_size);
+
+    if (p->type == FSCK_PART_TREE) {
+        fsck_tree_scan(&w);
+    } else {
+        fsck_self_scan(&w);
+    }
+
+    fsck_repair_batch(&w);  //** Flush whatever is left
+    free(w.bname);
+    free(w.btype);
+
+    log_printf(1, "partition %c %s problems=" XOT " failed=" XOT " checked=" XOT "\n", p->type, p->path, p->problems, p->failed, p->checked);
+    if (ckpt != NULL) ckpt_save(ckpt, p);
+
+    return(op_success_status);
+}
+
+//*************************************************************************
+// fsck_partition_add - Adds a partition to the list.  Takes ownership of path.
+//*************************************************************************
+
+void fsck_partition_add(lio_path_tuple_t *tuple, char *path, int type, fsck_part_t **plist, int *n, int *n_max)
+{
+    fsck_part_t *p;
+
+    if (*n >= *n_max) {
+        *n_max = (*n_max == 0) ? 64 : 2*(*n_max);
+        type_realloc(*plist, fsck_part_t, *n_max);
+    }
+
+    p = &((*plist)[*n]);
+    memset(p, 0, sizeof(fsck_part_t));
+    p->tuple = tuple;
+    p->path = path;
+    p->type = type;
+    (*n)++;
+}
+
+//*************************************************************************
+// fsck_partition_expand - Splits the tree rooted at path into partitions.
+//     Each level down to depth gets a SELF partition and the directories
+//     at the bottom level become full subtree partitions.
+//*************************************************************************
+
+void fsck_partition_expand(lio_path_tuple_t *tuple, char *path, int depth, fsck_part_t **plist, int *n, int *n_max)
+{
+    os_regex_table_t *rp;
+    os_object_iter_t *it;
+    char glob[OS_PATH_MAX];
+    char *fname;
+    int ftype, prefix_len;
+
+    fsck_partition_add(tuple, strdup(path), FSCK_PART_SELF, plist, n, n_max);
+
+    snprintf(glob, sizeof(glob), "%s/*", path);
+    rp = os_path_glob2regex(glob);
+    it = lio_create_object_iter(tuple->lc, tuple->creds, rp, NULL, OS_OBJECT_DIR, NULL, 0, NULL, 0);
+    if (it == NULL) {
+        log_printf(0, "ERROR: Failed with object_iter creation %s\n", glob);
+        os_regex_table_destroy(rp);
+        return;
+    }
+
+    while ((ftype = lio_next_object(tuple->lc, it, &fname, &prefix_len)) > 0) {
+        if (((ftype & OS_OBJECT_DIR) == 0) || (ftype & OS_OBJECT_SYMLINK)) {  //** Handled by the SELF partition
+            free(fname);
+        } else if (depth > 1) {
+            fsck_partition_expand(tuple, fname, depth-1, plist, n, n_max);
+            free(fname);
+        } else {
+            fsck_partition_add(tuple, fname, FSCK_PART_TREE, plist, n, n_max);
+        }
+    }
+
+    lio_destroy_object_iter(tuple->lc, it);
+    os_regex_table_destroy(rp);
+}
+
+//*************************************************************************
+// fsck_parallel - Partitions the paths and checks the partitions in parallel
+//*************************************************************************
+
+void fsck_parallel(lio_path_tuple_t *tlist, int n_paths, int n_parallel, int depth, ex_off_t *n, ex_off_t *nfailed, ex_off_t *checked)
+{
+    fsck_part_t *plist, *p, *done;
+    opque_t *q;
+    op_generic_t *gop;
+    int i, n_parts, n_max, n_resumed;
+
+    plist = NULL;
+    n_parts = n_max = 0;
+    for (i=0; i<n_paths; i++) {
+        fsck_partition_expand(&(tlist[i]), tlist[i].path, depth, &plist, &n_parts, &n_max);
+    }
+
+    q = new_opque();
+    opque_start_execution(q);
+
+    n_resumed = 0;
+    for (i=0; i<n_parts; i++) {
+        p = &(plist[i]);
+        if (ckpt != NULL) {
+            done = ckpt_lookup(ckpt, p->type, p->path);
+            if (done != NULL) {  //** Already completed on a previous run
+                p->problems = done->problems;
+                p->failed = done->failed;
+                p->checked = done->checked;
+                n_resumed++;
+                continue;
+            }
+        }
+
+        gop = new_thread_pool_op(lio_gc->tpc_unlimited, NULL, fsck_partition_task, (void *)p, NULL, 1);
+        gop_set_myid(gop, i);
+        opque_add(q, gop);
+
+        if (opque_tasks_left(q) >= n_parallel) {
+            gop = opque_waitany(q);
+            gop_free(gop, OP_DESTROY);
+        }
+    }
+
+    while ((gop = opque_waitany(q)) != NULL) {
+        gop_free(gop, OP_DESTROY);
+    }
+    opque_free(q, OP_DESTROY);
+
+    for (i=0; i<n_parts; i++) {
+        *n += plist[i].problems;
+        *nfailed += plist[i].failed;
+        *checked += plist[i].checked;
+        free(plist[i].path);
+    }
+    if (plist != NULL) free(plist);
+
+    info_printf(lio_ifd, 0, "Partitions: %d  Resumed from checkpoint: %d\n", n_parts, n_resumed);
+}
+
+//*************************************************************************
+// fsck_du_entry - Returns the aggregate for the directory, adding it if needed
+//*************************************************************************
+
+fsck_du_t *fsck_du_entry(list_t *table, char *path)
+{
+    fsck_du_t *du;
+
+    du = list_search(table, path);
+    if (du == NULL) {
+        type_malloc_clear(du, fsck_du_t, 1);
+        list_insert(table, path, du);
+    }
+
+    return(du);
+}
+
+//*************************************************************************
+// fsck_du_rebuild - Recalculates the directory usage aggregates (os.du) for
+//     every directory in the tree.  The tree should be quiescent since
+//     changes made during the walk can be missed.
+//*************************************************************************
+
+void fsck_du_rebuild(lio_path_tuple_t *tuple)
+{
+    list_t *table;
+    list_iter_t lit;
+    os_regex_table_t *rp;
+    os_object_iter_t *it;
+    opque_t *q;
+    op_generic_t *gop;
+    fsck_du_t *du;
+    char *key = "system.exnode.size";
+    char *val, *fname, *dname, *p;
+    char top[OS_PATH_MAX], path[OS_PATH_MAX];
+    int v_size, ftype, prefix_len, n, top_len;
+    int64_t bytes, files, dirs, nfailed;
+
+    strncpy(top, tuple->path, OS_PATH_MAX-3);
+    top[OS_PATH_MAX-3] = 0;
+    top_len = strlen(top);
+    while ((top_len > 1) && (top[top_len-1] == '/')) top[--top_len] = 0;
+
+    table = list_create(0, &list_string_compare, list_string_dup, list_simple_free, list_simple_free);
+    fsck_du_entry(table, top);
+
+    snprintf(path, OS_PATH_MAX, "%s/*", (strcmp(top, "/") == 0) ? "" : top);
+    rp = os_path_glob2regex(path);
+    v_size = -1024;
+    val = NULL;
+    it = lio_create_object_iter_alist(tuple->lc, tuple->creds, rp, NULL, OS_OBJECT_ANY, 10000, &key, (void **)&val, &v_size, 1);
+    if (it == NULL) {
+        info_printf(lio_ifd, 0, "ERROR: Failed creating the object iterator for the usage rebuild! path=%s\n", top);
+        os_regex_table_destroy(rp);
+        list_destroy(table);
+        return;
+    }
+
+    while ((ftype = lio_next_object(tuple->lc, it, &fname, &prefix_len)) > 0) {
+        bytes = files = dirs = 0;
+        if (ftype & OS_OBJECT_SYMLINK) {  //** Links count as a file but don't have any size of their own
+            files = 1;
+        } else if (ftype & OS_OBJECT_FILE) {
+            files = 1;
+            if (val != NULL) sscanf(val, I64T, &bytes);
+        } else if (ftype & OS_OBJECT_DIR) {
+            dirs = 1;
+            fsck_du_entry(table, fname);
+        }
+
+        //** Add it to all the parents in the tree
+        strncpy(path, fname, OS_PATH_MAX-1);
+        path[OS_PATH_MAX-1] = 0;
+        while ((p = strrchr(path, '/')) != NULL) {
+            *p = 0;
+            if (path[0] == 0) {  //** Hit the root
+                path[0] = '/';
+                path[1] = 0;
+            }
+            if ((int)strlen(path) < top_len) break;
+            du = fsck_du_entry(table, path);
+            du->bytes += bytes;
+            du->files += files;
+            du->dirs += dirs;
+            if (strcmp(path, "/") == 0) break;
+        }
+
+        free(fname);
+        v_size = -1024;
+        if (val != NULL) free(val);
+        val = NULL;
+    }
+
+    lio_destroy_object_iter(tuple->lc, it);
+    os_regex_table_destroy(rp);
+
+    //** Now store them
+    nfailed = 0;
+    q = new_opque();
+    opque_start_execution(q);
+    lit = list_iter_search(table, NULL, 0);
+    while (list_next(&lit, (list_key_t **)&dname, (list_data_t **)&du) == 0) {
+        n = snprintf(du->val, sizeof(du->val), I64T " " I64T " " I64T, du->bytes, du->files, du->dirs);
+        gop = gop_lio_set_attr(tuple->lc, tuple->creds, dname, NULL, "os.du", du->val, n);
+        opque_add(q, gop);
+        if (opque_tasks_left(q) > lio_parallel_task_count) {
+            gop = opque_waitany(q);
+            if (gop_completed_successfully(gop) != OP_STATE_SUCCESS) nfailed++;
+            gop_free(gop, OP_DESTROY);
+        }
+    }
+
+    while ((gop = opque_waitany(q)) != NULL) {
+        if (gop_completed_successfully(gop) != OP_STATE_SUCCESS) nfailed++;
+        gop_free(gop, OP_DESTROY);
+    }
+    opque_free(q, OP_DESTROY);
+
+    du = list_search(table, top);
+    info_printf(lio_ifd, 0, "Usage rebuilt: %s  bytes: " I64T "  files: " I64T "  dirs: " I64T "  directories: %d  failed: " I64T "\n",
+                top, du->bytes, du->files, du->dirs, list_key_count(table), nfailed);
+
+    list_destroy(table);
+}
+
+//*************************************************************************
+// fsck_cksum_check - Spot checks the files against their block checksum
+//     maps.  A random run of n_blocks is verified for each file or the
+//     whole file if n_blocks <= 0.
+//*************************************************************************
+
+void fsck_cksum_check(lio_path_tuple_t *tuple, ex_off_t n_blocks)
+{
+    os_regex_table_t *rp;
+    os_object_iter_t *it;
+    lio_fd_t *fd;
+    char *key = LIO_CKSUM_ATTR;
+    char *val, *fname;
+    ex_off_t bs, size, nb, off, len, bad_block;
+    int v_size, ftype, prefix_len, nbad;
+    int64_t n_good, n_bad, n_missing, n_failed;
+
+    rp = os_path_glob2regex(tuple->path);
+    v_size = -tuple->lc->max_attr;
+    val = NULL;
+    it = lio_create_object_iter_alist(tuple->lc, tuple->creds, rp, NULL, OS_OBJECT_FILE, 10000, &key, (void **)&val, &v_size, 1);
+    if (it == NULL) {
+        info_printf(lio_ifd, 0, "ERROR: Failed creating the object iterator for the checksum check! path=%s\n", tuple->path);
+        os_regex_table_destroy(rp);
+        return;
+    }
+
+    n_good = n_bad = n_missing = n_failed = 0;
+    while ((ftype = lio_next_object(tuple->lc, it, &fname, &prefix_len)) > 0) {
+        if ((ftype & OS_OBJECT_SYMLINK) || (val == NULL)) {
+            if (val == NULL) {
+                info_printf(lio_ifd, 0, "cksum:missing  object:%s\n", fname);
+                n_missing++;
+            }
+            goto next;
+        }
+
+        //** Pick the range to check from the map header
+        bs = size = 0;
+        sscanf(val, "crc32c:" I64T ":" I64T ":", &bs, &size);
+        off = 0;
+        len = -1;
+        if ((n_blocks > 0) && (bs > 0)) {
+            nb = (size + bs - 1) / bs;
+            if (nb > n_blocks) {
+                off = random_int(0, nb - n_blocks) * bs;
+                len = n_blocks * bs;
+            }
+        }
+
+        fd = NULL;
+        if (gop_sync_exec(gop_lio_open_object(tuple->lc, tuple->creds, fname, LIO_READ_MODE, NULL, &fd, 60)) != OP_STATE_SUCCESS) {
+            info_printf(lio_ifd, 0, "cksum:open_failed  object:%s\n", fname);
+            n_failed++;
+            goto next;
+        }
+
+        nbad = lio_cksum_verify(fd, off, len, 8, &bad_block);
+        gop_sync_exec(gop_lio_close_object(fd));
+
+        if (nbad < 0) {
+            info_printf(lio_ifd, 0, "cksum:stale  object:%s\n", fname);
+            n_missing++;
+        } else if (nbad > 0) {
+            info_printf(lio_ifd, 0, "cksum:bad  object:%s  bad_blocks:%d  first_bad_offset:" XOT "\n", fname, nbad, bad_block*bs);
+            n_bad++;
+        } else {
+            n_good++;
+        }
+
+next:
+        free(fname);
+        v_size = -tuple->lc->max_attr;
+        if (val != NULL) free(val);
+        val = NULL;
+    }
+
+    lio_destroy_object_iter(tuple->lc, it);
+    os_regex_table_destroy(rp);
+
+    info_printf(lio_ifd, 0, "Checksums checked: %s  good: " I64T "  bad: " I64T "  missing/stale: " I64T "  failed: " I64T "\n",
+                tuple->path, n_good, n_bad, n_missing, n_failed);
+}
+
+//*************************************************************************
+//*************************************************************************
+
+int main(int argc, char **argv)
+{
+    int i, size_mode, start_option, start_index, n_parallel, depth, n_paths;
+    lio_fsck_iter_t *it;
+    char *fname, *ckpt_fname;
     op_generic_t *gop;
     op_status_t status;
-    lio_path_tuple_t tuple;
-    int ftype, err;
+    lio_path_tuple_t tuple, *tlist;
+    int ftype, err, du_mode;
+    ex_off_t cksum_blocks;
     ex_off_t n, nfailed, checked;
 
     if (argc < 2) {
         printf("\n");
-        printf("lio_fsck LIO_COMMON_OPTIONS  [-o parent|manual|delete|user valid_user]  [-ex parent|manual|delete] [-s manual|repair] path_1 .. path_N\n");
+        printf("lio_fsck LIO_COMMON_OPTIONS  [-o parent|manual|delete|user valid_user]  [-ex parent|manual|delete] [-s manual|repair] [-np n] [-pd depth] [-ck checkpoint] [-batch n] [-du] [-cksum n] path_1 .. path_N\n");
         lio_print_options(stdout);
         lio_print_path_options(stdout);
         printf("    -o                 - How to handle missing system.owner issues.  Default is manual.\n");
@@ -70,6 +789,15 @@ int main(int argc, char **argv)
         printf("    -s                 - How to handle missing exnode size.  Default is repair.\n");
         printf("                            manual - Do nothing.  Leave the size missing.\n");
         printf("                            repair - If the exnode existst load it and determine the size.\n");
+        printf("    -np n              - Check the tree as partitions with up to n partitions in parallel.\n");
+        printf("    -pd depth          - Directory depth used to split the tree into partitions.  Default is 1.\n");
+        printf("    -ck checkpoint     - Record completed partitions in the checkpoint file and skip any\n");
+        printf("                         partitions already recorded there.  Implies partitioned mode.\n");
+        printf("    -batch n           - Number of problem objects to repair as a single batch.  Default is %d.\n", lio_parallel_task_count);
+        printf("    -du                - Rebuild the directory usage aggregates used by lio_du -a once the check completes.\n");
+        printf("                         Should be run from the top of the namespace while it's quiet.\n");
+        printf("    -cksum n           - Verify files against their block checksum maps once the check completes.\n");
+        printf("                         A random run of n blocks is read from each file.  Use 0 to read everything.\n");
         printf("    path               - Path prefix to use\n");
         printf("\n");
         return(1);
@@ -86,6 +814,12 @@ int main(int argc, char **argv)
     owner = NULL;
     exnode_mode = 0;
     size_mode = 0;
+    n_parallel = 0;
+    depth = 1;
+    ckpt_fname = NULL;
+    batch_size = lio_parallel_task_count;
+    du_mode = 0;
+    cksum_blocks = -1;
     i=1;
     do {
         start_option = i;
@@ -122,6 +856,29 @@ int main(int argc, char **argv)
                 size_mode = LIO_FSCK_SIZE_REPAIR;
             }
             i++;
+        } else if (strcmp(argv[i], "-np") == 0) {  //** Parallel partitions
+            i++;
+            n_parallel = atoi(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-pd") == 0) {  //** Partition depth
+            i++;
+            depth = atoi(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-ck") == 0) {  //** Checkpoint file
+            i++;
+            ckpt_fname = argv[i];
+            i++;
+        } else if (strcmp(argv[i], "-batch") == 0) {  //** Repair batch size
+            i++;
+            batch_size = atoi(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-du") == 0) {  //** Rebuild the usage aggregates
+            i++;
+            du_mode = 1;
+        } else if (strcmp(argv[i], "-cksum") == 0) {  //** Spot check the block checksums
+            i++;
+            cksum_blocks = atol(argv[i]);
+            i++;
         }
     } while ((start_option < i) && (i<argc));
     start_index = i;
@@ -131,6 +888,10 @@ int main(int argc, char **argv)
         return(2);
     }
 
+    if (depth < 1) depth = 1;
+    if (batch_size < 1) batch_size = 1;
+    if ((ckpt_fname != NULL) && (n_parallel <= 0)) n_parallel = 1;
+
     info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
     if (owner_mode == LIO_FSCK_USER) {
         info_printf(lio_ifd, 0, "owner_mode=%d (%s) exnode_mode=%d size_mode=%d (%d=manual, %d=parent, %d=delete, %d=user, %d=repair)\n",
@@ -140,6 +901,9 @@ int main(int argc, char **argv)
                     owner_mode, exnode_mode, size_mode, LIO_FSCK_MANUAL, LIO_FSCK_PARENT, LIO_FSCK_DELETE, LIO_FSCK_USER, LIO_FSCK_SIZE_REPAIR);
     }
     info_printf(lio_ifd, 0, "Possible error states: %d=missing owner, %d=missing exnode, %d=missing size, %d=missing inode\n", LIO_FSCK_MISSING_OWNER, LIO_FSCK_MISSING_EXNODE, LIO_FSCK_MISSING_EXNODE_SIZE, LIO_FSCK_MISSING_INODE);
+    if (n_parallel > 0) {
+        info_printf(lio_ifd, 0, "Partitioned mode: parallel=%d depth=%d batch=%d checkpoint=%s\n", n_parallel, depth, batch_size, (ckpt_fname) ? ckpt_fname : "NONE");
+    }
     info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
     info_flush(lio_ifd);
 
@@ -148,6 +912,30 @@ int main(int argc, char **argv)
     checked = 0;
     exnode_mode = exnode_mode | size_mode;
 
+    if (n_parallel > 0) {
+        if (ckpt_fname != NULL) {
+            ckpt = ckpt_open(ckpt_fname);
+            if (ckpt == NULL) {
+                lio_shutdown();
+                return(3);
+            }
+        }
+
+        n_paths = argc - start_index;
+        type_malloc(tlist, lio_path_tuple_t, n_paths);
+        for (i=0; i<n_paths; i++) {
+            tlist[i] = lio_path_resolve(lio_gc->auto_translate, argv[i+start_index]);
+        }
+
+        fsck_parallel(tlist, n_paths, n_parallel, depth, &n, &nfailed, &checked);
+
+        for (i=0; i<n_paths; i++) lio_path_release(&(tlist[i]));
+        free(tlist);
+
+        if (ckpt != NULL) ckpt_close(ckpt);
+        goto finished;
+    }
+
     for (i=start_index; i<argc; i++) {
         //** Create the simple path iterator
         tuple = lio_path_resolve(lio_gc->auto_translate, argv[i]);
@@ -173,6 +961,25 @@ int main(int argc, char **argv)
         lio_path_release(&tuple);
     }
 
+finished:
+    if (du_mode == 1) {
+        info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
+        for (i=start_index; i<argc; i++) {
+            tuple = lio_path_resolve(lio_gc->auto_translate, argv[i]);
+            fsck_du_rebuild(&tuple);
+            lio_path_release(&tuple);
+        }
+    }
+
+    if (cksum_blocks >= 0) {
+        info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
+        for (i=start_index; i<argc; i++) {
+            tuple = lio_path_resolve(lio_gc->auto_translate, argv[i]);
+            fsck_cksum_check(&tuple, cksum_blocks);
+            lio_path_release(&tuple);
+        }
+    }
+
     info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
     info_printf(lio_ifd, 0, "Problem objects: " XOT "  Repair Failed count: " XOT " Processed: " XOT "\n", n, nfailed, checked);
     info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
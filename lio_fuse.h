@@ -41,6 +41,7 @@ extern "C" {
 #define FUSE_USE_VERSION 26
 
 #include <fuse.h>
+#include <fuse_lowlevel.h>
 #include <apr_time.h>
 #include "list.h"
 #include "lio.h"
@@ -51,39 +52,92 @@ extern "C" {
 //#define LFS_TAPE_ATTR "user.tape_system"
 #define LFS_TAPE_ATTR "system.tape"
 
+#define LFS_INODE_KEY_SIZE 5   //** Number of attributes in _lfs_inode_keys
+
 #define LFS_INODE_OK     0  //** Everythings fine
 #define LFS_INODE_DROP   1  //** Drop the inode from the cache
 #define LFS_INODE_DELETE 2  //** Remove it from cache and delete the file contents
  
 typedef struct lio_fuse_file_handle_s lio_fuse_file_handle_t;
+
+typedef struct {  //** Slice of the open file table.  Files are spread across them by name
+apr_thread_mutex_t *lock;
+apr_pool_t *mpool;
+apr_hash_t *open_files;
+} lfs_open_shard_t;
  
 typedef struct {
 int enable_tape;
 int shutdown;
 int mount_point_len;
 atomic_int_t counter;
-list_t *ino_index;
+list_t *ino_index;    //** Low-level frontend inode table
+apr_thread_mutex_t *ino_lock;
+ex_id_t root_ino;
+int writeback_cache;
+int async_io;
+double attr_timeout;
+double entry_timeout;
 lio_config_t *lc;
 apr_pool_t *mpool;
-apr_thread_mutex_t *lock;
-apr_hash_t *open_files;
+int n_open_shards;
+lfs_open_shard_t *open_shard;
 struct fuse_operations fops;
 char *id;
 char *mount_point;
 segment_rw_hints_t *rw_hints;
 } lio_fuse_t;
  
+typedef struct {   //** Low-level frontend inode the kernel has a reference to
+ex_id_t ino;
+char *fname;      //** NULL if the path was overwritten or removed
+uint64_t nlookup;
+} lfs_ll_inode_t;
+
 typedef struct {
 lio_config_t *lc;
 char *mount_point;
 int lio_argc;
 char **lio_argv;
+lio_fuse_t *lfs;    //** Filled in by the low-level frontend's init
 } lio_fuse_init_args_t;
  
 extern struct fuse_operations lfs_fops;
+extern struct fuse_lowlevel_ops lfs_ll_ops;
+extern char *_lfs_inode_keys[];
  
 void *lfs_init(struct fuse_conn_info *conn);  // returns pointer to lio_fuse_t on success, otherwise NULL
+void *lfs_init_real(struct fuse_conn_info *conn, const int argc, const char **argv, const char *mount_point);
 void lfs_destroy(void *lfs); // expects a lio_fuse_t* as the argument
+
+//** Path based routines shared by the high-level and low-level frontends
+void _lfs_parse_stat_vals(lio_fuse_t *lfs, char *fname, struct stat *stat, char **val, int *v_size);
+int lfs_stat_real(lio_fuse_t *lfs, const char *fname, struct stat *stat);
+int lfs_object_create(lio_fuse_t *lfs, const char *fname, mode_t mode, int ftype);
+int lfs_object_remove(lio_fuse_t *lfs, const char *fname);
+int lfs_open_real(lio_fuse_t *lfs, const char *fname, struct fuse_file_info *fi);
+int lfs_release_real(lio_fuse_t *lfs, const char *fname, struct fuse_file_info *fi);
+int lfs_read_real(lio_fuse_t *lfs, const char *fname, char *buf, size_t size, off_t off, struct fuse_file_info *fi);
+int lfs_write_real(lio_fuse_t *lfs, const char *fname, const char *buf, size_t size, off_t off, struct fuse_file_info *fi);
+int lfs_flush(const char *fname, struct fuse_file_info *fi);
+int lfs_fsync_real(lio_fuse_t *lfs, const char *fname, int datasync, struct fuse_file_info *fi);
+int lfs_rename_real(lio_fuse_t *lfs, const char *oldname, const char *newname);
+int lfs_ftruncate(const char *fname, off_t new_size, struct fuse_file_info *fi);
+int lfs_truncate_real(lio_fuse_t *lfs, const char *fname, off_t new_size);
+int lfs_utimens_real(lio_fuse_t *lfs, const char *fname, const struct timespec tv[2]);
+
+//** Low-level frontend inode table
+char *_ll_path(lio_fuse_t *lfs, fuse_ino_t ino);
+void _ll_inode_ref(lio_fuse_t *lfs, const char *fname, struct stat *stat);
+void _ll_rename_paths(lio_fuse_t *lfs, const char *oldname, const char *newname);
+int lfs_listxattr_real(lio_fuse_t *lfs, const char *fname, char *list, size_t size);
+int lfs_getxattr_real(lio_fuse_t *lfs, const char *fname, const char *name, char *buf, size_t size);
+int lfs_setxattr_real(lio_fuse_t *lfs, const char *fname, const char *name, const char *fval, size_t size, int flags);
+int lfs_removexattr_real(lio_fuse_t *lfs, const char *fname, const char *name);
+int lfs_hardlink_real(lio_fuse_t *lfs, const char *oldname, const char *newname);
+int lfs_readlink_real(lio_fuse_t *lfs, const char *fname, char *buf, size_t bsize);
+int lfs_symlink_real(lio_fuse_t *lfs, const char *link, const char *newname);
+int lfs_statfs_real(lio_fuse_t *lfs, const char *fname, struct statvfs *fs);
  
 #ifdef __cplusplus
 }
@@ -55,14 +55,14 @@ http://www.accre.vanderbilt.edu
 #include "string_token.h"
 #include "apr_wrapper.h"
 
-//#define lfs_lock(lfs)  log_printf(0, "lfs_lock\n"); flush_log(); apr_thread_mutex_lock((lfs)->lock)
-//#define lfs_unlock(lfs) log_printf(0, "lfs_unlock\n");  flush_log(); apr_thread_mutex_unlock((lfs)->lock)
-#define lfs_lock(lfs)    apr_thread_mutex_lock((lfs)->lock)
-#define lfs_unlock(lfs)  apr_thread_mutex_unlock((lfs)->lock)
-
-#define _inode_key_size 11
-#define _inode_fuse_attr_start 7
-static char *_inode_keys[] = { "system.inode", "system.modify_data", "system.modify_attr", "system.exnode.size", "os.type", "os.link_count", "os.link",
+//#define lfs_lock(s)  log_printf(0, "lfs_lock\n"); flush_log(); apr_thread_mutex_lock((s)->lock)
+//#define lfs_unlock(s) log_printf(0, "lfs_unlock\n");  flush_log(); apr_thread_mutex_unlock((s)->lock)
+#define lfs_lock(s)    apr_thread_mutex_lock((s)->lock)
+#define lfs_unlock(s)  apr_thread_mutex_unlock((s)->lock)
+
+#define _inode_key_size LFS_INODE_KEY_SIZE
+#define _inode_fuse_attr_start 1
+char *_lfs_inode_keys[] = { OS_STAT_ATTR,
                                "security.selinux",  "system.posix_acl_access", "system.posix_acl_default", "security.capability"
                              };
 
@@ -81,6 +81,17 @@ typedef struct {
     int remove_on_close;
 }  lio_fuse_open_file_t;
 
+//*************************************************************************
+// lfs_open_shard - Returns the open file table shard holding the file
+//*************************************************************************
+
+lfs_open_shard_t *lfs_open_shard(lio_fuse_t *lfs, const char *fname)
+{
+    apr_ssize_t klen = APR_HASH_KEY_STRING;
+
+    return(&(lfs->open_shard[apr_hashfunc_default(fname, &klen) % lfs->n_open_shards]));
+}
+
 typedef struct {
     lio_fuse_t *lfs;
     os_object_iter_t *it;
@@ -129,73 +140,64 @@ mode_t ftype_lio2fuse(int ftype)
 
 void _lfs_parse_stat_vals(lio_fuse_t *lfs, char *fname, struct stat *stat, char **val, int *v_size)
 {
-    int i, n, readlink;
+    int i, readlink;
     lio_fuse_open_file_t *fop;
+    lfs_open_shard_t *shard;
+    os_stat_t st;
     ex_id_t ino;
-    char *link;
     lio_file_handle_t *fh;
     ex_off_t len;
-    int ts;
 
-    ino = 0;
-    if (val[0] != NULL) {
-        sscanf(val[0], XIDT, &ino);
-    } else {
+    if (lio_stat_record(lfs->lc, lfs->lc->creds, fname, &(val[0]), &(v_size[0]), &st) != 0) memset(&st, 0, sizeof(st));
+
+    ino = st.inode;
+    if (ino == 0) {
         generate_ex_id(&ino);
         log_printf(0, "Missing inode generating a temp fake one! ino=" XIDT "\n", ino);
     }
     stat->st_ino = ino;
 
     //** Modify TS's
-    ts = 0;
-    if (val[1] != NULL) lio_get_timestamp(val[1], &ts, NULL);
-    stat->st_mtime = ts;
-    ts = 0;
-    if (val[1] != NULL) lio_get_timestamp(val[2], &ts, NULL);
-    stat->st_ctime = ts;
+    stat->st_mtime = st.modify_data;
+    stat->st_ctime = st.modify_attr;
     stat->st_atime = stat->st_ctime;
 
     //** Get the symlink if it exists
     readlink = 0;
-    if (val[6] != NULL) {
-        link = val[6];
-        readlink = strlen(link);
-        log_printf(15, "inode->link=%s mount_point=%s moun_point_len=%d\n", link, lfs->mount_point, lfs->mount_point_len);
-        if (link[0] == '/') { //** IF an absolute link then we need to add the mount prefix back
+    if (st.link_len > 0) {
+        readlink = st.link_len;
+        log_printf(15, "inode->link=%.*s mount_point=%s moun_point_len=%d\n", st.link_len, st.link, lfs->mount_point, lfs->mount_point_len);
+        if (st.link[0] == '/') { //** IF an absolute link then we need to add the mount prefix back
             readlink += lfs->mount_point_len + 1;
         }
     }
 
     //** File types
-    n = 0;
-    if (val[4] != NULL) sscanf(val[4], "%d", &n);
-    stat->st_mode = ftype_lio2fuse(n);
+    stat->st_mode = ftype_lio2fuse(st.ftype);
 
     //** Size
     ino = 0;
-    lfs_lock(lfs);
-    fop = apr_hash_get(lfs->open_files, fname, APR_HASH_KEY_STRING);
+    shard = lfs_open_shard(lfs, fname);
+    lfs_lock(shard);
+    fop = apr_hash_get(shard->open_files, fname, APR_HASH_KEY_STRING);
     if (fop != NULL) ino = fop->sid;
-    lfs_unlock(lfs);
+    lfs_unlock(shard);
 
-    len = 0;
-    if (val[3] != NULL) sscanf(val[3], XOT, &len);
+    len = st.size;
     if (ino != 0) { //** Got an open file
-        lio_lock(lfs->lc);
+        lio_fh_shard_lock(lio_fh_shard(lfs->lc, ino));
         fh = _lio_get_file_handle(lfs->lc, ino);
-        if (fh) len = segment_size(fh->seg);
-        lio_unlock(lfs->lc);
+        if ((fh) && (fh->in_flight == 0)) len = segment_size(fh->seg);
+        lio_fh_shard_unlock(lio_fh_shard(lfs->lc, ino));
     }
 
-    stat->st_size = (n & OS_OBJECT_SYMLINK) ? readlink : len;
+    stat->st_size = (st.ftype & OS_OBJECT_SYMLINK) ? readlink : len;
     stat->st_blksize = 4096;
     stat->st_blocks = stat->st_size / 512;
     if (stat->st_size < 1024) stat->st_blksize = 1024;
 
     //** N-links
-    n = 0;
-    if (val[5] != NULL) sscanf(val[5], "%d", &n);
-    stat->st_nlink = n;
+    stat->st_nlink = st.nlink;
 
     //** All the various security ACLs that Linux likes to check we just ignore
     //** By fetching them with everything else we've preloaded the OS cache
@@ -229,9 +231,8 @@ lio_fuse_t *lfs_get_context()
 // lfs_stat - Does a stat on the file/dir
 //*************************************************************************
 
-int lfs_stat(const char *fname, struct stat *stat)
+int lfs_stat_real(lio_fuse_t *lfs, const char *fname, struct stat *stat)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     char *val[_inode_key_size];
     int v_size[_inode_key_size], i, err;
 
@@ -239,7 +240,7 @@ int lfs_stat(const char *fname, struct stat *stat)
     flush_log();
 
     for (i=0; i<_inode_key_size; i++) v_size[i] = -lfs->lc->max_attr;
-    err = lio_get_multiple_attrs(lfs->lc, lfs->lc->creds, fname, NULL, _inode_keys, (void **)val, v_size, _inode_key_size);
+    err = lio_get_multiple_attrs(lfs->lc, lfs->lc->creds, fname, NULL, _lfs_inode_keys, (void **)val, v_size, _inode_key_size);
 
     if (err != OP_STATE_SUCCESS) {
         return(-ENOENT);
@@ -252,6 +253,11 @@ int lfs_stat(const char *fname, struct stat *stat)
     return(0);
 }
 
+int lfs_stat(const char *fname, struct stat *stat)
+{
+    return(lfs_stat_real(lfs_get_context(), fname, stat));
+}
+
 //*************************************************************************
 // lfs_closedir - Closes the opendir file handle
 //*************************************************************************
@@ -315,7 +321,7 @@ int lfs_opendir(const char *fname, struct fuse_file_info *fi)
     snprintf(path, OS_PATH_MAX, "%s/*", fname);
     dit->path_regex = os_path_glob2regex(path);
 
-    dit->it = lio_create_object_iter_alist(dit->lfs->lc, dit->lfs->lc->creds, dit->path_regex, NULL, OS_OBJECT_ANY, 0, _inode_keys, (void **)dit->val, dit->v_size, _inode_key_size);
+    dit->it = lio_create_object_iter_alist(dit->lfs->lc, dit->lfs->lc->creds, dit->path_regex, NULL, OS_OBJECT_ANY, 0, _lfs_inode_keys, (void **)dit->val, dit->v_size, _inode_key_size);
 
     dit->stack = new_stack();
 
@@ -518,18 +524,21 @@ int lfs_actual_remove(lio_fuse_t *lfs, const char *fname, int ftype)
 int lfs_object_remove(lio_fuse_t *lfs, const char *fname)
 {
     lio_fuse_open_file_t *fop;
+    lfs_open_shard_t *shard;
 
     log_printf(1, "fname=%s\n", fname);
     flush_log();
 
     //** Check if it's open.  If so do a delayed removal
-    lfs_lock(lfs);
-    fop = apr_hash_get(lfs->open_files, fname, APR_HASH_KEY_STRING);
+    shard = lfs_open_shard(lfs, fname);
+    lfs_lock(shard);
+    fop = apr_hash_get(shard->open_files, fname, APR_HASH_KEY_STRING);
     if (fop != NULL) {
         fop->remove_on_close = 1;
+        lfs_unlock(shard);
         return(0);
     }
-    lfs_unlock(lfs);
+    lfs_unlock(shard);
 
     return(lfs_actual_remove(lfs, fname, 0));
 }
@@ -559,11 +568,11 @@ int lfs_rmdir(const char *fname)
 // lfs_open - Opens a file for I/O
 //*****************************************************************
 
-int lfs_open(const char *fname, struct fuse_file_info *fi)
+int lfs_open_real(lio_fuse_t *lfs, const char *fname, struct fuse_file_info *fi)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     lio_fd_t *fd;
     lio_fuse_open_file_t *fop;
+    lfs_open_shard_t *shard;
     int mode;
 
     mode = 0;
@@ -589,46 +598,54 @@ int lfs_open(const char *fname, struct fuse_file_info *fi)
 
     fi->fh = (uint64_t)fd;
 
-    lfs_lock(lfs);
-    fop = apr_hash_get(lfs->open_files, fname, APR_HASH_KEY_STRING);
+    shard = lfs_open_shard(lfs, fname);
+    lfs_lock(shard);
+    fop = apr_hash_get(shard->open_files, fname, APR_HASH_KEY_STRING);
     if (fop == NULL) {
         type_malloc_clear(fop, lio_fuse_open_file_t, 1);
         fop->fname = strdup(fd->path);
         fop->sid = segment_id(fd->fh->seg);
-        apr_hash_set(lfs->open_files, fop->fname, APR_HASH_KEY_STRING, fop);
+        apr_hash_set(shard->open_files, fop->fname, APR_HASH_KEY_STRING, fop);
     }
     fop->ref_count++;
-    lfs_unlock(lfs);
+    lfs_unlock(shard);
 
     return(0);
 }
 
+int lfs_open(const char *fname, struct fuse_file_info *fi)
+{
+    return(lfs_open_real(lfs_get_context(), fname, fi));
+}
+
 //*****************************************************************
 // lfs_release - Closes a file
 //*****************************************************************
 
-int lfs_release(const char *fname, struct fuse_file_info *fi)
+int lfs_release_real(lio_fuse_t *lfs, const char *fname, struct fuse_file_info *fi)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     lio_fd_t *fd = (lio_fd_t *)fi->fh;
     lio_fuse_open_file_t *fop;
+    lfs_open_shard_t *shard;
     int err, remove_on_close;
 
     log_printf(2, "fname=%s fd->path=%s fd=%p\n", fname, fd->path, fd);
 
     remove_on_close = 0;
 
-    lfs_lock(lfs);
-    fop = apr_hash_get(lfs->open_files, fname, APR_HASH_KEY_STRING);
+    shard = lfs_open_shard(lfs, fname);
+    lfs_lock(shard);
+    fop = apr_hash_get(shard->open_files, fname, APR_HASH_KEY_STRING);
     if (fop) {
         remove_on_close = fop->remove_on_close;
         fop->ref_count--;
         if (fop->ref_count <= 0) {  //** LAst one so remove it.
-            apr_hash_set(lfs->open_files, fname, APR_HASH_KEY_STRING, NULL);
+            apr_hash_set(shard->open_files, fname, APR_HASH_KEY_STRING, NULL);
             free(fop->fname);
             free(fop);
         }
     }
+    lfs_unlock(shard);  //** The close can take a while so don't hold up the other files in the shard
 
     //** See if we need to remove it
     if (remove_on_close == 1) {
@@ -644,7 +661,6 @@ int lfs_release(const char *fname, struct fuse_file_info *fi)
     }
 
     err = gop_sync_exec(gop_lio_close_object(fd)); // ** Close it but keep track of the error
-    lfs_unlock(lfs);
 
     if (err != OP_STATE_SUCCESS) {
         log_printf(0, "Failed closing file!  path=%s\n", fname);
@@ -654,14 +670,18 @@ int lfs_release(const char *fname, struct fuse_file_info *fi)
     return(0);
 }
 
+int lfs_release(const char *fname, struct fuse_file_info *fi)
+{
+    return(lfs_release_real(lfs_get_context(), fname, fi));
+}
+
 //*****************************************************************
 // lfs_read - Reads data from a file
 //    NOTE: Uses the LFS readahead hints
 //*****************************************************************
 
-int lfs_read(const char *fname, char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+int lfs_read_real(lio_fuse_t *lfs, const char *fname, char *buf, size_t size, off_t off, struct fuse_file_info *fi)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     lio_fd_t *fd;
     ex_off_t nbytes;
     apr_time_t now;
@@ -704,13 +724,17 @@ int lfs_read(const char *fname, char *buf, size_t size, off_t off, struct fuse_f
     return(nbytes);
 }
 
+int lfs_read(const char *fname, char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    return(lfs_read_real(lfs_get_context(), fname, buf, size, off, fi));
+}
+
 //*****************************************************************
 // lfs_write - Writes data to a file
 //*****************************************************************
 
-int lfs_write(const char *fname, const char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+int lfs_write_real(lio_fuse_t *lfs, const char *fname, const char *buf, size_t size, off_t off, struct fuse_file_info *fi)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     ex_off_t nbytes;
     lio_fd_t *fd;
 
@@ -726,6 +750,11 @@ int lfs_write(const char *fname, const char *buf, size_t size, off_t off, struct
     return(nbytes);
 }
 
+int lfs_write(const char *fname, const char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    return(lfs_write_real(lfs_get_context(), fname, buf, size, off, fi));
+}
+
 //*****************************************************************
 // lfs_flush - Flushes any data to backing store
 //*****************************************************************
@@ -764,9 +793,8 @@ int lfs_flush(const char *fname, struct fuse_file_info *fi)
 // lfs_fsync - Flushes any data to backing store
 //*****************************************************************
 
-int lfs_fsync(const char *fname, int datasync, struct fuse_file_info *fi)
+int lfs_fsync_real(lio_fuse_t *lfs, const char *fname, int datasync, struct fuse_file_info *fi)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     lio_fd_t *fd;
     int err;
     apr_time_t now;
@@ -794,28 +822,45 @@ int lfs_fsync(const char *fname, int datasync, struct fuse_file_info *fi)
     return(0);
 }
 
+int lfs_fsync(const char *fname, int datasync, struct fuse_file_info *fi)
+{
+    return(lfs_fsync_real(lfs_get_context(), fname, datasync, fi));
+}
+
 //*************************************************************************
 // lfs_rename - Renames a file
 //*************************************************************************
 
-int lfs_rename(const char *oldname, const char *newname)
+int lfs_rename_real(lio_fuse_t *lfs, const char *oldname, const char *newname)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     lio_fuse_open_file_t *fop;
+    lfs_open_shard_t *s_old, *s_new;
     int err;
 
     log_printf(1, "oldname=%s newname=%s\n", oldname, newname);
     flush_log();
 
-    lfs_lock(lfs);
-    fop = apr_hash_get(lfs->open_files, oldname, APR_HASH_KEY_STRING);
+    //** Lock both shards.  Always in table order to keep from deadlocking with another rename
+    s_old = lfs_open_shard(lfs, oldname);
+    s_new = lfs_open_shard(lfs, newname);
+    if (s_old <= s_new) {
+        lfs_lock(s_old);
+        if (s_new != s_old) lfs_lock(s_new);
+    } else {
+        lfs_lock(s_new);
+        lfs_lock(s_old);
+    }
+
+    fop = apr_hash_get(s_old->open_files, oldname, APR_HASH_KEY_STRING);
     if (fop) {  //** Got an open file so need to mve the entry there as well.
-        apr_hash_set(lfs->open_files, oldname, APR_HASH_KEY_STRING, NULL);
+        apr_hash_set(s_old->open_files, oldname, APR_HASH_KEY_STRING, NULL);
         free(fop->fname);
         fop->fname = strdup(newname);
-        apr_hash_set(lfs->open_files, fop->fname, APR_HASH_KEY_STRING, fop);
+        apr_hash_set(s_new->open_files, fop->fname, APR_HASH_KEY_STRING, fop);
     }
-    lfs_unlock(lfs);
+
+    if (s_new != s_old) lfs_unlock(s_new);
+    lfs_unlock(s_old);
 
     //** Do the move
     err = gop_sync_exec(gop_lio_move_object(lfs->lc, lfs->lc->creds, (char *)oldname, (char *)newname));
@@ -826,6 +871,11 @@ int lfs_rename(const char *oldname, const char *newname)
     return(0);
 }
 
+int lfs_rename(const char *oldname, const char *newname)
+{
+    return(lfs_rename_real(lfs_get_context(), oldname, newname));
+}
+
 
 //*****************************************************************
 // lfs_ftruncate - Truncate the file associated with the FD
@@ -854,9 +904,8 @@ int lfs_ftruncate(const char *fname, off_t new_size, struct fuse_file_info *fi)
 // lfs_truncate - Truncate the file
 //*****************************************************************
 
-int lfs_truncate(const char *fname, off_t new_size)
+int lfs_truncate_real(lio_fuse_t *lfs, const char *fname, off_t new_size)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     lio_fd_t *fd;
     ex_off_t ts;
     int result;
@@ -887,13 +936,17 @@ int lfs_truncate(const char *fname, off_t new_size)
     return(result);
 }
 
+int lfs_truncate(const char *fname, off_t new_size)
+{
+    return(lfs_truncate_real(lfs_get_context(), fname, new_size));
+}
+
 //*****************************************************************
 // lfs_utimens - Sets the access and mod times in ns
 //*****************************************************************
 
-int lfs_utimens(const char *fname, const struct timespec tv[2])
+int lfs_utimens_real(lio_fuse_t *lfs, const char *fname, const struct timespec tv[2])
 {
-    lio_fuse_t *lfs = lfs_get_context();
     char buf[1024];
     char *key;
     char *val;
@@ -924,14 +977,18 @@ int lfs_utimens(const char *fname, const struct timespec tv[2])
     return(0);
 }
 
+int lfs_utimens(const char *fname, const struct timespec tv[2])
+{
+    return(lfs_utimens_real(lfs_get_context(), fname, tv));
+}
+
 //*****************************************************************
 // lfs_listxattr - Lists the extended attributes
 //    These are currently defined as the user.* attributes
 //*****************************************************************
 
-int lfs_listxattr(const char *fname, char *list, size_t size)
+int lfs_listxattr_real(lio_fuse_t *lfs, const char *fname, char *list, size_t size)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     char *buf, *key, *val;
     int bpos, bufsize, v_size, n, i, err;
     os_regex_table_t *attr_regex;
@@ -1003,6 +1060,11 @@ int lfs_listxattr(const char *fname, char *list, size_t size)
     return(bpos);
 }
 
+int lfs_listxattr(const char *fname, char *list, size_t size)
+{
+    return(lfs_listxattr_real(lfs_get_context(), fname, list, size));
+}
+
 //*****************************************************************
 // lfs_set_tape_attr - Disburse the tape attribute
 //*****************************************************************
@@ -1210,13 +1272,8 @@ void lfs_get_tape_attr(lio_fuse_t *lfs, char *fname, char **tape_val, int *tape_
 //*****************************************************************
 
 #if defined(HAVE_XATTR)
-#  if ! defined(__APPLE__)
-int lfs_getxattr(const char *fname, const char *name, char *buf, size_t size)
-#  else
-int lfs_getxattr(const char *fname, const char *name, char *buf, size_t size, uint32_t dummy)
-#  endif
+int lfs_getxattr_real(lio_fuse_t *lfs, const char *fname, const char *name, char *buf, size_t size)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     char *val;
     int v_size, err;
 
@@ -1249,18 +1306,22 @@ int lfs_getxattr(const char *fname, const char *name, char *buf, size_t size, ui
     if (val != NULL) free(val);
     return(v_size);
 }
+
+#  if ! defined(__APPLE__)
+int lfs_getxattr(const char *fname, const char *name, char *buf, size_t size)
+#  else
+int lfs_getxattr(const char *fname, const char *name, char *buf, size_t size, uint32_t dummy)
+#  endif
+{
+    return(lfs_getxattr_real(lfs_get_context(), fname, name, buf, size));
+}
 #endif //HAVE_XATTR
 //*****************************************************************
 // lfs_setxattr - Sets a extended attribute
 //*****************************************************************
 #if defined(HAVE_XATTR)
-#  if ! defined(__APPLE__)
-int lfs_setxattr(const char *fname, const char *name, const char *fval, size_t size, int flags)
-#  else
-int lfs_setxattr(const char *fname, const char *name, const char *fval, size_t size, int flags, uint32_t dummy)
-#  endif
+int lfs_setxattr_real(lio_fuse_t *lfs, const char *fname, const char *name, const char *fval, size_t size, int flags)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     char *val;
     int v_size, err;
 
@@ -1297,13 +1358,21 @@ int lfs_setxattr(const char *fname, const char *name, const char *fval, size_t s
     return(0);
 }
 
+#  if ! defined(__APPLE__)
+int lfs_setxattr(const char *fname, const char *name, const char *fval, size_t size, int flags)
+#  else
+int lfs_setxattr(const char *fname, const char *name, const char *fval, size_t size, int flags, uint32_t dummy)
+#  endif
+{
+    return(lfs_setxattr_real(lfs_get_context(), fname, name, fval, size, flags));
+}
+
 //*****************************************************************
 // lfs_removexattr - Removes an extended attribute
 //*****************************************************************
 
-int lfs_removexattr(const char *fname, const char *name)
+int lfs_removexattr_real(lio_fuse_t *lfs, const char *fname, const char *name)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     int v_size, err;
 
     log_printf(1, "fname=%s attr_name=%s\n", fname, name);
@@ -1321,14 +1390,18 @@ int lfs_removexattr(const char *fname, const char *name)
 
     return(0);
 }
+
+int lfs_removexattr(const char *fname, const char *name)
+{
+    return(lfs_removexattr_real(lfs_get_context(), fname, name));
+}
 #endif //HAVE_XATTR
 //*************************************************************************
 // lfs_hardlink - Creates a hardlink to an existing file
 //*************************************************************************
 
-int lfs_hardlink(const char *oldname, const char *newname)
+int lfs_hardlink_real(lio_fuse_t *lfs, const char *oldname, const char *newname)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     int err;
 
     log_printf(1, "oldname=%s newname=%s\n", oldname, newname);
@@ -1343,13 +1416,17 @@ int lfs_hardlink(const char *oldname, const char *newname)
     return(0);
 }
 
+int lfs_hardlink(const char *oldname, const char *newname)
+{
+    return(lfs_hardlink_real(lfs_get_context(), oldname, newname));
+}
+
 //*****************************************************************
 //  lfs_readlink - Reads the object symlink
 //*****************************************************************
 
-int lfs_readlink(const char *fname, char *buf, size_t bsize)
+int lfs_readlink_real(lio_fuse_t *lfs, const char *fname, char *buf, size_t bsize)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     int v_size, err, i;
     char *val;
 
@@ -1382,13 +1459,17 @@ int lfs_readlink(const char *fname, char *buf, size_t bsize)
     return(0);
 }
 
+int lfs_readlink(const char *fname, char *buf, size_t bsize)
+{
+    return(lfs_readlink_real(lfs_get_context(), fname, buf, bsize));
+}
+
 //*****************************************************************
 //  lfs_symlink - Makes a symbolic link
 //*****************************************************************
 
-int lfs_symlink(const char *link, const char *newname)
+int lfs_symlink_real(lio_fuse_t *lfs, const char *link, const char *newname)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     const char *link2;
     int err;
 
@@ -1416,13 +1497,17 @@ int lfs_symlink(const char *link, const char *newname)
     return(0);
 }
 
+int lfs_symlink(const char *link, const char *newname)
+{
+    return(lfs_symlink_real(lfs_get_context(), link, newname));
+}
+
 //*************************************************************************
 // lfs_statfs - Returns the files system size
 //*************************************************************************
 
-int lfs_statfs(const char *fname, struct statvfs *fs)
+int lfs_statfs_real(lio_fuse_t *lfs, const char *fname, struct statvfs *fs)
 {
-    lio_fuse_t *lfs = lfs_get_context();
     rs_space_t space;
     char *config;
 
@@ -1451,6 +1536,11 @@ int lfs_statfs(const char *fname, struct statvfs *fs)
     return(0);
 }
 
+int lfs_statfs(const char *fname, struct statvfs *fs)
+{
+    return(lfs_statfs_real(lfs_get_context(), fname, fs));
+}
+
 
 //*************************************************************************
 //  lio_fuse_init - Creates a lowlevel fuse handle for use
@@ -1468,6 +1558,7 @@ void *lfs_init_real(struct fuse_conn_info *conn,
                     const char *mount_point)
 {
     lio_fuse_t *lfs;
+    int i;
     char *section =  "lfs";
 
 //#ifdef HAVE_XATTR
@@ -1521,8 +1612,16 @@ void *lfs_init_real(struct fuse_conn_info *conn,
     lfs->enable_tape = inip_get_integer(lfs->lc->ifd, section, "enable_tape", 0);
 
     apr_pool_create(&(lfs->mpool), NULL);
-    apr_thread_mutex_create(&(lfs->lock), APR_THREAD_MUTEX_DEFAULT, lfs->mpool);
-    lfs->open_files = apr_hash_make(lfs->mpool);
+
+    //** Each shard gets its own pool since the hash allocates out of it under the shard lock
+    lfs->n_open_shards = inip_get_integer(lfs->lc->ifd, section, "open_file_shards", 64);
+    if (lfs->n_open_shards < 1) lfs->n_open_shards = 1;
+    type_malloc_clear(lfs->open_shard, lfs_open_shard_t, lfs->n_open_shards);
+    for (i=0; i<lfs->n_open_shards; i++) {
+        apr_pool_create(&(lfs->open_shard[i].mpool), lfs->mpool);
+        apr_thread_mutex_create(&(lfs->open_shard[i].lock), APR_THREAD_MUTEX_DEFAULT, lfs->open_shard[i].mpool);
+        lfs->open_shard[i].open_files = apr_hash_make(lfs->open_shard[i].mpool);
+    }
 
     //** Get the default host ID for opens
     char hostname[1024];
@@ -1553,6 +1652,7 @@ void *lfs_init(struct fuse_conn_info *conn)
 void lfs_destroy(void *private_data)
 {
     lio_fuse_t *lfs;
+    int i;
 
     log_printf(0, "shutting down\n");
     flush_log();
@@ -1568,8 +1668,11 @@ void lfs_destroy(void *private_data)
     //** Clean up everything else
     if (lfs->id != NULL) free (lfs->id);
     free(lfs->mount_point);
-    apr_thread_mutex_destroy(lfs->lock);
-    apr_pool_destroy(lfs->mpool);
+    for (i=0; i<lfs->n_open_shards; i++) {
+        apr_thread_mutex_destroy(lfs->open_shard[i].lock);
+    }
+    free(lfs->open_shard);
+    apr_pool_destroy(lfs->mpool);  //** This also destroys the shard pools
 
     if (lfs->rw_hints) free(lfs->rw_hints);
     free(lfs);
@@ -0,0 +1,140 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//***********************************************************************
+// lio_fuse_ll - Mounts LIO using the low-level, inode based FUSE API
+//***********************************************************************
+
+#define _log_module_index 226
+
+
+#include <assert.h>
+#include "assert_result.h"
+#include "lio_fuse.h"
+#include <fuse_lowlevel.h>
+#include "exnode.h"
+#include "log.h"
+#include "iniparse.h"
+#include "type_malloc.h"
+#include "thread_pool.h"
+#include "lio.h"
+
+//*************************************************************************
+//*************************************************************************
+
+void print_usage(void)
+{
+    printf("\n"
+           "lio_fuse_ll mount_point [FUSE_OPTIONS] [--lio LIO_COMMON_OPTIONS]\n");
+    lio_print_options(stdout);
+    printf("    FUSE_OPTIONS:\n"
+           "       -h   --help            print this help\n"
+           "       -d   -o debug          enable debug output (implies -f)\n"
+           "       -s                     disable multi-threaded operation\n"
+           "       -f                     foreground operation\n"
+           "                                (REQUIRED unless  '-c /absolute/path/lio.cfg' is specified and all included files are absolute paths)"
+           "       -o OPT[,OPT...]        mount options\n"
+           "                                (for possible values of OPT see 'man mount.fuse')\n"
+           "\n"
+           "    The [lfs] section of the config also supports:\n"
+           "       attr_timeout=1.0       Seconds the kernel can cache attributes\n"
+           "       entry_timeout=1.0      Seconds the kernel can cache name lookups\n"
+           "       writeback_cache=1      Use the kernel writeback cache if available\n"
+           "       async_io=1             Reply to reads, writes, and stats from the op callback\n");
+}
+
+int main(int argc, char **argv)
+{
+    int err = -1;
+    lio_fuse_init_args_t lio_args;
+    struct fuse_args args;
+    struct fuse_chan *ch;
+    struct fuse_session *se;
+    char *mountpoint;
+    int fuse_argc, multithreaded, foreground, idx;
+    char **fuse_argv;
+
+    if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        print_usage();
+        return(1);
+    }
+
+    // ** split lio and fuse arguments **
+    memset(&lio_args, 0, sizeof(lio_args));
+    fuse_argc = argc;
+    fuse_argv = argv;
+    lio_args.lio_argc = 1;
+    lio_args.lio_argv = argv;
+
+    for (idx=1; idx<argc; idx++) {
+        if(strcmp(argv[idx], "--lio") == 0) {
+            fuse_argc = idx;
+            lio_args.lio_argc = argc - idx;
+            lio_args.lio_argv = &argv[idx];
+            lio_args.lio_argv[0] = argv[0]; //replace "--lio" with the executable name
+        }
+    }
+
+    args.argc = fuse_argc;
+    args.argv = fuse_argv;
+    args.allocated = 0;
+    if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) == -1) {
+        print_usage();
+        return(1);
+    }
+    lio_args.mount_point = mountpoint;
+
+    umask(0);
+
+    //** LIO is started in the init op so it's after any daemonizing
+    ch = fuse_mount(mountpoint, &args);
+    if (ch == NULL) {
+        fprintf(stderr, "ERROR mounting %s!\n", mountpoint);
+        fuse_opt_free_args(&args);
+        return(1);
+    }
+
+    se = fuse_lowlevel_new(&args, &lfs_ll_ops, sizeof(lfs_ll_ops), &lio_args);
+    if (se != NULL) {
+        if (fuse_set_signal_handlers(se) != -1) {
+            fuse_session_add_chan(se, ch);
+            fuse_daemonize(foreground);
+            err = (multithreaded) ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+            fuse_remove_signal_handlers(se);
+            fuse_session_remove_chan(ch);
+        }
+        fuse_session_destroy(se);  //** This calls the destroy op which shuts down LIO
+    }
+
+    fuse_unmount(mountpoint, ch);
+    free(mountpoint);
+    fuse_opt_free_args(&args);
+
+    return((err == 0) ? 0 : 1);
+}
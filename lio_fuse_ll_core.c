@@ -0,0 +1,1322 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//***********************************************************************
+// Low-level FUSE frontend.  Requests come in keyed by the LIO inode
+// instead of the full path so the kernel can use readdirplus, splice and
+// its own writeback cache.  LIO itself is path based so the inode table
+// maps each inode the kernel knows about back to its path.
+//***********************************************************************
+
+#define _log_module_index 225
+#include "config.h"
+
+#if defined(HAVE_SYS_XATTR_H)
+#include <sys/xattr.h>
+#elif defined(HAVE_ATTR_XATTR_H)
+#include <attr/xattr.h>
+#endif
+
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include "lio_fuse.h"   //** This needs to come 1st since it sets the FUSE version
+#include <fuse_lowlevel.h>
+#include "exnode.h"
+#include "ex3_compare.h"
+#include "log.h"
+#include "iniparse.h"
+#include "type_malloc.h"
+#include "lio.h"
+#include "string_token.h"
+
+#define ll_lock(lfs)    apr_thread_mutex_lock((lfs)->ino_lock)
+#define ll_unlock(lfs)  apr_thread_mutex_unlock((lfs)->ino_lock)
+
+typedef struct {
+    char *dentry;
+    struct stat stat;
+} lfs_ll_dentry_t;
+
+#define LL_AIO_READ    0
+#define LL_AIO_WRITE   1
+#define LL_AIO_GETATTR 2
+#define LL_AIO_LOOKUP  3
+
+typedef struct {   //** Request completed from the gop callback instead of a FUSE thread
+    fuse_req_t req;
+    lio_fuse_t *lfs;
+    op_generic_t *gop;
+    int type;
+    fuse_ino_t ino;
+    char *path;
+    char *buf;
+    size_t size;
+    char *val[LFS_INODE_KEY_SIZE];
+    int v_size[LFS_INODE_KEY_SIZE];
+} lfs_ll_aio_t;
+
+typedef struct {   //** Open directory.  Entries are kept so the kernel can seek back
+    os_object_iter_t *it;
+    os_regex_table_t *path_regex;
+    char *val[LFS_INODE_KEY_SIZE];
+    int v_size[LFS_INODE_KEY_SIZE];
+    char *path;
+    lfs_ll_dentry_t *de;
+    int n;
+    int max;
+    int finished;
+} lfs_ll_dir_t;
+
+//*************************************************************************
+// lfs_ll_context - Returns the LFS context for the request
+//*************************************************************************
+
+lio_fuse_t *lfs_ll_context(fuse_req_t req)
+{
+    lio_fuse_init_args_t *init_args = (lio_fuse_init_args_t *)fuse_req_userdata(req);
+
+    assert(init_args->lfs != NULL);
+    return(init_args->lfs);
+}
+
+//*************************************************************************
+// _ll_fuse_ino - Maps a LIO inode to the FUSE one.  The only difference is
+//    the root which FUSE wants as FUSE_ROOT_ID.
+//*************************************************************************
+
+fuse_ino_t _ll_fuse_ino(lio_fuse_t *lfs, ex_id_t ino)
+{
+    return((ino == lfs->root_ino) ? FUSE_ROOT_ID : ino);
+}
+
+//*************************************************************************
+// _ll_path - Returns the path for the inode or NULL if it's unknown
+//*************************************************************************
+
+char *_ll_path(lio_fuse_t *lfs, fuse_ino_t ino)
+{
+    lfs_ll_inode_t *inode;
+    ex_id_t lino;
+    char *fname;
+
+    if (ino == FUSE_ROOT_ID) return(strdup("/"));
+
+    lino = ino;
+    fname = NULL;
+    ll_lock(lfs);
+    inode = list_search(lfs->ino_index, (list_key_t *)&lino);
+    if ((inode != NULL) && (inode->fname != NULL)) fname = strdup(inode->fname);
+    ll_unlock(lfs);
+
+    if (fname == NULL) log_printf(1, "Unknown or stale inode! ino=" XIDT "\n", lino);
+    return(fname);
+}
+
+//*************************************************************************
+// _ll_child_path - Returns the path of the entry in the parent directory
+//*************************************************************************
+
+char *_ll_child_path(lio_fuse_t *lfs, fuse_ino_t parent, const char *name)
+{
+    char *dir, *fname;
+    int n;
+
+    dir = _ll_path(lfs, parent);
+    if (dir == NULL) return(NULL);
+
+    n = strlen(dir) + 1 + strlen(name) + 1;
+    type_malloc(fname, char, n);
+    if (strcmp(dir, "/") == 0) {
+        snprintf(fname, n, "/%s", name);
+    } else {
+        snprintf(fname, n, "%s/%s", dir, name);
+    }
+    free(dir);
+
+    return(fname);
+}
+
+//*************************************************************************
+// _ll_inode_ref - Adds a kernel reference to the inode and converts the
+//    stat's inode to what FUSE expects
+//*************************************************************************
+
+void _ll_inode_ref(lio_fuse_t *lfs, const char *fname, struct stat *stat)
+{
+    lfs_ll_inode_t *inode;
+    ex_id_t lino = stat->st_ino;
+
+    if (lino != lfs->root_ino) {
+        ll_lock(lfs);
+        inode = list_search(lfs->ino_index, (list_key_t *)&lino);
+        if (inode == NULL) {
+            type_malloc(inode, lfs_ll_inode_t, 1);
+            inode->ino = lino;
+            inode->fname = strdup(fname);
+            inode->nlookup = 0;
+            list_insert(lfs->ino_index, (list_key_t *)&(inode->ino), (list_data_t *)inode);
+        } else if ((inode->fname == NULL) || (strcmp(inode->fname, fname) != 0)) { //** Hardlink or stale so use the latest name
+            if (inode->fname != NULL) free(inode->fname);
+            inode->fname = strdup(fname);
+        }
+        inode->nlookup++;
+        ll_unlock(lfs);
+    }
+
+    stat->st_ino = _ll_fuse_ino(lfs, lino);
+}
+
+//*************************************************************************
+// _ll_rename_paths - Updates the table after a rename.  Everything under a
+//    renamed directory also has to be moved.  Any inode that lived at the
+//    destination was overwritten so its path is dropped.  The entry itself
+//    stays until the kernel forgets it but it now resolves to ESTALE
+//    instead of the new object.
+//*************************************************************************
+
+void _ll_rename_paths(lio_fuse_t *lfs, const char *oldname, const char *newname)
+{
+    list_iter_t it;
+    ex_id_t *ino;
+    lfs_ll_inode_t *inode;
+    char *fname;
+    int nold, nnew, n;
+
+    nold = strlen(oldname);
+    nnew = strlen(newname);
+
+    ll_lock(lfs);
+    it = list_iter_search(lfs->ino_index, NULL, 0);
+    while (list_next(&it, (list_key_t **)&ino, (list_data_t **)&inode) == 0) {
+        if (inode->fname == NULL) continue;  //** Already stale
+
+        if ((strncmp(inode->fname, oldname, nold) != 0) ||
+            ((inode->fname[nold] != 0) && (inode->fname[nold] != '/'))) {
+            //** Not being moved so see if it was overwritten
+            if (strncmp(inode->fname, newname, nnew) != 0) continue;
+            if ((inode->fname[nnew] != 0) && (inode->fname[nnew] != '/')) continue;
+
+            log_printf(5, "Overwritten by rename ino=" XIDT " fname=%s\n", inode->ino, inode->fname);
+            free(inode->fname);
+            inode->fname = NULL;
+            continue;
+        }
+
+        n = strlen(newname) + strlen(inode->fname + nold) + 1;
+        type_malloc(fname, char, n);
+        snprintf(fname, n, "%s%s", newname, inode->fname + nold);
+        free(inode->fname);
+        inode->fname = fname;
+    }
+    ll_unlock(lfs);
+}
+
+//*************************************************************************
+// _ll_entry - Stats the object and fills in the entry reply.  On success
+//    the inode is referenced as if the kernel had done a lookup.
+//*************************************************************************
+
+int _ll_entry(lio_fuse_t *lfs, const char *fname, struct fuse_entry_param *e)
+{
+    int err;
+
+    memset(e, 0, sizeof(struct fuse_entry_param));
+    err = lfs_stat_real(lfs, fname, &(e->attr));
+    if (err != 0) return(err);
+
+    e->attr_timeout = lfs->attr_timeout;
+    e->entry_timeout = lfs->entry_timeout;
+    _ll_inode_ref(lfs, fname, &(e->attr));
+    e->ino = e->attr.st_ino;
+
+    return(0);
+}
+
+//*************************************************************************
+// _ll_reply_entry - Replies with the entry for the newly created object
+//*************************************************************************
+
+void _ll_reply_entry(fuse_req_t req, lio_fuse_t *lfs, const char *fname, int err)
+{
+    struct fuse_entry_param e;
+
+    if (err == 0) err = _ll_entry(lfs, fname, &e);
+    if (err != 0) {
+        fuse_reply_err(req, -err);
+    } else {
+        fuse_reply_entry(req, &e);
+    }
+}
+
+//*************************************************************************
+// _ll_aio_cb - Replies to FUSE once the request's gop completes.  This runs
+//    in the thread completing the gop so it just formats the reply.
+//*************************************************************************
+
+void _ll_aio_cb(void *arg, int state)
+{
+    lfs_ll_aio_t *aio = (lfs_ll_aio_t *)arg;
+    lio_fuse_t *lfs = aio->lfs;
+    struct fuse_entry_param e;
+    struct stat stat;
+    ex_off_t n;
+    int i;
+
+    log_printf(5, "type=%d ino=" XIDT " state=%d\n", aio->type, (ex_id_t)aio->ino, state);
+
+    switch (aio->type) {
+    case LL_AIO_READ:
+        if (state == OP_STATE_SUCCESS) {
+            n = gop_get_status(aio->gop).error_code;  //** This can include any readahead
+            if (n > (ex_off_t)aio->size) n = aio->size;
+            if (n < 0) n = 0;
+#if FUSE_VERSION >= 29
+            struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(n);
+            bufv.buf[0].mem = aio->buf;
+            fuse_reply_data(aio->req, &bufv, FUSE_BUF_SPLICE_MOVE);
+#else
+            fuse_reply_buf(aio->req, aio->buf, n);
+#endif
+        } else {
+            fuse_reply_err(aio->req, EIO);
+        }
+        break;
+    case LL_AIO_WRITE:
+        if (state == OP_STATE_SUCCESS) {
+            fuse_reply_write(aio->req, aio->size);
+        } else {
+            fuse_reply_err(aio->req, EIO);
+        }
+        break;
+    case LL_AIO_GETATTR:
+    case LL_AIO_LOOKUP:
+        if (state != OP_STATE_SUCCESS) {
+            for (i=0; i<LFS_INODE_KEY_SIZE; i++) {
+                if (aio->val[i] != NULL) free(aio->val[i]);
+            }
+            fuse_reply_err(aio->req, ENOENT);
+            break;
+        }
+
+        _lfs_parse_stat_vals(lfs, aio->path, &stat, aio->val, aio->v_size);
+        if (aio->type == LL_AIO_GETATTR) {
+            stat.st_ino = aio->ino;
+            fuse_reply_attr(aio->req, &stat, lfs->attr_timeout);
+        } else {
+            memset(&e, 0, sizeof(e));
+            e.attr = stat;
+            e.attr_timeout = lfs->attr_timeout;
+            e.entry_timeout = lfs->entry_timeout;
+            _ll_inode_ref(lfs, aio->path, &(e.attr));
+            e.ino = e.attr.st_ino;
+            fuse_reply_entry(aio->req, &e);
+        }
+        break;
+    }
+
+    if (aio->path != NULL) free(aio->path);
+    if (aio->buf != NULL) free(aio->buf);
+    free(aio);
+}
+
+//*************************************************************************
+// _ll_aio_new - Makes a new async request
+//*************************************************************************
+
+lfs_ll_aio_t *_ll_aio_new(fuse_req_t req, lio_fuse_t *lfs, int type, fuse_ino_t ino)
+{
+    lfs_ll_aio_t *aio;
+
+    type_malloc_clear(aio, lfs_ll_aio_t, 1);
+    aio->req = req;
+    aio->lfs = lfs;
+    aio->type = type;
+    aio->ino = ino;
+
+    return(aio);
+}
+
+//*************************************************************************
+// _ll_aio_submit - Starts the request's gop.  The reply is sent from the
+//    callback and the gop is destroyed once it completes.
+//    NOTE: The callback is freed along with the gop.
+//*************************************************************************
+
+void _ll_aio_submit(lfs_ll_aio_t *aio, op_generic_t *gop)
+{
+    callback_t *cb;
+
+    aio->gop = gop;
+    type_malloc_clear(cb, callback_t, 1);
+    callback_set(cb, _ll_aio_cb, aio);
+    gop_callback_append(gop, cb);
+    gop_set_auto_destroy(gop, 1);
+    gop_start_execution(gop);
+}
+
+//*************************************************************************
+// _ll_aio_stat - Fetches the inode attributes asynchronously
+//*************************************************************************
+
+void _ll_aio_stat(fuse_req_t req, lio_fuse_t *lfs, int type, fuse_ino_t ino, char *fname)
+{
+    lfs_ll_aio_t *aio;
+    int i;
+
+    aio = _ll_aio_new(req, lfs, type, ino);
+    aio->path = fname;
+    for (i=0; i<LFS_INODE_KEY_SIZE; i++) aio->v_size[i] = -lfs->lc->max_attr;
+
+    _ll_aio_submit(aio, gop_lio_get_multiple_attrs(lfs->lc, lfs->lc->creds, aio->path, NULL, _lfs_inode_keys, (void **)aio->val, aio->v_size, LFS_INODE_KEY_SIZE));
+}
+
+//*************************************************************************
+// lfs_ll_lookup - Looks up the name in the parent directory
+//*************************************************************************
+
+void lfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+
+    fname = _ll_child_path(lfs, parent, name);
+    log_printf(1, "parent=" XIDT " name=%s fname=%s\n", (ex_id_t)parent, name, fname);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    if (lfs->async_io == 1) {
+        _ll_aio_stat(req, lfs, LL_AIO_LOOKUP, 0, fname);
+        return;
+    }
+
+    _ll_reply_entry(req, lfs, fname, 0);
+    free(fname);
+}
+
+//*************************************************************************
+// lfs_ll_forget - Drops the kernel's references to the inode
+//*************************************************************************
+
+void lfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lfs_ll_inode_t *inode;
+    ex_id_t lino = ino;
+
+    if (ino != FUSE_ROOT_ID) {
+        ll_lock(lfs);
+        inode = list_search(lfs->ino_index, (list_key_t *)&lino);
+        if (inode != NULL) {
+            inode->nlookup = (inode->nlookup > nlookup) ? inode->nlookup - nlookup : 0;
+            if (inode->nlookup == 0) {
+                list_remove(lfs->ino_index, (list_key_t *)&(inode->ino), (list_data_t *)inode);
+                if (inode->fname != NULL) free(inode->fname);
+                free(inode);
+            }
+        }
+        ll_unlock(lfs);
+    }
+
+    fuse_reply_none(req);
+}
+
+//*************************************************************************
+// lfs_ll_getattr - Stats the inode
+//*************************************************************************
+
+void lfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    struct stat stat;
+    char *fname;
+    int err;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    if (lfs->async_io == 1) {
+        _ll_aio_stat(req, lfs, LL_AIO_GETATTR, ino, fname);
+        return;
+    }
+
+    err = lfs_stat_real(lfs, fname, &stat);
+    free(fname);
+    if (err != 0) {
+        fuse_reply_err(req, -err);
+        return;
+    }
+
+    stat.st_ino = ino;
+    fuse_reply_attr(req, &stat, lfs->attr_timeout);
+}
+
+//*************************************************************************
+// lfs_ll_setattr - Changes the size or timestamps.  Everything else is
+//    ignored just like the high-level frontend.
+//*************************************************************************
+
+void lfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    struct timespec tv[2];
+    char *fname;
+    int err;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    err = 0;
+    if (to_set & FUSE_SET_ATTR_SIZE) {
+        if ((fi != NULL) && (fi->fh != 0)) {
+            err = lfs_ftruncate(fname, attr->st_size, fi);
+        } else {
+            err = lfs_truncate_real(lfs, fname, attr->st_size);
+        }
+    }
+
+    if ((err == 0) && (to_set & (FUSE_SET_ATTR_ATIME|FUSE_SET_ATTR_MTIME))) {
+        memset(tv, 0, sizeof(tv));
+        tv[0].tv_sec = attr->st_atime;
+        tv[1].tv_sec = (to_set & FUSE_SET_ATTR_MTIME) ? attr->st_mtime : time(NULL);
+        err = lfs_utimens_real(lfs, fname, tv);
+    }
+
+    free(fname);
+
+    if (err != 0) {
+        fuse_reply_err(req, -err);
+        return;
+    }
+
+    lfs_ll_getattr(req, ino, fi);
+}
+
+//*************************************************************************
+// lfs_ll_readlink - Reads the symlink
+//*************************************************************************
+
+void lfs_ll_readlink(fuse_req_t req, fuse_ino_t ino)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char buf[OS_PATH_MAX+1];
+    char *fname;
+    int err;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    err = lfs_readlink_real(lfs, fname, buf, OS_PATH_MAX);
+    free(fname);
+    if (err != 0) {
+        fuse_reply_err(req, -err);
+    } else {
+        fuse_reply_readlink(req, buf);
+    }
+}
+
+//*************************************************************************
+// lfs_ll_object_create - Makes a new file or directory
+//*************************************************************************
+
+void lfs_ll_object_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, int ftype)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+
+    fname = _ll_child_path(lfs, parent, name);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    _ll_reply_entry(req, lfs, fname, lfs_object_create(lfs, fname, mode, ftype));
+    free(fname);
+}
+
+void lfs_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev)
+{
+    lfs_ll_object_create(req, parent, name, mode, OS_OBJECT_FILE);
+}
+
+void lfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode)
+{
+    lfs_ll_object_create(req, parent, name, mode, OS_OBJECT_DIR);
+}
+
+//*************************************************************************
+// lfs_ll_remove - Removes a file or directory
+//*************************************************************************
+
+void lfs_ll_remove(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+    int err;
+
+    fname = _ll_child_path(lfs, parent, name);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    err = lfs_object_remove(lfs, fname);
+    free(fname);
+    fuse_reply_err(req, -err);
+}
+
+//*************************************************************************
+// lfs_ll_symlink - Makes a symbolic link
+//*************************************************************************
+
+void lfs_ll_symlink(fuse_req_t req, const char *link, fuse_ino_t parent, const char *name)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+
+    fname = _ll_child_path(lfs, parent, name);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    _ll_reply_entry(req, lfs, fname, lfs_symlink_real(lfs, link, fname));
+    free(fname);
+}
+
+//*************************************************************************
+// lfs_ll_link - Creates a hardlink to an existing file
+//*************************************************************************
+
+void lfs_ll_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent, const char *newname)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *oldname, *fname;
+
+    oldname = _ll_path(lfs, ino);
+    fname = _ll_child_path(lfs, newparent, newname);
+    if ((oldname == NULL) || (fname == NULL)) {
+        fuse_reply_err(req, ESTALE);
+    } else {
+        _ll_reply_entry(req, lfs, fname, lfs_hardlink_real(lfs, oldname, fname));
+    }
+
+    if (oldname != NULL) free(oldname);
+    if (fname != NULL) free(fname);
+}
+
+//*************************************************************************
+// lfs_ll_rename - Renames a file or directory
+//*************************************************************************
+
+void lfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent, const char *newname)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *oldpath, *newpath;
+    int err;
+
+    oldpath = _ll_child_path(lfs, parent, name);
+    newpath = _ll_child_path(lfs, newparent, newname);
+    if ((oldpath == NULL) || (newpath == NULL)) {
+        err = -ESTALE;
+    } else {
+        err = lfs_rename_real(lfs, oldpath, newpath);
+        if (err == 0) _ll_rename_paths(lfs, oldpath, newpath);
+    }
+
+    if (oldpath != NULL) free(oldpath);
+    if (newpath != NULL) free(newpath);
+    fuse_reply_err(req, -err);
+}
+
+//*************************************************************************
+// _ll_open_flags - Adjusts the open flags for the kernel writeback cache.
+//    The kernel reads pages in to merge partial writes and handles the
+//    append offsets itself.
+//*************************************************************************
+
+void _ll_open_flags(lio_fuse_t *lfs, struct fuse_file_info *fi)
+{
+    if (lfs->writeback_cache == 0) return;
+
+    if ((fi->flags & O_ACCMODE) == O_WRONLY) fi->flags = (fi->flags & ~O_ACCMODE) | O_RDWR;
+    fi->flags &= ~O_APPEND;
+}
+
+//*************************************************************************
+// lfs_ll_open - Opens a file for I/O
+//*************************************************************************
+
+void lfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+    int err;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    _ll_open_flags(lfs, fi);
+    err = lfs_open_real(lfs, fname, fi);
+    free(fname);
+
+    if (err != 0) {
+        fuse_reply_err(req, -err);
+    } else if (fuse_reply_open(req, fi) == -ENOENT) { //** The open was interrupted so undo it
+        lfs_release_real(lfs, ((lio_fd_t *)fi->fh)->path, fi);
+    }
+}
+
+//*************************************************************************
+// lfs_ll_create - Creates and opens a file
+//*************************************************************************
+
+void lfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    struct fuse_entry_param e;
+    char *fname;
+    int err;
+
+    fname = _ll_child_path(lfs, parent, name);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    err = lfs_object_create(lfs, fname, mode, OS_OBJECT_FILE);
+    if ((err == -EEXIST) && ((fi->flags & O_EXCL) == 0)) err = 0;  //** Lost a race with another create
+    if (err == 0) {
+        _ll_open_flags(lfs, fi);
+        err = lfs_open_real(lfs, fname, fi);
+    }
+
+    if (err == 0) {
+        err = _ll_entry(lfs, fname, &e);
+        if (err != 0) lfs_release_real(lfs, fname, fi);
+    }
+
+    if (err != 0) {
+        fuse_reply_err(req, -err);
+    } else if (fuse_reply_create(req, &e, fi) == -ENOENT) {
+        lfs_release_real(lfs, fname, fi);
+    }
+
+    free(fname);
+}
+
+//*************************************************************************
+// lfs_ll_release - Closes the file
+//*************************************************************************
+
+void lfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lio_fd_t *fd = (lio_fd_t *)fi->fh;
+    char *fname;
+
+    //** Use the current name in case it was renamed while open
+    fname = _ll_path(lfs, ino);
+    fuse_reply_err(req, -lfs_release_real(lfs, (fname) ? fname : fd->path, fi));
+    if (fname != NULL) free(fname);
+}
+
+//*************************************************************************
+// lfs_ll_read - Reads data from the file.  With FUSE 2.9 and later the
+//    buffer is handed back so it can be spliced into the kernel.
+//*************************************************************************
+
+void lfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lio_fd_t *fd = (lio_fd_t *)fi->fh;
+    lfs_ll_aio_t *aio;
+    char *buf;
+    int nbytes;
+
+    if (fd == NULL) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    //** Past the end is handled here so the gop always has work to do
+    if ((lfs->async_io == 1) && (off < segment_size(fd->fh->seg))) {
+        aio = _ll_aio_new(req, lfs, LL_AIO_READ, ino);
+        type_malloc(aio->buf, char, size);
+        aio->size = size;
+        _ll_aio_submit(aio, gop_lio_read(fd, aio->buf, size, off, lfs->rw_hints));
+        return;
+    }
+
+    type_malloc(buf, char, size);
+    nbytes = lfs_read_real(lfs, fd->path, buf, size, off, fi);
+    if (nbytes < 0) {
+        fuse_reply_err(req, EIO);
+    } else {
+#if FUSE_VERSION >= 29
+        struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(nbytes);
+        bufv.buf[0].mem = buf;
+        fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+#else
+        fuse_reply_buf(req, buf, nbytes);
+#endif
+    }
+
+    free(buf);
+}
+
+#if FUSE_VERSION >= 29
+//*************************************************************************
+// lfs_ll_write_buf - Writes data to the file.  The kernel's buffer may be
+//    a pipe if splicing is enabled so it's copied out first.
+//*************************************************************************
+
+void lfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *in_buf, off_t off, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lio_fd_t *fd = (lio_fd_t *)fi->fh;
+    size_t size = fuse_buf_size(in_buf);
+    struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(size);
+    lfs_ll_aio_t *aio;
+    char *buf;
+    ssize_t n;
+    int nbytes;
+
+    if (fd == NULL) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    //** The kernel reuses its buffer once we return so the data is copied
+    //** into one owned by the request.
+    if (lfs->async_io == 1) {
+        aio = _ll_aio_new(req, lfs, LL_AIO_WRITE, ino);
+        type_malloc(aio->buf, char, size);
+        bufv.buf[0].mem = aio->buf;
+        n = fuse_buf_copy(&bufv, in_buf, 0);
+        if (n < 0) {
+            free(aio->buf);
+            free(aio);
+            fuse_reply_err(req, EIO);
+            return;
+        }
+        aio->size = n;
+        _ll_aio_submit(aio, gop_lio_write(fd, aio->buf, n, off, lfs->rw_hints));
+        return;
+    }
+
+    //** If it's already in memory there's nothing to copy
+    if ((in_buf->count == 1) && ((in_buf->buf[0].flags & FUSE_BUF_IS_FD) == 0)) {
+        nbytes = lfs_write_real(lfs, fd->path, (char *)in_buf->buf[0].mem + in_buf->off, size, off, fi);
+    } else {
+        type_malloc(buf, char, size);
+        bufv.buf[0].mem = buf;
+        n = fuse_buf_copy(&bufv, in_buf, 0);
+        nbytes = (n < 0) ? n : lfs_write_real(lfs, fd->path, buf, n, off, fi);
+        free(buf);
+    }
+
+    if (nbytes < 0) {
+        fuse_reply_err(req, EIO);
+    } else {
+        fuse_reply_write(req, nbytes);
+    }
+}
+#endif
+
+//*************************************************************************
+// lfs_ll_write - Writes data to the file
+//*************************************************************************
+
+void lfs_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lio_fd_t *fd = (lio_fd_t *)fi->fh;
+    lfs_ll_aio_t *aio;
+    int nbytes;
+
+    if (fd == NULL) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    if (lfs->async_io == 1) {
+        aio = _ll_aio_new(req, lfs, LL_AIO_WRITE, ino);
+        type_malloc(aio->buf, char, size);
+        memcpy(aio->buf, buf, size);
+        aio->size = size;
+        _ll_aio_submit(aio, gop_lio_write(fd, aio->buf, size, off, lfs->rw_hints));
+        return;
+    }
+
+    nbytes = lfs_write_real(lfs, fd->path, buf, size, off, fi);
+    if (nbytes < 0) {
+        fuse_reply_err(req, EIO);
+    } else {
+        fuse_reply_write(req, nbytes);
+    }
+}
+
+//*************************************************************************
+// lfs_ll_flush/fsync - Flushes any data to backing store
+//*************************************************************************
+
+void lfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    lio_fd_t *fd = (lio_fd_t *)fi->fh;
+
+    fuse_reply_err(req, -lfs_flush((fd) ? fd->path : "", fi));
+}
+
+void lfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lio_fd_t *fd = (lio_fd_t *)fi->fh;
+
+    fuse_reply_err(req, -lfs_fsync_real(lfs, (fd) ? fd->path : "", datasync, fi));
+}
+
+//*************************************************************************
+// lfs_ll_opendir - Opens a directory for listing.  The attributes for
+//    each entry come back with the iterator so no extra stats are needed.
+//*************************************************************************
+
+void lfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lfs_ll_dir_t *dit;
+    char path[OS_PATH_MAX];
+    char *dir, *file;
+    int i, err;
+
+    type_malloc_clear(dit, lfs_ll_dir_t, 1);
+    dit->path = _ll_path(lfs, ino);
+    if (dit->path == NULL) {
+        free(dit);
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    //** Add "." and ".."
+    dit->max = 64;
+    type_malloc_clear(dit->de, lfs_ll_dentry_t, dit->max);
+    dit->de[0].dentry = strdup(".");
+    err = lfs_stat_real(lfs, dit->path, &(dit->de[0].stat));
+    dit->de[0].stat.st_ino = ino;
+    dit->de[1].dentry = strdup("..");
+    if (strcmp(dit->path, "/") != 0) {
+        os_path_split(dit->path, &dir, &file);
+        if (err == 0) err = lfs_stat_real(lfs, dir, &(dit->de[1].stat));
+        dit->de[1].stat.st_ino = _ll_fuse_ino(lfs, dit->de[1].stat.st_ino);
+        free(dir);
+        free(file);
+    } else {
+        dit->de[1].stat = dit->de[0].stat;
+    }
+    dit->n = 2;
+
+    if (err != 0) {
+        free(dit->de[0].dentry);
+        free(dit->de[1].dentry);
+        free(dit->de);
+        free(dit->path);
+        free(dit);
+        fuse_reply_err(req, -err);
+        return;
+    }
+
+    for (i=0; i<LFS_INODE_KEY_SIZE; i++) {
+        dit->v_size[i] = -lfs->lc->max_attr;
+        dit->val[i] = NULL;
+    }
+
+    snprintf(path, OS_PATH_MAX, "%s/*", (strcmp(dit->path, "/") == 0) ? "" : dit->path);
+    dit->path_regex = os_path_glob2regex(path);
+    dit->it = lio_create_object_iter_alist(lfs->lc, lfs->lc->creds, dit->path_regex, NULL, OS_OBJECT_ANY, 0, _lfs_inode_keys, (void **)dit->val, dit->v_size, LFS_INODE_KEY_SIZE);
+
+    fi->fh = (uint64_t)dit;
+    fuse_reply_open(req, fi);
+}
+
+//*************************************************************************
+// _ll_dir_get - Returns the n'th directory entry fetching more from the
+//    iterator as needed.  NULL is returned if past the end.
+//*************************************************************************
+
+lfs_ll_dentry_t *_ll_dir_get(lio_fuse_t *lfs, lfs_ll_dir_t *dit, int n)
+{
+    char *fname;
+    int ftype, prefix_len;
+
+    while ((n >= dit->n) && (dit->finished == 0)) {
+        ftype = lio_next_object(lfs->lc, dit->it, &fname, &prefix_len);
+        if (ftype <= 0) {
+            dit->finished = 1;
+            break;
+        }
+
+        if (dit->n == dit->max) {
+            dit->max = 2*dit->max;
+            type_realloc(dit->de, lfs_ll_dentry_t, dit->max);
+        }
+        dit->de[dit->n].dentry = strdup(fname+prefix_len+1);
+        _lfs_parse_stat_vals(lfs, fname, &(dit->de[dit->n].stat), dit->val, dit->v_size);
+        free(fname);
+        dit->n++;
+    }
+
+    return((n < dit->n) ? &(dit->de[n]) : NULL);
+}
+
+//*************************************************************************
+// _ll_readdir - Fills the reply buffer with entries starting at off
+//*************************************************************************
+
+void _ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi, int plus)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lfs_ll_dir_t *dit = (lfs_ll_dir_t *)fi->fh;
+    lfs_ll_dentry_t *de;
+    struct stat stat;
+    char *buf, *fname;
+    size_t pos, n;
+
+    if (dit == NULL) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    type_malloc(buf, char, size);
+    pos = 0;
+    while ((de = _ll_dir_get(lfs, dit, off)) != NULL) {
+#if FUSE_VERSION >= 29
+        if (plus == 1) {
+            struct fuse_entry_param e;
+            memset(&e, 0, sizeof(e));
+            e.attr = de->stat;
+            e.attr_timeout = lfs->attr_timeout;
+            e.entry_timeout = lfs->entry_timeout;
+            if (off > 1) e.attr.st_ino = _ll_fuse_ino(lfs, e.attr.st_ino);
+            e.ino = e.attr.st_ino;
+            n = fuse_add_direntry_plus(req, buf + pos, size - pos, de->dentry, &e, off+1);
+            if (n > size - pos) break;
+
+            if (off > 1) {  //** Everything but "." and ".." counts as a lookup
+                fname = _ll_child_path(lfs, ino, de->dentry);
+                if (fname != NULL) {
+                    stat = de->stat;
+                    _ll_inode_ref(lfs, fname, &stat);
+                    free(fname);
+                }
+            }
+        } else
+#endif
+        {
+            stat = de->stat;
+            if (off > 1) stat.st_ino = _ll_fuse_ino(lfs, stat.st_ino);
+            n = fuse_add_direntry(req, buf + pos, size - pos, de->dentry, &stat, off+1);
+            if (n > size - pos) break;
+        }
+
+        pos += n;
+        off++;
+    }
+
+    fuse_reply_buf(req, buf, pos);
+    free(buf);
+}
+
+void lfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    _ll_readdir(req, ino, size, off, fi, 0);
+}
+
+#if FUSE_VERSION >= 29
+void lfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    _ll_readdir(req, ino, size, off, fi, 1);
+}
+#endif
+
+//*************************************************************************
+// lfs_ll_releasedir - Closes the directory
+//*************************************************************************
+
+void lfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    lfs_ll_dir_t *dit = (lfs_ll_dir_t *)fi->fh;
+    int i;
+
+    if (dit != NULL) {
+        for (i=0; i<dit->n; i++) free(dit->de[i].dentry);
+        free(dit->de);
+        free(dit->path);
+        lio_destroy_object_iter(lfs->lc, dit->it);
+        os_regex_table_destroy(dit->path_regex);
+        free(dit);
+    }
+
+    fuse_reply_err(req, 0);
+}
+
+//*************************************************************************
+// lfs_ll_statfs - Returns the file system size
+//*************************************************************************
+
+void lfs_ll_statfs(fuse_req_t req, fuse_ino_t ino)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    struct statvfs fs;
+
+    lfs_statfs_real(lfs, "/", &fs);
+    fuse_reply_statfs(req, &fs);
+}
+
+#ifdef HAVE_XATTR
+//*************************************************************************
+// _ll_reply_xattr - Replies to a get/listxattr.  A size of 0 is a query
+//    for the space needed.
+//*************************************************************************
+
+void _ll_reply_xattr(fuse_req_t req, char *buf, size_t size, int n)
+{
+    if (n < 0) {
+        fuse_reply_err(req, -n);
+    } else if (size == 0) {
+        fuse_reply_xattr(req, n);
+    } else if (n > size) {
+        fuse_reply_err(req, ERANGE);
+    } else {
+        fuse_reply_buf(req, buf, n);
+    }
+}
+
+#  if ! defined(__APPLE__)
+void lfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size)
+#  else
+void lfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size, uint32_t position)
+#  endif
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname, *buf;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    type_malloc(buf, char, size+1);
+    _ll_reply_xattr(req, buf, size, lfs_getxattr_real(lfs, fname, name, buf, size));
+    free(buf);
+    free(fname);
+}
+
+void lfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname, *buf;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    type_malloc(buf, char, size+1);
+    _ll_reply_xattr(req, buf, size, lfs_listxattr_real(lfs, fname, buf, size));
+    free(buf);
+    free(fname);
+}
+
+#  if ! defined(__APPLE__)
+void lfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name, const char *value, size_t size, int flags)
+#  else
+void lfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name, const char *value, size_t size, int flags, uint32_t position)
+#  endif
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    fuse_reply_err(req, -lfs_setxattr_real(lfs, fname, name, value, size, flags));
+    free(fname);
+}
+
+void lfs_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name)
+{
+    lio_fuse_t *lfs = lfs_ll_context(req);
+    char *fname;
+
+    fname = _ll_path(lfs, ino);
+    if (fname == NULL) {
+        fuse_reply_err(req, ESTALE);
+        return;
+    }
+
+    fuse_reply_err(req, -lfs_removexattr_real(lfs, fname, name));
+    free(fname);
+}
+#endif //HAVE_XATTR
+
+//*************************************************************************
+// lfs_ll_init - Brings up LIO and the inode table and picks the kernel
+//    features to use
+//*************************************************************************
+
+void lfs_ll_init(void *userdata, struct fuse_conn_info *conn)
+{
+    lio_fuse_init_args_t *init_args = (lio_fuse_init_args_t *)userdata;
+    lio_fuse_t *lfs;
+    struct stat stat;
+    char *section = "lfs";
+
+    lfs = lfs_init_real(conn, init_args->lio_argc, (const char **)init_args->lio_argv, init_args->mount_point);
+    assert(lfs != NULL);
+    init_args->lfs = lfs;
+
+    lfs->attr_timeout = inip_get_double(lfs->lc->ifd, section, "attr_timeout", 1.0);
+    lfs->entry_timeout = inip_get_double(lfs->lc->ifd, section, "entry_timeout", 1.0);
+    lfs->writeback_cache = inip_get_integer(lfs->lc->ifd, section, "writeback_cache", 1);
+    lfs->async_io = inip_get_integer(lfs->lc->ifd, section, "async_io", 1);
+
+    apr_thread_mutex_create(&(lfs->ino_lock), APR_THREAD_MUTEX_DEFAULT, lfs->mpool);
+    lfs->ino_index = create_skiplist_full(10, 0.5, 0, &ex_id_compare, NULL, NULL, NULL);
+
+    //** The root is handed out by FUSE as FUSE_ROOT_ID so map it
+    if (lfs_stat_real(lfs, "/", &stat) == 0) lfs->root_ino = stat.st_ino;
+
+#if FUSE_VERSION >= 29
+    if (conn->capable & FUSE_CAP_SPLICE_READ) conn->want |= FUSE_CAP_SPLICE_READ;
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) conn->want |= FUSE_CAP_SPLICE_WRITE;
+    if (conn->capable & FUSE_CAP_SPLICE_MOVE) conn->want |= FUSE_CAP_SPLICE_MOVE;
+#endif
+    if (conn->capable & FUSE_CAP_ASYNC_READ) conn->want |= FUSE_CAP_ASYNC_READ;
+
+#ifdef FUSE_CAP_WRITEBACK_CACHE
+    if ((lfs->writeback_cache == 1) && (conn->capable & FUSE_CAP_WRITEBACK_CACHE)) {
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    } else {
+        lfs->writeback_cache = 0;
+    }
+#else
+    lfs->writeback_cache = 0;
+#endif
+
+    log_printf(0, "root_ino=" XIDT " writeback_cache=%d async_io=%d want=%x\n", lfs->root_ino, lfs->writeback_cache, lfs->async_io, conn->want);
+}
+
+//*************************************************************************
+// lfs_ll_destroy - Tears down the inode table and the LFS handle
+//*************************************************************************
+
+void lfs_ll_destroy(void *userdata)
+{
+    lio_fuse_init_args_t *init_args = (lio_fuse_init_args_t *)userdata;
+    lio_fuse_t *lfs = init_args->lfs;
+    list_iter_t it;
+    ex_id_t *ino;
+    lfs_ll_inode_t *inode;
+
+    if (lfs == NULL) return;
+
+    it = list_iter_search(lfs->ino_index, NULL, 0);
+    while (list_next(&it, (list_key_t **)&ino, (list_data_t **)&inode) == 0) {
+        if (inode->fname != NULL) free(inode->fname);
+        free(inode);
+    }
+    list_destroy(lfs->ino_index);
+    apr_thread_mutex_destroy(lfs->ino_lock);
+
+    init_args->lfs = NULL;
+    lfs_destroy(lfs);
+}
+
+struct fuse_lowlevel_ops lfs_ll_ops = {
+    .init = lfs_ll_init,
+    .destroy = lfs_ll_destroy,
+    .lookup = lfs_ll_lookup,
+    .forget = lfs_ll_forget,
+    .getattr = lfs_ll_getattr,
+    .setattr = lfs_ll_setattr,
+    .readlink = lfs_ll_readlink,
+    .mknod = lfs_ll_mknod,
+    .mkdir = lfs_ll_mkdir,
+    .unlink = lfs_ll_remove,
+    .rmdir = lfs_ll_remove,
+    .symlink = lfs_ll_symlink,
+    .rename = lfs_ll_rename,
+    .link = lfs_ll_link,
+    .open = lfs_ll_open,
+    .create = lfs_ll_create,
+    .read = lfs_ll_read,
+    .write = lfs_ll_write,
+    .flush = lfs_ll_flush,
+    .release = lfs_ll_release,
+    .fsync = lfs_ll_fsync,
+    .opendir = lfs_ll_opendir,
+    .readdir = lfs_ll_readdir,
+    .releasedir = lfs_ll_releasedir,
+    .statfs = lfs_ll_statfs,
+#ifdef HAVE_XATTR
+    .setxattr = lfs_ll_setxattr,
+    .getxattr = lfs_ll_getxattr,
+    .listxattr = lfs_ll_listxattr,
+    .removexattr = lfs_ll_removexattr,
+#endif
+#if FUSE_VERSION >= 29
+    .write_buf = lfs_ll_write_buf,
+    .readdirplus = lfs_ll_readdirplus,
+#endif
+};
+
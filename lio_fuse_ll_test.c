@@ -0,0 +1,177 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+//***********************************************************************
+// Checks the low-level FUSE frontend's inode table.  No mount is needed
+// since the table is driven directly the same way lookups and renames do.
+//***********************************************************************
+
+#define _log_module_index 225
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "lio_fuse.h"
+#include "log.h"
+#include "type_malloc.h"
+#include "lio.h"
+
+int nfailed = 0;
+
+//*************************************************************************
+// ll_ref - Adds a kernel reference for the path using the given inode
+//*************************************************************************
+
+void ll_ref(lio_fuse_t *lfs, char *fname, ex_id_t ino)
+{
+    struct stat stat;
+
+    memset(&stat, 0, sizeof(stat));
+    stat.st_ino = ino;
+    _ll_inode_ref(lfs, fname, &stat);
+}
+
+//*************************************************************************
+// ll_check - Makes sure the inode resolves to the path.  A NULL path means
+//    the inode should be stale.
+//*************************************************************************
+
+void ll_check(lio_fuse_t *lfs, ex_id_t ino, char *expected)
+{
+    char *fname;
+
+    fname = _ll_path(lfs, ino);
+    if (expected == NULL) {
+        if (fname != NULL) {
+            nfailed++;
+            log_printf(0, "ERROR: ino=" XIDT " should be stale but resolves to %s\n", ino, fname);
+            free(fname);
+        }
+        return;
+    }
+
+    if (fname == NULL) {
+        nfailed++;
+        log_printf(0, "ERROR: ino=" XIDT " is stale! expected=%s\n", ino, expected);
+        return;
+    }
+
+    if (strcmp(fname, expected) != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: ino=" XIDT " resolves to %s expected=%s\n", ino, fname, expected);
+    }
+    free(fname);
+}
+
+//*************************************************************************
+// ll_rename_tests - Renames with and without an existing target
+//*************************************************************************
+
+void ll_rename_tests(lio_fuse_t *lfs)
+{
+    //** Simple rename with a child
+    ll_ref(lfs, "/d1", 10);
+    ll_ref(lfs, "/d1/f1", 11);
+    ll_ref(lfs, "/d10", 12);  //** Shares the prefix but isn't under /d1
+    _ll_rename_paths(lfs, "/d1", "/d2");
+    ll_check(lfs, 10, "/d2");
+    ll_check(lfs, 11, "/d2/f1");
+    ll_check(lfs, 12, "/d10");
+    if (nfailed > 0) return;
+
+    //** Rename over an existing file.  The old target has to go stale
+    ll_ref(lfs, "/a", 20);
+    ll_ref(lfs, "/b", 21);
+    _ll_rename_paths(lfs, "/a", "/b");
+    ll_check(lfs, 20, "/b");
+    ll_check(lfs, 21, NULL);
+    if (nfailed > 0) return;
+
+    //** A new lookup of the stale inode, ie via a hardlink, revives it
+    ll_ref(lfs, "/c", 21);
+    ll_check(lfs, 21, "/c");
+    if (nfailed > 0) return;
+
+    //** Rename a directory over an existing empty one
+    ll_ref(lfs, "/x", 30);
+    ll_ref(lfs, "/x/f", 31);
+    ll_ref(lfs, "/y", 32);
+    _ll_rename_paths(lfs, "/x", "/y");
+    ll_check(lfs, 30, "/y");
+    ll_check(lfs, 31, "/y/f");
+    ll_check(lfs, 32, NULL);
+    if (nfailed > 0) return;
+
+    //** Renaming a hardlink onto another name for the same inode keeps it valid
+    ll_ref(lfs, "/h1", 40);
+    ll_ref(lfs, "/h2", 40);
+    _ll_rename_paths(lfs, "/h2", "/h1");
+    ll_check(lfs, 40, "/h1");
+    if (nfailed > 0) return;
+
+    log_printf(0, "PASSED!\n");
+}
+
+//*************************************************************************
+//*************************************************************************
+
+int main(int argc, char **argv)
+{
+    lio_fuse_t *lfs;
+    list_iter_t it;
+    ex_id_t *ino;
+    lfs_ll_inode_t *inode;
+
+    lio_init(&argc, &argv);
+
+    type_malloc_clear(lfs, lio_fuse_t, 1);
+    apr_pool_create(&(lfs->mpool), NULL);
+    apr_thread_mutex_create(&(lfs->ino_lock), APR_THREAD_MUTEX_DEFAULT, lfs->mpool);
+    lfs->ino_index = create_skiplist_full(10, 0.5, 0, &ex_id_compare, NULL, NULL, NULL);
+    lfs->root_ino = 1;
+
+    log_printf(0, "--------------------------------------------------------------------\n");
+    ll_rename_tests(lfs);
+    log_printf(0, "--------------------------------------------------------------------\n");
+    log_printf(0, "Tasks failed: %d\n", nfailed);
+    log_printf(0, "--------------------------------------------------------------------\n");
+
+    it = list_iter_search(lfs->ino_index, NULL, 0);
+    while (list_next(&it, (list_key_t **)&ino, (list_data_t **)&inode) == 0) {
+        if (inode->fname != NULL) free(inode->fname);
+        free(inode);
+    }
+    list_destroy(lfs->ino_index);
+    apr_thread_mutex_destroy(lfs->ino_lock);
+    apr_pool_destroy(lfs->mpool);
+    free(lfs);
+
+    lio_shutdown();
+
+    return((nfailed > 0) ? 1 : 0);
+}
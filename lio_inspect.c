@@ -32,6 +32,7 @@ http://www.accre.vanderbilt.edu
 #include <assert.h>
 #include "assert_result.h"
 #include <apr_signal.h>
+#include <unistd.h>
 #include "exnode.h"
 #include "log.h"
 #include "iniparse.h"
@@ -84,6 +85,8 @@ typedef struct {
     int  set_fail_size;
     int ftype;
     int pslot;
+    ex_off_t scan_index;  //** Object's position in the traversal.  -1 if the slot is free
+    char *prev_path;      //** Object scanned just before this one.  Used for checkpointing
 } inspect_t;
 
 typedef struct {
@@ -96,6 +99,44 @@ typedef struct {
     ex_off_t used;
 } rid_prep_entry_t;
 
+typedef struct {      //** Per depot copy accounting for the rebalance throttle
+    char *key;            //** Depot key, host:port
+    int active;           //** Copies in progress that read from or write to the depot
+    apr_time_t next_time; //** When the depot's bandwidth budget is free again
+    ex_off_t bytes_in;
+    ex_off_t bytes_out;
+} depot_throttle_t;
+
+typedef struct {      //** Moves between a source/destination RID pair
+    char *src;
+    char *dest;
+    int n;
+    int failed;
+    ex_off_t bytes;
+} rid_pair_t;
+
+typedef struct throttle_waiter_s throttle_waiter_t;
+
+struct throttle_waiter_s {
+    double gain;          //** How much the copies improve the balance
+    int n;
+    depot_throttle_t **depot;
+    throttle_waiter_t *next;
+    throttle_waiter_t *prev;
+};
+
+typedef struct {
+    apr_pool_t *mpool;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    apr_hash_t *rid_depot;   //** RID key -> depot
+    apr_hash_t *depots;      //** Depot key -> depot
+    apr_hash_t *pairs;       //** "src|dest" -> rid_pair_t
+    throttle_waiter_t *waiters;
+    int max_active;          //** Max concurrent copies per depot.  0 disables
+    ex_off_t max_bw;         //** Max bytes/sec per depot.  0 disables
+} rebalance_throttle_t;
+
 static creds_t *creds;
 static int global_whattodo;
 static ex_off_t bufsize;
@@ -115,6 +156,9 @@ apr_pool_t *rid_mpool = NULL;
 apr_thread_mutex_t *lock = NULL;
 list_t *seg_index;
 
+rebalance_throttle_t *throttle = NULL;
+rid_transfer_throttle_t throttle_fn;
+
 int shutdown_now = 0;
 apr_thread_mutex_t *shutdown_lock;
 apr_pool_t *shutdown_mpool;
@@ -727,6 +771,372 @@ void check_pools(Stack_t *pools, apr_thread_mutex_t *lock, int todo_mode, int *f
     }
 }
 
+//*************************************************************************
+// throttle_depot - Returns the depot for the RID.  The throttle lock
+//    must be held.
+//*************************************************************************
+
+depot_throttle_t *throttle_depot(rebalance_throttle_t *t, char *rid_key)
+{
+    depot_throttle_t *d;
+    char *ds_key, *key, *ptr;
+
+    d = apr_hash_get(t->rid_depot, rid_key, APR_HASH_KEY_STRING);
+    if (d != NULL) return(d);
+
+    //** The depot is the host:port part of the ds_key
+    ds_key = rs_get_rid_value(lio_gc->rs, rid_key, "ds_key");
+    if (ds_key == NULL) ds_key = strdup(rid_key);
+    ptr = strchr(ds_key, '/');
+    if (ptr != NULL) *ptr = 0;
+
+    d = apr_hash_get(t->depots, ds_key, APR_HASH_KEY_STRING);
+    if (d == NULL) {
+        d = apr_pcalloc(t->mpool, sizeof(depot_throttle_t));
+        d->key = apr_pstrdup(t->mpool, ds_key);
+        apr_hash_set(t->depots, d->key, APR_HASH_KEY_STRING, d);
+    }
+    free(ds_key);
+
+    key = apr_pstrdup(t->mpool, rid_key);
+    apr_hash_set(t->rid_depot, key, APR_HASH_KEY_STRING, d);
+
+    return(d);
+}
+
+//*************************************************************************
+// throttle_gain - Estimates how much the copies improve the pool balance
+//    using the remaining RID deltas.  Copies off the most overfull RIDs
+//    onto the most underfull ones come first.
+//*************************************************************************
+
+double throttle_gain(int n, char **src, char **dest, ex_off_t *bytes)
+{
+    rid_inspect_tweak_t *ri;
+    double gain;
+    int i;
+
+    gain = 0;
+    if (rid_changes == NULL) {
+        for (i=0; i<n; i++) gain += bytes[i];
+        return(gain);
+    }
+
+    apr_thread_mutex_lock(rid_lock);
+    for (i=0; i<n; i++) {
+        ri = apr_hash_get(rid_changes, src[i], APR_HASH_KEY_STRING);
+        if ((ri != NULL) && (ri->rid->delta < 0)) gain -= ri->rid->delta;
+        ri = apr_hash_get(rid_changes, dest[i], APR_HASH_KEY_STRING);
+        if ((ri != NULL) && (ri->rid->delta > 0)) gain += ri->rid->delta;
+    }
+    apr_thread_mutex_unlock(rid_lock);
+
+    return(gain);
+}
+
+//*************************************************************************
+// throttle_can_start - Returns 1 if the waiter's copies can start.  The
+//    depots must have free copy slots and no higher gain waiter can be
+//    waiting on the same depots.
+//*************************************************************************
+
+int throttle_can_start(rebalance_throttle_t *t, throttle_waiter_t *w)
+{
+    throttle_waiter_t *o;
+    int i, j, need;
+
+    if (t->max_active > 0) {
+        for (i=0; i<w->n; i++) {
+            if (w->depot[i]->active == 0) continue;  //** Always let an idle depot go
+            need = 0;
+            for (j=0; j<w->n; j++) {
+                if (w->depot[j] == w->depot[i]) need++;
+            }
+            if ((w->depot[i]->active + need) > t->max_active) return(0);
+        }
+    }
+
+    for (o = t->waiters; o != NULL; o = o->next) {
+        if ((o == w) || (o->gain <= w->gain)) continue;
+        for (i=0; i<w->n; i++) {
+            for (j=0; j<o->n; j++) {
+                if (w->depot[i] == o->depot[j]) return(0);
+            }
+        }
+    }
+
+    return(1);
+}
+
+//*************************************************************************
+// throttle_acquire - Blocks until the copies can start without exceeding
+//    the per depot copy and bandwidth limits
+//*************************************************************************
+
+void throttle_acquire(void *arg, int n, char **src, char **dest, ex_off_t *bytes)
+{
+    rebalance_throttle_t *t = (rebalance_throttle_t *)arg;
+    depot_throttle_t *depot[2*n];
+    throttle_waiter_t w;
+    apr_time_t start, dt, now;
+    int i;
+
+    w.gain = throttle_gain(n, src, dest, bytes);
+    w.n = 2*n;
+    w.depot = depot;
+    w.prev = NULL;
+
+    apr_thread_mutex_lock(t->lock);
+    for (i=0; i<n; i++) {
+        depot[2*i] = throttle_depot(t, src[i]);
+        depot[2*i+1] = throttle_depot(t, dest[i]);
+    }
+
+    //** Add ourselves to the waiting list and wait our turn
+    w.next = t->waiters;
+    if (t->waiters != NULL) t->waiters->prev = &w;
+    t->waiters = &w;
+    while (throttle_can_start(t, &w) == 0) {
+        apr_thread_cond_wait(t->cond, t->lock);
+    }
+    if (w.prev == NULL) {
+        t->waiters = w.next;
+    } else {
+        w.prev->next = w.next;
+    }
+    if (w.next != NULL) w.next->prev = w.prev;
+
+    //** Reserve the slots and bandwidth
+    start = apr_time_now();
+    for (i=0; i<w.n; i++) {
+        if (depot[i]->next_time > start) start = depot[i]->next_time;
+    }
+    for (i=0; i<n; i++) {
+        depot[2*i]->active++;
+        depot[2*i+1]->active++;
+        depot[2*i]->bytes_out += bytes[i];
+        depot[2*i+1]->bytes_in += bytes[i];
+        if (t->max_bw > 0) {
+            dt = ((double)bytes[i] * APR_USEC_PER_SEC) / t->max_bw;
+            if (depot[2*i]->next_time < start) depot[2*i]->next_time = start;
+            if (depot[2*i+1]->next_time < start) depot[2*i+1]->next_time = start;
+            depot[2*i]->next_time += dt;
+            depot[2*i+1]->next_time += dt;
+        }
+    }
+    apr_thread_cond_broadcast(t->cond);  //** Lower gain waiters may be able to go now
+    apr_thread_mutex_unlock(t->lock);
+
+    now = apr_time_now();
+    if (start > now) {
+        log_printf(5, "Pacing copies n=%d sleep=" TT "\n", n, start-now);
+        apr_sleep(start - now);
+    }
+}
+
+//*************************************************************************
+// throttle_release - Releases the copy slots and records the moves
+//*************************************************************************
+
+void throttle_release(void *arg, int n, char **src, char **dest, ex_off_t *bytes, int *success)
+{
+    rebalance_throttle_t *t = (rebalance_throttle_t *)arg;
+    rid_pair_t *p;
+    char key[2048];
+    int i;
+
+    apr_thread_mutex_lock(t->lock);
+    for (i=0; i<n; i++) {
+        throttle_depot(t, src[i])->active--;
+        throttle_depot(t, dest[i])->active--;
+
+        snprintf(key, sizeof(key), "%s|%s", src[i], dest[i]);
+        p = apr_hash_get(t->pairs, key, APR_HASH_KEY_STRING);
+        if (p == NULL) {
+            p = apr_pcalloc(t->mpool, sizeof(rid_pair_t));
+            p->src = apr_pstrdup(t->mpool, src[i]);
+            p->dest = apr_pstrdup(t->mpool, dest[i]);
+            apr_hash_set(t->pairs, apr_pstrdup(t->mpool, key), APR_HASH_KEY_STRING, p);
+        }
+        p->n++;
+        if (success[i] == 1) {
+            p->bytes += bytes[i];
+        } else {
+            p->failed++;
+        }
+    }
+    apr_thread_cond_broadcast(t->cond);
+    apr_thread_mutex_unlock(t->lock);
+}
+
+//*************************************************************************
+// throttle_create - Creates the rebalance throttle
+//*************************************************************************
+
+rebalance_throttle_t *throttle_create(int max_active, ex_off_t max_bw)
+{
+    rebalance_throttle_t *t;
+
+    type_malloc_clear(t, rebalance_throttle_t, 1);
+    assert_result(apr_pool_create(&(t->mpool), NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(t->lock), APR_THREAD_MUTEX_DEFAULT, t->mpool);
+    apr_thread_cond_create(&(t->cond), t->mpool);
+    t->rid_depot = apr_hash_make(t->mpool);
+    t->depots = apr_hash_make(t->mpool);
+    t->pairs = apr_hash_make(t->mpool);
+    t->max_active = max_active;
+    t->max_bw = max_bw;
+
+    throttle_fn.arg = t;
+    throttle_fn.acquire = throttle_acquire;
+    throttle_fn.release = throttle_release;
+
+    return(t);
+}
+
+//*************************************************************************
+// throttle_destroy - Destroys the rebalance throttle
+//*************************************************************************
+
+void throttle_destroy(rebalance_throttle_t *t)
+{
+    apr_thread_mutex_destroy(t->lock);
+    apr_thread_cond_destroy(t->cond);
+    apr_pool_destroy(t->mpool);
+    free(t);
+}
+
+//*************************************************************************
+// throttle_print - Prints the moves made between each RID pair and the
+//    traffic on each depot
+//*************************************************************************
+
+void throttle_print(info_fd_t *ifd, rebalance_throttle_t *t, int scale)
+{
+    apr_hash_index_t *hi;
+    rid_pair_t *p;
+    depot_throttle_t *d;
+    char pp1[128], pp2[128];
+
+    apr_thread_mutex_lock(t->lock);
+    info_printf(ifd, 0, "------------------ Data moves by RID pair -----------------\n");
+    for (hi = apr_hash_first(NULL, t->pairs); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&p);
+        info_printf(ifd, 0, "MOVE: %s -> %s  copies: %d  failed: %d  bytes: %s\n", p->src, p->dest, p->n, p->failed,
+                    pretty_print_double_with_scale(scale, (double)p->bytes, pp1));
+    }
+    for (hi = apr_hash_first(NULL, t->depots); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&d);
+        info_printf(ifd, 0, "DEPOT: %s  in: %s  out: %s\n", d->key, pretty_print_double_with_scale(scale, (double)d->bytes_in, pp1),
+                    pretty_print_double_with_scale(scale, (double)d->bytes_out, pp2));
+    }
+    info_printf(ifd, 0, "\n");
+    apr_thread_mutex_unlock(t->lock);
+}
+
+//*************************************************************************
+// checkpoint_load - Returns the path of the last object completed from the
+//    checkpoint file or NULL if there isn't one.  The counts from the run
+//    being resumed are also returned.
+//*************************************************************************
+
+char *checkpoint_load(char *fname, int *submitted, int *good, int *bad)
+{
+    inip_file_t *fd;
+    char *etext, *completed;
+    int finished;
+
+    *submitted = *good = *bad = 0;
+
+    if (access(fname, R_OK) != 0) return(NULL);
+
+    fd = inip_read(fname);
+    if (fd == NULL) return(NULL);
+
+    etext = inip_get_string(fd, "checkpoint", "completed_path", "");
+    finished = inip_get_integer(fd, "checkpoint", "finished", 0);
+    if (finished == 0) {
+        *submitted = inip_get_integer(fd, "checkpoint", "submitted", 0);
+        *good = inip_get_integer(fd, "checkpoint", "success", 0);
+        *bad = inip_get_integer(fd, "checkpoint", "fail", 0);
+    }
+    inip_destroy(fd);
+
+    if (finished == 1) {
+        info_printf(lio_ifd, 0, "Checkpoint %s is from a completed run.  Starting from the beginning\n", fname);
+        free(etext);
+        return(NULL);
+    }
+
+    completed = NULL;
+    if (etext[0] != 0) {
+        completed = unescape_text('\\', etext);
+        info_printf(lio_ifd, 0, "Resuming from checkpoint %s.  Skipping everything up to and including %s\n", fname, completed);
+    }
+    free(etext);
+
+    return(completed);
+}
+
+//*************************************************************************
+// checkpoint_save - Stores the checkpoint.  Every object up to and
+//    including completed in the traversal order is finished.  The file is
+//    synced before it replaces the old one so a crash leaves one or the
+//    other.
+//*************************************************************************
+
+void checkpoint_save(char *fname, char *completed, int finished, int submitted, int good, int bad)
+{
+    char tmp[strlen(fname)+5];
+    char *etext;
+    FILE *fd;
+    int err;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fname);
+    fd = fopen(tmp, "w");
+    if (fd == NULL) {
+        info_printf(lio_ifd, 0, "ERROR: Unable to store checkpoint %s\n", fname);
+        return;
+    }
+
+    etext = (completed != NULL) ? escape_text("=#[]", '\\', completed) : NULL;
+    fprintf(fd, "[checkpoint]\n");
+    fprintf(fd, "completed_path=%s\n", ((etext != NULL) ? etext : ""));
+    fprintf(fd, "finished=%d\n", finished);
+    fprintf(fd, "submitted=%d\n", submitted);
+    fprintf(fd, "success=%d\n", good);
+    fprintf(fd, "fail=%d\n", bad);
+    if (etext != NULL) free(etext);
+
+    err = (fflush(fd) != 0) ? 1 : 0;
+    if (fsync(fileno(fd)) != 0) err = 1;
+    if (fclose(fd) != 0) err = 1;
+
+    if ((err != 0) || (rename(tmp, fname) != 0)) {
+        info_printf(lio_ifd, 0, "ERROR: Unable to store checkpoint %s\n", fname);
+        unlink(tmp);
+    }
+}
+
+//*************************************************************************
+// checkpoint_completed - Returns the path of the object before which all
+//    objects in the traversal are finished.  last_path is the most recent
+//    object scanned and is used if nothing is in flight.
+//*************************************************************************
+
+char *checkpoint_completed(inspect_t *w, int n, char *last_path)
+{
+    int i, oldest;
+
+    oldest = -1;
+    for (i=0; i<n; i++) {
+        if (w[i].scan_index < 0) continue;
+        if ((oldest == -1) || (w[i].scan_index < w[oldest].scan_index)) oldest = i;
+    }
+
+    return((oldest == -1) ? last_path : w[oldest].prev_path);
+}
+
 //*************************************************************************
 //  inspect_task
 //*************************************************************************
@@ -823,6 +1233,7 @@ op_status_t inspect_task(void *arg, int id)
     memset(&args, 0, sizeof(args));
     args.rid_lock = rid_lock;
     args.rid_changes = rid_changes;
+    args.throttle = (throttle != NULL) ? &throttle_fn : NULL;
     args.query = query;
     args.qs = new_opque();
     args.qf = new_opque();
@@ -1067,6 +1478,10 @@ int main(int argc, char **argv)
     char *key_rebalance, *value;
     int submitted, good, bad, do_print, print_pools, assume_skip, base, rtol_mode;
     int pool_finished, pool_todo, check_iter, todo_mode;
+    int rmax;
+    ex_off_t rbw, nscanned, obj_index, ck_interval;
+    char *ck_fname, *ck_path, *last_path, *prev_path;
+    int ck_submitted, ck_good, ck_bad;
     int recurse_depth = 10000;
     inspect_t *w;
     char *set_key, *set_success, *set_fail, *select_key, *select_value;
@@ -1079,12 +1494,17 @@ int main(int argc, char **argv)
     check_iter = 100;
     todo_mode = 0;
     from_stdin = 0;
+    rmax = 0;
+    rbw = 0;
+    ck_fname = NULL;
+    ck_interval = 1000;
 
 //printf("argc=%d\n", argc);
     if (argc < 2) {
         printf("\n");
         printf("lio_inspect LIO_COMMON_OPTIONS [-rd recurse_depth] [-b bufsize] [-es] [-eh] [-ew] [-rerr] [-werr] [-h | -hi][-f] [-s] [-r]\n");
-        printf("            [-pc pool.cfg] [-pp iter] [-rebalance [auto|key]] [-q extra_query] [-bl key value] [-p] -o inspect_opt [LIO_PATH_OPTIONS | -]\n");
+        printf("            [-pc pool.cfg] [-pp iter] [-rebalance [auto|key]] [-rmax n] [-rbw bytes/s] [-ck file] [-cki n]\n");
+        printf("            [-q extra_query] [-bl key value] [-p] -o inspect_opt [LIO_PATH_OPTIONS | -]\n");
         lio_print_options(stdout);
         lio_print_path_options(stdout);
         printf("    -rd recurse_depth  - Max recursion depth on directories. Defaults to %d\n", recurse_depth);
@@ -1100,6 +1520,12 @@ int main(int argc, char **argv)
         printf("                       The convergence criteria corresponds to exiting when all negative (n) RIDs have converged or positive (p), or both (np).\n");
         printf("    -rebalance auto|key tol - Don't use a config file instead just rebalance using pools created using the given key and tolerance.\n");
         printf("                         If the key=auto then a single pool is creted using all resources.\n");
+        printf("    -rmax n            - Max number of concurrent data moves reading from or writing to each depot. Default is no limit.\n");
+        printf("                         Moves that improve the pool balance the most are started first.\n");
+        printf("    -rbw bytes/s       - Max data move bandwidth for each depot. Units supported. Default is no limit.\n");
+        printf("    -ck file           - Store progress in the checkpoint file and resume from it if it exists.\n");
+        printf("                         The same paths and selection options must be used when resuming.\n");
+        printf("    -cki n             - How often, in objects scanned, to update the checkpoint. Default is " XOT "\n", ck_interval);
         printf("    -h                 - Print pools using base 1000\n");
         printf("    -hi                - Print print pools using base 1024\n");
         printf("    -q  extra_query    - Extra RS query for data placement. AND-ed with default query\n");
@@ -1308,6 +1734,23 @@ int main(int argc, char **argv)
             i++;
             if (todo_mode == 0) todo_mode = 3;
             log_printf(5, "REBALANCE: key=%s tmode=%d tol=%lf\n", key_rebalance, rtol_mode, rtol);
+        } else if (strcmp(argv[i], "-rmax") == 0) { //** Max concurrent moves per depot
+            i++;
+            rmax = atoi(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-rbw") == 0) { //** Max move bandwidth per depot
+            i++;
+            rbw = string_get_integer(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-ck") == 0) { //** Checkpoint file
+            i++;
+            ck_fname = argv[i];
+            i++;
+        } else if (strcmp(argv[i], "-cki") == 0) { //** Checkpoint interval
+            i++;
+            ck_interval = string_get_integer(argv[i]);
+            if (ck_interval <= 0) ck_interval = 1000;
+            i++;
         } else if (strcmp(argv[i], "-h") == 0) {  //** Use base 10
             i++;
             base = 1000;
@@ -1379,6 +1822,14 @@ int main(int argc, char **argv)
     }
 
 
+    //** Pace the data moves if requested
+    if ((rmax > 0) || (rbw > 0)) throttle = throttle_create(rmax, rbw);
+
+    ck_submitted = ck_good = ck_bad = 0;
+    ck_path = (ck_fname != NULL) ? checkpoint_load(ck_fname, &ck_submitted, &ck_good, &ck_bad) : NULL;
+    last_path = prev_path = NULL;
+    nscanned = 0;
+
     global_whattodo |= option;
     if ((option == INSPECT_QUICK_REPAIR) || (option == INSPECT_SCAN_REPAIR) || (option == INSPECT_FULL_REPAIR)) global_whattodo |= force_repair;
 
@@ -1392,6 +1843,7 @@ int main(int argc, char **argv)
     }
 
     type_malloc_clear(w, inspect_t, lio_parallel_task_count);
+    for (i=0; i<lio_parallel_task_count; i++) w[i].scan_index = -1;
     seg_index = list_create(0, &list_string_compare, NULL, list_simple_free, NULL);
     assert_result(apr_pool_create(&mpool, NULL), APR_SUCCESS);
     apr_thread_mutex_create(&lock, APR_THREAD_MUTEX_DEFAULT, mpool);
@@ -1436,6 +1888,11 @@ int main(int argc, char **argv)
         }
 
         while (((ftype = lio_next_object(tuple.lc, it, &fname, &prefix_len)) > 0) && (pool_todo > 0)) {
+            obj_index = nscanned;
+            nscanned++;
+            prev_path = last_path;  //** Kept with the object if it's submitted for checkpointing
+            last_path = strdup(fname);
+
             gotone = ((acount == 1) && (assume_skip == 0)) ? 1 : 0;
             for (i=1; i<acount; i++) {
                 if ((vals[i] != NULL) && (i != select_index)) {
@@ -1467,6 +1924,14 @@ int main(int argc, char **argv)
                 if (vals[select_index] != NULL) free(vals[select_index]);
             }
 
+            if (ck_path != NULL) {  //** Already handled in the run we're resuming
+                gotone = 0;
+                if (strcmp(fname, ck_path) == 0) {  //** Found where we left off
+                    free(ck_path);
+                    ck_path = NULL;
+                }
+            }
+
             if (gotone == 1) {
                 if (print_pools) {
                     if (dump_iter > 0) {
@@ -1499,6 +1964,9 @@ int main(int argc, char **argv)
                 w[slot].set_success_size = set_success_size;
                 w[slot].set_fail = set_fail;
                 w[slot].set_fail_size = set_fail_size;
+                w[slot].scan_index = obj_index;
+                w[slot].prev_path = prev_path;
+                prev_path = NULL;
 
                 vals[0] = NULL;
                 fname = NULL;
@@ -1519,6 +1987,11 @@ int main(int argc, char **argv)
                         bad++;
                     }
                     slot = gop_get_myid(gop);
+                    w[slot].scan_index = -1;
+                    if (w[slot].prev_path != NULL) {
+                        free(w[slot].prev_path);
+                        w[slot].prev_path = NULL;
+                    }
                     gop_free(gop, OP_DESTROY);
                 } else {
                     slot++;
@@ -1528,6 +2001,16 @@ int main(int argc, char **argv)
                 if (vals[0] != NULL) free(vals[0]);
             }
 
+            if (prev_path != NULL) {
+                free(prev_path);
+                prev_path = NULL;
+            }
+
+            if ((ck_fname != NULL) && ((nscanned % ck_interval) == 0) && (ck_path == NULL)) {
+                checkpoint_save(ck_fname, checkpoint_completed(w, lio_parallel_task_count, last_path), 0,
+                                submitted + ck_submitted, good + ck_good, bad + ck_bad);
+            }
+
             //** Check if we hsould kick out
             apr_thread_mutex_lock(shutdown_lock);
             if (shutdown_now == 1) {
@@ -1566,18 +2049,35 @@ int main(int argc, char **argv)
 
     opque_free(q, OP_DESTROY);
 
+    //** Everything scanned is finished at this point
+    if (ck_path != NULL) {  //** Never found where we left off so leave the checkpoint alone
+        info_printf(lio_ifd, 0, "ERROR: Checkpoint object %s no longer exists!  Remove %s to start over\n", ck_path, ck_fname);
+        free(ck_path);
+        err = 2;
+    } else if (ck_fname != NULL) {
+        checkpoint_save(ck_fname, last_path, ((shutdown_now == 0) ? 1 : 0), submitted + ck_submitted, good + ck_good, bad + ck_bad);
+    }
+    if (last_path != NULL) free(last_path);
+    for (i=0; i<lio_parallel_task_count; i++) {
+        if (w[i].prev_path != NULL) free(w[i].prev_path);
+    }
+
     apr_thread_mutex_destroy(lock);
     apr_pool_destroy(mpool);
     list_destroy(seg_index);
 
     info_printf(lio_ifd, 0, "--------------------------------------------------------------------\n");
     info_printf(lio_ifd, 0, "Submitted: %d   Success: %d   Fail: %d\n", submitted, good, bad);
+    if (ck_submitted > 0) {
+        info_printf(lio_ifd, 0, "Including the resumed run -- Submitted: %d   Success: %d   Fail: %d\n",
+                    submitted + ck_submitted, good + ck_good, bad + ck_bad);
+    }
 
     if (submitted != (good+bad)) {
         info_printf(lio_ifd, 0, "ERROR FAILED self-consistency check! Submitted != Success+Fail\n");
         err = 2;
     }
-    if (bad > 0) {
+    if ((bad + ck_bad) > 0) {
         info_printf(lio_ifd, 0, "ERROR Some files failed inspection!\n");
         err = 1;
     }
@@ -1590,6 +2090,11 @@ int main(int argc, char **argv)
         }
     }
 
+    if (throttle != NULL) {
+        throttle_print(lio_ifd, throttle, base);
+        throttle_destroy(throttle);
+    }
+
     free(w);
 
     if (rid_lock != NULL) apr_thread_mutex_destroy(rid_lock);
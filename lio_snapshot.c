@@ -0,0 +1,194 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+#define _log_module_index 224
+
+#include <assert.h>
+#include "assert_result.h"
+#include "exnode.h"
+#include "log.h"
+#include "iniparse.h"
+#include "type_malloc.h"
+#include "thread_pool.h"
+#include "segment_log.h"
+#include "lio.h"
+
+//*************************************************************************
+// snap_get - Copies the snapshot to a local file
+//*************************************************************************
+
+int snap_get(lio_path_tuple_t *tuple, segment_t *seg, char *fname)
+{
+    ex_off_t bufsize = 20*1024*1024;
+    ex_off_t pos, size, len;
+    char *buffer;
+    tbuffer_t tbuf;
+    ex_iovec_t iov;
+    FILE *fd;
+    int err;
+
+    fd = fopen(fname, "w");
+    if (fd == NULL) {
+        info_printf(lio_ifd, 0, "ERROR opening local file %s\n", fname);
+        return(1);
+    }
+
+    type_malloc(buffer, char, bufsize);
+
+    err = 0;
+    size = segment_size(seg);
+    for (pos=0; pos < size; pos += len) {
+        len = ((size - pos) > bufsize) ? bufsize : size - pos;
+        ex_iovec_single(&iov, pos, len);
+        tbuffer_single(&tbuf, len, buffer);
+        if (gop_sync_exec(segment_read(seg, tuple->lc->da, NULL, 1, &iov, &tbuf, 0, tuple->lc->timeout)) != OP_STATE_SUCCESS) {
+            info_printf(lio_ifd, 0, "ERROR reading snapshot at offset " XOT "\n", pos);
+            err = 1;
+            break;
+        }
+        fwrite(buffer, len, 1, fd);
+    }
+
+    fclose(fd);
+    free(buffer);
+
+    return(err);
+}
+
+//*************************************************************************
+//*************************************************************************
+
+int main(int argc, char **argv)
+{
+    int err, ftype, start_index, i, v_size;
+    char *ex_data, *name, *snap, *local;
+    exnode_t *ex;
+    exnode_exchange_t *exp;
+    segment_t *seg, *sseg;
+    lio_path_tuple_t tuple;
+
+    if (argc < 2) {
+        printf("\n");
+        printf("lio_snapshot LIO_COMMON_OPTIONS [-c name | -g name local_file] file\n");
+        lio_print_options(stdout);
+        printf("    -c name       - Take a snapshot of the file with the given name.  The file must be closed.\n");
+        printf("    -g name local_file - Copy the contents of the snapshot to the local file\n");
+        printf("    file          - File to use.  If no options are given the snapshots are listed\n");
+        return(1);
+    }
+
+    lio_init(&argc, &argv);
+
+    //*** Parse the args
+    snap = NULL;
+    local = NULL;
+    i = 1;
+    if (strcmp(argv[i], "-c") == 0) {
+        i++;
+        snap = argv[i];
+        i++;
+    } else if (strcmp(argv[i], "-g") == 0) {
+        i++;
+        snap = argv[i];
+        i++;
+        local = argv[i];
+        i++;
+    }
+    start_index = i;
+
+    if (argv[start_index] == NULL) {
+        info_printf(lio_ifd, 0, "Missing file!\n");
+        return(2);
+    }
+
+    tuple = lio_path_resolve(lio_gc->auto_translate, argv[start_index]);
+
+    //** Taking a snapshot is handled by the core
+    if ((snap != NULL) && (local == NULL)) {
+        err = gop_sync_exec(gop_lio_snapshot(tuple.lc, tuple.creds, tuple.path, snap));
+        if (err != OP_STATE_SUCCESS) {
+            info_printf(lio_ifd, 0, "ERROR creating snapshot %s for %s\n", snap, tuple.path);
+        }
+        goto finished;
+    }
+
+    //** Check if it exists
+    ftype = lio_exists(tuple.lc, tuple.creds, tuple.path);
+    if ((ftype & OS_OBJECT_FILE) == 0) { //** Doesn't exist or is a dir
+        info_printf(lio_ifd, 1, "ERROR source file(%s) doesn't exist or is a dir ftype=%d!\n", tuple.path, ftype);
+        goto finished;
+    }
+
+    //** Get the exnode
+    v_size = -tuple.lc->max_attr;
+    err = lio_get_attr(tuple.lc, tuple.creds, tuple.path, NULL, "system.exnode", (void **)&ex_data, &v_size);
+    if (err != OP_STATE_SUCCESS) {
+        info_printf(lio_ifd, 0, "Failed retrieving exnode! err=%d path=%s\n", err, tuple.path);
+        goto finished;
+    }
+
+    //** Load it
+    exp = exnode_exchange_text_parse(ex_data);
+    ex = exnode_create();
+    if (exnode_deserialize(ex, exp, tuple.lc->ess) != 0) {
+        info_printf(lio_ifd, 0, "No default segment!  Aborting!\n");
+        goto finished;
+    }
+
+    seg = exnode_get_default(ex);
+    if (seg == NULL) {
+        info_printf(lio_ifd, 0, "No default segment!  Aborting!\n");
+        goto finished;
+    }
+
+    if (snap == NULL) {  //** List the snapshots, newest first
+        sseg = seg;
+        while ((sseg = slog_snapshot_next(sseg, &name)) != NULL) {
+            info_printf(lio_ifd, 0, "%s " XOT "\n", name, segment_size(sseg));
+        }
+    } else {
+        sseg = slog_snapshot_find(seg, snap);
+        if (sseg == NULL) {
+            info_printf(lio_ifd, 0, "ERROR snapshot %s not found!\n", snap);
+        } else {
+            snap_get(&tuple, sseg, local);
+        }
+    }
+
+    exnode_destroy(ex);
+    exnode_exchange_destroy(exp);
+
+finished:
+    lio_path_release(&tuple);
+
+    lio_shutdown();
+
+    return(0);
+}
+
@@ -79,6 +79,10 @@ extern "C" {
 #define OS_VATTR_PREFIX  1   //** Routine is called  whenever the VA prefix matches the attr.  Does not show up in iterators.
  
 #define OS_CREDS_INI_TYPE 0  //** Load creds from file
+
+#define OS_STAT_ATTR "system.stat"  //** Virtual attr returning all the stat fields as a single binary record
+#define OS_STAT_VERSION 1
+#define OS_STAT_RECORD_SIZE 48      //** Fixed part of the record.  Any symlink target follows it
  
 typedef struct os_authz_s os_authz_t;
  
@@ -104,6 +108,17 @@ int n;
 os_regex_entry_t *regex_entry;
 } os_regex_table_t;
  
+typedef struct {     //** Unpacked OS_STAT_ATTR record
+ex_id_t inode;
+ex_off_t size;       //** system.exnode.size
+int64_t modify_data; //** Timestamps in seconds
+int64_t modify_attr;
+int ftype;
+int nlink;
+int link_len;        //** Length of the symlink target or 0
+char *link;          //** Points into the packed record so it is NOT NULL terminated
+} os_stat_t;
+ 
 struct object_service_fn_s;
 typedef struct object_service_fn_s object_service_fn_t;
 typedef struct os_virtual_attr_s os_virtual_attr_t;
@@ -219,6 +234,8 @@ char *os_glob2regex(char *glob);
 os_regex_table_t *os_regex2table(char *regex);
 int os_regex_table_pack(os_regex_table_t *regex, unsigned char *buffer, int bufsize);
 os_regex_table_t *os_regex_table_unpack(unsigned char *buffer, int bufsize, int *used);
+int os_stat_pack(os_stat_t *st, unsigned char *buffer, int bufsize);
+int os_stat_unpack(unsigned char *buffer, int bufsize, os_stat_t *st);
  
  
 struct os_authz_s {
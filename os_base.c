@@ -487,6 +487,87 @@ fail:
     return(NULL);
 }
 
+//***********************************************************************
+// _os_stat_put/_os_stat_get - Fixed width little endian helpers for the
+//    stat record so it's the same no matter who built it
+//***********************************************************************
+
+void _os_stat_put(unsigned char *buffer, int64_t value, int nbytes)
+{
+    int i;
+
+    for (i=0; i<nbytes; i++) {
+        buffer[i] = value & 0xFF;
+        value = value >> 8;
+    }
+}
+
+int64_t _os_stat_get(unsigned char *buffer, int nbytes)
+{
+    uint64_t value;
+    int i;
+
+    value = 0;
+    for (i=nbytes-1; i>=0; i--) {
+        value = (value << 8) | buffer[i];
+    }
+
+    if (nbytes == 4) return((int32_t)value);  //** Sign extend
+    return((int64_t)value);
+}
+
+//***********************************************************************
+// os_stat_pack - Packs the stat fields into the OS_STAT_ATTR record and
+//   returns the number of bytes used or the negative of the space needed
+//***********************************************************************
+
+int os_stat_pack(os_stat_t *st, unsigned char *buffer, int bufsize)
+{
+    int n;
+
+    n = OS_STAT_RECORD_SIZE + st->link_len;
+    if (n > bufsize) return(-n);
+
+    _os_stat_put(&(buffer[0]), OS_STAT_VERSION, 4);
+    _os_stat_put(&(buffer[4]), st->ftype, 4);
+    _os_stat_put(&(buffer[8]), st->nlink, 4);
+    _os_stat_put(&(buffer[12]), st->link_len, 4);
+    _os_stat_put(&(buffer[16]), st->inode, 8);
+    _os_stat_put(&(buffer[24]), st->size, 8);
+    _os_stat_put(&(buffer[32]), st->modify_data, 8);
+    _os_stat_put(&(buffer[40]), st->modify_attr, 8);
+    if (st->link_len > 0) memcpy(&(buffer[OS_STAT_RECORD_SIZE]), st->link, st->link_len);
+
+    return(n);
+}
+
+//***********************************************************************
+// os_stat_unpack - Unpacks an OS_STAT_ATTR record.  The link points into
+//   the buffer.  Returns 0 on success.
+//***********************************************************************
+
+int os_stat_unpack(unsigned char *buffer, int bufsize, os_stat_t *st)
+{
+    if ((buffer == NULL) || (bufsize < OS_STAT_RECORD_SIZE)) return(1);
+    if (_os_stat_get(&(buffer[0]), 4) != OS_STAT_VERSION) {
+        log_printf(1, "Unknown stat record version=" I64T "\n", _os_stat_get(&(buffer[0]), 4));
+        return(1);
+    }
+
+    st->ftype = _os_stat_get(&(buffer[4]), 4);
+    st->nlink = _os_stat_get(&(buffer[8]), 4);
+    st->link_len = _os_stat_get(&(buffer[12]), 4);
+    st->inode = _os_stat_get(&(buffer[16]), 8);
+    st->size = _os_stat_get(&(buffer[24]), 8);
+    st->modify_data = _os_stat_get(&(buffer[32]), 8);
+    st->modify_attr = _os_stat_get(&(buffer[40]), 8);
+
+    if ((st->link_len < 0) || ((OS_STAT_RECORD_SIZE + st->link_len) > bufsize)) return(1);
+    st->link = (st->link_len > 0) ? (char *)&(buffer[OS_STAT_RECORD_SIZE]) : NULL;
+
+    return(0);
+}
+
 //***********************************************************************
 // os_local_filetype - Determines the file type
 //***********************************************************************
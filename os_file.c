@@ -37,6 +37,7 @@ http://www.accre.vanderbilt.edu
 #include <sys/types.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <errno.h>
 #include <assert.h>
 #include "assert_result.h"
 #include <apr_pools.h>
@@ -239,12 +240,11 @@ typedef struct {
     int mode;
 } osfile_fsck_iter_t;
 
-#define osf_obj_lock(lock)  apr_thread_mutex_lock(lock)
-#define osf_obj_unlock(lock)  apr_thread_mutex_unlock(lock)
-
 //void path_split(char *path, char **dir, char **file);
 char *resolve_hardlink(object_service_fn_t *os, char *src_path, int add_prefix);
-apr_thread_mutex_t *osf_retrieve_lock(object_service_fn_t *os, char *path, int *table_slot);
+osf_obj_lock_t *osf_obj_lock(object_service_fn_t *os, char *path, int mode);
+void osf_obj_unlock(object_service_fn_t *os, osf_obj_lock_t *lock);
+int osf_lock_shard_slot(osfile_priv_t *osf, char *path);
 int osf_set_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *ofd, char *attr, void *val, int v_size, int *atype, int append_val);
 int osf_get_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *ofd, char *attr, void **val, int *v_size, int *atype);
 op_generic_t *osfile_set_attr(object_service_fn_t *os, creds_t *creds, os_fd_t *fd, char *key, void *val, int v_size);
@@ -698,28 +698,65 @@ void full_object_unlock(osfile_fd_t *fd)
     apr_thread_mutex_unlock(osf->fobj_lock);
 }
 
+//***********************************************************************
+// osf_multi_lock_paths - Locks a collection of objects.  The locks are
+//     acquired in path order so multiple object ops can't deadlock.
+//     Duplicate paths only get locked once using the strongest mode.
+//***********************************************************************
+
+void osf_multi_lock_paths(object_service_fn_t *os, char **path, int *mode, int n, osf_obj_lock_t **lock_table, int *n_locks)
+{
+    char *p;
+    int i, j, m, n_unique;
+
+    //** Do an insertion sort since there are normally just a few paths
+    for (i=1; i<n; i++) {
+        p = path[i];
+        m = mode[i];
+        for (j=i-1; (j>=0) && (strcmp(path[j], p) > 0); j--) {
+            path[j+1] = path[j];
+            mode[j+1] = mode[j];
+        }
+        path[j+1] = p;
+        mode[j+1] = m;
+    }
+
+    //** Now lock them skipping the dups
+    n_unique = 0;
+    for (i=0; i<n; i=j) {
+        m = mode[i];
+        for (j=i+1; (j<n) && (strcmp(path[i], path[j]) == 0); j++) {
+            if (mode[j] == OSF_LOCK_WRITE) m = OSF_LOCK_WRITE;
+        }
+        lock_table[n_unique] = osf_obj_lock(os, path[i], m);
+        n_unique++;
+    }
+
+    *n_locks = n_unique;
+}
+
 //***********************************************************************
 // osf_multi_lock - Used to resolve/lock a collection of attrs that are
 //     links
 //***********************************************************************
 
-void osf_multi_lock(object_service_fn_t *os, creds_t *creds, osfile_fd_t *fd, char **key, int n_keys, int first_link, apr_thread_mutex_t **lock_table, int *n_locks)
+void osf_multi_lock(object_service_fn_t *os, creds_t *creds, osfile_fd_t *fd, char **key, int n_keys, int first_link, int lock_mode, osf_obj_lock_t **lock_table, int *n_locks)
 {
     osfile_priv_t *osf = (osfile_priv_t *)os->priv;
-    int i, j, n, atype, small_slot, small_index, max_index;
+    int i, j, n, atype;
     int v_size, va_prefix_len;
-    int lock_slot[n_keys+1];
+    char *path[n_keys+1];
+    int mode[n_keys+1];
     char linkname[OS_PATH_MAX];
     char attr_name[OS_PATH_MAX];
     void *val = linkname;
 
     //** Always get the primary
     n = 0;
-    lock_table[n] = osf_retrieve_lock(os, fd->object_name, &lock_slot[n]);
+    path[n] = strdup(fd->object_name);
+    mode[n] = lock_mode;
     n++;
 
-    log_printf(15, "lock_slot[0]=%d fname=%s\n", lock_slot[0], fd->object_name);
-
     //** Set up the va attr_link key for use
     va_prefix_len = (long)osf->attr_link_pva.priv;
     strcpy(attr_name, osf->attr_link_pva.attribute);
@@ -742,40 +779,19 @@ void osf_multi_lock(object_service_fn_t *os, creds_t *creds, osfile_fd_t *fd, ch
             }
             linkname[j] = 0;
 
-            lock_table[n] = osf_retrieve_lock(os, linkname, &lock_slot[n]);
             log_printf(15, "checking n=%d key=%s lname=%s v_size=%dj=%d\n", n, key[i], linkname, v_size, j);
-
-            //** Make sure I don't already have it in the list
-            for (j=0; j<n; j++) {
-                if (lock_slot[n] == lock_slot[j]) {
-                    n--;
-                    break;
-                }
-            }
+            path[n] = strdup(linkname);
+            mode[n] = lock_mode;
             n++;
         }
     }
 
-    log_printf(15, "n_locks=%d\n", n);
+    osf_multi_lock_paths(os, path, mode, n, lock_table, n_locks);
 
-    *n_locks = n;  //** Return the lock count
+    log_printf(15, "n_locks=%d\n", *n_locks);
 
-    //** Now acquire them in order from smallest->largest
-    //** This is done naively cause normally there will be just a few locks
-    max_index = osf->internal_lock_size;
-    for (i=0; i<n; i++) {
-        small_slot = -1;
-        small_index = max_index;
-        for (j=0; j<n; j++) {
-            if (small_index > lock_slot[i]) {
-                small_index = lock_slot[i];
-                small_slot = i;
-            }
-        }
-
-        apr_thread_mutex_lock(lock_table[small_slot]);
-        lock_slot[small_slot] = max_index;
-    }
+    //** The lock keeps its own copy of the path
+    for (i=0; i<n; i++) free(path[i]);
 
     return;
 }
@@ -785,12 +801,12 @@ void osf_multi_lock(object_service_fn_t *os, creds_t *creds, osfile_fd_t *fd, ch
 // osf_multi_unlock - Releases a collection of locks
 //***********************************************************************
 
-void osf_multi_unlock(apr_thread_mutex_t **lock, int n)
+void osf_multi_unlock(object_service_fn_t *os, osf_obj_lock_t **lock, int n)
 {
     int i;
 
-    for (i=0; i<n; i++) {
-        apr_thread_mutex_unlock(lock[i]);
+    for (i=n-1; i>=0; i--) {
+        osf_obj_unlock(os, lock[i]);
     }
 
     return;
@@ -828,6 +844,36 @@ int va_create_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_t *
     return(osf_store_val(buffer, bufsize, val, v_size));
 }
 
+//***********************************************************************
+// osf_readlink - Stores the symlink target relative to the namespace in
+//    link and returns its length.  If not a symlink 0 is returned.
+//***********************************************************************
+
+int osf_readlink(osfile_priv_t *osf, char *fullname, char *buffer, int bufsize, char **link)
+{
+    struct stat s;
+    int n;
+
+    *link = NULL;
+    if (lstat(fullname, &s) != 0) return(0);
+    if (S_ISLNK(s.st_mode) == 0) return(0);
+
+    n = readlink(fullname, buffer, bufsize-1);
+    if (n <= 0) return(0);
+
+    buffer[n] = 0;
+    log_printf(15, "file_path=%s fullname=%s link=%s\n", osf->file_path, fullname, buffer);
+
+    if (buffer[0] == '/') {
+        *link = &(buffer[osf->file_path_len]);
+        n = n - osf->file_path_len;
+    } else {
+        *link = buffer;
+    }
+
+    return(n);
+}
+
 //***********************************************************************
 // va_link_get_attr - Returns the object link information
 //***********************************************************************
@@ -836,41 +882,45 @@ int va_link_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_t *cr
 {
     osfile_fd_t *fd = (osfile_fd_t *)ofd;
     osfile_priv_t *osf = (osfile_priv_t *)fd->os->priv;
-    struct stat s;
     char buffer[32*1024];
-    int err, n, offset;
+    char *link;
+    int n;
     char fullname[OS_PATH_MAX];
 
     *atype = OS_OBJECT_VIRTUAL;
 
     snprintf(fullname, OS_PATH_MAX, "%s%s", osf->file_path, fd->object_name);
 
-    err = lstat(fullname, &s);
-    if (err == 0) {
-        if (S_ISLNK(s.st_mode) == 0) {
-            *v_size = 0;
-            *val = NULL;
-            return(0);
-        }
+    n = osf_readlink(osf, fullname, buffer, sizeof(buffer), &link);
+    if (n > 0) return(osf_store_val(link, n, val, v_size));
 
-        n = readlink(fullname, buffer, sizeof(buffer)-1);
-        if (n > 0) {
-            buffer[n] = 0;
-            log_printf(15, "file_path=%s fullname=%s link=%s\n", osf->file_path, fullname, buffer);
+    if (*v_size < 0) *val = NULL;
+    *v_size = 0;
 
-            if (buffer[0] == '/') {
-                offset = osf->file_path_len;
-                n = n - offset;
-                return(osf_store_val(&(buffer[offset]), n, val, v_size));
-            } else {
-                return(osf_store_val(buffer, n, val, v_size));
-            }
+    return(0);
+}
+
+//***********************************************************************
+// osf_link_count - Returns the link count as seen by the user
+//***********************************************************************
+
+int osf_link_count(char *fullname)
+{
+    struct stat s;
+    int n;
+
+    if (lstat(fullname, &s) == 0) {
+        n = s.st_nlink;
+        if (S_ISDIR(s.st_mode)) {
+            n = n - 1;  //** IF a dir don't count the attribute dir
+        } else if ( n > 1) { //** Normal files should only have 1.  If more then it's a hardlink so tweak it
+            n = n - 1;
         }
+    } else {
+        n = 1;   //** Dangling link probably
     }
 
-    *v_size = 0;
-
-    return(0);
+    return(n);
 }
 
 //***********************************************************************
@@ -881,7 +931,6 @@ int va_link_count_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds
 {
     osfile_fd_t *fd = (osfile_fd_t *)ofd;
     osfile_priv_t *osf = (osfile_priv_t *)fd->os->priv;
-    struct stat s;
     char buffer[32];
     int err, n;
     char fullname[OS_PATH_MAX];
@@ -890,18 +939,7 @@ int va_link_count_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds
 
     snprintf(fullname, OS_PATH_MAX, "%s%s", osf->file_path, fd->object_name);
 
-    err = lstat(fullname, &s);
-    if (err == 0) {
-        n = s.st_nlink;
-        if (S_ISDIR(s.st_mode)) {
-            n = n - 1;  //** IF a dir don't count the attribute dir
-        } else if ( n > 1) { //** Normal files should only have 1.  If more then it's a hardlink so tweak it
-            n = n - 1;
-        }
-    } else {
-        n = 1;   //** Dangling link probably
-    }
-
+    n = osf_link_count(fullname);
     err = snprintf(buffer, 32, "%d", n);
     return(osf_store_val(buffer, err, val, v_size));
 }
@@ -931,6 +969,65 @@ int va_type_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_t *cr
     return(osf_store_val(buffer, bufsize, val, v_size));
 }
 
+//***********************************************************************
+// osf_stat_int_attr - Returns the leading integer of an attribute or 0
+//    if it's missing.  Timestamps are stored as "time|id" so this works
+//    for them as well.
+//***********************************************************************
+
+int64_t osf_stat_int_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *fd, char *key)
+{
+    char buffer[256];
+    void *val = buffer;
+    int64_t n;
+    int v_size, atype;
+
+    n = 0;
+    v_size = sizeof(buffer)-1;
+    if (osf_get_attr(os, creds, fd, key, &val, &v_size, &atype) == 0) {
+        if (v_size > 0) {
+            buffer[v_size] = 0;
+            sscanf(buffer, I64T, &n);
+        }
+    }
+
+    return(n);
+}
+
+//***********************************************************************
+// va_stat_get_attr - Returns all the fields needed for a stat as a single
+//    binary record.  This saves the client fetching and parsing each one.
+//***********************************************************************
+
+int va_stat_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char *key, void **val, int *v_size, int *atype)
+{
+    osfile_fd_t *fd = (osfile_fd_t *)ofd;
+    osfile_priv_t *osf = (osfile_priv_t *)fd->os->priv;
+    os_stat_t st;
+    char lbuf[32*1024];
+    unsigned char record[OS_STAT_RECORD_SIZE + sizeof(lbuf)];
+    char fullname[OS_PATH_MAX];
+    int n;
+
+    *atype = OS_OBJECT_VIRTUAL;
+
+    snprintf(fullname, OS_PATH_MAX, "%s%s", osf->file_path, fd->object_name);
+
+    st.ftype = os_local_filetype(fullname);
+    st.nlink = osf_link_count(fullname);
+    st.link_len = osf_readlink(osf, fullname, lbuf, sizeof(lbuf), &(st.link));
+    st.inode = osf_stat_int_attr(os, creds, fd, "system.inode");
+    st.size = osf_stat_int_attr(os, creds, fd, "system.exnode.size");
+    st.modify_data = osf_stat_int_attr(os, creds, fd, "system.modify_data");
+    st.modify_attr = osf_stat_int_attr(os, creds, fd, "system.modify_attr");
+
+    n = os_stat_pack(&st, record, sizeof(record));
+
+    log_printf(15, "fname=%s ftype=%d ino=" XIDT " size=" XOT " nbytes=%d\n", fd->object_name, st.ftype, st.inode, st.size, n);
+
+    return(osf_store_val(record, n, val, v_size));
+}
+
 //***********************************************************************
 // va_lock_get_attr - Returns the file lock information
 //***********************************************************************
@@ -1301,31 +1398,430 @@ int va_null_get_link_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_
 }
 
 //***********************************************************************
-//  osf_retrieve_lock - Returns the internal lock for the object
+// osf_du_read - Loads the usage aggregate from the directory attr dir.
+//    Returns 0 on success and 1 if the aggregate isn't maintained.
+//***********************************************************************
+
+int osf_du_read(char *attr_dir, osf_du_t *du)
+{
+    FILE *fd;
+    char fname[OS_PATH_MAX];
+    int n;
+
+    snprintf(fname, OS_PATH_MAX, "%s/%s", attr_dir, OSF_DU_ATTR);
+    fd = fopen(fname, "r");
+    if (fd == NULL) return(1);
+
+    n = fscanf(fd, I64T " " I64T " " I64T, &(du->bytes), &(du->files), &(du->dirs));
+    fclose(fd);
+
+    return((n == 3) ? 0 : 1);
+}
+
+//***********************************************************************
+// osf_du_write - Stores the usage aggregate in the directory attr dir.
+//    The new value is written to a temp file and renamed over the old one
+//    so readers and a crash only ever see a complete aggregate.  The temp
+//    name uses FILE_ATTR_PREFIX so attribute listings skip it.
+//***********************************************************************
+
+int osf_du_write(object_service_fn_t *os, char *attr_dir, osf_du_t *du)
+{
+    char buffer[128];
+    char fname[OS_PATH_MAX];
+    char tmpname[OS_PATH_MAX];
+    FILE *fd;
+    int n, err;
+
+    n = snprintf(buffer, sizeof(buffer), I64T " " I64T " " I64T, du->bytes, du->files, du->dirs);
+
+    snprintf(fname, OS_PATH_MAX, "%s/%s", attr_dir, OSF_DU_ATTR);
+    snprintf(tmpname, OS_PATH_MAX, "%s/%s%s.tmp", attr_dir, FILE_ATTR_PREFIX, OSF_DU_ATTR);
+    fd = fopen(tmpname, "w");
+    if (fd == NULL) {
+        log_printf(0, "ERROR opening fname=%s errno=%d\n", tmpname, errno);
+        return(-1);
+    }
+
+    err = (fwrite(buffer, n, 1, fd) == 1) ? 0 : -1;
+    if (fflush(fd) != 0) err = -1;
+    if (fdatasync(fileno(fd)) != 0) err = -1;
+    if (fclose(fd) != 0) err = -1;
+    if (err == 0) err = rename(tmpname, fname);
+
+    if (err != 0) {
+        log_printf(0, "ERROR writing fname=%s errno=%d\n", fname, errno);
+        unlink(tmpname);
+        return(-1);
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// osf_du_file_size - Returns the size stored in the attribute file
+//***********************************************************************
+
+int64_t osf_du_file_size(object_service_fn_t *os, char *fname)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    char buffer[64];
+    void *val;
+    FILE *fd;
+    int64_t size;
+    int v_size, err;
+
+    size = 0;
+    val = buffer;
+    v_size = sizeof(buffer)-1;
+
+    //** Any pending journal change is the current value
+    if (osf->journal != NULL) {
+        err = osfj_get(osf->journal, fname, &val, &v_size);
+        if (err == 0) {
+            buffer[v_size] = 0;
+            sscanf(buffer, I64T, &size);
+            return(size);
+        } else if (err == 1) {
+            return(0);
+        }
+    }
+
+    fd = fopen(fname, "r");
+    if (fd == NULL) return(0);
+    v_size = fread(buffer, 1, sizeof(buffer)-1, fd);
+    fclose(fd);
+    buffer[v_size] = 0;
+    sscanf(buffer, I64T, &size);
+
+    return(size);
+}
+
+//***********************************************************************
+// osf_du_object - Returns the usage the object contributes to its parents
+//    fname is the full path of the object and path is the object name.
+//***********************************************************************
+
+void osf_du_object(object_service_fn_t *os, char *fname, char *path, osf_du_t *du)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    char aname[OS_PATH_MAX];
+    char *attr_dir;
+    int ftype;
+
+    memset(du, 0, sizeof(osf_du_t));
+
+    ftype = os_local_filetype(fname);
+    if (ftype & (OS_OBJECT_FILE|OS_OBJECT_SYMLINK)) {
+        du->files = 1;
+        attr_dir = object_attr_dir(os, osf->file_path, path, OS_OBJECT_FILE);
+        snprintf(aname, OS_PATH_MAX, "%s/%s", attr_dir, OSF_DU_SIZE_KEY);
+        du->bytes = osf_du_file_size(os, aname);
+        free(attr_dir);
+    } else if (ftype & OS_OBJECT_DIR) {
+        attr_dir = object_attr_dir(os, osf->file_path, path, OS_OBJECT_DIR);
+        if (osf_du_read(attr_dir, du) != 0) {
+            log_printf(1, "WARNING: Missing usage aggregate for path=%s.  Run lio_fsck -du to rebuild it.\n", path);
+            memset(du, 0, sizeof(osf_du_t));
+        }
+        free(attr_dir);
+        du->dirs++;
+    }
+}
+
+//***********************************************************************
+// osf_du_lock - Returns the usage lock stripe covering the attribute
+//    directory or file.  Only one stripe is ever held at a time.
+//***********************************************************************
+
+apr_thread_mutex_t *osf_du_lock(osfile_priv_t *osf, char *attr_path)
+{
+    return(osf->du_lock[osf_lock_shard_slot(osf, attr_path)]);
+}
+
+//***********************************************************************
+// osf_du_fd_lock - Returns the usage lock stripe for the directory fd.  The
+//    stripe name matches the one osf_du_update() uses.
+//***********************************************************************
+
+apr_thread_mutex_t *osf_du_fd_lock(osfile_priv_t *osf, osfile_fd_t *fd)
+{
+    char name[OS_PATH_MAX];
+    char attr_dir[OS_PATH_MAX];
+    int n;
+
+    strncpy(name, fd->object_name, OS_PATH_MAX-1);
+    name[OS_PATH_MAX-1] = 0;
+    n = strlen(name);
+    while ((n > 0) && (name[n-1] == '/')) name[--n] = 0;
+    snprintf(attr_dir, OS_PATH_MAX, "%s%s/%s", osf->file_path, name, FILE_ATTR_PREFIX);
+
+    return(osf_du_lock(osf, attr_dir));
+}
+
+//***********************************************************************
+// osf_du_update - Adds the change to every parent directory of the object
+//    that is maintaining a usage aggregate.  Each directory is updated
+//    under its own lock stripe so unrelated trees don't serialize.
+//***********************************************************************
+
+void osf_du_update(object_service_fn_t *os, char *path, int64_t bytes, int64_t files, int64_t dirs)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    char parent[OS_PATH_MAX];
+    char attr_dir[OS_PATH_MAX];
+    apr_thread_mutex_t *lock;
+    osf_du_t du;
+    char *p;
+    int n;
+
+    if ((osf->du_enabled == 0) || ((bytes == 0) && (files == 0) && (dirs == 0))) return;
+
+    strncpy(parent, path, OS_PATH_MAX-1);
+    parent[OS_PATH_MAX-1] = 0;
+    n = strlen(parent);
+    while ((n > 0) && (parent[n-1] == '/')) parent[--n] = 0;
+
+    while ((p = strrchr(parent, '/')) != NULL) {
+        while ((p > parent) && (*(p-1) == '/')) p--;
+        *p = 0;
+
+        snprintf(attr_dir, OS_PATH_MAX, "%s%s/%s", osf->file_path, parent, FILE_ATTR_PREFIX);
+        lock = osf_du_lock(osf, attr_dir);
+        apr_thread_mutex_lock(lock);
+        if (osf_du_read(attr_dir, &du) == 0) {  //** Skip it if it's not tracked here
+            du.bytes += bytes;
+            du.files += files;
+            du.dirs += dirs;
+            osf_du_write(os, attr_dir, &du);
+        }
+        apr_thread_mutex_unlock(lock);
+    }
+
+    log_printf(15, "path=%s bytes=" I64T " files=" I64T " dirs=" I64T "\n", path, bytes, files, dirs);
+}
+
+//***********************************************************************
+// va_du_get_attr - Returns a directory's usage aggregate
 //***********************************************************************
 
-apr_thread_mutex_t *osf_retrieve_lock(object_service_fn_t *os, char *path, int *table_slot)
+int va_du_get_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char *key, void **val, int *v_size, int *atype)
 {
+    osfile_fd_t *fd = (osfile_fd_t *)ofd;
     osfile_priv_t *osf = (osfile_priv_t *)os->priv;
-    chksum_t cs;
-    char  digest[OSF_LOCK_CHKSUM_SIZE];
-    unsigned int *n;
-    int nbytes, slot;
-    tbuffer_t tbuf;
+    apr_thread_mutex_t *lock;
+    char buffer[128];
+    osf_du_t du;
+    int n, err;
+
+    *atype = OS_OBJECT_VIRTUAL;
+
+    if ((fd->ftype & OS_OBJECT_DIR) == 0) {
+        if (*v_size < 0) *val = NULL;
+        *v_size = -1;
+        return(1);
+    }
 
-    nbytes = strlen(path);
-    tbuffer_single(&tbuf, nbytes, path);
-    chksum_set(&cs, OSF_LOCK_CHKSUM);
-    chksum_add(&cs, nbytes, &tbuf, 0);
-    chksum_get(&cs, CHKSUM_DIGEST_BIN, digest);
+    lock = osf_du_fd_lock(osf, fd);
+    apr_thread_mutex_lock(lock);
+    err = osf_du_read(fd->attr_dir, &du);
+    apr_thread_mutex_unlock(lock);
 
-    n = (unsigned int *)(&digest[OSF_LOCK_CHKSUM_SIZE-sizeof(unsigned int)]);
-    slot = (*n) % osf->internal_lock_size;
-    log_printf(15, "n=%u internal_lock_size=%d slot=%d path=!%s!\n", *n, osf->internal_lock_size, slot, path);
-    flush_log();
-    if (table_slot != NULL) *table_slot = slot;
+    if (err != 0) {
+        if (*v_size < 0) *val = NULL;
+        *v_size = -1;
+        return(1);
+    }
 
-    return(osf->internal_lock[slot]);
+    n = snprintf(buffer, sizeof(buffer), I64T " " I64T " " I64T, du.bytes, du.files, du.dirs);
+    return(osf_store_val(buffer, n, val, v_size));
+}
+
+//***********************************************************************
+// va_du_set_attr - Replaces a directory's usage aggregate.  This is only
+//    used by fsck when rebuilding them.
+//***********************************************************************
+
+int va_du_set_attr(os_virtual_attr_t *va, object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char *key, void *val, int v_size, int *atype)
+{
+    osfile_fd_t *fd = (osfile_fd_t *)ofd;
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    char buffer[128];
+    apr_thread_mutex_t *lock;
+    osf_du_t du;
+    int err;
+
+    *atype = OS_OBJECT_VIRTUAL;
+
+    if ((fd->ftype & OS_OBJECT_DIR) == 0) return(-1);
+
+    lock = osf_du_fd_lock(osf, fd);
+
+    if (v_size < 0) {  //** Stop tracking this directory
+        apr_thread_mutex_lock(lock);
+        err = lowlevel_set_attr(os, fd->attr_dir, OSF_DU_ATTR, NULL, -1);
+        apr_thread_mutex_unlock(lock);
+        return(err);
+    }
+
+    if (v_size >= (int)sizeof(buffer)) return(-1);
+    memcpy(buffer, val, v_size);
+    buffer[v_size] = 0;
+    if (sscanf(buffer, I64T " " I64T " " I64T, &(du.bytes), &(du.files), &(du.dirs)) != 3) return(-1);
+
+    apr_thread_mutex_lock(lock);
+    err = osf_du_write(os, fd->attr_dir, &du);
+    apr_thread_mutex_unlock(lock);
+
+    return(err);
+}
+
+//***********************************************************************
+//  osf_lock_shard_slot - Returns the lock table shard for the object
+//***********************************************************************
+
+int osf_lock_shard_slot(osfile_priv_t *osf, char *path)
+{
+    uint32_t h;
+    int i;
+
+    h = 2166136261U;   //** FNV-1a
+    for (i=0; path[i] != 0; i++) {
+        h ^= (unsigned char)path[i];
+        h *= 16777619U;
+    }
+
+    return(h % osf->internal_lock_size);
+}
+
+//***********************************************************************
+//  osf_obj_lock - Acquires the object's lock in either OSF_LOCK_READ or
+//     OSF_LOCK_WRITE mode.  The lock is created if needed.  Waiting
+//     writers block new readers so they don't starve.
+//***********************************************************************
+
+osf_obj_lock_t *osf_obj_lock(object_service_fn_t *os, char *path, int mode)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    osf_lock_shard_t *shard;
+    osf_obj_lock_t *ol;
+    int slot;
+
+    slot = osf_lock_shard_slot(osf, path);
+    shard = &(osf->lock_shard[slot]);
+
+    apr_thread_mutex_lock(shard->lock);
+    ol = apr_hash_get(shard->table, path, APR_HASH_KEY_STRING);
+    if (ol == NULL) {  //** 1st user so make it
+        if (shard->free_list != NULL) {
+            ol = shard->free_list;
+            shard->free_list = ol->next;
+        } else {
+            type_malloc(ol, osf_obj_lock_t, 1);
+            apr_thread_cond_create(&(ol->cond), shard->mpool);
+        }
+        ol->path = strdup(path);
+        ol->shard = slot;
+        ol->ref_count = 0;
+        ol->readers = 0;
+        ol->writer = 0;
+        ol->writers_waiting = 0;
+        ol->next = NULL;
+        apr_hash_set(shard->table, ol->path, APR_HASH_KEY_STRING, ol);
+    }
+
+    ol->ref_count++;
+    if (mode == OSF_LOCK_WRITE) {
+        ol->writers_waiting++;
+        while ((ol->writer == 1) || (ol->readers > 0)) {
+            apr_thread_cond_wait(ol->cond, shard->lock);
+        }
+        ol->writers_waiting--;
+        ol->writer = 1;
+    } else {
+        while ((ol->writer == 1) || (ol->writers_waiting > 0)) {
+            apr_thread_cond_wait(ol->cond, shard->lock);
+        }
+        ol->readers++;
+    }
+    apr_thread_mutex_unlock(shard->lock);
+
+    log_printf(15, "slot=%d mode=%d path=!%s!\n", slot, mode, path);
+
+    return(ol);
+}
+
+//***********************************************************************
+//  osf_obj_unlock - Releases the object lock and recycles it if unused
+//***********************************************************************
+
+void osf_obj_unlock(object_service_fn_t *os, osf_obj_lock_t *ol)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    osf_lock_shard_t *shard = &(osf->lock_shard[ol->shard]);
+
+    apr_thread_mutex_lock(shard->lock);
+
+    if (ol->writer == 1) {  //** Writers are exclusive so it has to be us
+        ol->writer = 0;
+    } else {
+        ol->readers--;
+    }
+
+    ol->ref_count--;
+    if (ol->ref_count == 0) {  //** No one else is using it so recycle it
+        apr_hash_set(shard->table, ol->path, APR_HASH_KEY_STRING, NULL);
+        free(ol->path);
+        ol->path = NULL;
+        ol->next = shard->free_list;
+        shard->free_list = ol;
+    } else if ((ol->writer == 0) && (ol->readers == 0)) {
+        apr_thread_cond_broadcast(ol->cond);
+    }
+
+    apr_thread_mutex_unlock(shard->lock);
+}
+
+//***********************************************************************
+//  osf_lock_shards_create - Makes the object lock table
+//***********************************************************************
+
+void osf_lock_shards_create(osfile_priv_t *osf)
+{
+    osf_lock_shard_t *shard;
+    int i;
+
+    type_malloc_clear(osf->lock_shard, osf_lock_shard_t, osf->internal_lock_size);
+    for (i=0; i<osf->internal_lock_size; i++) {
+        shard = &(osf->lock_shard[i]);
+        assert_result(apr_pool_create(&(shard->mpool), NULL), APR_SUCCESS);
+        apr_thread_mutex_create(&(shard->lock), APR_THREAD_MUTEX_DEFAULT, shard->mpool);
+        shard->table = apr_hash_make(shard->mpool);
+    }
+}
+
+//***********************************************************************
+//  osf_lock_shards_destroy - Destroys the object lock table
+//***********************************************************************
+
+void osf_lock_shards_destroy(osfile_priv_t *osf)
+{
+    osf_lock_shard_t *shard;
+    osf_obj_lock_t *ol;
+    int i;
+
+    for (i=0; i<osf->internal_lock_size; i++) {
+        shard = &(osf->lock_shard[i]);
+        if (apr_hash_count(shard->table) > 0) log_printf(0, "ERROR: slot=%d has %d locks still in use!\n", i, apr_hash_count(shard->table));
+        while ((ol = shard->free_list) != NULL) {
+            shard->free_list = ol->next;
+            apr_thread_cond_destroy(ol->cond);
+            free(ol);
+        }
+        apr_thread_mutex_destroy(shard->lock);
+        apr_pool_destroy(shard->mpool);
+    }
+    free(osf->lock_shard);
 }
 
 
@@ -1708,6 +2204,40 @@ void osfile_free_mk_mv_rm(void *arg)
     free(op);
 }
 
+//***********************************************************************
+// osf_journal_release - Releases any journaled attributes for the objects
+//    before they're removed, moved or linked.  This covers the object itself,
+//    which holds a directory's attributes, and a file's attribute directory.
+//    fname2 can be NULL.
+//***********************************************************************
+
+void osf_journal_release(object_service_fn_t *os, char *fname1, char *fname2, int discard)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    char fattr[2][OS_PATH_MAX];
+    char *paths[4];
+    char *fname[2];
+    char *dir, *base;
+    int i, n;
+
+    if (osf->journal == NULL) return;
+
+    fname[0] = fname1;
+    fname[1] = fname2;
+    n = 0;
+    for (i=0; i<2; i++) {
+        if (fname[i] == NULL) continue;
+        os_path_split(fname[i], &dir, &base);
+        snprintf(fattr[i], OS_PATH_MAX, "%s/%s/%s%s", dir, FILE_ATTR_PREFIX, FILE_ATTR_PREFIX, base);
+        free(dir);
+        free(base);
+        paths[n++] = fname[i];
+        paths[n++] = fattr[i];
+    }
+
+    osfj_release_paths(osf->journal, paths, n, discard);
+}
+
 //***********************************************************************
 // osf_object_remove - Removes the current dir or object (non-recursive)
 //***********************************************************************
@@ -1722,6 +2252,10 @@ int osf_object_remove(object_service_fn_t *os, char *path)
     ftype = os_local_filetype(path);
     hard_inode = NULL;
 
+    //** Pending attribute changes go away with the object.  A hardlink's attrs
+    //** are shared with the other links so those have to be kept.
+    osf_journal_release(os, path, NULL, ((ftype & OS_OBJECT_HARDLINK) ? 0 : 1));
+
     log_printf(15, "ftype=%d path=%s\n", ftype, path);
 
     //** It's a file or the proxy is missing so assume it's a file and remoe the FA directoory
@@ -1774,13 +2308,15 @@ op_status_t osfile_remove_object_fn(void *arg, int id)
     int ftype;
     char fname[OS_PATH_MAX];
     op_status_t status;
-    apr_thread_mutex_t *lock;
+    osf_obj_lock_t *lock;
+    osf_du_t du;
 
     if (osaz_object_remove(osf->osaz, op->creds, op->src_path) == 0)  return(op_failure_status);
     snprintf(fname, OS_PATH_MAX, "%s%s", osf->file_path, op->src_path);
 
-    lock = osf_retrieve_lock(op->os, op->src_path, NULL);
-    osf_obj_lock(lock);
+    lock = osf_obj_lock(op->os, op->src_path, OSF_LOCK_WRITE);
+
+    if (osf->du_enabled == 1) osf_du_object(op->os, fname, op->src_path, &du);
 
 
     ftype = os_local_filetype(fname);
@@ -1789,7 +2325,7 @@ op_status_t osfile_remove_object_fn(void *arg, int id)
         status = (osf_object_remove(op->os, fname) == 0) ? op_success_status : op_failure_status;
     } else {  //** Directory so make sure it's empty
         if (osf_is_empty(fname) != 1) {
-            osf_obj_unlock(lock);
+            osf_obj_unlock(op->os, lock);
             log_printf(15, "Oops! trying to remove a non-empty dir: fname=%s ftype=%d\n", op->src_path, ftype);
             return(op_failure_status);
         }
@@ -1800,7 +2336,11 @@ op_status_t osfile_remove_object_fn(void *arg, int id)
         status = (osf_object_remove(op->os, fname) == 0) ? op_success_status : op_failure_status;
     }
 
-    osf_obj_unlock(lock);
+    osf_obj_unlock(op->os, lock);
+
+    if ((osf->du_enabled == 1) && (status.op_status == OP_STATE_SUCCESS)) {
+        osf_du_update(op->os, op->src_path, -du.bytes, -du.files, -du.dirs);
+    }
 
     return(status);
 }
@@ -2123,7 +2663,8 @@ op_status_t osfile_create_object_fn(void *arg, int id)
     char *dir, *base;
     char fname[OS_PATH_MAX];
     char fattr[OS_PATH_MAX];
-    apr_thread_mutex_t *lock;
+    osf_obj_lock_t *lock;
+    osf_du_t du;
 
     if (osaz_object_create(osf->osaz, op->creds, op->src_path) == 0)  return(op_failure_status);
 
@@ -2131,13 +2672,12 @@ op_status_t osfile_create_object_fn(void *arg, int id)
 
     log_printf(0, "base=%s src=%s fname=%s\n", osf->file_path, op->src_path, fname);
 
-    lock = osf_retrieve_lock(op->os, op->src_path, NULL);
-    osf_obj_lock(lock);
+    lock = osf_obj_lock(op->os, op->src_path, OSF_LOCK_WRITE);
 
     if (op->type == OS_OBJECT_FILE) {
         fd = fopen(fname, "w");
         if (fd == NULL) {
-            osf_obj_unlock(lock);
+            osf_obj_unlock(op->os, lock);
             return(op_failure_status);
         }
 
@@ -2152,7 +2692,7 @@ op_status_t osfile_create_object_fn(void *arg, int id)
             safe_remove(op->os, fname);
             free(dir);
             free(base);
-            osf_obj_unlock(lock);
+            osf_obj_unlock(op->os, lock);
             return(op_failure_status);
         } else {
             free(dir);
@@ -2161,7 +2701,7 @@ op_status_t osfile_create_object_fn(void *arg, int id)
     } else {  //** Directory object
         err = mkdir(fname, DIR_PERMS);
         if (err != 0) {
-            osf_obj_unlock(lock);
+            osf_obj_unlock(op->os, lock);
             return(op_failure_status);
         }
 
@@ -2171,12 +2711,24 @@ op_status_t osfile_create_object_fn(void *arg, int id)
         if (err != 0) {
             log_printf(0, "Error creating object attr directory! path=%s full=%s\n", op->src_path, fattr);
             safe_remove(op->os, fname);
-            osf_obj_unlock(lock);
+            osf_obj_unlock(op->os, lock);
             return(op_failure_status);
         }
+
+        //** It's empty so the usage aggregate starts out correct
+        if (osf->du_enabled == 1) {
+            memset(&du, 0, sizeof(du));
+            osf_du_write(op->os, fattr, &du);
+        }
     }
 
-    osf_obj_unlock(lock);
+    osf_obj_unlock(op->os, lock);
+
+    if (op->type == OS_OBJECT_FILE) {
+        osf_du_update(op->os, op->src_path, 0, 1, 0);
+    } else {
+        osf_du_update(op->os, op->src_path, 0, 0, 1);
+    }
 
     return(op_success_status);
 }
@@ -2296,12 +2848,15 @@ int osf_file2hardlink(object_service_fn_t *os, char *src_path)
 
     //** IF the src is a symlink we need to get that
 
+    //** The attr dir is about to move so flush any pending journal changes for it
+    snprintf(sfname, OS_PATH_MAX, "%s%s", osf->file_path, src_path);
+    osf_journal_release(os, sfname, NULL, 0);
+
     //** Pick a hardlink location
     id = 0;
     get_random(&id, sizeof(id));
     slot = atomic_counter(&(osf->hardlink_count)) % osf->hardlink_dir_size;
     snprintf(fullname, OS_PATH_MAX, "%s/%d/" XIDT, osf->hardlink_path, slot, id);
-    snprintf(sfname, OS_PATH_MAX, "%s%s", osf->file_path, src_path);
     hattr = object_attr_dir(os, "", fullname, OS_OBJECT_FILE);
     sattr = object_attr_dir(os, osf->file_path, src_path, OS_OBJECT_FILE);
 
@@ -2399,12 +2954,14 @@ op_status_t osfile_hardlink_object_fn(void *arg, int id)
     osfile_mk_mv_rm_t *op = (osfile_mk_mv_rm_t *)arg;
     osfile_priv_t *osf = (osfile_priv_t *)op->os->priv;
     op_status_t status;
-    apr_thread_mutex_t *hlock, *dlock;
-    int hslot, dslot;
+    osf_obj_lock_t *lock_table[2];
+    char *lock_path[2];
+    int lock_mode[2], n_locks;
     char sfname[OS_PATH_MAX];
     char dfname[OS_PATH_MAX];
     char *sapath, *dapath, *link_path;
     int err, ftype;
+    osf_du_t du;
 
     if ((osaz_object_access(osf->osaz, op->creds, op->src_path, OS_MODE_READ_IMMEDIATE) == 0) ||
             (osaz_object_create(osf->osaz, op->creds, op->dest_path) == 0)) return(op_failure_status);
@@ -2439,17 +2996,10 @@ op_status_t osfile_hardlink_object_fn(void *arg, int id)
     snprintf(dfname, OS_PATH_MAX, "%s%s", osf->file_path, op->dest_path);
 
     //** Acquire the locks
-    hlock = osf_retrieve_lock(op->os, link_path, &hslot);
-    dlock = osf_retrieve_lock(op->os, dfname, &dslot);
-    if (hslot < dslot) {
-        apr_thread_mutex_lock(hlock);
-        apr_thread_mutex_lock(dlock);
-    } else if (hslot > dslot) {
-        apr_thread_mutex_lock(dlock);
-        apr_thread_mutex_lock(hlock);
-    } else {
-        apr_thread_mutex_lock(hlock);
-    }
+    lock_path[0] = link_path;
+    lock_path[1] = dfname;
+    lock_mode[0] = lock_mode[1] = OSF_LOCK_WRITE;
+    osf_multi_lock_paths(op->os, lock_path, lock_mode, 2, lock_table, &n_locks);
 
     //** Hardlink the proxy
     if (link(link_path, dfname) != 0) {
@@ -2472,11 +3022,15 @@ op_status_t osfile_hardlink_object_fn(void *arg, int id)
     free(sapath);
     free(dapath);
 
+    if (osf->du_enabled == 1) {
+        osf_du_object(op->os, dfname, op->dest_path, &du);
+        osf_du_update(op->os, op->dest_path, du.bytes, du.files, du.dirs);
+    }
+
     status = op_success_status;
 
 finished:
-    apr_thread_mutex_unlock(hlock);
-    if (hslot != dslot)  apr_thread_mutex_unlock(dlock);
+    osf_multi_unlock(op->os, lock_table, n_locks);
     free(link_path);
 
     return(status);
@@ -2520,7 +3074,8 @@ op_status_t osfile_move_object_fn(void *arg, int id)
     char sfname[OS_PATH_MAX];
     char dfname[OS_PATH_MAX];
     char *dir, *base;
-    int err;
+    int err, dtype, moved, dremoved;
+    osf_du_t du, ddu;
 
     if ((osaz_object_remove(osf->osaz, op->creds, op->src_path) == 0) ||
             (osaz_object_create(osf->osaz, op->creds, op->dest_path) == 0)) return(op_failure_status);
@@ -2528,9 +3083,29 @@ op_status_t osfile_move_object_fn(void *arg, int id)
     snprintf(sfname, OS_PATH_MAX, "%s%s", osf->file_path, op->src_path);
     snprintf(dfname, OS_PATH_MAX, "%s%s", osf->file_path, op->dest_path);
 
+    osf_journal_release(op->os, sfname, dfname, 0);
+
     ftype = os_local_filetype(sfname);
+    dtype = os_local_filetype(dfname);
+    if (osf->du_enabled == 1) {
+        osf_du_object(op->os, sfname, op->src_path, &du);
+        memset(&ddu, 0, sizeof(ddu));
+        if ((dtype != 0) && (ftype != 0) && (strcmp(sfname, dfname) != 0)) osf_du_object(op->os, dfname, op->dest_path, &ddu);  //** Being overwritten
+    }
+
+    //** A file being replaced has to go first.  Otherwise its attribute directory blocks the attr move
+    //** and a hardlink would leave its reference count behind.
+    dremoved = 0;
+    if ((ftype & (OS_OBJECT_FILE|OS_OBJECT_SYMLINK)) && (dtype & (OS_OBJECT_FILE|OS_OBJECT_SYMLINK)) && (strcmp(sfname, dfname) != 0)) {
+        if (osf_object_remove(op->os, dfname) != 0) {
+            log_printf(0, "ERROR: Unable to remove the destination being overwritten dfname=%s\n", dfname);
+            return(op_failure_status);
+        }
+        dremoved = 1;
+    }
 
     err = rename(sfname, dfname);  //** Move the file/dir
+    moved = (err == 0) ? 1 : 0;
     log_printf(15, "sfname=%s dfname=%s err=%d\n", sfname, dfname, err);
 
     if ((ftype & (OS_OBJECT_FILE|OS_OBJECT_SYMLINK)) && (err==0)) { //** File move
@@ -2549,6 +3124,16 @@ op_status_t osfile_move_object_fn(void *arg, int id)
         err = rename(sfname, dfname);
     }
 
+    //** Shift the usage from the old parents to the new ones dropping anything that was overwritten
+    if (osf->du_enabled == 1) {
+        if (moved == 1) {
+            osf_du_update(op->os, op->src_path, -du.bytes, -du.files, -du.dirs);
+            osf_du_update(op->os, op->dest_path, du.bytes - ddu.bytes, du.files - ddu.files, du.dirs - ddu.dirs);
+        } else if (dremoved == 1) {
+            osf_du_update(op->os, op->dest_path, -ddu.bytes, -ddu.files, -ddu.dirs);
+        }
+    }
+
     return((err == 0) ? op_success_status : op_failure_status);
 }
 
@@ -2581,30 +3166,23 @@ op_status_t osfile_copy_multiple_attrs_fn(void *arg, int id)
     osfile_copy_attr_t *op = (osfile_copy_attr_t *)arg;
     osfile_priv_t *osf = (osfile_priv_t *)op->os->priv;
     op_status_t status;
-    apr_thread_mutex_t *lock_src, *lock_dest;
+    osf_obj_lock_t *lock_table[2];
+    char *lock_path[2];
+    int lock_mode[2], n_locks;
     void *val;
     int v_size;
-    int slot_src, slot_dest;
     int i, err, atype;
 
-    //** Lock the individual objects based on their slot positions to avoid a deadlock
-    lock_src = osf_retrieve_lock(op->os, op->fd_src->object_name, &slot_src);
-    lock_dest = osf_retrieve_lock(op->os, op->fd_dest->object_name, &slot_dest);
-    if (slot_src < slot_dest) {
-        osf_obj_lock(lock_src);
-        osf_obj_lock(lock_dest);
-    } else if (slot_src > slot_dest) {
-        osf_obj_lock(lock_dest);
-        osf_obj_lock(lock_src);
-    } else {  //** Same slot so only need to lock one
-        lock_dest = NULL;
-        osf_obj_lock(lock_src);
-    }
-
+    //** Lock the objects.  The source only needs to be shared unless it's also the dest
+    lock_path[0] = op->fd_src->object_name;
+    lock_mode[0] = OSF_LOCK_READ;
+    lock_path[1] = op->fd_dest->object_name;
+    lock_mode[1] = OSF_LOCK_WRITE;
+    osf_multi_lock_paths(op->os, lock_path, lock_mode, 2, lock_table, &n_locks);
 
     status = op_success_status;
     for (i=0; i<op->n; i++) {
-        log_printf(15, " fsrc=%s (lock=%d) fdest=%s (lock=%d)   n=%d key_src[0]=%s key_dest[0]=%s\n", op->fd_src->object_name, slot_src, op->fd_dest->object_name, slot_dest, op->n, op->key_src[i], op->key_dest[i]);
+        log_printf(15, " fsrc=%s fdest=%s   n=%d key_src[0]=%s key_dest[0]=%s\n", op->fd_src->object_name, op->fd_dest->object_name, op->n, op->key_src[i], op->key_dest[i]);
         if ((osaz_attr_access(osf->osaz, op->creds, op->fd_src->object_name, op->key_src[i], OS_MODE_READ_IMMEDIATE) == 1) &&
                 (osaz_attr_create(osf->osaz, op->creds, op->fd_dest->object_name, op->key_dest[i]) == 1)) {
 
@@ -2628,8 +3206,7 @@ op_status_t osfile_copy_multiple_attrs_fn(void *arg, int id)
         }
     }
 
-    osf_obj_unlock(lock_src);
-    if (lock_dest != NULL) osf_obj_unlock(lock_dest);
+    osf_multi_unlock(op->os, lock_table, n_locks);
 
     log_printf(15, "fsrc=%s fdest=%s err=%d\n", op->fd_src->object_name, op->fd_dest->object_name, status.error_code);
 
@@ -2691,17 +3268,28 @@ op_status_t osfile_symlink_multiple_attrs_fn(void *arg, int id)
     osfile_copy_attr_t *op = (osfile_copy_attr_t *)arg;
     osfile_priv_t *osf = (osfile_priv_t *)op->os->priv;
     op_status_t status;
-    apr_thread_mutex_t *lock_dest;
+    osf_obj_lock_t *lock_dest;
     char sfname[OS_PATH_MAX];
     char dfname[OS_PATH_MAX];
-    int slot_dest;
+    char **paths;
     int i, err;
 
-    //** Lock the source
-    lock_dest = osf_retrieve_lock(op->os, op->fd_dest->object_name, &slot_dest);
-    osf_obj_lock(lock_dest);
+    //** Lock the destination
+    lock_dest = osf_obj_lock(op->os, op->fd_dest->object_name, OSF_LOCK_WRITE);
+
+    //** A pending change to a destination key would otherwise land on the link
+    if (osf->journal != NULL) {
+        type_malloc(paths, char *, op->n);
+        for (i=0; i<op->n; i++) {
+            type_malloc(paths[i], char, OS_PATH_MAX);
+            snprintf(paths[i], OS_PATH_MAX, "%s/%s", op->fd_dest->attr_dir, op->key_dest[i]);
+        }
+        osfj_release_paths(osf->journal, paths, op->n, 0);
+        for (i=0; i<op->n; i++) free(paths[i]);
+        free(paths);
+    }
 
-    log_printf(15, " fsrc[0]=%s fdest=%s (lock=%d)   n=%d key_src[0]=%s key_dest[0]=%s\n", op->src_path[0], op->fd_dest->object_name, slot_dest, op->n, op->key_src[0], op->key_dest[0]);
+    log_printf(15, " fsrc[0]=%s fdest=%s   n=%d key_src[0]=%s key_dest[0]=%s\n", op->src_path[0], op->fd_dest->object_name, op->n, op->key_src[0], op->key_dest[0]);
 
     status = op_success_status;
     for (i=0; i<op->n; i++) {
@@ -2725,7 +3313,7 @@ op_status_t osfile_symlink_multiple_attrs_fn(void *arg, int id)
         }
     }
 
-    osf_obj_unlock(lock_dest);
+    osf_obj_unlock(op->os, lock_dest);
 
     log_printf(15, "fsrc[0]=%s fdest=%s err=%d\n", op->src_path[0], op->fd_dest->object_name, status.error_code);
 
@@ -2790,13 +3378,25 @@ op_status_t osfile_move_multiple_attrs_fn(void *arg, int id)
     osfile_priv_t *osf = (osfile_priv_t *)op->os->priv;
     os_virtual_attr_t *va1, *va2;
     op_status_t status;
-    apr_thread_mutex_t *lock;
+    osf_obj_lock_t *lock;
     int i, err;
     char sfname[OS_PATH_MAX];
     char dfname[OS_PATH_MAX];
+    char **paths;
+
+    lock = osf_obj_lock(op->os, op->fd->object_name, OSF_LOCK_WRITE);
 
-    lock = osf_retrieve_lock(op->os, op->fd->object_name, NULL);
-    osf_obj_lock(lock);
+    //** Both the old and new keys have to be settled in the tree before the rename
+    if (osf->journal != NULL) {
+        type_malloc(paths, char *, 2*op->n);
+        for (i=0; i<2*op->n; i++) {
+            type_malloc(paths[i], char, OS_PATH_MAX);
+            snprintf(paths[i], OS_PATH_MAX, "%s/%s", op->fd->attr_dir, ((i < op->n) ? op->key_old[i] : op->key_new[i - op->n]));
+        }
+        osfj_release_paths(osf->journal, paths, 2*op->n, 0);
+        for (i=0; i<2*op->n; i++) free(paths[i]);
+        free(paths);
+    }
 
     status = op_success_status;
     for (i=0; i<op->n; i++) {
@@ -2824,7 +3424,7 @@ op_status_t osfile_move_multiple_attrs_fn(void *arg, int id)
         }
     }
 
-    osf_obj_unlock(lock);
+    osf_obj_unlock(op->os, lock);
 
     return(status);
 }
@@ -2926,6 +3526,15 @@ int osf_get_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *ofd, char
         return(1);
     }
 
+    //** Pending journal changes take precedence over what's on disk
+    if (osf->journal != NULL) {
+        n = osfj_get(osf->journal, fname, val, v_size);
+        if (n != OSFJ_NOT_FOUND) {
+            *atype = (n == 0) ? OS_OBJECT_FILE : 0;
+            return(n);
+        }
+    }
+
     *atype = os_local_filetype(fname);
 
     fd = fopen(fname, "r");
@@ -2970,12 +3579,12 @@ op_status_t osf_get_ma_links(void *arg, int id, int first_link)
 {
     osfile_attr_op_t *op = (osfile_attr_op_t *)arg;
     int err, i, atype, n_locks;
-    apr_thread_mutex_t *lock_table[op->n+1];
+    osf_obj_lock_t *lock_table[op->n+1];
     op_status_t status;
 
     status = op_success_status;
 
-    osf_multi_lock(op->os, op->creds, op->fd, op->key, op->n, first_link, lock_table, &n_locks);
+    osf_multi_lock(op->os, op->creds, op->fd, op->key, op->n, first_link, OSF_LOCK_READ, lock_table, &n_locks);
 
     err = 0;
     for (i=0; i<op->n; i++) {
@@ -2987,7 +3596,7 @@ op_status_t osf_get_ma_links(void *arg, int id, int first_link)
         }
     }
 
-    osf_multi_unlock(lock_table, n_locks);
+    osf_multi_unlock(op->os, lock_table, n_locks);
 
     if (err != 0) status = op_failure_status;
 
@@ -3006,12 +3615,11 @@ op_status_t osf_get_multiple_attr_fn(void *arg, int id)
 //  char timestamp[OS_PATH_MAX];
     int err, i, j, atype, v_start[op->n], oops;
     op_status_t status;
-    apr_thread_mutex_t *lock;
+    osf_obj_lock_t *lock;
 
     status = op_success_status;
 
-    lock = osf_retrieve_lock(op->os, op->fd->object_name, NULL);
-    osf_obj_lock(lock);
+    lock = osf_obj_lock(op->os, op->fd->object_name, OSF_LOCK_READ);
 
     err = 0;
     oops = 0;
@@ -3034,7 +3642,7 @@ op_status_t osf_get_multiple_attr_fn(void *arg, int id)
 //  snprintf(timestamp, OS_PATH_MAX, TT "|%s|%s", date, cred_get_id(op->creds), op->fd->id);
 //  lowlevel_set_attr(op->os, op->fd->attr_dir, "system.access", timestamp, strlen(timestamp));
 
-    osf_obj_unlock(lock);
+    osf_obj_unlock(op->os, lock);
 
     if (oops == 1) { //** Multi object locking required
         for (j=0; j<=i; j++) {  //** Clean up any data allocated
@@ -3129,6 +3737,31 @@ int lowlevel_set_attr(object_service_fn_t *os, char *attr_dir, char *attr, void
     return(0);
 }
 
+//***********************************************************************
+// osf_store_attr - Stores the attribute value in the resolved attr file
+//***********************************************************************
+
+int osf_store_attr(object_service_fn_t *os, char *fname, char *attr, void *val, int v_size, int append_val)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    FILE *fd;
+
+    if (osf->journal != NULL) {
+        if (append_val == 0) return((osfj_set(osf->journal, fname, val, v_size) == 0) ? 0 : -1);
+        osfj_sync(osf->journal, NULL);  //** Appends go straight to disk so flush anything pending first
+    }
+
+    fd = fopen(fname, (append_val == 0) ? "w" : "a");
+
+//log_printf(15, "fd=%p\n", fd);
+    if (fd == NULL) log_printf(0, "ERROR opening attr file attr=%s val=%s v_size=%d fname=%s append=%d\n", attr, val, v_size, fname, append_val);
+    if (fd == NULL) return(-1);
+    if (v_size > 0) fwrite(val, v_size, 1, fd);
+    fclose(fd);
+
+    return(0);
+}
+
 //***********************************************************************
 // osf_set_attr - Sets the attribute given the name and base directory
 //***********************************************************************
@@ -3137,11 +3770,13 @@ int osf_set_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *ofd, char
 {
     osfile_priv_t *osf = (osfile_priv_t *)os->priv;
     list_iter_t it;
-    FILE *fd;
     os_virtual_attr_t *va;
-    int n;
+    apr_thread_mutex_t *lock = NULL;
+    int n, is_size;
+    int64_t old_size, new_size;
     char *ca;
     char fname[OS_PATH_MAX];
+    char buffer[64];
 
     if (osaz_attr_access(osf->osaz, creds, ofd->object_name, attr, OS_MODE_READ_BLOCKING) == 0) {
         *atype = 0;
@@ -3165,11 +3800,32 @@ int osf_set_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *ofd, char
         return(va->set(va, os, creds, ofd, attr, val, v_size, atype));
     }
 
+    //** Size changes are folded into the parent directory usage aggregates
+    is_size = ((osf->du_enabled == 1) && (ofd->ftype & OS_OBJECT_FILE) && (strcmp(attr, OSF_DU_SIZE_KEY) == 0)) ? 1 : 0;
+
     if (v_size < 0) { //** Want to remove the attribute
         if (osaz_attr_remove(osf->osaz, creds, ofd->object_name, attr) == 0) return(1);
         snprintf(fname, OS_PATH_MAX, "%s/%s", ofd->attr_dir, attr);
-        safe_remove(os, fname);
-        return(0);
+        if ((osf->journal != NULL) && ((os_local_filetype(fname) & OS_OBJECT_SYMLINK) == 0)) {
+            //** Key the journal on the same resolved name osf_get_attr() looks up
+            osf_resolve_attr_path(os, fname, ofd->object_name, attr, ofd->ftype, atype, 20);
+        }
+        if (is_size == 1) {
+            lock = osf_du_lock(osf, fname);
+            apr_thread_mutex_lock(lock);
+        }
+        old_size = (is_size == 1) ? osf_du_file_size(os, fname) : 0;
+        if ((osf->journal != NULL) && ((os_local_filetype(fname) & OS_OBJECT_SYMLINK) == 0)) {
+            n = (osfj_set(osf->journal, fname, NULL, -1) == 0) ? 0 : -1;
+        } else {
+            safe_remove(os, fname);
+            n = 0;
+        }
+        if (is_size == 1) {
+            apr_thread_mutex_unlock(lock);
+            if (n == 0) osf_du_update(os, ofd->object_name, -old_size, 0, 0);
+        }
+        return(n);
     }
 
     n = osf_resolve_attr_path(os, fname, ofd->object_name, attr, ofd->ftype, atype, 20);
@@ -3183,15 +3839,26 @@ int osf_set_attr(object_service_fn_t *os, creds_t *creds, osfile_fd_t *ofd, char
         if (osaz_attr_create(osf->osaz, creds, ofd->object_name, attr) == 0) return(1);
     }
 
-    fd = fopen(fname, (append_val == 0) ? "w" : "a");
+    if (is_size == 1) {
+        new_size = 0;
+        n = (v_size < (int)sizeof(buffer)) ? v_size : sizeof(buffer)-1;
+        memcpy(buffer, val, n);
+        buffer[n] = 0;
+        sscanf(buffer, I64T, &new_size);
 
-//log_printf(15, "fd=%p\n", fd);
-    if (fd == NULL) log_printf(0, "ERROR opening attr file attr=%s val=%s v_size=%d fname=%s append=%d\n", attr, val, v_size, fname, append_val);
-    if (fd == NULL) return(-1);
-    if (v_size > 0) fwrite(val, v_size, 1, fd);
-    fclose(fd);
+        //** The caller's object lock doesn't cover a size reached through a hardlink or
+        //** the timestamp VA so the read and store are done under the size file's stripe
+        lock = osf_du_lock(osf, fname);
+        apr_thread_mutex_lock(lock);
+        old_size = osf_du_file_size(os, fname);
+        n = osf_store_attr(os, fname, attr, val, v_size, append_val);
+        apr_thread_mutex_unlock(lock);
 
-    return(0);
+        if (n == 0) osf_du_update(os, ofd->object_name, new_size - old_size, 0, 0);
+        return(n);
+    }
+
+    return(osf_store_attr(os, fname, attr, val, v_size, append_val));
 }
 
 //***********************************************************************
@@ -3204,19 +3871,19 @@ op_status_t osf_set_multiple_attr_fn(void *arg, int id)
 {
     osfile_attr_op_t *op = (osfile_attr_op_t *)arg;
     int err, i, atype, n_locks;
-    apr_thread_mutex_t *lock_table[op->n+1];
+    osf_obj_lock_t *lock_table[op->n+1];
     op_status_t status;
 
     status = op_success_status;
 
-    osf_multi_lock(op->os, op->creds, op->fd, op->key, op->n, 0, lock_table, &n_locks);
+    osf_multi_lock(op->os, op->creds, op->fd, op->key, op->n, 0, OSF_LOCK_WRITE, lock_table, &n_locks);
 
     err = 0;
     for (i=0; i<op->n; i++) {
         err += osf_set_attr(op->os, op->creds, op->fd, op->key[i], op->val[i], op->v_size[i], &atype, 0);
     }
 
-    osf_multi_unlock(lock_table, n_locks);
+    osf_multi_unlock(op->os, lock_table, n_locks);
 
     if (err != 0) status = op_failure_status;
 
@@ -3361,6 +4028,8 @@ os_attr_iter_t *osfile_create_attr_iter(object_service_fn_t *os, creds_t *creds,
     assert_result(apr_pool_create(&(it->mpool), NULL), APR_SUCCESS);
     it->va_index = apr_hash_first(it->mpool, osf->vattr_hash);
 
+    if (osf->journal != NULL) osfj_sync(osf->journal, fd->attr_dir);  //** The dir listing needs to reflect any pending changes
+
     it->d = opendir(fd->attr_dir);
     it->regex = attr;
     it->fd = fd;
@@ -3633,7 +4302,7 @@ op_status_t osfile_open_object_fn(void *arg, int id)
     int ftype, err;
     char fname[OS_PATH_MAX];
     op_status_t status;
-    apr_thread_mutex_t *lock;
+    osf_obj_lock_t *lock;
 
     log_printf(15, "Attempting to open object=%s\n", op->path);
 
@@ -3648,8 +4317,7 @@ op_status_t osfile_open_object_fn(void *arg, int id)
         return(op_failure_status);
     }
 
-    lock = osf_retrieve_lock(op->os, op->path, NULL);
-    osf_obj_lock(lock);
+    lock = osf_obj_lock(op->os, op->path, OSF_LOCK_READ);
 
     type_malloc(fd, osfile_fd_t, 1);
 
@@ -3662,7 +4330,7 @@ op_status_t osfile_open_object_fn(void *arg, int id)
 
     fd->attr_dir = object_attr_dir(op->os, osf->file_path, fd->object_name, ftype);
 
-    osf_obj_unlock(lock);
+    osf_obj_unlock(op->os, lock);
 
     err = full_object_lock(fd, op->max_wait);  //** Do a full lock if needed
     log_printf(15, "full_object_lock=%d fname=%s uuid=" LU " max_wait=%d\n", err, fd->object_name, fd->uuid, op->max_wait);
@@ -4123,18 +4791,19 @@ void osfile_destroy(object_service_fn_t *os)
     osfile_priv_t *osf = (osfile_priv_t *)os->priv;
     int i;
 
+    if (osf->journal != NULL) osfj_destroy(osf->journal);
+
 //  i = atomic_dec(_path_parse_count);
 //  if (i <= 0) {
 //     apr_thread_mutex_destroy(_path_parse_lock);
 //     apr_pool_destroy(_path_parse_pool);
 //  }
 
-    for (i=0; i<osf->internal_lock_size; i++) {
-        apr_thread_mutex_destroy(osf->internal_lock[i]);
-    }
-    free(osf->internal_lock);
+    osf_lock_shards_destroy(osf);
 
     apr_thread_mutex_destroy(osf->fobj_lock);
+    for (i=0; i<osf->internal_lock_size; i++) apr_thread_mutex_destroy(osf->du_lock[i]);
+    free(osf->du_lock);
     list_destroy(osf->fobj_table);
     list_destroy(osf->vattr_prefix);
     destroy_pigeon_coop(osf->fobj_pc);
@@ -4164,8 +4833,9 @@ object_service_fn_t *object_service_file_create(service_manager_t *ess, inip_fil
     osaz_create_t *osaz_create;
     authn_create_t *authn_create;
     char pname[OS_PATH_MAX], pattr[OS_PATH_MAX];
-    char *atype, *asection;
-    int i, err;
+    char *atype, *asection, *journal;
+    int i, err, journal_max_pending, journal_apply_interval;
+    osf_du_t du;
 
     if (section == NULL) section = "osfile";
 
@@ -4225,10 +4895,7 @@ object_service_fn_t *object_service_file_create(service_manager_t *ess, inip_fil
     osf->hardlink_path_len = strlen(osf->hardlink_path);
 
     apr_pool_create(&osf->mpool, NULL);
-    type_malloc_clear(osf->internal_lock, apr_thread_mutex_t *, osf->internal_lock_size);
-    for (i=0; i<osf->internal_lock_size; i++) {
-        apr_thread_mutex_create(&(osf->internal_lock[i]), APR_THREAD_MUTEX_DEFAULT, osf->mpool);
-    }
+    osf_lock_shards_create(osf);
 
     apr_thread_mutex_create(&(osf->fobj_lock), APR_THREAD_MUTEX_DEFAULT, osf->mpool);
     osf->fobj_table = list_create(0, &list_string_compare, list_string_dup, list_simple_free, list_no_data_free);
@@ -4282,6 +4949,13 @@ object_service_fn_t *object_service_file_create(service_manager_t *ess, inip_fil
     apr_hash_set(osf->vattr_hash, osf->type_va.attribute, APR_HASH_KEY_STRING, &(osf->type_va));
     apr_hash_set(osf->vattr_hash, osf->create_va.attribute, APR_HASH_KEY_STRING, &(osf->create_va));
 
+    osf->stat_va.attribute = OS_STAT_ATTR;
+    osf->stat_va.priv = os;
+    osf->stat_va.get = va_stat_get_attr;
+    osf->stat_va.set = va_null_set_attr;
+    osf->stat_va.get_link = va_null_get_link_attr;
+    apr_hash_set(osf->vattr_hash, osf->stat_va.attribute, APR_HASH_KEY_STRING, &(osf->stat_va));
+
     osf->attr_link_pva.attribute = "os.attr_link";
     osf->attr_link_pva.priv = (void *)(long)strlen(osf->attr_link_pva.attribute);
     osf->attr_link_pva.get = va_attr_link_get_attr;
@@ -4311,6 +4985,16 @@ object_service_fn_t *object_service_file_create(service_manager_t *ess, inip_fil
     list_insert(osf->vattr_prefix, osf->timestamp_pva.attribute, &(osf->timestamp_pva));
     list_insert(osf->vattr_prefix, osf->append_pva.attribute, &(osf->append_pva));
 
+    osf->du_va.attribute = OSF_DU_ATTR;
+    osf->du_va.priv = os;
+    osf->du_va.get = va_du_get_attr;
+    osf->du_va.set = va_du_set_attr;
+    osf->du_va.get_link = va_null_get_link_attr;
+    apr_hash_set(osf->vattr_hash, osf->du_va.attribute, APR_HASH_KEY_STRING, &(osf->du_va));
+    type_malloc(osf->du_lock, apr_thread_mutex_t *, osf->internal_lock_size);
+    for (i=0; i<osf->internal_lock_size; i++) apr_thread_mutex_create(&(osf->du_lock[i]), APR_THREAD_MUTEX_DEFAULT, osf->mpool);
+    osf->du_enabled = (fd == NULL) ? 1 : inip_get_integer(fd, section, "usage_aggregates", 1);
+
     os->type = OS_TYPE_FILE;
 
     os->destroy_service = osfile_destroy;
@@ -4387,6 +5071,25 @@ object_service_fn_t *object_service_file_create(service_manager_t *ess, inip_fil
 
     }
 
+    //** A new namespace can start tracking usage right away.  Otherwise it's up to fsck to build them
+    if ((osf->du_enabled == 1) && (osf_du_read(pname, &du) != 0) && (osf_is_dir_empty(osf->file_path) == 1)) {
+        memset(&du, 0, sizeof(du));
+        osf_du_write(os, pname, &du);
+    }
+
+    //** Journaled mode.  Any leftover journal is replayed before we start taking requests
+    journal = (fd == NULL) ? NULL : inip_get_string(fd, section, "journal", NULL);
+    if (journal != NULL) {
+        journal_max_pending = inip_get_integer(fd, section, "journal_max_pending", 10000);
+        journal_apply_interval = inip_get_integer(fd, section, "journal_apply_interval_ms", 1000);
+        osf->journal = osfj_create(os, journal, journal_max_pending, journal_apply_interval);
+        free(journal);
+        if (osf->journal == NULL) {
+            os_destroy(os);
+            return(NULL);
+        }
+    }
+
     //** Make sure al lthe hardlink dirs exist
     for (i=0; i<osf->hardlink_dir_size; i++) {
         snprintf(pname, OS_PATH_MAX, "%s/%d", osf->hardlink_path, i);
@@ -0,0 +1,966 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+
+//***********************************************************************
+// Write-ahead journal for the file backed OS.
+//
+// Attribute mutations are appended to the journal and made durable with a
+// group commit, one fdatasync() covers every record queued by all threads
+// since the last flush.  The mutation is also placed in an in-memory overlay
+// which is consulted by reads until the apply thread has written it into
+// the attribute tree.  The apply pass writes the whole batch into the tree
+// and makes it durable with a single syncfs() before the journal is
+// rewritten to hold only the durable records still sitting in the overlay.
+// If a group commit fails its records are cut back off the journal and the
+// overlay reverts to the last durable value for each attribute.
+//
+// Overlay keys are normalized so every path that resolves to the same
+// attribute file, eg via a symlinked attribute, finds the same entry.
+//
+// Anything that restructures the tree (removes, moves, links) has to call
+// osfj_release_paths() first with the paths it's about to change.  Only the
+// pending changes under those paths are written into the tree, and a cancel
+// record is group committed so a replay after a crash skips every older
+// record under them and can never land on a recycled path.  The rest of the
+// journal is left alone so namespace changes don't force a full apply.
+//***********************************************************************
+
+#define _log_module_index 222
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stddef.h>
+#include <zlib.h>
+#include "assert_result.h"
+#include "apr_wrapper.h"
+#include "ex3_system.h"
+#include "object_service_abstract.h"
+#include "type_malloc.h"
+#include "log.h"
+#include "os_file_priv.h"
+
+#define OSFJ_MAGIC 0x4f534a31   //** "OSJ1"
+#define OSFJ_CANCEL -2          //** Record v_size for a path cancel
+
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;        //** Covers everything after this field including the name and value
+    uint64_t seq;
+    int32_t fname_len;
+    int32_t v_size;
+} osfj_record_t;
+
+//***********************************************************************
+// _osfj_crc - Calculates the record checksum
+//***********************************************************************
+
+uint32_t _osfj_crc(osfj_record_t *r, char *fname, char *val)
+{
+    uLong crc;
+
+    crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *)&(r->seq), sizeof(osfj_record_t) - offsetof(osfj_record_t, seq));
+    crc = crc32(crc, (const Bytef *)fname, r->fname_len);
+    if (r->v_size > 0) crc = crc32(crc, (const Bytef *)val, r->v_size);
+
+    return(crc);
+}
+
+//***********************************************************************
+// _osfj_key - Normalizes an attribute file name into an overlay key.
+//    Resolved attribute symlinks can carry doubled slashes.
+//***********************************************************************
+
+void _osfj_key(char *key, const char *fname)
+{
+    int i, n;
+
+    n = 0;
+    for (i=0; (fname[i] != 0) && (n < OS_PATH_MAX-1); i++) {
+        if ((fname[i] == '/') && (n > 0) && (key[n-1] == '/')) continue;
+        key[n] = fname[i];
+        n++;
+    }
+    key[n] = 0;
+}
+
+//***********************************************************************
+// _osfj_encode - Appends a record to the buffer.  Returns the new size.
+//***********************************************************************
+
+int _osfj_encode(char **buffer, int *buf_max, int used, uint64_t seq, char *fname, char *val, int v_size)
+{
+    osfj_record_t r;
+    int n;
+
+    r.magic = OSFJ_MAGIC;
+    r.seq = seq;
+    r.fname_len = strlen(fname);
+    r.v_size = v_size;
+    r.crc = _osfj_crc(&r, fname, val);
+
+    n = used + sizeof(r) + r.fname_len + ((v_size > 0) ? v_size : 0);
+    if (n > *buf_max) {
+        *buf_max = 2*n;
+        type_realloc(*buffer, char, *buf_max);
+    }
+
+    memcpy(*buffer + used, &r, sizeof(r));
+    used += sizeof(r);
+    memcpy(*buffer + used, fname, r.fname_len);
+    used += r.fname_len;
+    if (v_size > 0) {
+        memcpy(*buffer + used, val, v_size);
+        used += v_size;
+    }
+
+    return(used);
+}
+
+//***********************************************************************
+// _osfj_write_all - Writes the whole buffer handling short writes
+//***********************************************************************
+
+int _osfj_write_all(int fd, char *buffer, int n)
+{
+    int i, err;
+
+    for (i=0; i<n; i += err) {
+        err = write(fd, buffer + i, n - i);
+        if (err <= 0) return(-1);
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// _osfj_store - Stores an attribute in the tree.  It's not durable until
+//    _osfj_sync_tree() is called.
+//***********************************************************************
+
+int _osfj_store(object_service_fn_t *os, char *fname, char *val, int v_size)
+{
+    int fd, err;
+
+    if (v_size < 0) {  //** Removing the attribute
+        safe_remove(os, fname);
+        return(0);
+    }
+
+    fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd == -1) {
+        log_printf(0, "ERROR opening attr file fname=%s\n", fname);
+        return(-1);
+    }
+
+    err = (v_size > 0) ? _osfj_write_all(fd, val, v_size) : 0;
+    if (close(fd) != 0) err = -1;
+
+    if (err != 0) log_printf(0, "ERROR storing attr file fname=%s v_size=%d\n", fname, v_size);
+    return(err);
+}
+
+//***********************************************************************
+// _osfj_store_sync - Stores an attribute and makes just that file and its
+//    directory entry durable
+//***********************************************************************
+
+int _osfj_store_sync(object_service_fn_t *os, char *fname, char *val, int v_size)
+{
+    char *dir, *base;
+    int fd, err;
+
+    err = _osfj_store(os, fname, val, v_size);
+    if (err != 0) return(err);
+
+    if (v_size >= 0) {
+        fd = open(fname, O_RDONLY);
+        if ((fd == -1) || (fsync(fd) != 0)) err = -1;
+        if (fd != -1) close(fd);
+    }
+
+    os_path_split(fname, &dir, &base);
+    fd = open(dir, O_RDONLY);
+    if ((fd == -1) || (fsync(fd) != 0)) err = -1;
+    if (fd != -1) close(fd);
+    free(dir);
+    free(base);
+
+    if (err != 0) log_printf(0, "ERROR syncing attr file fname=%s\n", fname);
+    return(err);
+}
+
+//***********************************************************************
+// _osfj_path_match - Returns 1 if the key is one of the paths or is below
+//    one of them
+//***********************************************************************
+
+int _osfj_path_match(char *key, char **paths, int n_paths)
+{
+    int i, n;
+
+    for (i=0; i<n_paths; i++) {
+        n = strlen(paths[i]);
+        if ((strncmp(key, paths[i], n) == 0) && ((key[n] == 0) || (key[n] == '/'))) return(1);
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// _osfj_sync_tree - Makes everything stored in the tree durable.  One
+//    syncfs() covers the whole batch instead of an fsync() per attribute.
+//***********************************************************************
+
+int _osfj_sync_tree(osfile_journal_t *j)
+{
+    if (syncfs(j->tree_fd) != 0) {
+        log_printf(0, "ERROR syncing the attribute tree journal=%s\n", j->fname);
+        return(-1);
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// _osfj_entry_free - Frees an overlay entry
+//***********************************************************************
+
+void _osfj_entry_free(osfj_entry_t *e)
+{
+    if (e->val != NULL) free(e->val);
+    if (e->prev_val != NULL) free(e->prev_val);
+    free(e->fname);
+    free(e);
+}
+
+//***********************************************************************
+// _osfj_snapshot - Makes copies of the overlay entries with seq <= max_seq.
+//    If an entry's current value is newer its previous durable value is
+//    used instead.  The journal lock should be held.
+//***********************************************************************
+
+osfj_entry_t *_osfj_snapshot(osfile_journal_t *j, uint64_t max_seq, int *n_snap)
+{
+    apr_hash_index_t *hi;
+    osfj_entry_t *e, *snap;
+    char *val;
+    int n;
+
+    n = apr_hash_count(j->overlay);
+    type_malloc_clear(snap, osfj_entry_t, n+1);
+
+    n = 0;
+    for (hi=apr_hash_first(NULL, j->overlay); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&e);
+        if (e->seq <= max_seq) {
+            snap[n].v_size = e->v_size;
+            snap[n].seq = e->seq;
+            val = e->val;
+        } else if ((e->prev_seq != 0) && (e->prev_seq <= max_seq)) {
+            snap[n].v_size = e->prev_v_size;
+            snap[n].seq = e->prev_seq;
+            val = e->prev_val;
+        } else {
+            continue;
+        }
+        snap[n].fname = strdup(e->fname);
+        if (snap[n].v_size > 0) {
+            type_malloc(snap[n].val, char, snap[n].v_size);
+            memcpy(snap[n].val, val, snap[n].v_size);
+        }
+        n++;
+    }
+
+    *n_snap = n;
+    return(snap);
+}
+
+//***********************************************************************
+// _osfj_snapshot_free - Destroys a snapshot
+//***********************************************************************
+
+void _osfj_snapshot_free(osfj_entry_t *snap, int n)
+{
+    int i;
+
+    for (i=0; i<n; i++) {
+        free(snap[i].fname);
+        if (snap[i].val != NULL) free(snap[i].val);
+    }
+    free(snap);
+}
+
+//***********************************************************************
+// _osfj_rotate - Replaces the journal with one holding just the durable
+//    records still in the overlay.  The lock should be held and applying
+//    set by the caller.  The lock is released during the IO.
+//***********************************************************************
+
+void _osfj_rotate(osfile_journal_t *j)
+{
+    osfj_entry_t *snap;
+    char tmpname[OS_PATH_MAX];
+    char *dir, *base, *buffer;
+    int i, n, used, buf_max, fd, dfd, err;
+
+    //** Keep anyone else from appending to the file while we swap it out
+    j->rotating = 1;
+    while (j->flushing == 1) apr_thread_cond_wait(j->cond, j->lock);
+
+    snap = _osfj_snapshot(j, j->durable_seq, &n);
+    apr_thread_mutex_unlock(j->lock);
+
+    if (n == 0) {  //** Nothing to keep so just truncate it
+        err = ftruncate(j->fd, 0);
+        if (err == 0) err = fsync(j->fd);
+        fd = -1;
+    } else {
+        buf_max = 64*1024;
+        type_malloc(buffer, char, buf_max);
+        used = 0;
+        for (i=0; i<n; i++) {
+            used = _osfj_encode(&buffer, &buf_max, used, snap[i].seq, snap[i].fname, snap[i].val, snap[i].v_size);
+        }
+
+        snprintf(tmpname, sizeof(tmpname), "%s.tmp", j->fname);
+        fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0600);
+        err = (fd == -1) ? -1 : _osfj_write_all(fd, buffer, used);
+        if (err == 0) err = fsync(fd);
+        if (err == 0) err = rename(tmpname, j->fname);
+        if (err == 0) {  //** Make the rename durable
+            os_path_split(j->fname, &dir, &base);
+            dfd = open(dir, O_RDONLY);
+            if (dfd != -1) {
+                fsync(dfd);
+                close(dfd);
+            }
+            free(dir);
+            free(base);
+        } else if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+        free(buffer);
+    }
+
+    if (err != 0) log_printf(0, "ERROR rotating journal fname=%s n=%d\n", j->fname, n);
+    _osfj_snapshot_free(snap, n);
+
+    apr_thread_mutex_lock(j->lock);
+    if (fd != -1) {
+        close(j->fd);
+        j->fd = fd;
+    }
+    j->rotate_failed = (err != 0) ? 1 : 0;
+    j->rotating = 0;
+    apr_thread_cond_broadcast(j->cond);
+}
+
+//***********************************************************************
+// _osfj_purge - Reverts the overlay entries from a failed group commit to
+//    their last durable value.  The lock should be held.
+//***********************************************************************
+
+void _osfj_purge(osfile_journal_t *j, uint64_t lo, uint64_t hi)
+{
+    apr_hash_index_t *hidx;
+    osfj_entry_t *e;
+
+    for (hidx=apr_hash_first(NULL, j->overlay); hidx != NULL; hidx = apr_hash_next(hidx)) {
+        apr_hash_this(hidx, NULL, NULL, (void **)&e);
+        if ((e->seq < lo) || (e->seq > hi)) continue;
+
+        if (e->prev_seq != 0) {
+            if (e->val != NULL) free(e->val);
+            e->val = e->prev_val;
+            e->v_size = e->prev_v_size;
+            e->seq = e->prev_seq;
+            e->prev_val = NULL;
+            e->prev_seq = 0;
+        } else {  //** The tree has the durable value.  Deleting the current entry is safe while iterating
+            apr_hash_set(j->overlay, e->fname, APR_HASH_KEY_STRING, NULL);
+            _osfj_entry_free(e);
+        }
+    }
+}
+
+//***********************************************************************
+// _osfj_apply - Writes the durable part of the overlay into the tree and
+//    shrinks the journal.  The lock should be held.  It's released during
+//    the IO.
+//***********************************************************************
+
+void _osfj_apply(osfile_journal_t *j)
+{
+    osfj_entry_t *snap, *e;
+    int i, n, err;
+
+    j->applying = 1;
+    snap = _osfj_snapshot(j, j->durable_seq, &n);
+    apr_thread_mutex_unlock(j->lock);
+
+    log_printf(5, "Applying n=%d\n", n);
+    err = 0;
+    for (i=0; i<n; i++) {
+        if (_osfj_store(j->os, snap[i].fname, snap[i].val, snap[i].v_size) != 0) err = -1;
+    }
+    if ((err == 0) && (n > 0)) err = _osfj_sync_tree(j);
+
+    apr_thread_mutex_lock(j->lock);
+
+    if (err == 0) {
+        //** Drop everything that hasn't been changed while we were working
+        for (i=0; i<n; i++) {
+            e = apr_hash_get(j->overlay, snap[i].fname, APR_HASH_KEY_STRING);
+            if (e == NULL) continue;
+            if (e->seq == snap[i].seq) {
+                apr_hash_set(j->overlay, e->fname, APR_HASH_KEY_STRING, NULL);
+                _osfj_entry_free(e);
+            } else if (e->prev_seq == snap[i].seq) {  //** The tree now holds the previous value
+                if (e->prev_val != NULL) free(e->prev_val);
+                e->prev_val = NULL;
+                e->prev_seq = 0;
+            }
+        }
+    } else {  //** Leave it all in the overlay and journal and try again next pass
+        log_printf(0, "ERROR applying journal.  Will retry n=%d fname=%s\n", n, j->fname);
+    }
+    _osfj_snapshot_free(snap, n);
+
+    if (err == 0) _osfj_rotate(j);
+
+    j->applying = 0;
+    apr_thread_cond_broadcast(j->cond);
+}
+
+//***********************************************************************
+// osfj_apply_thread - Periodically applies the journal to the tree
+//***********************************************************************
+
+void *osfj_apply_thread(apr_thread_t *th, void *data)
+{
+    osfile_journal_t *j = (osfile_journal_t *)data;
+
+    apr_thread_mutex_lock(j->lock);
+    while (j->shutdown == 0) {
+        apr_thread_cond_timedwait(j->apply_cond, j->lock, j->apply_interval);
+        if ((apr_hash_count(j->overlay) > 0) && (j->applying == 0) && (j->barrier == 0)) {
+            _osfj_apply(j);
+        }
+    }
+    apr_thread_mutex_unlock(j->lock);
+
+    return(NULL);
+}
+
+//***********************************************************************
+// _osfj_commit - Waits for the record with the given seq to be durable.
+//    The first thread to find no flush in progress becomes the leader and
+//    commits everything queued so far.  The lock should be held.
+//***********************************************************************
+
+int _osfj_commit(osfile_journal_t *j, uint64_t seq)
+{
+    uint64_t flush_seq, first_seq;
+    char *buffer;
+    off_t offset;
+    int n, err;
+
+    err = 0;
+    while (j->durable_seq < seq) {
+        if ((j->flushing == 0) && (j->rotating == 0)) {
+            j->flushing = 1;
+            buffer = j->buffer;
+            n = j->buf_used;
+            flush_seq = j->seq;
+            first_seq = j->durable_seq + 1;
+            type_malloc(j->buffer, char, j->buf_max);
+            j->buf_used = 0;
+            apr_thread_mutex_unlock(j->lock);
+
+            offset = lseek(j->fd, 0, SEEK_END);
+            err = _osfj_write_all(j->fd, buffer, n);
+            if (err == 0) err = fdatasync(j->fd);
+            if (err != 0) {  //** Cut off anything partial so later records aren't stranded behind it on replay
+                log_printf(0, "ERROR committing journal fname=%s n=%d\n", j->fname, n);
+                if ((offset == -1) || (ftruncate(j->fd, offset) != 0)) log_printf(0, "ERROR truncating failed commit fname=%s\n", j->fname);
+            }
+            free(buffer);
+
+            apr_thread_mutex_lock(j->lock);
+            if (err != 0) {  //** Let the other threads in the batch know it failed and drop their changes
+                j->fail_lo = first_seq;
+                j->fail_hi = flush_seq;
+                _osfj_purge(j, first_seq, flush_seq);
+            }
+            j->durable_seq = flush_seq;
+            j->flushing = 0;
+            apr_thread_cond_broadcast(j->cond);
+        } else {
+            apr_thread_cond_wait(j->cond, j->lock);
+        }
+    }
+
+    if ((seq >= j->fail_lo) && (seq <= j->fail_hi)) err = -1;
+
+    return(err);
+}
+
+//***********************************************************************
+// osfj_set - Journals an attribute change.  If v_size < 0 the attribute
+//    is removed.  Returns once the change is durable.
+//***********************************************************************
+
+int osfj_set(osfile_journal_t *j, char *fname, void *val, int v_size)
+{
+    osfj_entry_t *e;
+    uint64_t seq;
+    char key[OS_PATH_MAX];
+    int err;
+
+    _osfj_key(key, fname);
+
+    apr_thread_mutex_lock(j->lock);
+
+    //** Wait for any barriers and throttle if the apply thread is falling behind
+    while ((j->barrier > 0) || (apr_hash_count(j->overlay) >= j->max_pending)) {
+        if (j->barrier == 0) apr_thread_cond_signal(j->apply_cond);
+        apr_thread_cond_wait(j->cond, j->lock);
+    }
+
+    seq = ++j->seq;
+    j->buf_used = _osfj_encode(&(j->buffer), &(j->buf_max), j->buf_used, seq, key, val, v_size);
+
+    //** Update the overlay so reads see the change immediately
+    e = apr_hash_get(j->overlay, key, APR_HASH_KEY_STRING);
+    if (e == NULL) {
+        type_malloc_clear(e, osfj_entry_t, 1);
+        e->fname = strdup(key);
+        apr_hash_set(j->overlay, e->fname, APR_HASH_KEY_STRING, e);
+    } else if (e->seq <= j->durable_seq) {  //** Keep the durable value in case this one fails to commit
+        if (e->prev_val != NULL) free(e->prev_val);
+        e->prev_val = e->val;
+        e->prev_v_size = e->v_size;
+        e->prev_seq = e->seq;
+        e->val = NULL;
+    } else if (e->val != NULL) {
+        free(e->val);
+        e->val = NULL;
+    }
+    e->seq = seq;
+    e->v_size = (v_size < 0) ? -1 : v_size;
+    if (v_size > 0) {
+        type_malloc(e->val, char, v_size);
+        memcpy(e->val, val, v_size);
+    }
+
+    err = _osfj_commit(j, seq);
+    apr_thread_mutex_unlock(j->lock);
+
+    return(err);
+}
+
+//***********************************************************************
+// osfj_get - Looks up the attribute in the journal overlay.  Returns
+//    OSFJ_NOT_FOUND if the journal doesn't have it, 1 if it's pending
+//    removal and 0 if the value was returned.  The val and v_size
+//    semantics are the same as osf_get_attr.
+//***********************************************************************
+
+int osfj_get(osfile_journal_t *j, char *fname, void **val, int *v_size)
+{
+    osfj_entry_t *e;
+    char key[OS_PATH_MAX];
+    char *ca;
+    int n, bsize;
+
+    _osfj_key(key, fname);
+
+    apr_thread_mutex_lock(j->lock);
+    e = apr_hash_get(j->overlay, key, APR_HASH_KEY_STRING);
+    if (e == NULL) {
+        apr_thread_mutex_unlock(j->lock);
+        return(OSFJ_NOT_FOUND);
+    }
+
+    if (e->v_size < 0) {  //** Pending removal
+        apr_thread_mutex_unlock(j->lock);
+        if (*v_size < 0) *val = NULL;
+        *v_size = -1;
+        return(1);
+    }
+
+    n = e->v_size;
+    if (*v_size < 0) { //** Need to allocate the space
+        if (n > -*v_size) n = -*v_size;
+        bsize = n + 1;
+        *val = malloc(bsize);
+    } else {
+        if (n > *v_size) n = *v_size;
+        bsize = *v_size;
+    }
+
+    memcpy(*val, e->val, n);
+    apr_thread_mutex_unlock(j->lock);
+
+    *v_size = n;
+    if (bsize > n) {   //** Add a NULL terminator in case it may be a string
+        ca = (char *)(*val);
+        ca[n] = 0;
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// osfj_sync - Applies any pending changes.  If attr_dir is given the
+//    apply is only done if the overlay has changes inside it.
+//***********************************************************************
+
+void osfj_sync(osfile_journal_t *j, char *attr_dir)
+{
+    apr_hash_index_t *hi;
+    osfj_entry_t *e;
+    char key[OS_PATH_MAX];
+    int n, found;
+
+    apr_thread_mutex_lock(j->lock);
+
+    if (attr_dir != NULL) {
+        _osfj_key(key, attr_dir);
+        n = strlen(key);
+        if ((n > 1) && (key[n-1] == '/')) n--;
+        found = 0;
+        for (hi=apr_hash_first(NULL, j->overlay); hi != NULL; hi = apr_hash_next(hi)) {
+            apr_hash_this(hi, NULL, NULL, (void **)&e);
+            if ((strncmp(e->fname, key, n) == 0) && (e->fname[n] == '/')) {
+                found = 1;
+                break;
+            }
+        }
+        if (found == 0) {
+            apr_thread_mutex_unlock(j->lock);
+            return;
+        }
+    }
+
+    while (j->applying == 1) apr_thread_cond_wait(j->cond, j->lock);
+    if (apr_hash_count(j->overlay) > 0) _osfj_apply(j);
+
+    apr_thread_mutex_unlock(j->lock);
+}
+
+//***********************************************************************
+// osfj_barrier - Blocks new changes, applies everything pending, and
+//    empties the journal.
+//***********************************************************************
+
+void osfj_barrier(osfile_journal_t *j)
+{
+    apr_thread_mutex_lock(j->lock);
+
+    j->barrier++;
+    while ((j->flushing == 1) || (j->applying == 1) || (j->durable_seq < j->seq)) {
+        apr_thread_cond_wait(j->cond, j->lock);
+    }
+
+    if ((apr_hash_count(j->overlay) > 0) || (lseek(j->fd, 0, SEEK_END) > 0)) _osfj_apply(j);
+
+    j->barrier--;
+    apr_thread_cond_broadcast(j->cond);
+    apr_thread_mutex_unlock(j->lock);
+}
+
+//***********************************************************************
+// osfj_release_paths - Releases the journal's hold on the paths before
+//    they are removed, moved or linked.  Pending changes under them are
+//    written into the tree unless discard is set, and dropped from the
+//    overlay.  A cancel record for each path is then group committed so a
+//    replay skips the older records under them.  Nothing else in the journal
+//    is touched.  If that fails it falls back to a full barrier.
+//***********************************************************************
+
+void osfj_release_paths(osfile_journal_t *j, char **paths, int n_paths, int discard)
+{
+    apr_hash_index_t *hi;
+    osfj_entry_t *e;
+    char **keys;
+    char key[OS_PATH_MAX];
+    uint64_t seq;
+    int i, n, err;
+
+    type_malloc(keys, char *, n_paths);
+    for (i=0; i<n_paths; i++) {
+        _osfj_key(key, paths[i]);
+        n = strlen(key);
+        if ((n > 1) && (key[n-1] == '/')) key[n-1] = 0;
+        keys[i] = strdup(key);
+    }
+
+    apr_thread_mutex_lock(j->lock);
+
+    //** Wait until nothing under the paths is in flight.  An apply pass
+    //** works from a snapshot and a group commit can still fail.
+    for (;;) {
+        while ((j->barrier > 0) || (j->applying == 1)) apr_thread_cond_wait(j->cond, j->lock);
+
+        n = 0;
+        seq = 0;
+        for (hi=apr_hash_first(NULL, j->overlay); hi != NULL; hi = apr_hash_next(hi)) {
+            apr_hash_this(hi, NULL, NULL, (void **)&e);
+            if (_osfj_path_match(e->fname, keys, n_paths) == 0) continue;
+            n++;
+            if (e->seq > seq) seq = e->seq;
+        }
+        if (seq <= j->durable_seq) break;
+
+        _osfj_commit(j, seq);  //** Releases the lock so check again.  Failures are purged from the overlay
+    }
+
+    //** Nothing live under the paths.  Unless a rotation failed the journal only holds overlay records
+    if ((n == 0) && (j->rotate_failed == 0)) goto finished;
+
+    //** Store what's pending.  The lock is held so nothing new can sneak in.
+    err = 0;
+    for (hi=apr_hash_first(NULL, j->overlay); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&e);
+        if (_osfj_path_match(e->fname, keys, n_paths) == 0) continue;
+        if ((discard == 0) && (_osfj_store_sync(j->os, e->fname, e->val, e->v_size) != 0)) err = -1;
+    }
+    if (err != 0) goto fallback;
+
+    //** Cancel the old records and drop the entries.  Deleting while iterating is safe
+    for (i=0; i<n_paths; i++) {
+        seq = ++j->seq;
+        j->buf_used = _osfj_encode(&(j->buffer), &(j->buf_max), j->buf_used, seq, keys[i], NULL, OSFJ_CANCEL);
+    }
+    for (hi=apr_hash_first(NULL, j->overlay); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&e);
+        if (_osfj_path_match(e->fname, keys, n_paths) == 0) continue;
+        apr_hash_set(j->overlay, e->fname, APR_HASH_KEY_STRING, NULL);
+        _osfj_entry_free(e);
+    }
+
+    if (_osfj_commit(j, seq) == 0) goto finished;
+
+fallback:  //** Apply everything and empty the journal instead
+    log_printf(0, "ERROR releasing paths.  Using a full barrier. journal=%s path[0]=%s\n", j->fname, keys[0]);
+    apr_thread_mutex_unlock(j->lock);
+    osfj_barrier(j);
+    apr_thread_mutex_lock(j->lock);
+
+finished:
+    apr_thread_mutex_unlock(j->lock);
+
+    for (i=0; i<n_paths; i++) free(keys[i]);
+    free(keys);
+}
+
+//***********************************************************************
+// _osfj_replay - Replays the journal into the tree.  Processing stops at
+//    the first torn or corrupt record.  Records under a path that was later
+//    cancelled are skipped.  Returns the number of records applied or -1 if
+//    they couldn't be made durable.
+//***********************************************************************
+
+int _osfj_replay(osfile_journal_t *j)
+{
+    osfj_record_t r;
+    struct stat st;
+    char *buffer, *fname, *val;
+    char **cancel;
+    uint64_t *cancel_seq;
+    off_t pos, end;
+    int i, n, nc, used, skip;
+
+    if (fstat(j->fd, &st) != 0) return(0);
+    if (st.st_size == 0) return(0);
+
+    type_malloc(buffer, char, st.st_size);
+    used = 0;
+    while (used < st.st_size) {
+        n = pread(j->fd, buffer + used, st.st_size - used, used);
+        if (n <= 0) break;
+        used += n;
+    }
+
+    //** 1st pass finds the end of the good records and collects the cancels
+    n = 0;
+    pos = 0;
+    while (pos + (off_t)sizeof(r) <= used) {
+        memcpy(&r, buffer + pos, sizeof(r));
+        if ((r.magic != OSFJ_MAGIC) || (r.fname_len <= 0) || (r.fname_len >= OS_PATH_MAX)) break;
+        if (pos + (off_t)sizeof(r) + r.fname_len + ((r.v_size > 0) ? r.v_size : 0) > used) break;  //** Torn write
+
+        fname = buffer + pos + sizeof(r);
+        val = fname + r.fname_len;
+        if (_osfj_crc(&r, fname, val) != r.crc) break;
+
+        if (r.v_size == OSFJ_CANCEL) n++;
+        if (r.seq > j->seq) j->seq = r.seq;
+        pos += sizeof(r) + r.fname_len + ((r.v_size > 0) ? r.v_size : 0);
+    }
+    end = pos;
+
+    if (end < used) log_printf(0, "WARNING: Ignoring %d bytes of torn or corrupt journal records. fname=%s\n", (int)(used - end), j->fname);
+
+    type_malloc(cancel, char *, n+1);
+    type_malloc(cancel_seq, uint64_t, n+1);
+    nc = 0;
+    for (pos=0; pos<end; pos += sizeof(r) + r.fname_len + ((r.v_size > 0) ? r.v_size : 0)) {
+        memcpy(&r, buffer + pos, sizeof(r));
+        if (r.v_size != OSFJ_CANCEL) continue;
+        cancel[nc] = strndup(buffer + pos + sizeof(r), r.fname_len);
+        cancel_seq[nc] = r.seq;
+        nc++;
+    }
+
+    //** 2nd pass does the stores
+    n = 0;
+    for (pos=0; pos<end; pos += sizeof(r) + r.fname_len + ((r.v_size > 0) ? r.v_size : 0)) {
+        memcpy(&r, buffer + pos, sizeof(r));
+        if (r.v_size == OSFJ_CANCEL) continue;
+
+        fname = strndup(buffer + pos + sizeof(r), r.fname_len);
+        val = buffer + pos + sizeof(r) + r.fname_len;
+        skip = 0;
+        for (i=0; i<nc; i++) {
+            if ((cancel_seq[i] > r.seq) && (_osfj_path_match(fname, &(cancel[i]), 1) == 1)) {
+                skip = 1;
+                break;
+            }
+        }
+        if (skip == 0) {
+            _osfj_store(j->os, fname, val, (r.v_size < 0) ? -1 : r.v_size);
+            n++;
+        }
+        free(fname);
+    }
+
+    for (i=0; i<nc; i++) free(cancel[i]);
+    free(cancel);
+    free(cancel_seq);
+    free(buffer);
+
+    if ((n > 0) && (_osfj_sync_tree(j) != 0)) return(-1);
+
+    return(n);
+}
+
+//***********************************************************************
+// osfj_create - Opens the journal and replays anything left from the last run
+//***********************************************************************
+
+osfile_journal_t *osfj_create(object_service_fn_t *os, char *fname, int max_pending, int apply_interval_ms)
+{
+    osfile_priv_t *osf = (osfile_priv_t *)os->priv;
+    osfile_journal_t *j;
+    int n;
+
+    type_malloc_clear(j, osfile_journal_t, 1);
+    j->os = os;
+    j->fname = strdup(fname);
+    j->max_pending = (max_pending > 0) ? max_pending : 1;
+    j->apply_interval = apr_time_from_msec(apply_interval_ms);
+
+    j->tree_fd = open(osf->file_path, O_RDONLY);
+    if (j->tree_fd == -1) {
+        log_printf(0, "ERROR opening attribute tree path=%s\n", osf->file_path);
+        free(j->fname);
+        free(j);
+        return(NULL);
+    }
+
+    j->fd = open(fname, O_RDWR|O_CREAT|O_APPEND, 0600);
+    if (j->fd == -1) {
+        log_printf(0, "ERROR opening journal fname=%s\n", fname);
+        close(j->tree_fd);
+        free(j->fname);
+        free(j);
+        return(NULL);
+    }
+
+    //** Replay whatever is left and start with a clean journal
+    n = _osfj_replay(j);
+    log_printf(0, "Replayed %d journal records. fname=%s\n", n, fname);
+    if ((n < 0) || (ftruncate(j->fd, 0) != 0) || (fsync(j->fd) != 0)) {
+        log_printf(0, "ERROR truncating journal fname=%s\n", fname);
+        close(j->fd);
+        close(j->tree_fd);
+        free(j->fname);
+        free(j);
+        return(NULL);
+    }
+    j->durable_seq = j->seq;
+
+    j->buf_max = 64*1024;
+    type_malloc(j->buffer, char, j->buf_max);
+
+    assert_result(apr_pool_create(&(j->mpool), NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(j->lock), APR_THREAD_MUTEX_DEFAULT, j->mpool);
+    apr_thread_cond_create(&(j->cond), j->mpool);
+    apr_thread_cond_create(&(j->apply_cond), j->mpool);
+    j->overlay = apr_hash_make(j->mpool);
+
+    thread_create_assert(&(j->apply_thread), NULL, osfj_apply_thread, (void *)j, j->mpool);
+
+    return(j);
+}
+
+//***********************************************************************
+// osfj_destroy - Flushes everything to the tree and closes the journal
+//***********************************************************************
+
+void osfj_destroy(osfile_journal_t *j)
+{
+    apr_status_t value;
+
+    osfj_barrier(j);
+
+    apr_thread_mutex_lock(j->lock);
+    j->shutdown = 1;
+    apr_thread_cond_broadcast(j->apply_cond);
+    apr_thread_mutex_unlock(j->lock);
+    apr_thread_join(&value, j->apply_thread);
+
+    close(j->fd);
+    close(j->tree_fd);
+    apr_thread_mutex_destroy(j->lock);
+    apr_thread_cond_destroy(j->cond);
+    apr_thread_cond_destroy(j->apply_cond);
+    apr_pool_destroy(j->mpool);
+    free(j->buffer);
+    free(j->fname);
+    free(j);
+}
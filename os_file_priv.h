@@ -33,8 +33,6 @@ http://www.accre.vanderbilt.edu
 
 #include "object_service_abstract.h"
 #include "authn_abstract.h"
-#include "chksum.h"
-#include <openssl/md5.h>
 
 #ifndef _OS_FILE_PRIV_H_
 #define _OS_FILE_PRIV_H_
@@ -50,8 +48,78 @@ extern "C" {
 #define FILE_ATTR_PREFIX_LEN 6
 
 #define DIR_PERMS S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH
-#define OSF_LOCK_CHKSUM CHKSUM_MD5
-#define OSF_LOCK_CHKSUM_SIZE MD5_DIGEST_LENGTH
+
+#define OSF_DU_ATTR "os.du"                    //** Directory usage aggregate: "bytes files dirs"
+#define OSF_DU_SIZE_KEY "system.exnode.size"  //** File size tracked by the aggregates
+
+#define OSF_LOCK_READ  0   //** Shared object lock
+#define OSF_LOCK_WRITE 1   //** Exclusive object lock
+
+typedef struct osf_obj_lock_s osf_obj_lock_t;
+
+struct osf_obj_lock_s {   //** Per object reader/writer lock.  Created on demand and freed when unused
+    char *path;
+    apr_thread_cond_t *cond;
+    int shard;
+    int ref_count;         //** Holders plus waiters
+    int readers;
+    int writer;
+    int writers_waiting;
+    osf_obj_lock_t *next;  //** Free list link
+};
+
+typedef struct {
+    apr_thread_mutex_t *lock;
+    apr_pool_t *mpool;
+    apr_hash_t *table;     //** Active object locks keyed by path
+    osf_obj_lock_t *free_list;
+} osf_lock_shard_t;
+
+#define OSFJ_NOT_FOUND -1  //** osfj_get() return when the journal doesn't hold the attribute
+
+typedef struct {      //** Journaled attribute mutation not yet applied to the tree
+    char *fname;      //** Full path of the attribute file
+    char *val;
+    int v_size;       //** -1 means remove the attribute
+    uint64_t seq;
+    char *prev_val;   //** Last durable value.  Restored if the current one fails to commit
+    int prev_v_size;
+    uint64_t prev_seq; //** 0 if the tree holds the last durable value
+} osfj_entry_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    char *fname;                  //** Journal file
+    int fd;
+    int tree_fd;                  //** Used to sync the attribute tree once per apply pass
+    apr_pool_t *mpool;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;      //** Group commit, barrier and back pressure waiters
+    apr_thread_cond_t *apply_cond;
+    apr_thread_t *apply_thread;
+    apr_hash_t *overlay;          //** Pending mutations keyed by attribute file name
+    char *buffer;                 //** Records waiting for the next group commit
+    int buf_used;
+    int buf_max;
+    uint64_t seq;                 //** Last seq handed out
+    uint64_t durable_seq;         //** Last seq that is fsync'ed in the journal
+    uint64_t fail_lo;             //** Seq range of the last failed group commit
+    uint64_t fail_hi;
+    int flushing;
+    int applying;
+    int rotating;
+    int rotate_failed;            //** Journal may still hold records that were applied and dropped
+    int barrier;
+    int shutdown;
+    int max_pending;
+    apr_time_t apply_interval;
+} osfile_journal_t;
+
+typedef struct {      //** Recursive usage below a directory
+    int64_t bytes;
+    int64_t files;    //** Files, symlinks and hardlinks
+    int64_t dirs;     //** Doesn't include the directory itself
+} osf_du_t;
 
 typedef struct {
     int base_path_len;
@@ -65,7 +133,7 @@ typedef struct {
     char *hardlink_path;
     char *host_id;
     thread_pool_context_t *tpc;
-    apr_thread_mutex_t **internal_lock;
+    osf_lock_shard_t *lock_shard;
     os_authz_t *osaz;
     authn_t *authn;
     apr_pool_t *mpool;
@@ -80,13 +148,28 @@ typedef struct {
     os_virtual_attr_t link_count_va;
     os_virtual_attr_t type_va;
     os_virtual_attr_t create_va;
+    os_virtual_attr_t stat_va;
     os_virtual_attr_t attr_link_pva;
     os_virtual_attr_t attr_type_pva;
     os_virtual_attr_t timestamp_pva;
     os_virtual_attr_t append_pva;
+    os_virtual_attr_t du_va;
+    apr_thread_mutex_t **du_lock;  //** Striped by attribute directory to serialize each aggregate's updates
+    int du_enabled;
     int max_copy;
+    osfile_journal_t *journal;  //** NULL unless journaled mode is enabled
 } osfile_priv_t;
 
+int safe_remove(object_service_fn_t *os, char *path);
+
+osfile_journal_t *osfj_create(object_service_fn_t *os, char *fname, int max_pending, int apply_interval_ms);
+void osfj_destroy(osfile_journal_t *j);
+int osfj_set(osfile_journal_t *j, char *fname, void *val, int v_size);
+int osfj_get(osfile_journal_t *j, char *fname, void **val, int *v_size);
+void osfj_sync(osfile_journal_t *j, char *attr_dir);
+void osfj_barrier(osfile_journal_t *j);
+void osfj_release_paths(osfile_journal_t *j, char **paths, int n_paths, int discard);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,1743 @@
+/*
+Advanced Computing Center for Research and Education Proprietary License
+Version 1.0 (April 2006)
+
+Copyright (c) 2006, Advanced Computing Center for Research and Education,
+ Vanderbilt University, All rights reserved.
+
+This Work is the sole and exclusive property of the Advanced Computing Center
+for Research and Education department at Vanderbilt University.  No right to
+disclose or otherwise disseminate any of the information contained herein is
+granted by virtue of your possession of this software except in accordance with
+the terms and conditions of a separate License Agreement entered into with
+Vanderbilt University.
+
+THE AUTHOR OR COPYRIGHT HOLDERS PROVIDES THE "WORK" ON AN "AS IS" BASIS,
+WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR
+PURPOSE, AND NON-INFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Vanderbilt University
+Advanced Computing Center for Research and Education
+230 Appleton Place
+Nashville, TN 37203
+http://www.accre.vanderbilt.edu
+*/
+
+
+//***********************************************************************
+// Sharded OS implementation.  Spreads the namespace across several child
+// object services, typically os_remote_client's each talking to a
+// different lio_server.
+//
+// Objects are placed by hashing the first prefix_depth path components
+// onto a consistent hash ring.  Anything shallower than that is a "global"
+// directory.  Global directories exist on every shard so the tree can be
+// walked everywhere but their attributes only live on the primary shard 0.
+//***********************************************************************
+
+#define _log_module_index 221
+
+#include <stdlib.h>
+#include "apr_wrapper.h"
+#include "ex3_system.h"
+#include "object_service_abstract.h"
+#include "type_malloc.h"
+#include "log.h"
+#include "thread_pool.h"
+#include "iniparse.h"
+#include "os_shard.h"
+#include "os_remote.h"
+
+#define OSSH_MOVE_PENDING_KEY "os_shard.move_pending"
+#define OSSH_MAX_RECURSE 10000
+
+typedef struct {
+    uint64_t hash;
+    int shard;
+} ossh_ring_t;
+
+typedef struct {
+    object_service_fn_t **shard;  //** Child OS for each shard
+    char **shard_section;
+    ossh_ring_t *ring;            //** Consistent hash ring sorted by hash
+    thread_pool_context_t *tpc;
+    int n_shards;
+    int n_ring;
+    int prefix_depth;             //** Number of path components used to pick the shard
+    int max_attr;                 //** Max attribute size when copying objects between shards
+} ossh_priv_t;
+
+typedef struct {
+    int shard;
+    char *fname;
+    os_fd_t *fd_child;
+} ossh_fd_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    int shard;
+    os_attr_iter_t *it;
+} ossh_attr_iter_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    os_object_iter_t **it_child;
+    os_attr_iter_t **ait_child;
+    ossh_attr_iter_t it_attr;
+    void **val;
+    int *v_size;
+    int *v_size_initial;
+    int n_keys;
+    int curr;
+} ossh_object_iter_t;
+
+typedef struct {
+    os_fsck_iter_t **it_child;
+    int curr;
+} ossh_fsck_iter_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    op_generic_t **gop;     //** Per shard op or NULL if not used
+} ossh_bcast_op_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    creds_t *creds;
+    char *src_path;
+    char *dest_path;
+    char *id;
+    int type;
+} ossh_mk_mv_rm_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    creds_t *creds;
+    ossh_fd_t *fd_src;
+    ossh_fd_t *fd_dest;
+    char **key_src;
+    char **key_dest;
+    int n;
+} ossh_copy_attr_t;
+
+typedef struct {
+    object_service_fn_t *os;
+    os_fd_t **pfd;
+    os_fd_t *cfd;
+    ossh_fd_t *close_fd;
+    op_generic_t *gop;
+    char *path;
+    int shard;
+} ossh_open_op_t;
+
+//***********************************************************************
+// _ossh_hash - FNV-1a hash used for the ring
+//***********************************************************************
+
+uint64_t _ossh_hash(const char *str, int len, uint64_t h)
+{
+    int i;
+
+    for (i=0; i<len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+    }
+
+    return(h);
+}
+
+//***********************************************************************
+// _ossh_ring_compare - qsort comparison for the ring
+//***********************************************************************
+
+int _ossh_ring_compare(const void *a, const void *b)
+{
+    const ossh_ring_t *r1 = (const ossh_ring_t *)a;
+    const ossh_ring_t *r2 = (const ossh_ring_t *)b;
+
+    if (r1->hash < r2->hash) return(-1);
+    if (r1->hash > r2->hash) return(1);
+    return(r1->shard - r2->shard);
+}
+
+//***********************************************************************
+// _ossh_route - Returns the shard the path lives on.  If the path is
+//    shallower than the prefix depth it's a global object, *global is set
+//    and the primary shard is returned.
+//***********************************************************************
+
+int _ossh_route(ossh_priv_t *ossh, const char *path, int *global)
+{
+    uint64_t h;
+    int i, start, depth, lo, hi, mid;
+
+    //** Hash the normalized leading components.  Duplicate slashes are skipped
+    //** so "a/b", "/a/b" and "//a//b/" all land in the same place.
+    h = 14695981039346656037ULL;
+    depth = 0;
+    i = 0;
+    while ((path[i] != 0) && (depth < ossh->prefix_depth)) {
+        while (path[i] == '/') i++;
+        if (path[i] == 0) break;
+        start = i;
+        while ((path[i] != '/') && (path[i] != 0)) i++;
+        h = _ossh_hash("/", 1, h);
+        h = _ossh_hash(&(path[start]), i-start, h);
+        depth++;
+    }
+
+    if (depth < ossh->prefix_depth) {
+        *global = 1;
+        return(0);
+    }
+
+    *global = 0;
+
+    //** Find the 1st ring entry >= h wrapping around if needed
+    lo = 0;
+    hi = ossh->n_ring;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (ossh->ring[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == ossh->n_ring) lo = 0;
+
+    return(ossh->ring[lo].shard);
+}
+
+//***********************************************************************
+// _ossh_regex_route - Routes a path regex.  Returns the shard if the
+//    regex has a fixed prefix deep enough to pin it to a shard or -1 if
+//    all the shards have to be checked.
+//***********************************************************************
+
+int _ossh_regex_route(ossh_priv_t *ossh, os_regex_table_t *path)
+{
+    int global, shard;
+
+    if (path == NULL) return(-1);
+    if (path->n == 0) return(-1);
+    if (path->regex_entry[0].fixed == 0) return(-1);
+
+    shard = _ossh_route(ossh, path->regex_entry[0].expression, &global);
+    return((global == 1) ? -1 : shard);
+}
+
+//***********************************************************************
+// ossh_bcast_fn - Waits for all the shard ops to complete
+//***********************************************************************
+
+op_status_t ossh_bcast_fn(void *arg, int tid)
+{
+    ossh_bcast_op_t *op = (ossh_bcast_op_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    op_status_t status, s;
+    int i;
+
+    status = op_success_status;
+    for (i=0; i<ossh->n_shards; i++) {
+        if (op->gop[i] == NULL) continue;
+        s = gop_sync_exec_status(op->gop[i]);
+        op->gop[i] = NULL;
+        if (s.op_status != OP_STATE_SUCCESS) {
+            log_printf(1, "shard=%s failed error_code=%d\n", ossh->shard_section[i], s.error_code);
+            status = s;
+        } else if (status.op_status == OP_STATE_SUCCESS) {
+            status.error_code += s.error_code;  //** Keep the running count for the regex ops
+        }
+    }
+
+    return(status);
+}
+
+//***********************************************************************
+// ossh_bcast_free - Frees a broadcast op
+//***********************************************************************
+
+void ossh_bcast_free(void *arg)
+{
+    ossh_bcast_op_t *op = (ossh_bcast_op_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    int i;
+
+    for (i=0; i<ossh->n_shards; i++) {
+        if (op->gop[i] != NULL) gop_free(op->gop[i], OP_DESTROY);
+    }
+    free(op->gop);
+    free(op);
+}
+
+//***********************************************************************
+// ossh_bcast_new - Makes a new broadcast op container
+//***********************************************************************
+
+ossh_bcast_op_t *ossh_bcast_new(object_service_fn_t *os)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_bcast_op_t *op;
+
+    type_malloc_clear(op, ossh_bcast_op_t, 1);
+    op->os = os;
+    type_malloc_clear(op->gop, op_generic_t *, ossh->n_shards);
+
+    return(op);
+}
+
+//***********************************************************************
+// ossh_bcast_gop - Makes the gop for the broadcast op
+//***********************************************************************
+
+op_generic_t *ossh_bcast_gop(object_service_fn_t *os, ossh_bcast_op_t *op)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    op_generic_t *gop;
+
+    gop = new_thread_pool_op(ossh->tpc, NULL, ossh_bcast_fn, (void *)op, ossh_bcast_free, 1);
+    gop_set_private(gop, op);
+    return(gop);
+}
+
+//***********************************************************************
+// ossh_remove_regex_object - Removes the matching objects from all the
+//    shards holding them.  If the path pins it to a single shard only
+//    that one is used.
+//***********************************************************************
+
+op_generic_t *ossh_remove_regex_object(object_service_fn_t *os, creds_t *creds, os_regex_table_t *path, os_regex_table_t *object_regex, int obj_types, int recurse_depth)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_bcast_op_t *op;
+    int i, shard;
+
+    shard = _ossh_regex_route(ossh, path);
+    op = ossh_bcast_new(os);
+    for (i=0; i<ossh->n_shards; i++) {
+        if ((shard >= 0) && (i != shard)) continue;
+        op->gop[i] = os_remove_regex_object(ossh->shard[i], creds, path, object_regex, obj_types, recurse_depth);
+    }
+
+    return(ossh_bcast_gop(os, op));
+}
+
+//***********************************************************************
+// ossh_abort_remove_regex_object - Aborts a bulk remove call
+//***********************************************************************
+
+op_generic_t *ossh_abort_remove_regex_object(object_service_fn_t *os, op_generic_t *gop)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_bcast_op_t *op = (ossh_bcast_op_t *)gop_get_private(gop);
+    opque_t *q;
+    int i;
+
+    q = new_opque();
+    for (i=0; i<ossh->n_shards; i++) {
+        if (op->gop[i] != NULL) opque_add(q, os_abort_remove_regex_object(ossh->shard[i], op->gop[i]));
+    }
+
+    return(opque_get_gop(q));
+}
+
+//***********************************************************************
+// ossh_regex_object_set_multiple_attrs - Does a bulk regex change across
+//    all the shards
+//***********************************************************************
+
+op_generic_t *ossh_regex_object_set_multiple_attrs(object_service_fn_t *os, creds_t *creds, char *id, os_regex_table_t *path, os_regex_table_t *object_regex, int object_types, int recurse_depth, char **key, void **val, int *v_size, int n_attrs)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_bcast_op_t *op;
+    int i, shard;
+
+    shard = _ossh_regex_route(ossh, path);
+    op = ossh_bcast_new(os);
+    for (i=0; i<ossh->n_shards; i++) {
+        if ((shard >= 0) && (i != shard)) continue;
+        op->gop[i] = os_regex_object_set_multiple_attrs(ossh->shard[i], creds, id, path, object_regex, object_types, recurse_depth, key, val, v_size, n_attrs);
+    }
+
+    return(ossh_bcast_gop(os, op));
+}
+
+//***********************************************************************
+// ossh_abort_regex_object_set_multiple_attrs - Aborts a bulk attr call
+//***********************************************************************
+
+op_generic_t *ossh_abort_regex_object_set_multiple_attrs(object_service_fn_t *os, op_generic_t *gop)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_bcast_op_t *op = (ossh_bcast_op_t *)gop_get_private(gop);
+    opque_t *q;
+    int i;
+
+    q = new_opque();
+    for (i=0; i<ossh->n_shards; i++) {
+        if (op->gop[i] != NULL) opque_add(q, os_abort_regex_object_set_multiple_attrs(ossh->shard[i], op->gop[i]));
+    }
+
+    return(opque_get_gop(q));
+}
+
+//***********************************************************************
+//  ossh_exists - Returns the object type  and 0 if it doesn't exist
+//***********************************************************************
+
+op_generic_t *ossh_exists(object_service_fn_t *os, creds_t *creds, char *path)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int global;
+
+    return(os_exists(ossh->shard[_ossh_route(ossh, path, &global)], creds, path));
+}
+
+//***********************************************************************
+// ossh_free_mk_mv_rm - Frees a create/move/remove op
+//***********************************************************************
+
+void ossh_free_mk_mv_rm(void *arg)
+{
+    ossh_mk_mv_rm_t *op = (ossh_mk_mv_rm_t *)arg;
+
+    if (op->src_path != NULL) free(op->src_path);
+    if (op->dest_path != NULL) free(op->dest_path);
+    if (op->id != NULL) free(op->id);
+    free(op);
+}
+
+//***********************************************************************
+// ossh_new_mk_mv_rm - Makes a new create/move/remove op
+//***********************************************************************
+
+ossh_mk_mv_rm_t *ossh_new_mk_mv_rm(object_service_fn_t *os, creds_t *creds, char *src_path, char *dest_path, char *id, int type)
+{
+    ossh_mk_mv_rm_t *op;
+
+    type_malloc_clear(op, ossh_mk_mv_rm_t, 1);
+    op->os = os;
+    op->creds = creds;
+    op->src_path = (src_path == NULL) ? NULL : strdup(src_path);
+    op->dest_path = (dest_path == NULL) ? NULL : strdup(dest_path);
+    op->id = (id == NULL) ? NULL : strdup(id);
+    op->type = type;
+
+    return(op);
+}
+
+//***********************************************************************
+// ossh_global_create_fn - Creates a global directory on every shard.
+//    The primary goes first since it holds the attributes.
+//***********************************************************************
+
+op_status_t ossh_global_create_fn(void *arg, int tid)
+{
+    ossh_mk_mv_rm_t *op = (ossh_mk_mv_rm_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    op_status_t status;
+    int i;
+
+    status = gop_sync_exec_status(os_create_object(ossh->shard[0], op->creds, op->src_path, op->type, op->id));
+    if (status.op_status != OP_STATE_SUCCESS) return(status);
+
+    for (i=1; i<ossh->n_shards; i++) {
+        if (gop_sync_exec(os_create_object(ossh->shard[i], op->creds, op->src_path, op->type, op->id)) != OP_STATE_SUCCESS) {
+            log_printf(0, "ERROR creating global object on shard=%s fname=%s\n", ossh->shard_section[i], op->src_path);
+            status = op_failure_status;
+        }
+    }
+
+    return(status);
+}
+
+//***********************************************************************
+// ossh_create_object - Creates an object
+//***********************************************************************
+
+op_generic_t *ossh_create_object(object_service_fn_t *os, creds_t *creds, char *path, int type, char *id)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int shard, global;
+
+    shard = _ossh_route(ossh, path, &global);
+    if (global == 0) return(os_create_object(ossh->shard[shard], creds, path, type, id));
+
+    return(new_thread_pool_op(ossh->tpc, NULL, ossh_global_create_fn, (void *)ossh_new_mk_mv_rm(os, creds, path, NULL, id, type), ossh_free_mk_mv_rm, 1));
+}
+
+//***********************************************************************
+// ossh_global_remove_fn - Removes a global directory from every shard.
+//    The primary goes last so a failure leaves the attributes intact.
+//***********************************************************************
+
+op_status_t ossh_global_remove_fn(void *arg, int tid)
+{
+    ossh_mk_mv_rm_t *op = (ossh_mk_mv_rm_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    int i;
+
+    for (i=ossh->n_shards-1; i>0; i--) {
+        if (gop_sync_exec(os_remove_object(ossh->shard[i], op->creds, op->src_path)) != OP_STATE_SUCCESS) {
+            log_printf(1, "ERROR removing global object on shard=%s fname=%s\n", ossh->shard_section[i], op->src_path);
+            return(op_failure_status);
+        }
+    }
+
+    return(gop_sync_exec_status(os_remove_object(ossh->shard[0], op->creds, op->src_path)));
+}
+
+//***********************************************************************
+// ossh_remove_object - Generates a remove object operation
+//***********************************************************************
+
+op_generic_t *ossh_remove_object(object_service_fn_t *os, creds_t *creds, char *path)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int shard, global;
+
+    shard = _ossh_route(ossh, path, &global);
+    if (global == 0) return(os_remove_object(ossh->shard[shard], creds, path));
+
+    return(new_thread_pool_op(ossh->tpc, NULL, ossh_global_remove_fn, (void *)ossh_new_mk_mv_rm(os, creds, path, NULL, NULL, 0), ossh_free_mk_mv_rm, 1));
+}
+
+//***********************************************************************
+// ossh_symlink_object - Generates a symbolic link object operation.  The
+//    link lives on the destination shard so the target has to be there too.
+//***********************************************************************
+
+op_generic_t *ossh_symlink_object(object_service_fn_t *os, creds_t *creds, char *src_path, char *dest_path, char *id)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int src_shard, dest_shard, src_global, dest_global;
+
+    src_shard = _ossh_route(ossh, src_path, &src_global);
+    dest_shard = _ossh_route(ossh, dest_path, &dest_global);
+
+    if (dest_global == 1) {
+        log_printf(1, "ERROR: Can't link into a global directory.  src=%s dest=%s\n", src_path, dest_path);
+        return(gop_dummy(op_failure_status));
+    } else if ((src_global == 0) && (src_shard != dest_shard)) {
+        log_printf(1, "ERROR: Cross shard symlink. src=%s dest=%s\n", src_path, dest_path);
+        return(gop_dummy(op_failure_status));
+    }
+
+    return(os_symlink_object(ossh->shard[dest_shard], creds, src_path, dest_path, id));
+}
+
+//***********************************************************************
+// ossh_hardlink_object - Generates a hard link object operation.  Hard
+//    links share the underlying object so they can't span shards.
+//***********************************************************************
+
+op_generic_t *ossh_hardlink_object(object_service_fn_t *os, creds_t *creds, char *src_path, char *dest_path, char *id)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int src_shard, dest_shard, src_global, dest_global;
+
+    src_shard = _ossh_route(ossh, src_path, &src_global);
+    dest_shard = _ossh_route(ossh, dest_path, &dest_global);
+
+    if ((src_global == 1) || (dest_global == 1) || (src_shard != dest_shard)) {
+        log_printf(1, "ERROR: Cross shard hardlink. src=%s dest=%s\n", src_path, dest_path);
+        return(gop_dummy(op_failure_status));
+    }
+
+    return(os_hardlink_object(ossh->shard[dest_shard], creds, src_path, dest_path, id));
+}
+
+//***********************************************************************
+// _ossh_copy_attrs - Copies all the real attributes between objects on
+//    different shards.  The OS managed "os.*" virtual attributes are skipped.
+//***********************************************************************
+
+int _ossh_copy_attrs(object_service_fn_t *os, creds_t *creds, object_service_fn_t *src_os, char *src_path, object_service_fn_t *dest_os, char *dest_path, char *extra_key, char *extra_val)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    os_fd_t *sfd, *dfd;
+    os_attr_iter_t *it;
+    os_regex_table_t *regex;
+    char **key, *k;
+    void **val, *v;
+    int *v_size, vs;
+    int i, n, n_max, err;
+
+    if (gop_sync_exec(os_open_object(src_os, creds, src_path, OS_MODE_READ_IMMEDIATE, NULL, &sfd, 60)) != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR opening src=%s\n", src_path);
+        return(1);
+    }
+    if (gop_sync_exec(os_open_object(dest_os, creds, dest_path, OS_MODE_WRITE_IMMEDIATE, NULL, &dfd, 60)) != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR opening dest=%s\n", dest_path);
+        gop_sync_exec(os_close_object(src_os, sfd));
+        return(1);
+    }
+
+    //** Slurp in all the attributes
+    n_max = 64;
+    type_malloc(key, char *, n_max);
+    type_malloc(val, void *, n_max);
+    type_malloc(v_size, int, n_max);
+    n = 0;
+
+    regex = os_path_glob2regex("*");
+    it = os_create_attr_iter(src_os, creds, sfd, regex, -ossh->max_attr);
+    if (it != NULL) {
+        v = NULL;
+        vs = -ossh->max_attr;
+        while (os_next_attr(src_os, it, &k, &v, &vs) == 0) {
+            if (strncmp(k, "os.", 3) == 0) {  //** Skip the virtual attributes
+                free(k);
+                if (v != NULL) free(v);
+            } else {
+                if (n >= (n_max-1)) {
+                    n_max = 2*n_max;
+                    type_realloc(key, char *, n_max);
+                    type_realloc(val, void *, n_max);
+                    type_realloc(v_size, int, n_max);
+                }
+                key[n] = k;
+                val[n] = v;
+                v_size[n] = vs;
+                n++;
+            }
+            v = NULL;
+            vs = -ossh->max_attr;
+        }
+        os_destroy_attr_iter(src_os, it);
+    }
+    os_regex_table_destroy(regex);
+
+    //** Tack on the caller's extra attribute if needed
+    if (extra_key != NULL) {
+        key[n] = strdup(extra_key);
+        val[n] = (extra_val == NULL) ? NULL : strdup(extra_val);
+        v_size[n] = (extra_val == NULL) ? -1 : strlen(extra_val);
+        n++;
+    }
+
+    err = 0;
+    if (n > 0) {
+        if (gop_sync_exec(os_set_multiple_attrs(dest_os, creds, dfd, key, val, v_size, n)) != OP_STATE_SUCCESS) {
+            log_printf(1, "ERROR storing attrs on dest=%s\n", dest_path);
+            err = 1;
+        }
+    }
+
+    for (i=0; i<n; i++) {
+        free(key[i]);
+        if (val[i] != NULL) free(val[i]);
+    }
+    free(key);
+    free(val);
+    free(v_size);
+
+    gop_sync_exec(os_close_object(src_os, sfd));
+    gop_sync_exec(os_close_object(dest_os, dfd));
+
+    return(err);
+}
+
+//***********************************************************************
+// _ossh_copy_object - Creates the object on the destination shard and
+//    copies over its attributes
+//***********************************************************************
+
+int _ossh_copy_object(object_service_fn_t *os, creds_t *creds, object_service_fn_t *src_os, char *src_path, object_service_fn_t *dest_os, char *dest_path, int ftype, char *extra_key, char *extra_val)
+{
+    char *link;
+    int v_size, err;
+    os_fd_t *fd;
+
+    if (ftype & OS_OBJECT_SYMLINK) {  //** Symlinks just get recreated
+        link = NULL;
+        v_size = -OS_PATH_MAX;
+        err = gop_sync_exec(os_open_object(src_os, creds, src_path, OS_MODE_READ_IMMEDIATE, NULL, &fd, 60));
+        if (err != OP_STATE_SUCCESS) return(1);
+        err = gop_sync_exec(os_get_attr(src_os, creds, fd, "os.link", (void **)&link, &v_size));
+        gop_sync_exec(os_close_object(src_os, fd));
+        if ((err != OP_STATE_SUCCESS) || (link == NULL)) return(1);
+        err = gop_sync_exec(os_symlink_object(dest_os, creds, link, dest_path, NULL));
+        free(link);
+        return((err == OP_STATE_SUCCESS) ? 0 : 1);
+    }
+
+    if (gop_sync_exec(os_create_object(dest_os, creds, dest_path, ftype & (OS_OBJECT_FILE|OS_OBJECT_DIR), NULL)) != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR creating dest=%s\n", dest_path);
+        return(1);
+    }
+
+    return(_ossh_copy_attrs(os, creds, src_os, src_path, dest_os, dest_path, extra_key, extra_val));
+}
+
+//***********************************************************************
+// _ossh_remove_list - Removes the objects on the stack, last pushed first,
+//    followed by the root.  Nothing is matched as a glob so names with
+//    wildcard characters only remove themselves.  Returns 0 on success.
+//***********************************************************************
+
+int _ossh_remove_list(object_service_fn_t *os, creds_t *creds, Stack_t *stack, char *root)
+{
+    char *fname;
+    int err;
+
+    err = 0;
+    while ((fname = (char *)pop(stack)) != NULL) {
+        if (gop_sync_exec(os_remove_object(os, creds, fname)) != OP_STATE_SUCCESS) {
+            log_printf(1, "ERROR removing fname=%s\n", fname);
+            err = 1;
+        }
+        free(fname);
+    }
+
+    if (gop_sync_exec(os_remove_object(os, creds, root)) != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR removing root=%s\n", root);
+        err = 1;
+    }
+
+    return(err);
+}
+
+//***********************************************************************
+// _ossh_glob_escape - Returns path as a glob matching only itself with
+//    the suffix appended unescaped
+//***********************************************************************
+
+char *_ossh_glob_escape(char *path, char *suffix)
+{
+    char *glob;
+    int i, j, n;
+
+    n = 2*strlen(path) + strlen(suffix) + 1;
+    type_malloc(glob, char, n);
+
+    j = 0;
+    for (i=0; path[i] != 0; i++) {
+        if ((path[i] == '*') || (path[i] == '?') || (path[i] == '[')) glob[j++] = '\\';
+        glob[j++] = path[i];
+    }
+    strcpy(glob + j, suffix);
+
+    return(glob);
+}
+
+//***********************************************************************
+// ossh_move_cross_fn - Moves an object between shards using a 2 phase
+//    protocol.
+//
+//    Prepare: The source root is opened for writing so other writers are
+//      held off until the move completes.  The object (and its subtree for
+//      a directory) is copied to the destination shard.  The destination
+//      root is tagged with OSSH_MOVE_PENDING_KEY holding the source path.
+//      Any failure removes the partial copy and the source is left untouched.
+//    Commit: The copied source objects are removed and the pending tag is
+//      cleared.  If the source removal fails, for example because something
+//      was added to the subtree during the copy, the tag is left in place so
+//      fsck can find the duplicate.
+//***********************************************************************
+
+op_status_t ossh_move_cross_fn(void *arg, int tid)
+{
+    ossh_mk_mv_rm_t *op = (ossh_mk_mv_rm_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    object_service_fn_t *src_os, *dest_os;
+    os_object_iter_t *it;
+    os_regex_table_t *regex;
+    os_fd_t *fd, *sfd;
+    Stack_t *src_stack, *dest_stack;
+    char *fname, *glob;
+    char dname[OS_PATH_MAX];
+    int ftype, global, prefix_len, err, n;
+
+    src_os = ossh->shard[_ossh_route(ossh, op->src_path, &global)];
+    dest_os = ossh->shard[_ossh_route(ossh, op->dest_path, &global)];
+
+    ftype = gop_sync_exec_status(os_exists(src_os, op->creds, op->src_path)).error_code;
+    if (ftype <= 0) return(op_failure_status);
+
+    //** A hardlink can't span shards.  Copying it would silently break the link
+    if (ftype & OS_OBJECT_HARDLINK) {
+        log_printf(1, "ERROR can't move a hardlink between shards src=%s dest=%s\n", op->src_path, op->dest_path);
+        return(op_failure_status);
+    }
+
+    if (gop_sync_exec_status(os_exists(dest_os, op->creds, op->dest_path)).error_code != 0) {
+        log_printf(1, "ERROR dest exists! dest=%s\n", op->dest_path);
+        return(op_failure_status);
+    }
+
+    //** Hold the source lock until it's removed so no updates slip in after the copy
+    if (gop_sync_exec(os_open_object(src_os, op->creds, op->src_path, OS_MODE_WRITE_BLOCKING, NULL, &sfd, 60)) != OP_STATE_SUCCESS) {
+        log_printf(1, "ERROR locking src=%s\n", op->src_path);
+        return(op_failure_status);
+    }
+
+    src_stack = new_stack();
+    dest_stack = new_stack();
+
+    //** Phase 1 - Prepare.  Copy the root and tag it as pending
+    log_printf(5, "PREPARE src=%s dest=%s ftype=%d\n", op->src_path, op->dest_path, ftype);
+    err = _ossh_copy_object(op->os, op->creds, src_os, op->src_path, dest_os, op->dest_path, ftype, OSSH_MOVE_PENDING_KEY, op->src_path);
+
+    //** and if it's a directory walk the subtree.  Parents are returned before children.
+    if ((err == 0) && (ftype & OS_OBJECT_DIR) && ((ftype & OS_OBJECT_SYMLINK) == 0)) {
+        n = strlen(op->src_path);
+        glob = _ossh_glob_escape(op->src_path, "/*");
+        regex = os_path_glob2regex(glob);
+        free(glob);
+        it = (regex == NULL) ? NULL : os_create_object_iter(src_os, op->creds, regex, NULL, OS_OBJECT_ANY, NULL, OSSH_MAX_RECURSE, NULL, 0);
+        if (it == NULL) {
+            err = 1;
+        } else {
+            while ((ftype = os_next_object(src_os, it, &fname, &prefix_len)) > 0) {
+                if ((strncmp(fname, op->src_path, n) != 0) || (fname[n] != '/')) {  //** Not in the subtree
+                    free(fname);
+                    continue;
+                }
+                snprintf(dname, sizeof(dname), "%s%s", op->dest_path, fname + n);
+                if ((err == 0) && (ftype & OS_OBJECT_HARDLINK)) {
+                    log_printf(1, "ERROR can't move a hardlink between shards fname=%s\n", fname);
+                    err = 1;
+                }
+                if (err == 0) {
+                    err = _ossh_copy_object(op->os, op->creds, src_os, fname, dest_os, dname, ftype, NULL, NULL);
+                    push(dest_stack, strdup(dname));  //** Even on failure since it may be partially created
+                }
+                if (err == 0) {
+                    push(src_stack, fname);
+                } else {
+                    free(fname);
+                }
+            }
+            os_destroy_object_iter(src_os, it);
+        }
+        if (regex != NULL) os_regex_table_destroy(regex);
+    }
+
+    if (err != 0) {  //** Roll back the partial copy
+        log_printf(1, "ERROR prepare failed.  Rolling back src=%s dest=%s\n", op->src_path, op->dest_path);
+        _ossh_remove_list(dest_os, op->creds, dest_stack, op->dest_path);
+        while ((fname = (char *)pop(src_stack)) != NULL) free(fname);
+        free_stack(src_stack, 0);
+        free_stack(dest_stack, 0);
+        gop_sync_exec(os_close_object(src_os, sfd));
+        return(op_failure_status);
+    }
+
+    //** Phase 2 - Commit.  Remove the source and clear the pending tag
+    log_printf(5, "COMMIT src=%s dest=%s\n", op->src_path, op->dest_path);
+    err = _ossh_remove_list(src_os, op->creds, src_stack, op->src_path);
+    while ((fname = (char *)pop(dest_stack)) != NULL) free(fname);
+    free_stack(src_stack, 0);
+    free_stack(dest_stack, 0);
+    gop_sync_exec(os_close_object(src_os, sfd));
+    if (err != 0) {
+        log_printf(0, "ERROR commit failed removing src=%s.  dest=%s left tagged with %s\n", op->src_path, op->dest_path, OSSH_MOVE_PENDING_KEY);
+        return(op_failure_status);
+    }
+
+    if (gop_sync_exec(os_open_object(dest_os, op->creds, op->dest_path, OS_MODE_WRITE_IMMEDIATE, NULL, &fd, 60)) == OP_STATE_SUCCESS) {
+        gop_sync_exec(os_set_attr(dest_os, op->creds, fd, OSSH_MOVE_PENDING_KEY, NULL, -1));
+        gop_sync_exec(os_close_object(dest_os, fd));
+    }
+
+    return(op_success_status);
+}
+
+//***********************************************************************
+// _ossh_has_sharded_children - Returns 1 if any shard holds objects under
+//    the global path at the prefix depth, ie objects whose shard was picked
+//    using the global path's name.
+//***********************************************************************
+
+int _ossh_has_sharded_children(ossh_priv_t *ossh, creds_t *creds, char *path)
+{
+    os_object_iter_t *it;
+    os_regex_table_t *regex;
+    char glob[OS_PATH_MAX];
+    char *fname;
+    int i, depth, n, prefix_len, found;
+
+    //** Count the components in the global path
+    depth = 0;
+    i = 0;
+    while (path[i] != 0) {
+        while (path[i] == '/') i++;
+        if (path[i] == 0) break;
+        while ((path[i] != '/') && (path[i] != 0)) i++;
+        depth++;
+    }
+
+    //** and pad it out with wildcards down to the sharded level
+    n = snprintf(glob, sizeof(glob), "%s", path);
+    for (i=depth; (i<ossh->prefix_depth) && (n < (int)sizeof(glob)-3); i++) {
+        n += snprintf(glob + n, sizeof(glob) - n, "/*");
+    }
+
+    found = 0;
+    regex = os_path_glob2regex(glob);
+    for (i=0; (i<ossh->n_shards) && (found == 0); i++) {
+        it = os_create_object_iter(ossh->shard[i], creds, regex, NULL, OS_OBJECT_ANY, NULL, 0, NULL, 0);
+        if (it == NULL) {  //** Can't tell so play it safe
+            found = 1;
+            break;
+        }
+        if (os_next_object(ossh->shard[i], it, &fname, &prefix_len) > 0) {
+            log_printf(5, "path=%s has sharded child=%s on shard=%s\n", path, fname, ossh->shard_section[i]);
+            free(fname);
+            found = 1;
+        }
+        os_destroy_object_iter(ossh->shard[i], it);
+    }
+    os_regex_table_destroy(regex);
+
+    return(found);
+}
+
+//***********************************************************************
+// ossh_global_move_fn - Renames a global directory on all shards.
+//    Anything below it at the prefix depth was placed using the old name
+//    so the rename is refused unless the subtree has nothing sharded in it.
+//    Otherwise those objects would be stranded on shards the new name no
+//    longer routes to.
+//***********************************************************************
+
+op_status_t ossh_global_move_fn(void *arg, int tid)
+{
+    ossh_mk_mv_rm_t *op = (ossh_mk_mv_rm_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    op_status_t status;
+    int i;
+
+    if (_ossh_has_sharded_children(ossh, op->creds, op->src_path) == 1) {
+        log_printf(1, "ERROR: Can't rename a global directory with sharded objects below it. src=%s dest=%s\n", op->src_path, op->dest_path);
+        return(op_failure_status);
+    }
+
+    status = gop_sync_exec_status(os_move_object(ossh->shard[0], op->creds, op->src_path, op->dest_path));
+    if (status.op_status != OP_STATE_SUCCESS) return(status);
+
+    for (i=1; i<ossh->n_shards; i++) {
+        if (gop_sync_exec(os_move_object(ossh->shard[i], op->creds, op->src_path, op->dest_path)) != OP_STATE_SUCCESS) {
+            log_printf(0, "ERROR moving global object on shard=%s src=%s dest=%s\n", ossh->shard_section[i], op->src_path, op->dest_path);
+            status = op_failure_status;
+        }
+    }
+
+    return(status);
+}
+
+//***********************************************************************
+// ossh_move_object - Generates a move object operation
+//***********************************************************************
+
+op_generic_t *ossh_move_object(object_service_fn_t *os, creds_t *creds, char *src_path, char *dest_path)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int src_shard, dest_shard, src_global, dest_global;
+
+    src_shard = _ossh_route(ossh, src_path, &src_global);
+    dest_shard = _ossh_route(ossh, dest_path, &dest_global);
+
+    if ((src_global == 0) && (dest_global == 0)) {
+        if (src_shard == dest_shard) return(os_move_object(ossh->shard[src_shard], creds, src_path, dest_path));
+
+        return(new_thread_pool_op(ossh->tpc, NULL, ossh_move_cross_fn, (void *)ossh_new_mk_mv_rm(os, creds, src_path, dest_path, NULL, 0), ossh_free_mk_mv_rm, 1));
+    }
+
+    //** Renaming a global directory changes the shard of everything below
+    //** it at the prefix level so it's only allowed if there's nothing there
+    if ((src_global == 1) && (dest_global == 1)) {
+        return(new_thread_pool_op(ossh->tpc, NULL, ossh_global_move_fn, (void *)ossh_new_mk_mv_rm(os, creds, src_path, dest_path, NULL, 0), ossh_free_mk_mv_rm, 1));
+    }
+
+    log_printf(1, "ERROR: Can't move between a global and sharded level. src=%s dest=%s\n", src_path, dest_path);
+    return(gop_dummy(op_failure_status));
+}
+
+//***********************************************************************
+// ossh_open_object_fn - Handles the actual object open
+//***********************************************************************
+
+op_status_t ossh_open_object_fn(void *arg, int tid)
+{
+    ossh_open_op_t *op = (ossh_open_op_t *)arg;
+    op_status_t status;
+    ossh_fd_t *fd;
+
+    status = gop_sync_exec_status(op->gop);
+    op->gop = NULL;
+
+    if (status.op_status != OP_STATE_SUCCESS) return(status);
+
+    type_malloc(fd, ossh_fd_t, 1);
+    fd->shard = op->shard;
+    fd->fname = op->path;
+    op->path = NULL;
+    fd->fd_child = op->cfd;
+    *op->pfd = fd;
+
+    return(status);
+}
+
+//***********************************************************************
+//  ossh_open_free - Frees an open op structure
+//***********************************************************************
+
+void ossh_open_free(void *arg)
+{
+    ossh_open_op_t *op = (ossh_open_op_t *)arg;
+
+    if (op->path != NULL) free(op->path);
+    if (op->gop != NULL) gop_free(op->gop, OP_DESTROY);
+    free(op);
+}
+
+//***********************************************************************
+//  ossh_open_object - Makes the open file op
+//***********************************************************************
+
+op_generic_t *ossh_open_object(object_service_fn_t *os, creds_t *creds, char *path, int mode, char *id, os_fd_t **pfd, int max_wait)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_open_op_t *op;
+    op_generic_t *gop;
+    int global;
+
+    type_malloc_clear(op, ossh_open_op_t, 1);
+    op->os = os;
+    op->pfd = pfd;
+    op->path = strdup(path);
+    op->shard = _ossh_route(ossh, path, &global);
+
+    op->gop = os_open_object(ossh->shard[op->shard], creds, op->path, mode, id, &(op->cfd), max_wait);
+    gop = new_thread_pool_op(ossh->tpc, NULL, ossh_open_object_fn, (void *)op, ossh_open_free, 1);
+
+    gop_set_private(gop, op);
+    return(gop);
+}
+
+//***********************************************************************
+//  ossh_abort_open_object - Aborts an ongoing open file op
+//***********************************************************************
+
+op_generic_t *ossh_abort_open_object(object_service_fn_t *os, op_generic_t *gop)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_open_op_t *op = (ossh_open_op_t *)gop_get_private(gop);
+
+    return(os_abort_open_object(ossh->shard[op->shard], op->gop));
+}
+
+//***********************************************************************
+// ossh_close_object_fn - Handles the actual object close
+//***********************************************************************
+
+op_status_t ossh_close_object_fn(void *arg, int tid)
+{
+    ossh_open_op_t *op = (ossh_open_op_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    ossh_fd_t *fd = op->close_fd;
+    op_status_t status;
+
+    status = gop_sync_exec_status(os_close_object(ossh->shard[fd->shard], fd->fd_child));
+
+    free(fd->fname);
+    free(fd);
+
+    return(status);
+}
+
+//***********************************************************************
+//  ossh_close_object - Closes the object
+//***********************************************************************
+
+op_generic_t *ossh_close_object(object_service_fn_t *os, os_fd_t *ofd)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_open_op_t *op;
+
+    type_malloc_clear(op, ossh_open_op_t, 1);
+    op->os = os;
+    op->close_fd = (ossh_fd_t *)ofd;
+    return(new_thread_pool_op(ossh->tpc, NULL, ossh_close_object_fn, (void *)op, free, 1));
+}
+
+//***********************************************************************
+// ossh_get_attr - Gets an attribute
+//***********************************************************************
+
+op_generic_t *ossh_get_attr(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char *key, void **val, int *v_size)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+
+    return(os_get_attr(ossh->shard[fd->shard], creds, fd->fd_child, key, val, v_size));
+}
+
+//***********************************************************************
+// ossh_set_attr - Sets an attribute
+//***********************************************************************
+
+op_generic_t *ossh_set_attr(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char *key, void *val, int v_size)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+
+    return(os_set_attr(ossh->shard[fd->shard], creds, fd->fd_child, key, val, v_size));
+}
+
+//***********************************************************************
+// ossh_get_multiple_attrs - Gets multiple attributes
+//***********************************************************************
+
+op_generic_t *ossh_get_multiple_attrs(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char **key, void **val, int *v_size, int n)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+
+    return(os_get_multiple_attrs(ossh->shard[fd->shard], creds, fd->fd_child, key, val, v_size, n));
+}
+
+//***********************************************************************
+// ossh_set_multiple_attrs - Sets multiple attributes
+//***********************************************************************
+
+op_generic_t *ossh_set_multiple_attrs(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char **key, void **val, int *v_size, int n)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+
+    return(os_set_multiple_attrs(ossh->shard[fd->shard], creds, fd->fd_child, key, val, v_size, n));
+}
+
+//***********************************************************************
+// ossh_move_attr - Renames an attribute
+//***********************************************************************
+
+op_generic_t *ossh_move_attr(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char *key_old, char *key_new)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+
+    return(os_move_attr(ossh->shard[fd->shard], creds, fd->fd_child, key_old, key_new));
+}
+
+//***********************************************************************
+// ossh_move_multiple_attrs - Renames multiple attributes
+//***********************************************************************
+
+op_generic_t *ossh_move_multiple_attrs(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, char **key_old, char **key_new, int n)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+
+    return(os_move_multiple_attrs(ossh->shard[fd->shard], creds, fd->fd_child, key_old, key_new, n));
+}
+
+//***********************************************************************
+// ossh_copy_cross_fn - Copies attributes between objects on different
+//    shards by fetching them from the source and storing them on the dest
+//***********************************************************************
+
+op_status_t ossh_copy_cross_fn(void *arg, int tid)
+{
+    ossh_copy_attr_t *op = (ossh_copy_attr_t *)arg;
+    ossh_priv_t *ossh = (ossh_priv_t *)op->os->priv;
+    op_status_t status;
+    void **val;
+    int *v_size;
+    int i;
+
+    type_malloc_clear(val, void *, op->n);
+    type_malloc(v_size, int, op->n);
+    for (i=0; i<op->n; i++) v_size[i] = -ossh->max_attr;
+
+    status = gop_sync_exec_status(os_get_multiple_attrs(ossh->shard[op->fd_src->shard], op->creds, op->fd_src->fd_child, op->key_src, val, v_size, op->n));
+    if (status.op_status == OP_STATE_SUCCESS) {
+        status = gop_sync_exec_status(os_set_multiple_attrs(ossh->shard[op->fd_dest->shard], op->creds, op->fd_dest->fd_child, op->key_dest, val, v_size, op->n));
+    }
+
+    for (i=0; i<op->n; i++) {
+        if (val[i] != NULL) free(val[i]);
+    }
+    free(val);
+    free(v_size);
+
+    return(status);
+}
+
+//***********************************************************************
+// ossh_copy_multiple_attrs - Copies multiple attributes between objects
+//***********************************************************************
+
+op_generic_t *ossh_copy_multiple_attrs(object_service_fn_t *os, creds_t *creds, os_fd_t *fd_src, char **key_src, os_fd_t *fd_dest, char **key_dest, int n)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *sfd = (ossh_fd_t *)fd_src;
+    ossh_fd_t *dfd = (ossh_fd_t *)fd_dest;
+    ossh_copy_attr_t *op;
+
+    if (sfd->shard == dfd->shard) return(os_copy_multiple_attrs(ossh->shard[sfd->shard], creds, sfd->fd_child, key_src, dfd->fd_child, key_dest, n));
+
+    type_malloc(op, ossh_copy_attr_t, 1);
+    op->os = os;
+    op->creds = creds;
+    op->fd_src = sfd;
+    op->fd_dest = dfd;
+    op->key_src = key_src;
+    op->key_dest = key_dest;
+    op->n = n;
+
+    return(new_thread_pool_op(ossh->tpc, NULL, ossh_copy_cross_fn, (void *)op, free, 1));
+}
+
+//***********************************************************************
+// ossh_copy_attr - Copies an attribute between objects
+//***********************************************************************
+
+op_generic_t *ossh_copy_attr(object_service_fn_t *os, creds_t *creds, os_fd_t *fd_src, char *key_src, os_fd_t *fd_dest, char *key_dest)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *sfd = (ossh_fd_t *)fd_src;
+    ossh_fd_t *dfd = (ossh_fd_t *)fd_dest;
+    ossh_copy_attr_t *op;
+
+    if (sfd->shard == dfd->shard) return(os_copy_attr(ossh->shard[sfd->shard], creds, sfd->fd_child, key_src, dfd->fd_child, key_dest));
+
+    //** The key pointers have to outlive this call so stash them after the op
+    op = malloc(sizeof(ossh_copy_attr_t) + 2*sizeof(char *));
+    assert(op != NULL);
+    op->os = os;
+    op->creds = creds;
+    op->fd_src = sfd;
+    op->fd_dest = dfd;
+    op->key_src = (char **)(op + 1);
+    op->key_dest = op->key_src + 1;
+    op->key_src[0] = key_src;
+    op->key_dest[0] = key_dest;
+    op->n = 1;
+
+    return(new_thread_pool_op(ossh->tpc, NULL, ossh_copy_cross_fn, (void *)op, free, 1));
+}
+
+//***********************************************************************
+// ossh_symlink_multiple_attrs - Generates a link multiple attributes
+//    operation.  Attribute links are resolved by the shard's OS so all
+//    the sources have to live on the same shard as the destination.
+//***********************************************************************
+
+op_generic_t *ossh_symlink_multiple_attrs(object_service_fn_t *os, creds_t *creds, char **src_path, char **key_src, os_fd_t *fd_dest, char **key_dest, int n)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *dfd = (ossh_fd_t *)fd_dest;
+    int i, global;
+
+    for (i=0; i<n; i++) {
+        if (_ossh_route(ossh, src_path[i], &global) != dfd->shard) {
+            log_printf(1, "ERROR: Cross shard attribute link src=%s dest=%s\n", src_path[i], dfd->fname);
+            return(gop_dummy(op_failure_status));
+        }
+    }
+
+    return(os_symlink_multiple_attrs(ossh->shard[dfd->shard], creds, src_path, key_src, dfd->fd_child, key_dest, n));
+}
+
+//***********************************************************************
+// ossh_symlink_attr - Generates a link attribute operation
+//***********************************************************************
+
+op_generic_t *ossh_symlink_attr(object_service_fn_t *os, creds_t *creds, char *src_path, char *key_src, os_fd_t *fd_dest, char *key_dest)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *dfd = (ossh_fd_t *)fd_dest;
+    int global;
+
+    if (_ossh_route(ossh, src_path, &global) != dfd->shard) {
+        log_printf(1, "ERROR: Cross shard attribute link src=%s dest=%s\n", src_path, dfd->fname);
+        return(gop_dummy(op_failure_status));
+    }
+
+    return(os_symlink_attr(ossh->shard[dfd->shard], creds, src_path, key_src, dfd->fd_child, key_dest));
+}
+
+//***********************************************************************
+// ossh_next_attr - Returns the next matching attribute
+//***********************************************************************
+
+int ossh_next_attr(os_attr_iter_t *oit, char **key, void **val, int *v_size)
+{
+    ossh_attr_iter_t *it = (ossh_attr_iter_t *)oit;
+    ossh_priv_t *ossh = (ossh_priv_t *)it->os->priv;
+
+    if (it->it == NULL) return(-1);
+    return(os_next_attr(ossh->shard[it->shard], it->it, key, val, v_size));
+}
+
+//***********************************************************************
+// ossh_create_attr_iter - Creates an attribute iterator.  The object's
+//    attributes all live on its shard.
+//***********************************************************************
+
+os_attr_iter_t *ossh_create_attr_iter(object_service_fn_t *os, creds_t *creds, os_fd_t *ofd, os_regex_table_t *attr, int v_max)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fd_t *fd = (ossh_fd_t *)ofd;
+    ossh_attr_iter_t *it;
+
+    type_malloc(it, ossh_attr_iter_t, 1);
+    it->os = os;
+    it->shard = fd->shard;
+    it->it = os_create_attr_iter(ossh->shard[fd->shard], creds, fd->fd_child, attr, v_max);
+    if (it->it == NULL) {
+        free(it);
+        return(NULL);
+    }
+
+    return(it);
+}
+
+//***********************************************************************
+// ossh_destroy_attr_iter - Destroys an attribute iterator
+//***********************************************************************
+
+void ossh_destroy_attr_iter(os_attr_iter_t *oit)
+{
+    ossh_attr_iter_t *it = (ossh_attr_iter_t *)oit;
+    ossh_priv_t *ossh = (ossh_priv_t *)it->os->priv;
+
+    os_destroy_attr_iter(ossh->shard[it->shard], it->it);
+    free(it);
+}
+
+//***********************************************************************
+// ossh_next_object - Returns the iterators next matching object.  The
+//    shards are drained in order.  Global directories exist on every shard
+//    so they are only reported from the primary.
+//***********************************************************************
+
+int ossh_next_object(os_object_iter_t *oit, char **fname, int *prefix_len)
+{
+    ossh_object_iter_t *it = (ossh_object_iter_t *)oit;
+    ossh_priv_t *ossh;
+    int ftype, global, i;
+
+    if (it == NULL) {
+        log_printf(0, "ERROR: it=NULL\n");
+        return(-2);
+    }
+
+    ossh = (ossh_priv_t *)it->os->priv;
+
+    while (it->curr < ossh->n_shards) {
+        if (it->it_child[it->curr] == NULL) {
+            it->curr++;
+            continue;
+        }
+
+        ftype = os_next_object(ossh->shard[it->curr], it->it_child[it->curr], fname, prefix_len);
+        if (ftype < 0) return(ftype);  //** Got an error
+        if (ftype == 0) {  //** Finished with this shard
+            it->curr++;
+            continue;
+        }
+
+        if (it->curr != 0) {
+            _ossh_route(ossh, *fname, &global);
+            if (global == 1) {  //** Dup of the primary's copy so skip it
+                free(*fname);
+                for (i=0; i<it->n_keys; i++) {
+                    if (it->val[i] != NULL) {
+                        free(it->val[i]);
+                        it->val[i] = NULL;
+                    }
+                    it->v_size[i] = it->v_size_initial[i];
+                }
+                continue;
+            }
+        }
+
+        it->it_attr.shard = it->curr;
+        it->it_attr.it = (it->ait_child != NULL) ? it->ait_child[it->curr] : NULL;
+        return(ftype);
+    }
+
+    *fname = NULL;
+    *prefix_len = -1;
+    return(0);
+}
+
+//***********************************************************************
+// ossh_destroy_object_iter - Destroy the object iterator
+//***********************************************************************
+
+void ossh_destroy_object_iter(os_object_iter_t *oit)
+{
+    ossh_object_iter_t *it = (ossh_object_iter_t *)oit;
+    ossh_priv_t *ossh;
+    int i;
+
+    if (it == NULL) {
+        log_printf(0, "ERROR: it=NULL\n");
+        return;
+    }
+
+    ossh = (ossh_priv_t *)it->os->priv;
+    for (i=0; i<ossh->n_shards; i++) {
+        if (it->it_child[i] != NULL) os_destroy_object_iter(ossh->shard[i], it->it_child[i]);
+    }
+
+    free(it->it_child);
+    if (it->ait_child != NULL) free(it->ait_child);
+    if (it->v_size_initial != NULL) free(it->v_size_initial);
+    free(it);
+}
+
+//***********************************************************************
+// _ossh_new_object_iter - Makes an empty object iterator
+//***********************************************************************
+
+ossh_object_iter_t *_ossh_new_object_iter(object_service_fn_t *os, int with_attr)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_object_iter_t *it;
+
+    type_malloc_clear(it, ossh_object_iter_t, 1);
+    it->os = os;
+    it->it_attr.os = os;
+    type_malloc_clear(it->it_child, os_object_iter_t *, ossh->n_shards);
+    if (with_attr == 1) type_malloc_clear(it->ait_child, os_attr_iter_t *, ossh->n_shards);
+
+    return(it);
+}
+
+//***********************************************************************
+// ossh_create_object_iter - Creates an object iterator to selectively
+//  retreive object/attribute combinations.  If the path pins the search
+//  to a single shard only it is used.
+//***********************************************************************
+
+os_object_iter_t *ossh_create_object_iter(object_service_fn_t *os, creds_t *creds, os_regex_table_t *path, os_regex_table_t *object_regex, int object_types,
+        os_regex_table_t *attr, int recurse_depth, os_attr_iter_t **it_attr, int v_max)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_object_iter_t *it;
+    int i, shard;
+
+    it = _ossh_new_object_iter(os, (it_attr != NULL) ? 1 : 0);
+    if (it_attr != NULL) *it_attr = (os_attr_iter_t *)&(it->it_attr);
+
+    shard = _ossh_regex_route(ossh, path);
+    for (i=0; i<ossh->n_shards; i++) {
+        if ((shard >= 0) && (i != shard)) continue;
+
+        it->it_child[i] = os_create_object_iter(ossh->shard[i], creds, path, object_regex, object_types, attr, recurse_depth, (it_attr != NULL) ? &(it->ait_child[i]) : NULL, v_max);
+        if (it->it_child[i] == NULL) {
+            log_printf(1, "ERROR creating iterator on shard=%s\n", ossh->shard_section[i]);
+            ossh_destroy_object_iter(it);
+            return(NULL);
+        }
+    }
+
+    return(it);
+}
+
+//***********************************************************************
+// ossh_create_object_iter_alist - Creates an object iterator to selectively
+//  retreive object/attribute from a fixed attr list
+//***********************************************************************
+
+os_object_iter_t *ossh_create_object_iter_alist(object_service_fn_t *os, creds_t *creds, os_regex_table_t *path, os_regex_table_t *object_regex, int object_types,
+        int recurse_depth, char **key, void **val, int *v_size, int n_keys)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_object_iter_t *it;
+    int i, shard;
+
+    it = _ossh_new_object_iter(os, 0);
+    it->val = val;
+    it->v_size = v_size;
+    it->n_keys = n_keys;
+    type_malloc(it->v_size_initial, int, n_keys);
+    memcpy(it->v_size_initial, v_size, n_keys*sizeof(int));
+
+    shard = _ossh_regex_route(ossh, path);
+    for (i=0; i<ossh->n_shards; i++) {
+        if ((shard >= 0) && (i != shard)) continue;
+
+        it->it_child[i] = os_create_object_iter_alist(ossh->shard[i], creds, path, object_regex, object_types, recurse_depth, key, val, v_size, n_keys);
+        if (it->it_child[i] == NULL) {
+            log_printf(1, "ERROR creating iterator on shard=%s\n", ossh->shard_section[i]);
+            ossh_destroy_object_iter(it);
+            return(NULL);
+        }
+    }
+
+    return(it);
+}
+
+//***********************************************************************
+//  ossh_fsck_object - Routes the object check to its shard
+//***********************************************************************
+
+op_generic_t *ossh_fsck_object(object_service_fn_t *os, creds_t *creds, char *fname, int ftype, int resolution)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int global;
+
+    return(os_fsck_object(ossh->shard[_ossh_route(ossh, fname, &global)], creds, fname, ftype, resolution));
+}
+
+//***********************************************************************
+// ossh_next_fsck - Returns the next problem object from any shard
+//***********************************************************************
+
+int ossh_next_fsck(object_service_fn_t *os, os_fsck_iter_t *oit, char **bad_fname, int *bad_atype)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fsck_iter_t *it = (ossh_fsck_iter_t *)oit;
+    int err, global;
+
+    while (it->curr < ossh->n_shards) {
+        if (it->it_child[it->curr] == NULL) {
+            it->curr++;
+            continue;
+        }
+
+        err = os_next_fsck(ossh->shard[it->curr], it->it_child[it->curr], bad_fname, bad_atype);
+        if (err == OS_FSCK_FINISHED) {
+            it->curr++;
+            continue;
+        } else if (err == OS_FSCK_ERROR) {
+            return(err);
+        }
+
+        //** Global dirs on the secondaries don't hold attributes so ignore them
+        if ((it->curr != 0) && (*bad_fname != NULL)) {
+            _ossh_route(ossh, *bad_fname, &global);
+            if (global == 1) {
+                free(*bad_fname);
+                *bad_fname = NULL;
+                continue;
+            }
+        }
+
+        return(err);
+    }
+
+    return(OS_FSCK_FINISHED);
+}
+
+//***********************************************************************
+// ossh_create_fsck_iter - Creates an fsck iterator across the shards
+//***********************************************************************
+
+os_fsck_iter_t *ossh_create_fsck_iter(object_service_fn_t *os, creds_t *creds, char *path, int mode)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fsck_iter_t *it;
+    int i, shard, global;
+
+    shard = _ossh_route(ossh, path, &global);
+
+    type_malloc_clear(it, ossh_fsck_iter_t, 1);
+    type_malloc_clear(it->it_child, os_fsck_iter_t *, ossh->n_shards);
+    for (i=0; i<ossh->n_shards; i++) {
+        if ((global == 0) && (i != shard)) continue;
+        it->it_child[i] = os_create_fsck_iter(ossh->shard[i], creds, path, mode);
+    }
+
+    return(it);
+}
+
+//***********************************************************************
+// ossh_destroy_fsck_iter - Destroys an fsck iterator
+//***********************************************************************
+
+void ossh_destroy_fsck_iter(object_service_fn_t *os, os_fsck_iter_t *oit)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    ossh_fsck_iter_t *it = (ossh_fsck_iter_t *)oit;
+    int i;
+
+    for (i=0; i<ossh->n_shards; i++) {
+        if (it->it_child[i] != NULL) os_destroy_fsck_iter(ossh->shard[i], it->it_child[i]);
+    }
+    free(it->it_child);
+    free(it);
+}
+
+//***********************************************************************
+// ossh_cred_init - Intialize a set of credentials
+//***********************************************************************
+
+creds_t *ossh_cred_init(object_service_fn_t *os, int type, void **args)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+
+    return(os_cred_init(ossh->shard[0], type, args));
+}
+
+//***********************************************************************
+// ossh_cred_destroy - Destroys a set ot credentials
+//***********************************************************************
+
+void ossh_cred_destroy(object_service_fn_t *os, creds_t *creds)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+
+    return(os_cred_destroy(ossh->shard[0], creds));
+}
+
+//***********************************************************************
+// ossh_destroy
+//***********************************************************************
+
+void ossh_destroy(object_service_fn_t *os)
+{
+    ossh_priv_t *ossh = (ossh_priv_t *)os->priv;
+    int i;
+
+    for (i=0; i<ossh->n_shards; i++) {
+        os_destroy(ossh->shard[i]);
+        free(ossh->shard_section[i]);
+    }
+
+    free(ossh->shard);
+    free(ossh->shard_section);
+    free(ossh->ring);
+    free(ossh);
+    free(os);
+}
+
+//***********************************************************************
+//  object_service_shard_create - Creates a sharded OS
+//***********************************************************************
+
+object_service_fn_t *object_service_shard_create(service_manager_t *ess, inip_file_t *fd, char *section)
+{
+    object_service_fn_t *os;
+    ossh_priv_t *ossh;
+    os_create_t *os_create;
+    inip_element_t *ele;
+    char *key, *ctype;
+    char buffer[1024];
+    int i, j, n_max, virtual_nodes;
+
+    log_printf(10, "START\n");
+    if (section == NULL) section = "os_shard";
+
+    type_malloc_clear(os, object_service_fn_t, 1);
+    type_malloc_clear(ossh, ossh_priv_t, 1);
+    os->priv = (void *)ossh;
+
+    ossh->prefix_depth = inip_get_integer(fd, section, "prefix_depth", 1);
+    ossh->max_attr = inip_get_integer(fd, section, "max_attr_size", 10*1024*1024);
+    virtual_nodes = inip_get_integer(fd, section, "virtual_nodes", 64);
+    if (ossh->prefix_depth < 1) ossh->prefix_depth = 1;
+    if (virtual_nodes < 1) virtual_nodes = 1;
+
+    //** Load the shards.  Each "shard=<section>" entry is a child OS
+    n_max = 8;
+    type_malloc_clear(ossh->shard, object_service_fn_t *, n_max);
+    type_malloc_clear(ossh->shard_section, char *, n_max);
+    ele = inip_first_element(inip_find_group(fd, section));
+    while (ele != NULL) {
+        key = inip_get_element_key(ele);
+        if (strcmp(key, "shard") == 0) {
+            if (ossh->n_shards >= n_max) {
+                n_max = 2*n_max;
+                type_realloc(ossh->shard, object_service_fn_t *, n_max);
+                type_realloc(ossh->shard_section, char *, n_max);
+            }
+            i = ossh->n_shards;
+            ossh->shard_section[i] = strdup(inip_get_element_value(ele));
+            ctype = inip_get_string(fd, ossh->shard_section[i], "type", OS_TYPE_REMOTE_CLIENT);
+            os_create = lookup_service(ess, OS_AVAILABLE, ctype);
+            ossh->shard[i] = (os_create == NULL) ? NULL : (*os_create)(ess, fd, ossh->shard_section[i]);
+            if (ossh->shard[i] == NULL) {
+                log_printf(0, "Error loading shard object service!  type=%s section=%s\n", ctype, ossh->shard_section[i]);
+                fprintf(stderr, "Error loading shard object service!  type=%s section=%s\n", ctype, ossh->shard_section[i]);
+                fflush(stderr);
+                abort();
+            }
+            free(ctype);
+            ossh->n_shards++;
+        }
+        ele = inip_next_element(ele);
+    }
+
+    if (ossh->n_shards == 0) {
+        log_printf(0, "ERROR:  No shards defined! section=%s\n", section);
+        abort();
+    }
+
+    //** Make the consistent hash ring.  The points are based on the section
+    //** names so adding a shard only moves the keys it takes over.
+    ossh->n_ring = ossh->n_shards * virtual_nodes;
+    type_malloc(ossh->ring, ossh_ring_t, ossh->n_ring);
+    for (i=0; i<ossh->n_shards; i++) {
+        for (j=0; j<virtual_nodes; j++) {
+            snprintf(buffer, sizeof(buffer), "%s#%d", ossh->shard_section[i], j);
+            ossh->ring[i*virtual_nodes + j].hash = _ossh_hash(buffer, strlen(buffer), 14695981039346656037ULL);
+            ossh->ring[i*virtual_nodes + j].shard = i;
+        }
+    }
+    qsort(ossh->ring, ossh->n_ring, sizeof(ossh_ring_t), _ossh_ring_compare);
+
+    log_printf(1, "n_shards=%d prefix_depth=%d virtual_nodes=%d\n", ossh->n_shards, ossh->prefix_depth, virtual_nodes);
+
+    //** Get the thread pool to use
+    ossh->tpc = lookup_service(ess, ESS_RUNNING, ESS_TPC_UNLIMITED); assert(ossh->tpc != NULL);
+
+    //** Set up the fn ptrs
+    os->type = OS_TYPE_SHARD;
+
+    os->destroy_service = ossh_destroy;
+    os->cred_init = ossh_cred_init;
+    os->cred_destroy = ossh_cred_destroy;
+    os->exists = ossh_exists;
+    os->create_object = ossh_create_object;
+    os->remove_object = ossh_remove_object;
+    os->remove_regex_object = ossh_remove_regex_object;
+    os->abort_remove_regex_object = ossh_abort_remove_regex_object;
+    os->move_object = ossh_move_object;
+    os->symlink_object = ossh_symlink_object;
+    os->hardlink_object = ossh_hardlink_object;
+    os->create_object_iter = ossh_create_object_iter;
+    os->create_object_iter_alist = ossh_create_object_iter_alist;
+    os->next_object = ossh_next_object;
+    os->destroy_object_iter = ossh_destroy_object_iter;
+    os->open_object = ossh_open_object;
+    os->close_object = ossh_close_object;
+    os->abort_open_object = ossh_abort_open_object;
+    os->get_attr = ossh_get_attr;
+    os->set_attr = ossh_set_attr;
+    os->symlink_attr = ossh_symlink_attr;
+    os->copy_attr = ossh_copy_attr;
+    os->get_multiple_attrs = ossh_get_multiple_attrs;
+    os->set_multiple_attrs = ossh_set_multiple_attrs;
+    os->copy_multiple_attrs = ossh_copy_multiple_attrs;
+    os->symlink_multiple_attrs = ossh_symlink_multiple_attrs;
+    os->move_attr = ossh_move_attr;
+    os->move_multiple_attrs = ossh_move_multiple_attrs;
+    os->regex_object_set_multiple_attrs = ossh_regex_object_set_multiple_attrs;
+    os->abort_regex_object_set_multiple_attrs = ossh_abort_regex_object_set_multiple_attrs;
+    os->create_attr_iter = ossh_create_attr_iter;
+    os->next_attr = ossh_next_attr;
+    os->destroy_attr_iter = ossh_destroy_attr_iter;
+
+    os->create_fsck_iter = ossh_create_fsck_iter;
+    os->destroy_fsck_iter = ossh_destroy_fsck_iter;
+    os->next_fsck = ossh_next_fsck;
+    os->fsck_object = ossh_fsck_object;
+
+    log_printf(10, "END\n");
+
+    return(os);
+}
@@ -734,6 +734,387 @@ void os_create_remove_tests()
     return;
 }
 
+// **********************************************************************************
+//  path_attr_rw - Opens the path and either sets (val != NULL) or checks the attribute
+//     against cmp.  Returns 0 on success
+// **********************************************************************************
+
+int path_attr_rw(char *path, char *key, char *val, char *cmp)
+{
+    object_service_fn_t *os = lio_gc->os;
+    creds_t  *creds = lio_gc->creds;
+    os_fd_t *fd;
+    char *rval;
+    int err, v_size;
+
+    err = gop_sync_exec(os_open_object(os, creds, path, OS_MODE_READ_IMMEDIATE, "me", &fd, wait_time));
+    if (err != OP_STATE_SUCCESS) {
+        log_printf(0, "ERROR: opening file: %s err=%d\n", path, err);
+        return(1);
+    }
+
+    if (val != NULL) {
+        err = gop_sync_exec(os_set_attr(os, creds, fd, key, val, strlen(val)));
+        err = (err == OP_STATE_SUCCESS) ? 0 : 1;
+    } else {
+        rval = NULL;
+        v_size = -1000;
+        err = gop_sync_exec(os_get_attr(os, creds, fd, key, (void **)&rval, &v_size));
+        if ((err != OP_STATE_SUCCESS) || (rval == NULL) || (strcmp(rval, cmp) != 0)) {
+            log_printf(0, "ERROR: path=%s attr=%s got=%s should be %s\n", path, key, rval, cmp);
+            err = 1;
+        } else {
+            err = 0;
+        }
+        if (rval != NULL) free(rval);
+    }
+
+    gop_sync_exec(os_close_object(os, fd));
+    return(err);
+}
+
+// **********************************************************************************
+//  du_check - Compares the directory's usage aggregate with the expected
+//     "bytes files dirs" string.  Returns 0 if it matches.
+// **********************************************************************************
+
+int du_check(char *dir, char *expect)
+{
+    char path[PATH_LEN];
+
+    snprintf(path, PATH_LEN, "%s/%s", prefix, dir);
+    return(path_attr_rw(path, "os.du", NULL, expect));
+}
+
+// **********************************************************************************
+//  du_size - Sets the size the usage aggregates track for the file
+// **********************************************************************************
+
+int du_size(char *file, char *size)
+{
+    char path[PATH_LEN];
+
+    snprintf(path, PATH_LEN, "%s/%s", prefix, file);
+    return(path_attr_rw(path, "system.exnode.size", size, NULL));
+}
+
+// **********************************************************************************
+//  os_du_tests - Checks the directory usage aggregates follow creates,
+//     removes, moves, including over an existing file, and resizes.
+// **********************************************************************************
+
+void os_du_tests()
+{
+    object_service_fn_t *os = lio_gc->os;
+    creds_t  *creds = lio_gc->creds;
+    int err, i;
+    char foo_path[PATH_LEN];
+    char bar_path[PATH_LEN];
+    char *rval;
+    int v_size;
+    os_fd_t *fd;
+    os_regex_table_t *regex;
+    char *dirs[] = { "dutest", "dutest/sub" };
+    char *files[] = { "dutest/f1", "dutest/sub/f2", "dutest/g" };
+    char *sizes[] = { "100", "10", "7" };
+
+    // ** Make the top directory and see if the aggregates are even maintained
+    snprintf(foo_path, PATH_LEN, "%s/%s", prefix, dirs[0]);
+    err = gop_sync_exec(os_create_object(os, creds, foo_path, OS_OBJECT_DIR, "me"));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: creating dir: %s err=%d\n", foo_path, err);
+        return;
+    }
+
+    err = gop_sync_exec(os_open_object(os, creds, foo_path, OS_MODE_READ_IMMEDIATE, "me", &fd, wait_time));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: opening dir: %s err=%d\n", foo_path, err);
+        return;
+    }
+    rval = NULL;
+    v_size = -1000;
+    err = gop_sync_exec(os_get_attr(os, creds, fd, "os.du", (void **)&rval, &v_size));
+    gop_sync_exec(os_close_object(os, fd));
+    if (rval != NULL) free(rval);
+    if ((err != OP_STATE_SUCCESS) || (v_size <= 0)) {
+        log_printf(0, "Usage aggregates aren't maintained.  Skipping\n");
+        goto cleanup;
+    }
+    if (du_check("dutest", "0 0 0") != 0) {
+        nfailed++;
+        return;
+    }
+
+    // ** Creates
+    snprintf(foo_path, PATH_LEN, "%s/%s", prefix, dirs[1]);
+    err = gop_sync_exec(os_create_object(os, creds, foo_path, OS_OBJECT_DIR, "me"));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: creating dir: %s err=%d\n", foo_path, err);
+        return;
+    }
+    for (i=0; i<3; i++) {
+        snprintf(foo_path, PATH_LEN, "%s/%s", prefix, files[i]);
+        err = gop_sync_exec(os_create_object(os, creds, foo_path, OS_OBJECT_FILE, "me"));
+        if (err != OP_STATE_SUCCESS) {
+            nfailed++;
+            log_printf(0, "ERROR: creating file: %s err=%d\n", foo_path, err);
+            return;
+        }
+    }
+    if (du_check("dutest", "0 3 1") != 0) {
+        nfailed++;
+        return;
+    }
+    if (du_check("dutest/sub", "0 1 0") != 0) {
+        nfailed++;
+        return;
+    }
+
+    // ** Resizes
+    for (i=0; i<3; i++) {
+        if (du_size(files[i], sizes[i]) != 0) {
+            nfailed++;
+            log_printf(0, "ERROR: Setting the size of %s\n", files[i]);
+            return;
+        }
+    }
+    if (du_check("dutest", "117 3 1") != 0) {
+        nfailed++;
+        return;
+    }
+    if (du_size("dutest/f1", "40") != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: Shrinking dutest/f1\n");
+        return;
+    }
+    if (du_check("dutest", "57 3 1") != 0) {
+        nfailed++;
+        return;
+    }
+    if (du_check("dutest/sub", "10 1 0") != 0) {
+        nfailed++;
+        return;
+    }
+
+    // ** Move f1 into sub
+    snprintf(foo_path, PATH_LEN, "%s/dutest/f1", prefix);
+    snprintf(bar_path, PATH_LEN, "%s/dutest/sub/f1", prefix);
+    err = gop_sync_exec(os_move_object(os, creds, foo_path, bar_path));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: moving file src: %s  dest: %s err=%d\n", foo_path, bar_path, err);
+        return;
+    }
+    if (du_check("dutest", "57 3 1") != 0) {
+        nfailed++;
+        return;
+    }
+    if (du_check("dutest/sub", "50 2 0") != 0) {
+        nfailed++;
+        return;
+    }
+
+    // ** Move sub/f2 over g.  The overwritten file's usage has to go away
+    snprintf(foo_path, PATH_LEN, "%s/dutest/sub/f2", prefix);
+    snprintf(bar_path, PATH_LEN, "%s/dutest/g", prefix);
+    err = gop_sync_exec(os_move_object(os, creds, foo_path, bar_path));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: moving file over an existing one src: %s  dest: %s err=%d\n", foo_path, bar_path, err);
+        return;
+    }
+    if (du_check("dutest", "50 2 1") != 0) {
+        nfailed++;
+        return;
+    }
+    if (du_check("dutest/sub", "40 1 0") != 0) {
+        nfailed++;
+        return;
+    }
+
+    // ** Removes
+    err = gop_sync_exec(os_remove_object(os, creds, bar_path));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: removing file: %s err=%d\n", bar_path, err);
+        return;
+    }
+    if (du_check("dutest", "40 1 1") != 0) {
+        nfailed++;
+        return;
+    }
+    snprintf(foo_path, PATH_LEN, "%s/dutest/sub/f1", prefix);
+    err = gop_sync_exec(os_remove_object(os, creds, foo_path));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: removing file: %s err=%d\n", foo_path, err);
+        return;
+    }
+    if (du_check("dutest", "0 0 1") != 0) {
+        nfailed++;
+        return;
+    }
+    if (du_check("dutest/sub", "0 0 0") != 0) {
+        nfailed++;
+        return;
+    }
+
+cleanup:
+    snprintf(foo_path, PATH_LEN, "%s/dutest", prefix);
+    regex = os_path_glob2regex(foo_path);
+    gop_sync_exec(os_remove_regex_object(os, creds, regex, NULL, OS_OBJECT_ANY, 1000));
+    os_regex_table_destroy(regex);
+
+    log_printf(0, "PASSED!\n");
+}
+
+// **********************************************************************************
+//  os_move_tests - Directory renames and moves between directories.  With a
+//     sharded OS the directories can land on different shards so these
+//     check nothing is stranded and hardlinks aren't silently split.
+// **********************************************************************************
+
+void os_move_tests()
+{
+    object_service_fn_t *os = lio_gc->os;
+    creds_t  *creds = lio_gc->creds;
+    int err, i;
+    char foo_path[PATH_LEN];
+    char bar_path[PATH_LEN];
+    char *match_path[3];
+    os_regex_table_t *regex;
+    char *dirs[] = { "mvdir", "mvdir/sub", "mvsrc", "mvdest" };
+    char *files[] = { "mvdir/a", "mvdir/sub/b", "mvsrc/f" };
+    char *rm[] = { "mvdir", "mvdir2", "mvsrc", "mvdest" };
+
+    for (i=0; i<3; i++) {
+        type_malloc_clear(match_path[i], char, PATH_LEN);
+    }
+
+    // ** Make the test tree
+    for (i=0; i<4; i++) {
+        snprintf(foo_path, PATH_LEN, "%s/%s", prefix, dirs[i]);
+        err = gop_sync_exec(os_create_object(os, creds, foo_path, OS_OBJECT_DIR, "me"));
+        if (err != OP_STATE_SUCCESS) {
+            nfailed++;
+            log_printf(0, "ERROR: creating dir: %s err=%d\n", foo_path, err);
+            return;
+        }
+    }
+    for (i=0; i<3; i++) {
+        snprintf(foo_path, PATH_LEN, "%s/%s", prefix, files[i]);
+        err = gop_sync_exec(os_create_object(os, creds, foo_path, OS_OBJECT_FILE, "me"));
+        if (err != OP_STATE_SUCCESS) {
+            nfailed++;
+            log_printf(0, "ERROR: creating file: %s err=%d\n", foo_path, err);
+            return;
+        }
+    }
+
+    // ** Rename the non-empty mvdir -> mvdir2.  A sharded OS may refuse this but
+    // ** either way everything has to be reachable under exactly one of the names
+    snprintf(foo_path, PATH_LEN, "%s/mvdir", prefix);
+    snprintf(bar_path, PATH_LEN, "%s/mvdir2", prefix);
+    err = gop_sync_exec(os_move_object(os, creds, foo_path, bar_path));
+    if (err != OP_STATE_SUCCESS) {
+        log_printf(0, "Directory rename refused src=%s dest=%s.  Checking the source is intact\n", foo_path, bar_path);
+        snprintf(bar_path, PATH_LEN, "%s/mvdir", prefix);
+    } else if (gop_sync_exec(os_exists(os, creds, foo_path)) == OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: Oops!  dir exists after rename: %s\n", foo_path);
+        return;
+    }
+    snprintf(match_path[0], PATH_LEN, "%s/a", bar_path);
+    snprintf(match_path[1], PATH_LEN, "%s/sub/b", bar_path);
+    err = path_scan_and_check(bar_path, match_path, 2, 1000, OS_OBJECT_FILE);
+    if (err != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: Regex scan after rename: %s err=%d\n", bar_path, err);
+        return;
+    }
+    for (i=0; i<2; i++) {   //** Make sure the objects route to where they live
+        if (path_attr_rw(match_path[i], "user.mvtest", "renamed", NULL) != 0) {
+            nfailed++;
+            log_printf(0, "ERROR: Can't access after rename: %s\n", match_path[i]);
+            return;
+        }
+    }
+
+    // ** Move mvsrc/f -> mvdest/f and make sure the attributes came along
+    snprintf(foo_path, PATH_LEN, "%s/mvsrc/f", prefix);
+    snprintf(bar_path, PATH_LEN, "%s/mvdest/f", prefix);
+    if (path_attr_rw(foo_path, "user.mvtest", "moved", NULL) != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: Setting attr on %s\n", foo_path);
+        return;
+    }
+    err = gop_sync_exec(os_move_object(os, creds, foo_path, bar_path));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: moving file src: %s  dest: %s err=%d\n", foo_path, bar_path, err);
+        return;
+    }
+    if (gop_sync_exec(os_exists(os, creds, foo_path)) == OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: Oops!  file exists after move: %s\n", foo_path);
+        return;
+    }
+    if (path_attr_rw(bar_path, "user.mvtest", NULL, "moved") != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: Lost the attribute moving to %s\n", bar_path);
+        return;
+    }
+
+    // ** Hardlink mvdest/hf->mvdest/f and move the link back to mvsrc.  If the
+    // ** move is allowed the link has to still share attributes with its target
+    snprintf(foo_path, PATH_LEN, "%s/mvdest/hf", prefix);
+    err = gop_sync_exec(os_hardlink_object(os, creds, bar_path, foo_path, "me"));
+    if (err != OP_STATE_SUCCESS) {
+        nfailed++;
+        log_printf(0, "ERROR: hard linking file src: %s  dest: %s err=%d\n", bar_path, foo_path, err);
+        return;
+    }
+    snprintf(bar_path, PATH_LEN, "%s/mvsrc/hf", prefix);
+    err = gop_sync_exec(os_move_object(os, creds, foo_path, bar_path));
+    if (err != OP_STATE_SUCCESS) {
+        log_printf(0, "Hardlink move refused src=%s dest=%s.  Checking the source is intact\n", foo_path, bar_path);
+        snprintf(bar_path, PATH_LEN, "%s/mvdest/hf", prefix);
+    }
+    snprintf(foo_path, PATH_LEN, "%s/mvdest/f", prefix);
+    if (path_attr_rw(bar_path, "user.mvtest", "linked", NULL) != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: Setting attr on %s\n", bar_path);
+        return;
+    }
+    if (path_attr_rw(foo_path, "user.mvtest", NULL, "linked") != 0) {
+        nfailed++;
+        log_printf(0, "ERROR: Hardlink %s no longer shares attributes with %s\n", bar_path, foo_path);
+        return;
+    }
+
+    // ** Clean up
+    for (i=0; i<4; i++) {
+        snprintf(foo_path, PATH_LEN, "%s/%s", prefix, rm[i]);
+        regex = os_path_glob2regex(foo_path);
+        gop_sync_exec(os_remove_regex_object(os, creds, regex, NULL, OS_OBJECT_ANY, 1000));
+        os_regex_table_destroy(regex);
+        if (gop_sync_exec(os_exists(os, creds, foo_path)) == OP_STATE_SUCCESS) {
+            nfailed++;
+            log_printf(0, "ERROR: rm -r %s failed\n", foo_path);
+            return;
+        }
+    }
+
+    for (i=0; i<3; i++) {
+        free(match_path[i]);
+    }
+
+    log_printf(0, "PASSED!\n");
+}
+
 // **********************************************************************************
 //  attr_check - Checks that the regex key/val mataches
 // **********************************************************************************
@@ -2271,6 +2652,12 @@ int main(int argc, char **argv)
     os_create_remove_tests();
     if (nfailed > 0) goto oops;
 
+    os_move_tests();
+    if (nfailed > 0) goto oops;
+
+    os_du_tests();
+    if (nfailed > 0) goto oops;
+
     os_attribute_tests();
     if (nfailed > 0) goto oops;
 
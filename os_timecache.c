@@ -966,6 +966,14 @@ void ostc_cache_update_attrs(object_service_fn_t *os, char *fname, char **key, v
 
     move_to_bottom(&tree);
     obj = get_ele_data(&tree);
+
+    //** The stat record is built from the other attributes so just drop it
+    attr = apr_hash_get(obj->attrs, OS_STAT_ATTR, APR_HASH_KEY_STRING);
+    if (attr != NULL) {
+        apr_hash_set(obj->attrs, OS_STAT_ATTR, APR_HASH_KEY_STRING, NULL);
+        free_ostcdb_attr(attr);
+    }
+
     for (i=0; i<n; i++) {
         attr = apr_hash_get(obj->attrs, key[i], APR_HASH_KEY_STRING);
         if (attr == NULL) continue;  //** Not in cache so ignore updating it
@@ -34,6 +34,7 @@ http://www.accre.vanderbilt.edu
 #define _log_module_index 159
 
 #include <assert.h>
+#include <stdlib.h>
 #include "assert_result.h"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -72,6 +73,15 @@ typedef struct {
     kvq_ele_t *pickone;
 } kvq_table_t;
 
+typedef struct {
+    char *rid_key;
+    char *ds_key;
+    data_inquire_t *space;
+    apr_time_t deadline;   //** Successes arriving after this are stale
+} rss_inquire_t;
+
+#define RSS_PLACEMENT_INDEX_MAX 1000
+
 int _rs_simple_refresh(resource_service_fn_t *rs);
 
 //***********************************************************************
@@ -188,6 +198,232 @@ int rss_test(rsq_base_ele_t *q, rss_rid_entry_t *rse, int n_match, kvq_ele_t *un
     return(found);
 }
 
+//***********************************************************************
+// _rss_query_superset - Evaluates the query against the RID ignoring any
+//    unique/pickone constraints.  Those only remove matches so as long as
+//    the query has no NOT the result is a superset of what the full
+//    query can return.
+//***********************************************************************
+
+int _rss_query_superset(rsq_base_t *query, rss_rid_entry_t *rse, Stack_t *stack)
+{
+    kvq_ele_t uniq, pickone;
+    rsq_base_ele_t *q;
+    int state, *a, *b, *op_state;
+
+    empty_stack(stack, 1);
+    for (q = query->head; q != NULL; q = q->next) {
+        state = 1;
+        switch (q->op) {
+        case RSQ_BASE_OP_KV:
+            memset(&uniq, 0, sizeof(uniq));
+            memset(&pickone, 0, sizeof(pickone));
+            state = rss_test(q, rse, 0, &uniq, &pickone);
+            break;
+        case RSQ_BASE_OP_AND:
+        case RSQ_BASE_OP_OR:
+            a = (int *)pop(stack);
+            b = (int *)pop(stack);
+            if ((a != NULL) && (b != NULL)) {
+                state = (q->op == RSQ_BASE_OP_AND) ? ((*a) && (*b)) : ((*a) || (*b));
+            }
+            if (a != NULL) free(a);
+            if (b != NULL) free(b);
+            break;
+        }
+
+        type_malloc(op_state, int, 1);
+        *op_state = state;
+        push(stack, (void *)op_state);
+    }
+
+    op_state = (int *)pop(stack);
+    if (op_state == NULL) return(1);  //** Malformed so let the full check flag it
+
+    state = *op_state;
+    free(op_state);
+    return(state);
+}
+
+//***********************************************************************
+// _rss_placement_clear - Clears the placement index
+//   NOTE:  Assumes rs is already locked!
+//***********************************************************************
+
+void _rss_placement_clear(rs_simple_priv_t *rss)
+{
+    apr_hash_index_t *hi;
+    rss_placement_t *p;
+    char *qstr;
+    apr_ssize_t klen;
+
+    for (hi = apr_hash_first(NULL, rss->placement_index); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, (const void **)&qstr, &klen, (void **)&p);
+        apr_hash_set(rss->placement_index, qstr, klen, NULL);
+
+        free(qstr);
+        free(p->slot);
+        free(p);
+    }
+
+    apr_hash_clear(rss->placement_index);
+}
+
+//***********************************************************************
+// _rss_placement_get - Returns the candidate RID list for the query.  The
+//    list is built on the first use of the query and reused until the
+//    RID table is reloaded.  NULL is returned if the query can't be indexed.
+//   NOTE:  Assumes rs is already locked!
+//***********************************************************************
+
+rss_placement_t *_rss_placement_get(resource_service_fn_t *rs, rsq_base_t *query)
+{
+    rs_simple_priv_t *rss = (rs_simple_priv_t *)rs->priv;
+    rss_placement_t *p;
+    rsq_base_ele_t *q;
+    Stack_t *stack;
+    char *qstr;
+    int i;
+
+    //** A NOT could be flipped by the unique/pickone checks so skip those
+    for (q = query->head; q != NULL; q = q->next) {
+        if (q->op == RSQ_BASE_OP_NOT) return(NULL);
+    }
+
+    qstr = rs_query_base_print(rs, query);
+    if (qstr == NULL) return(NULL);
+
+    p = apr_hash_get(rss->placement_index, qstr, APR_HASH_KEY_STRING);
+    if (p != NULL) {
+        free(qstr);
+        return(p);
+    }
+
+    //** Keep the index from growing without bound with ad hoc queries
+    if (apr_hash_count(rss->placement_index) >= RSS_PLACEMENT_INDEX_MAX) _rss_placement_clear(rss);
+
+    type_malloc(p, rss_placement_t, 1);
+    type_malloc(p->slot, int, rss->n_rids);
+    p->n = 0;
+
+    stack = new_stack();
+    for (i=0; i<rss->n_rids; i++) {
+        if (_rss_query_superset(query, rss->random_array[i], stack) == 1) {
+            p->slot[p->n] = i;
+            p->n++;
+        }
+    }
+    free_stack(stack, 1);
+
+    log_printf(5, "New placement entry query=%s n_candidates=%d\n", qstr, p->n);
+
+    apr_hash_set(rss->placement_index, qstr, APR_HASH_KEY_STRING, p);
+
+    return(p);
+}
+
+//***********************************************************************
+// _rss_placement_score - Returns the placement weight for the RID.  This is
+//    the usable free space scaled by the observed I/O bandwidth.
+//***********************************************************************
+
+double _rss_placement_score(rs_simple_priv_t *rss, rss_rid_entry_t *rse, apr_time_t now)
+{
+    blacklist_t *bl = rss->bl;
+    blacklist_ioperf_t *perf;
+    blacklist_rid_t *bl_rid;
+    double score;
+
+    score = (rse->space_free > rss->min_free) ? rse->space_free - rss->min_free : 0;
+    if (bl == NULL) return(score);
+
+    apr_thread_mutex_lock(bl->lock);
+    perf = apr_hash_get(bl->ioperf, rse->rid_key, APR_HASH_KEY_STRING);
+    if (perf != NULL) score = score * perf->bandwidth / (perf->bandwidth + bl->min_bandwidth);
+
+    bl_rid = apr_hash_get(bl->table, rse->rid_key, APR_HASH_KEY_STRING);
+    if (bl_rid != NULL) {
+        if (bl_rid->recheck_time > now) score = 0.01 * score;  //** Currently blacklisted so de-prioritize it
+    }
+    apr_thread_mutex_unlock(bl->lock);
+
+    return(score);
+}
+
+//***********************************************************************
+// _rss_pick_two - Picks 2 random candidates and returns the index into
+//    the candidate list of the one with the better placement score
+//***********************************************************************
+
+int _rss_pick_two(rs_simple_priv_t *rss, rss_placement_t *p, apr_time_t now)
+{
+    int a, b;
+
+    a = random_int(0, p->n-1);
+    if (p->n == 1) return(a);
+
+    b = random_int(0, p->n-1);
+    if (a == b) return(a);
+
+    return((_rss_placement_score(rss, rss->random_array[p->slot[b]], now) > _rss_placement_score(rss, rss->random_array[p->slot[a]], now)) ? b : a);
+}
+
+//***********************************************************************
+// _rss_pick_compare - Sorts the pick list by delta, largest first
+//***********************************************************************
+
+typedef struct {
+    int slot;
+    ex_off_t delta;
+} rss_pick_t;
+
+int _rss_pick_compare(const void *p1, const void *p2)
+{
+    const rss_pick_t *a = (const rss_pick_t *)p1;
+    const rss_pick_t *b = (const rss_pick_t *)p2;
+
+    if (a->delta > b->delta) return(-1);
+    if (a->delta < b->delta) return(1);
+    return(0);
+}
+
+//***********************************************************************
+// _rss_pick_from_order - Orders the RIDs in a rebalance pick list so the
+//    ones needing the most data are tried first.  This way each move
+//    closes the largest remaining imbalance.
+//***********************************************************************
+
+void _rss_pick_from_order(rs_simple_priv_t *rss, apr_hash_t *pick_from, rss_placement_t *p)
+{
+    apr_hash_index_t *hi;
+    rid_change_entry_t *rc;
+    rss_rid_entry_t *rse;
+    rss_pick_t *pk;
+    const void *key;
+    apr_ssize_t klen;
+    int i, n;
+
+    n = apr_hash_count(pick_from);
+    type_malloc(pk, rss_pick_t, n+1);
+    i = 0;
+    for (hi = apr_hash_first(NULL, pick_from); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, &klen, (void **)&rc);
+        rse = list_search(rss->rid_table, (char *)key);
+        if (rse == NULL) continue;
+        pk[i].slot = rse->slot;
+        pk[i].delta = rc->delta;
+        i++;
+    }
+
+    qsort(pk, i, sizeof(rss_pick_t), _rss_pick_compare);
+
+    p->n = i;
+    type_malloc(p->slot, int, i+1);
+    for (n=0; n<i; n++) p->slot[n] = pk[n].slot;
+
+    free(pk);
+}
+
 //***********************************************************************
 // rs_simple_request - Processes a simple RS request
 //***********************************************************************
@@ -204,9 +440,11 @@ op_generic_t *rs_simple_request(resource_service_fn_t *arg, data_attr_t *da, rs_
     op_status_t status;
     opque_t *que;
     rss_rid_entry_t *rse;
+    rss_placement_t *cand, *use_cand, pick_order;
     rsq_base_ele_t *q;
     int slot, rnd_off, i, j, k, i_unique, i_pickone, found, err_cnt, loop, loop_end;
-    int state, *a, *b, *op_state, unique_size;
+    int state, *a, *b, *op_state, unique_size, n_scan;
+    apr_time_t now;
     Stack_t *stack;
 
     log_printf(15, "rs_simple_request: START rss->n_rids=%d n_rid=%d req_size=%d fixed_size=%d\n", rss->n_rids, n_rid, req_size, fixed_size);
@@ -255,10 +493,16 @@ op_generic_t *rs_simple_request(resource_service_fn_t *arg, data_attr_t *da, rs_
     found = 0;
 //  max_size = (req_size > fixed_size) ? req_size : fixed_size;
 
+    //** Get the candidate list for the new allocations if using weighted placement
+    cand = ((rss->weighted_placement == 1) && (rss->n_rids > 0)) ? _rss_placement_get(arg, query_global) : NULL;
+    now = apr_time_now();
+
     for (i=0; i < n_rid; i++) {
         found = 0;
         loop_end = 1;
         query_local = NULL;
+        use_cand = NULL;
+        n_scan = rss->n_rids;
         rnd_off = random_int(0, rss->n_rids-1);
 //rnd_off = 0;  //FIXME
 
@@ -298,8 +542,24 @@ op_generic_t *rs_simple_request(resource_service_fn_t *arg, data_attr_t *da, rs_
             }
         }
 
-        for (j=0; j<rss->n_rids; j++) {
-            slot = (rnd_off+j) % rss->n_rids;
+        //** Only the candidates need to be scanned and we start with the better of 2 random picks
+        if ((cand != NULL) && (i >= fixed_size) && (query_local == NULL) && (pick_from == NULL)) {
+            use_cand = cand;
+            n_scan = cand->n;
+            rnd_off = (n_scan > 0) ? _rss_pick_two(rss, cand, now) : 0;
+        }
+
+        //** When rebalancing try the RIDs furthest from their target first
+        pick_order.slot = NULL;
+        if ((pick_from != NULL) && (i >= fixed_size)) {
+            _rss_pick_from_order(rss, pick_from, &pick_order);
+            use_cand = &pick_order;
+            n_scan = pick_order.n;
+            rnd_off = 0;
+        }
+
+        for (j=0; j<n_scan; j++) {
+            slot = (use_cand == NULL) ? (rnd_off+j) % rss->n_rids : use_cand->slot[(rnd_off+j) % n_scan];
             rse = rss->random_array[slot];
             if (pick_from != NULL) {
                 rid_change = apr_hash_get(pick_from, rse->rid_key, APR_HASH_KEY_STRING);
@@ -351,7 +611,7 @@ op_generic_t *rs_simple_request(resource_service_fn_t *arg, data_attr_t *da, rs_
                     case RSQ_BASE_OP_OR:
                         a = (int *)pop(stack);
                         b = (int *)pop(stack);
-                        state = a || b;
+                        state = (*a) || (*b);
                         //log_printf(0, "%d OR %d = %d\n", *a, *b, state);
                         free(a);
                         free(b);
@@ -419,6 +679,8 @@ op_generic_t *rs_simple_request(resource_service_fn_t *arg, data_attr_t *da, rs_
             }
         }
 
+        if (pick_order.slot != NULL) free(pick_order.slot);
+
         if ((found == 0) && (i>=fixed_size)) break;
 
     }
@@ -715,76 +977,172 @@ void rss_translate_cap_set(resource_service_fn_t *rs, char *rid_key, data_cap_se
 }
 
 //***********************************************************************
-// rss_perform_check - Checks the RIDs and updates their status
+// _rss_apply_inquiry - Applies a completed RID inquiry to the RID's status.
+//    If discard is set the response is thrown away and only cleaned up.
+//    Returns 1 if the status changed and 0 otherwise.
 //***********************************************************************
 
-int rss_perform_check(resource_service_fn_t *rs)
+int _rss_apply_inquiry(resource_service_fn_t *rs, op_generic_t *gop, int discard)
 {
     rs_simple_priv_t *rss = (rs_simple_priv_t *)rs->priv;
-    apr_hash_index_t *hi;
+    rss_inquire_t *iq = gop_get_private(gop);
     rss_check_entry_t *ce;
+    op_status_t status;
     int prev_status, status_change;
+
+    status = gop_get_status(gop);
+    status_change = 0;
+
+    if (discard == 1) {
+        log_printf(5, "Discarding stale response ds_key=%s\n", iq->ds_key);
+        goto cleanup;
+    }
+
+    apr_thread_mutex_lock(rss->lock);
+    ce = apr_hash_get(rss->rid_mapping, iq->rid_key, APR_HASH_KEY_STRING);
+    if (ce != NULL) {  //** It could have been dropped by a reload while we were waiting
+        prev_status = ce->re->status;
+        if (status.op_status == OP_STATE_SUCCESS) {  //** Got a valid response
+            ce->re->space_free = ds_res_inquire_get(rss->ds, DS_INQUIRE_FREE, iq->space);
+            ce->re->space_used = ds_res_inquire_get(rss->ds, DS_INQUIRE_USED, iq->space);
+            ce->re->space_total = ds_res_inquire_get(rss->ds, DS_INQUIRE_TOTAL, iq->space);
+            if (ce->re->status != RS_STATUS_IGNORE) {
+                if (ce->re->space_free <= rss->min_free) {
+                    ce->re->status = RS_STATUS_OUT_OF_SPACE;
+                } else {
+                    ce->re->status = RS_STATUS_UP;
+                }
+            }
+        } else {  //** No response so mark it as down
+            if (ce->re->status != RS_STATUS_IGNORE) ce->re->status = RS_STATUS_DOWN;
+        }
+        if (prev_status != ce->re->status) status_change = 1;
+
+        log_printf(15, "ds_key=%s prev_status=%d new_status=%d\n", ce->ds_key, prev_status, ce->re->status);
+    }
+    apr_thread_mutex_unlock(rss->lock);
+
+cleanup:
+    ds_inquire_destroy(rss->ds, iq->space);
+    free(iq->rid_key);
+    free(iq->ds_key);
+    free(iq);
+    gop_free(gop, OP_DESTROY);
+
+    return(status_change);
+}
+
+//***********************************************************************
+// _rss_inquiry_discard - Returns 1 if the completed inquiry is stale and
+//    should be discarded.  Everything is stale once we're shutting down or
+//    the table was reloaded.  Otherwise only a success arriving after the
+//    op's own deadline is.  Late failures are still applied so a dead
+//    depot gets marked down.
+//***********************************************************************
+
+int _rss_inquiry_discard(resource_service_fn_t *rs, op_generic_t *gop, int map_version)
+{
+    rs_simple_priv_t *rss = (rs_simple_priv_t *)rs->priv;
+    rss_inquire_t *iq = gop_get_private(gop);
+    int stale;
+
+    apr_thread_mutex_lock(rss->lock);
+    stale = ((rss->shutdown != 0) || (rss->modify_time != map_version)) ? 1 : 0;
+    apr_thread_mutex_unlock(rss->lock);
+    if (stale == 1) return(1);
+
+    if ((gop_get_status(gop).op_status == OP_STATE_SUCCESS) && (apr_time_now() > iq->deadline)) return(1);
+
+    return(0);
+}
+
+//***********************************************************************
+// rss_perform_check - Checks the RIDs and updates their status.
+//    At most check_concurrency inquiries are in flight at once and each
+//    result is applied as soon as it completes.  Registered entities are
+//    notified as soon as a RID changes state instead of at the end of the pass.
+//    Each inquiry gets check_timeout from its own submit time.  A success
+//    arriving after that, or any result after the table is reloaded, is
+//    stale and discarded so it can't flip the RID's status.
+//***********************************************************************
+
+int rss_perform_check(resource_service_fn_t *rs, int map_version)
+{
+    rs_simple_priv_t *rss = (rs_simple_priv_t *)rs->priv;
+    apr_hash_index_t *hi;
+    rss_check_entry_t *ce;
+    rss_inquire_t **iq_list, *iq;
+    int i, n, n_changes, abort_check;
     char *rid;
     apr_ssize_t klen;
-    op_status_t status;
     opque_t *q;
     op_generic_t *gop;
 
     log_printf(5, "START\n");
 
-    //** Generate the task list
-    q = new_opque();
-
-    status_change = 0;
+    //** Snapshot the RIDs to check.  We make our own copies so a reload
+    //** during the pass doesn't pull the rug out from under us.
     apr_thread_mutex_lock(rss->lock);
+    n = apr_hash_count(rss->rid_mapping);
+    type_malloc(iq_list, rss_inquire_t *, n+1);
+    i = 0;
     for (hi = apr_hash_first(NULL, rss->rid_mapping); hi != NULL; hi = apr_hash_next(hi)) {
         apr_hash_this(hi, (const void **)&rid, &klen, (void **)&ce);
-//     if (ce->re->status != RS_STATUS_IGNORE) {
-        gop = ds_res_inquire(rss->ds, ce->ds_key, rss->da, ce->space, rss->check_timeout);
-        gop_set_private(gop, ce);
-        opque_add(q, gop);
-//     }
+        type_malloc(iq, rss_inquire_t, 1);
+        iq->rid_key = strdup(ce->rid_key);
+        iq->ds_key = strdup(ce->ds_key);
+        iq->space = ds_inquire_create(rss->ds);
+        iq_list[i] = iq;
+        i++;
     }
     apr_thread_mutex_unlock(rss->lock);
 
-    //** Wait for them all to complete
-    opque_waitall(q);
+    q = new_opque();
+    n_changes = 0;
+    abort_check = 0;
+    for (i=0; i<n; i++) {
+        iq = iq_list[i];
+        if (abort_check == 0) {
+            iq->deadline = apr_time_now() + apr_time_from_sec(rss->check_timeout);
+            gop = ds_res_inquire(rss->ds, iq->ds_key, rss->da, iq->space, rss->check_timeout);
+            gop_set_private(gop, iq);
+            opque_add(q, gop);
+        } else {  //** Just clean up the rest
+            ds_inquire_destroy(rss->ds, iq->space);
+            free(iq->rid_key);
+            free(iq->ds_key);
+            free(iq);
+            continue;
+        }
 
-    //** Process the results
-    apr_thread_mutex_lock(rss->lock);
-    if (rss->modify_time == rss->current_check) {  //** Only process the results if not updated
-        for (gop = opque_get_next_finished(q); gop != NULL; gop = opque_get_next_finished(q)) {
-            status = gop_get_status(gop);
-            ce = gop_get_private(gop);
-            prev_status = ce->re->status;
-            if (status.op_status == OP_STATE_SUCCESS) {  //** Got a valid response
-                ce->re->space_free = ds_res_inquire_get(rss->ds, DS_INQUIRE_FREE, ce->space);
-                ce->re->space_used = ds_res_inquire_get(rss->ds, DS_INQUIRE_USED, ce->space);
-                ce->re->space_total = ds_res_inquire_get(rss->ds, DS_INQUIRE_TOTAL, ce->space);
-                if (ce->re->status != RS_STATUS_IGNORE) {
-                    if (ce->re->space_free <= rss->min_free) {
-                        ce->re->status = RS_STATUS_OUT_OF_SPACE;
-                    } else {
-                        ce->re->status = RS_STATUS_UP;
-                    }
-                }
-            } else {  //** No response so mark it as down
-                if (ce->re->status != RS_STATUS_IGNORE) ce->re->status = RS_STATUS_DOWN;
+        if (opque_tasks_left(q) >= rss->check_concurrency) {
+            gop = opque_waitany(q);
+            if (_rss_apply_inquiry(rs, gop, _rss_inquiry_discard(rs, gop, map_version)) == 1) {
+                n_changes++;
+                rss_mapping_notify(rs, map_version, 1);
             }
-            if (prev_status != ce->re->status) status_change = 1;
 
-            log_printf(15, "ds_key=%s prev_status=%d new_status=%d\n", ce->ds_key, prev_status, ce->re->status);
-            gop_free(gop, OP_DESTROY);
+            //** Stop submitting if we're shutting down or the table was reloaded
+            apr_thread_mutex_lock(rss->lock);
+            if ((rss->shutdown != 0) || (rss->modify_time != map_version)) abort_check = 1;
+            apr_thread_mutex_unlock(rss->lock);
         }
+    }
 
+    //** Process the stragglers.  We still have to wait for them all to clean up
+    while ((gop = opque_waitany(q)) != NULL) {
+        if (_rss_apply_inquiry(rs, gop, _rss_inquiry_discard(rs, gop, map_version)) == 1) {
+            n_changes++;
+            rss_mapping_notify(rs, map_version, 1);
+        }
     }
 
     opque_free(q, OP_DESTROY);
-    apr_thread_mutex_unlock(rss->lock);
+    free(iq_list);
 
-    log_printf(5, "END status_change=%d\n", status_change);
+    log_printf(5, "END n_changes=%d\n", n_changes);
 
-    return(status_change);
+    return(n_changes);
 }
 
 //***********************************************************************
@@ -857,9 +1215,11 @@ void *rss_check_thread(apr_thread_t *th, void *data)
         map_version = rss->modify_time;
         apr_thread_mutex_unlock(rss->lock);
 
-        status_change = (rss->check_timeout <= 0) ? 0 : rss_perform_check(rs);
+        //** Any status changes are sent as they are detected
+        status_change = (rss->check_timeout <= 0) ? 0 : rss_perform_check(rs, map_version);
 
-        if (((do_notify == 1) && (rss->dynamic_mapping == 1)) || (status_change != 0))  rss_mapping_notify(rs, map_version, status_change);
+        if ((do_notify == 1) && (rss->dynamic_mapping == 1))  rss_mapping_notify(rs, map_version, 0);
+        log_printf(5, "status_change=%d\n", status_change);
 
         log_printf(5, "LOOP END\n");
 
@@ -965,6 +1325,7 @@ int _rs_simple_refresh(resource_service_fn_t *rs)
         rss->modify_time = sbuf.st_mtime;
         if (rss->rid_table != NULL) list_destroy(rss->rid_table);
         if (rss->random_array != NULL) free(rss->random_array);
+        _rss_placement_clear(rss);  //** The candidate lists point into the old table
         err = _rs_simple_load(rs, rss->fname);  //** Load the new file
         _rss_make_check_table(rs);  //** and make the new inquiry table
         apr_thread_cond_signal(rss->cond);  //** Notify the check thread that we made a change
@@ -996,12 +1357,15 @@ void rs_simple_destroy(resource_service_fn_t *rs)
     apr_thread_join(&value, rss->check_thread);
 
     //** Now we can free up all the space
+    _rss_placement_clear(rss);
     apr_thread_mutex_destroy(rss->lock);
     apr_thread_cond_destroy(rss->cond);
     apr_pool_destroy(rss->mpool);  //** This also frees the hash tables
 
     if (rss->rid_table != NULL) list_destroy(rss->rid_table);
 
+    if (rss->bl != NULL) blacklist_destroy(rss->bl);
+
     free(rss->random_array);
     free(rss->fname);
     free(rss);
@@ -1028,9 +1392,11 @@ resource_service_fn_t *rs_simple_create(void *arg, inip_file_t *kf, char *sectio
     apr_thread_cond_create(&(rss->cond), rss->mpool);
     rss->rid_mapping = apr_hash_make(rss->mpool);
     rss->mapping_updates = apr_hash_make(rss->mpool);
+    rss->placement_index = apr_hash_make(rss->mpool);
 
     rss->ds = lookup_service(ess, ESS_RUNNING, ESS_DS);
     rss->da = lookup_service(ess, ESS_RUNNING, ESS_DA);
+    rss->bl = blacklist_ref(lookup_service(ess, ESS_RUNNING, "blacklist"));  //** Used for the observed RID performance.  The RS can outlive the LIO context so hold a ref
 
     //** Set the resource service fn ptrs
     type_malloc_clear(rs, resource_service_fn_t, 1);
@@ -1056,7 +1422,10 @@ resource_service_fn_t *rs_simple_create(void *arg, inip_file_t *kf, char *sectio
     rss->dynamic_mapping = inip_get_integer(kf, section, "dynamic_mapping", 0);
     rss->check_interval = inip_get_integer(kf, section, "check_interval", 300);
     rss->check_timeout = inip_get_integer(kf, section, "check_timeout", 60);
+    rss->check_concurrency = inip_get_integer(kf, section, "check_concurrency", 100);
+    if (rss->check_concurrency <= 0) rss->check_concurrency = 1;
     rss->min_free = inip_get_integer(kf, section, "min_free", 100*1024*1024);
+    rss->weighted_placement = inip_get_integer(kf, section, "weighted_placement", 1);
 
     //** Set the modify time to force a change
     rss->modify_time = 0;
@@ -35,6 +35,7 @@ http://www.accre.vanderbilt.edu
 #include "data_service_abstract.h"
 #include "opque.h"
 #include "service_manager.h"
+#include "blacklist.h"
 
 #ifndef _RS_SIMPLE_PRIV_H_
 #define _RS_SIMPLE_PRIV_H_
@@ -61,6 +62,11 @@ typedef struct {
     rss_rid_entry_t *re;
 } rss_check_entry_t;
 
+typedef struct {
+    int n;          //** Number of candidate RIDs
+    int *slot;      //** random_array slots of the RIDs matching the query
+} rss_placement_t;
+
 typedef struct {
     list_t *rid_table;
     rss_rid_entry_t **random_array;
@@ -73,6 +79,8 @@ typedef struct {
     apr_pool_t *mpool;
     apr_hash_t *mapping_updates;
     apr_hash_t *rid_mapping;
+    apr_hash_t *placement_index;  //** Query string -> rss_placement_t candidate list
+    blacklist_t *bl;
     time_t modify_time;
     time_t current_check;
     char *fname;
@@ -83,7 +91,9 @@ typedef struct {
     int unique_rids;
     int check_interval;
     int check_timeout;
+    int check_concurrency;  //** Max number of RID inquiries in flight
     int last_config_size;
+    int weighted_placement;
 } rs_simple_priv_t;
 
 #ifdef __cplusplus
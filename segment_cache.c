@@ -63,6 +63,7 @@ typedef struct {
     int        n_iov;
     int skip_ppages;
     int timeout;
+    int request_id;  //** Tells the page access tracking one request from another
 int dummy;
 } cache_rw_op_t;
 
@@ -95,6 +96,7 @@ typedef struct {
 } cache_clone_t;
 
 atomic_int_t _cache_count = 0;
+atomic_int_t _cache_request_count = 0;
 atomic_int_t _flush_count = 0;
 
 op_status_t cache_rw_func(void *arg, int id);
@@ -328,6 +330,7 @@ int cache_rw_pages(segment_t *seg, segment_rw_hints_t *rw_hints, page_handle_t *
     cache_cond_t *cache_cond;
     iovec_t iovec[pl_size];
     page_handle_t blank_pages[pl_size];
+    page_handle_t vlist[pl_size];
     cache_counters_t cc;
     int error_count, blank_count;
     int myid, n, i, j, pli, contig_start;
@@ -343,6 +346,28 @@ int cache_rw_pages(segment_t *seg, segment_rw_hints_t *rw_hints, page_handle_t *
     blank_count = 0;
     last_page = -1;
 
+    //** Check the victim tier before going to the child.  Hits are handled
+    //** like blank pages since the data is already in place.
+    if (s->c->victim != NULL) {
+        n = 0;
+        for (i=0; i<pl_size; i++) {
+            ph = &(plist[i]);
+            if (rw_mode == CACHE_READ) {
+                if ((ph->data->ptr != NULL) && (cache_victim_get(s->c->victim, segment_id(seg), s->data_version, ph->p->offset, ph->data->ptr, s->page_size) == 0)) {
+                    blank_pages[blank_count] = *ph;
+                    blank_count++;
+                    continue;
+                }
+            } else {  //** Writing new data so any older copy is stale
+                cache_victim_invalidate(s->c->victim, segment_id(seg), ph->p->offset, ph->p->offset + s->page_size - 1);
+            }
+            vlist[n] = *ph;
+            n++;
+        }
+        plist = vlist;
+        pl_size = n;
+    }
+
     //** Figure out the contiguous blocks
     q = new_opque();
     myid = -1;
@@ -891,14 +916,36 @@ int cache_page_drop(segment_t *seg, ex_off_t lo, ex_off_t hi)
 //     or semenget close operation
 //
 //  NOTE:  This is designed to be called by other apps whereas the "cache_drop_page"
-//     rotuine is deisgned to be used by segment_cache routines only
+//     rotuine is deisgned to be used by segment_cache routines only.  The
+//     caller is assumed to have changed the data so the victim copies go also.
 //*******************************************************************************
 
 int cache_drop_pages(segment_t *seg, ex_off_t lo, ex_off_t hi)
 {
+    cache_segment_t *s;
+
     if (strcmp(seg->header.type, SEGMENT_TYPE_CACHE) != 0) return(0);
 
-    return(cache_page_drop(seg, lo, hi));
+    s = (cache_segment_t *)seg->priv;
+    cache_page_drop(seg, lo, hi);
+    if (s->c->victim != NULL) cache_victim_invalidate(s->c->victim, segment_id(seg), lo, hi);
+
+    return(0);
+}
+
+//*******************************************************************************
+//  cache_segment_set_data_version - Sets the version used to tag pages handed
+//     to the victim tier.  Copies stored under a different version are ignored.
+//*******************************************************************************
+
+void cache_segment_set_data_version(segment_t *seg, uint32_t version)
+{
+    cache_segment_t *s;
+
+    if (strcmp(seg->header.type, SEGMENT_TYPE_CACHE) != 0) return;
+
+    s = (cache_segment_t *)seg->priv;
+    s->data_version = version;
 }
 
 //*******************************************************************************
@@ -1007,7 +1054,7 @@ int cache_dirty_pages_get(segment_t *seg, int mode, ex_off_t lo, ex_off_t hi, ex
 
             if ((n < *n_pages) && (p->offset < *hi_got)) {
                 if (skip_mode == 0) {
-                    s->c->fn.s_page_access(s->c, p, CACHE_FLUSH, 0);  //** Update page access information
+                    s->c->fn.s_page_access(s->c, p, CACHE_FLUSH, 0, 0, p->offset);  //** Update page access information
                     p->access_pending[CACHE_FLUSH]++;
                     log_printf(15, "PAGE_GET seg=" XIDT " p->offset=" XOT " usage=%d index=%d\n", segment_id(seg), p->offset, p->curr_data->usage_count, p->current_index);
 
@@ -1063,7 +1110,7 @@ int cache_dirty_pages_get(segment_t *seg, int mode, ex_off_t lo, ex_off_t hi, ex
 //  cache_read_pages_get - Retrieves pages from cache for READING over the given range
 //*******************************************************************************
 
-int cache_read_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode, ex_off_t lo, ex_off_t hi, ex_off_t *hi_got, page_handle_t *page, iovec_t *iov, int *n_pages, tbuffer_t *buf, ex_off_t bpos_start, void **cache_missed, ex_off_t master_size)
+int cache_read_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode, ex_off_t lo, ex_off_t hi, ex_off_t *hi_got, page_handle_t *page, iovec_t *iov, int *n_pages, tbuffer_t *buf, ex_off_t bpos_start, void **cache_missed, ex_off_t master_size, int request_id)
 {
     cache_segment_t *s = (cache_segment_t *)seg->priv;
     ex_off_t lo_row, hi_row, *poff, n, old_hi, bpos, ppos, len;
@@ -1154,7 +1201,7 @@ int cache_read_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode,
                 if (skip_mode == 0) {
                     p->used_count++;
                     p->curr_data->usage_count++;
-                    s->c->fn.s_page_access(s->c, p, CACHE_READ, master_size);  //** Update page access information
+                    s->c->fn.s_page_access(s->c, p, CACHE_READ, master_size, request_id, lo);  //** Update page access information
 
                     //** Determine the buffer / to page offset
                     if (lo >= p->offset) {
@@ -1240,7 +1287,7 @@ int cache_read_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode,
 //  cache_write_pages_get - Retrieves pages from cache over the given range for WRITING
 //*******************************************************************************
 
-int cache_write_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode, ex_off_t lo, ex_off_t hi, ex_off_t *hi_got, page_handle_t *page, iovec_t *iov, int *n_pages, tbuffer_t *buf, ex_off_t bpos_start, void **cache_missed, ex_off_t master_size)
+int cache_write_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode, ex_off_t lo, ex_off_t hi, ex_off_t *hi_got, page_handle_t *page, iovec_t *iov, int *n_pages, tbuffer_t *buf, ex_off_t bpos_start, void **cache_missed, ex_off_t master_size, int request_id)
 {
     cache_segment_t *s = (cache_segment_t *)seg->priv;
     ex_off_t lo_row, hi_row, *poff, n, old_hi, coff, pstart, page_off, bpos, ppos, len;
@@ -1320,7 +1367,7 @@ int cache_write_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode
                 }
 
                 np->used_count++;
-                s->c->fn.s_page_access(s->c, np, CACHE_WRITE, master_size);  //** Update page access information
+                s->c->fn.s_page_access(s->c, np, CACHE_WRITE, master_size, request_id, lo);  //** Update page access information
                 np->bit_fields |= C_ISDIRTY;
                 s->c->fn.adjust_dirty(s->c, s->page_size);
 
@@ -1458,7 +1505,7 @@ int cache_write_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode
                     }
 
                     p->used_count++;
-                    s->c->fn.s_page_access(s->c, p, CACHE_WRITE, master_size);  //** Update page access information
+                    s->c->fn.s_page_access(s->c, p, CACHE_WRITE, master_size, request_id, lo);  //** Update page access information
                     p->curr_data->usage_count++;
 
                     if (p->bit_fields & C_EMPTY) p->bit_fields ^= C_EMPTY;
@@ -1523,7 +1570,7 @@ int cache_write_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode
                                 }
 
                                 np->used_count++;
-                                s->c->fn.s_page_access(s->c, np, CACHE_WRITE, master_size);  //** Update page access information
+                                s->c->fn.s_page_access(s->c, np, CACHE_WRITE, master_size, request_id, lo);  //** Update page access information
                                 np->curr_data->usage_count++;
                                 if ((np->bit_fields & C_ISDIRTY) == 0) {
                                     np->bit_fields |= C_ISDIRTY;
@@ -1630,7 +1677,7 @@ int cache_write_pages_get(segment_t *seg, segment_rw_hints_t *rw_hints, int mode
         for (i=0; i<pload_count; i++) { //** This stuff requires a lock
             p = pload[i].p;
             p->used_count++;
-            s->c->fn.s_page_access(s->c, p, CACHE_WRITE, master_size);  //** Update page access information
+            s->c->fn.s_page_access(s->c, p, CACHE_WRITE, master_size, request_id, lo);  //** Update page access information
 
             p->curr_data->usage_count++;  //** NOTE don't have to update the bit_fields cause it's done in cache_release_pages()
         }
@@ -2486,6 +2533,8 @@ op_status_t cache_rw_func(void *arg, int id)
     err = op_success_status;
     if (cop->n_iov == 0) return(err);  //** Nothing to do so kick out
 
+    cop->request_id = unique_cache_request_id();
+
     init_stack(&stack);
 
     //** Push the initial ranges onto the work queue
@@ -2558,9 +2607,9 @@ op_status_t cache_rw_func(void *arg, int id)
         log_printf(15, "processing range: lo=" XOT " hi=" XOT " progress=%d mode=%d\n", curr->lo, curr->hi, progress, mode);
 
         if (cop->rw_mode == CACHE_READ) {
-            status = cache_read_pages_get(seg, cop->rw_hints, mode, curr->lo, curr->hi, &hi_got, page, iov, &n_pages, cop->buf, curr->boff, &(cache_missed[curr->iov_index]), cop->iov[curr->iov_index].len);
+            status = cache_read_pages_get(seg, cop->rw_hints, mode, curr->lo, curr->hi, &hi_got, page, iov, &n_pages, cop->buf, curr->boff, &(cache_missed[curr->iov_index]), cop->iov[curr->iov_index].len, cop->request_id);
         } else if (cop->rw_mode == CACHE_WRITE) {
-            status = cache_write_pages_get(seg, cop->rw_hints, mode, curr->lo, curr->hi, &hi_got, page, iov, &n_pages, cop->buf, curr->boff, &(cache_missed[curr->iov_index]), cop->iov[curr->iov_index].len);
+            status = cache_write_pages_get(seg, cop->rw_hints, mode, curr->lo, curr->hi, &hi_got, page, iov, &n_pages, cop->buf, curr->boff, &(cache_missed[curr->iov_index]), cop->iov[curr->iov_index].len, cop->request_id);
         } else {
             log_printf(0, "ERROR invalid rw_mode!!!!!! rw_mode=%d\n", cop->rw_mode);
             err = op_error_status;
@@ -2980,6 +3029,7 @@ int cache_stats(cache_t *c, cache_stats_t *cs)
                 cs->hit_bytes += s->stats.hit_bytes;
                 cs->miss_bytes += s->stats.miss_bytes;
                 cs->unused_bytes += s->stats.unused_bytes;
+                cs->resident_bytes += s->stats.resident_bytes;
                 segment_unlock(seg2);
             } else {
                 n++;
@@ -3048,6 +3098,48 @@ int cache_stats_print(cache_stats_t *cs, char *buffer, int *used, int nmax)
     d3 = cs->dirty_bytes * 1.0 / (1024.0*1024.0*1024.0);
     n += append_printf(buffer, used, nmax, "Dirty: " XOT " bytes (%lf GiB)\n", cs->dirty_bytes, d3);
 
+    d3 = cs->resident_bytes * 1.0 / (1024.0*1024.0*1024.0);
+    n += append_printf(buffer, used, nmax, "Resident: " XOT " bytes (%lf GiB)\n", cs->resident_bytes, d3);
+
+    return(n);
+}
+
+//***********************************************************************
+// cache_shares_print - Prints how much of the cache each segment holds
+//***********************************************************************
+
+int cache_shares_print(cache_t *c, char *buffer, int *used, int nmax)
+{
+    cache_segment_t *s;
+    list_iter_t it;
+    segment_t *seg;
+    ex_id_t *sid;
+    ex_off_t total;
+    double d1, d2;
+    int n = 0;
+
+    cache_lock(c);
+
+    total = 0;
+    it = list_iter_search(c->segments, NULL, 0);
+    while (list_next(&it, (list_key_t **)&sid, (list_data_t **)&seg) == 0) {
+        s = (cache_segment_t *)seg->priv;
+        total += s->stats.resident_bytes;
+    }
+
+    n += append_printf(buffer, used, nmax, "Segments holding pages: %d  Active: %d\n", c->n_resident_segments, c->n_active_segments);
+    it = list_iter_search(c->segments, NULL, 0);
+    while (list_next(&it, (list_key_t **)&sid, (list_data_t **)&seg) == 0) {
+        s = (cache_segment_t *)seg->priv;
+        if (s->stats.resident_bytes == 0) continue;
+
+        d1 = s->stats.resident_bytes * 1.0 / (1024.0*1024.0);
+        d2 = (total > 0) ? (100.0*s->stats.resident_bytes) / total : 0;
+        n += append_printf(buffer, used, nmax, "  " XIDT ": " XOT " bytes (%lf MiB) (%lf%% of cached)\n", segment_id(seg), s->stats.resident_bytes, d1, d2);
+    }
+
+    cache_unlock(c);
+
     return(n);
 }
 
@@ -3111,6 +3203,7 @@ op_status_t segcache_truncate_func(void *arg, int id)
 
         log_printf(5, "seg=" XIDT " dropping extra pages. NOW\n");
         cache_page_drop(cop->seg, cop->new_size, XOT_MAX);
+        if (s->c->victim != NULL) cache_victim_invalidate(s->c->victim, segment_id(cop->seg), cop->new_size, XOT_MAX);
         log_printf(5, "seg=" XIDT " dropping extra pages. FINISHED\n");
     }
 
@@ -3271,6 +3364,7 @@ op_generic_t *segcache_remove(segment_t *seg, data_attr_t *da, int timeout)
     cache_segment_t *s = (cache_segment_t *)seg->priv;
 
     cache_page_drop(seg, 0, s->total_size + 1);
+    if (s->c->victim != NULL) cache_victim_invalidate(s->c->victim, segment_id(seg), 0, XOT_MAX);
     return(segment_remove(s->child_seg, da, timeout));
 }
 
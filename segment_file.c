@@ -425,7 +425,7 @@ op_generic_t *segfile_clone(segment_t *seg, data_attr_t *da, segment_t **clone_s
     sfc->dseg = clone;
     sfc->copy_data = 0;
 
-    if (mode == CLONE_STRUCT_AND_DATA) sfc->copy_data = 1;
+    if (mode != CLONE_STRUCTURE) sfc->copy_data = 1;
 
     gop = new_thread_pool_op(sd->tpc, sd->qname, segfile_clone_func, (void *)sfc, free, 1);
 
@@ -92,6 +92,14 @@ typedef struct {
     int timeout;
 } seglog_merge_t;
 
+typedef struct {
+    segment_t *seg;
+    segment_t **top_seg;
+    data_attr_t *da;
+    char *name;
+    int timeout;
+} seglog_snapshot_t;
+
 //***********************************************************************
 // _slog_find_base - Recursives though the semgents base until it finds
 //   the root, non-log segment base and returns it.
@@ -111,6 +119,130 @@ segment_t *_slog_find_base(segment_t *sseg)
     return(seg);
 }
 
+//***********************************************************************
+// _slog_merged_add - Adds a range to a flattened chain index
+//***********************************************************************
+
+void _slog_merged_add(interval_skiplist_t *isl, segment_t *seg, ex_off_t lo, ex_off_t hi, ex_off_t offset)
+{
+    slog_merged_t *m;
+
+    type_malloc(m, slog_merged_t, 1);
+    m->lo = lo;
+    m->hi = hi;
+    m->offset = offset;
+    m->seg = seg;
+    insert_interval_skiplist(isl, (skiplist_key_t *)&(m->lo), (skiplist_key_t *)&(m->hi), (skiplist_data_t *)m);
+}
+
+//***********************************************************************
+// _slog_merged_copy - Copies the [lo,hi] portion of the base's flattened
+//    index into isl.  Anything not covered, or everything if the base has
+//    no index, is mapped directly to the base segment.
+//***********************************************************************
+
+void _slog_merged_copy(interval_skiplist_t *isl, segment_t *base, interval_skiplist_t *bmerged, ex_off_t lo, ex_off_t hi)
+{
+    interval_skiplist_iter_t it;
+    slog_merged_t *m;
+    ex_off_t pos, clo, chi;
+
+    if (bmerged == NULL) {
+        _slog_merged_add(isl, base, lo, hi, lo);
+        return;
+    }
+
+    pos = lo;
+    it = iter_search_interval_skiplist(bmerged, (skiplist_key_t *)&lo, (skiplist_key_t *)&hi);
+    while ((m = (slog_merged_t *)next_interval_skiplist(&it)) != NULL) {
+        clo = (m->lo < lo) ? lo : m->lo;
+        chi = (m->hi > hi) ? hi : m->hi;
+        if (clo > pos) _slog_merged_add(isl, base, pos, clo-1, pos);
+        _slog_merged_add(isl, m->seg, clo, chi, m->offset + (clo - m->lo));
+        pos = chi + 1;
+    }
+
+    if (pos <= hi) _slog_merged_add(isl, base, pos, hi, pos);
+}
+
+interval_skiplist_t *_slog_merged_get(segment_t *seg);
+
+//***********************************************************************
+// _slog_merged_build - Builds the flattened index for a read only log
+//    level.  Every range points straight at the data segment in the chain
+//    holding the bytes or at the root base so reads don't have to walk
+//    the chain a level at a time.
+//    NOTE: Assumes the segment is locked.
+//***********************************************************************
+
+void _slog_merged_build(segment_t *seg)
+{
+    seglog_priv_t *s = (seglog_priv_t *)seg->priv;
+    interval_skiplist_t *bmerged;
+    interval_skiplist_iter_t it;
+    slog_range_t *r;
+    ex_off_t pos;
+
+    bmerged = _slog_merged_get(s->base_seg);
+    s->merged = create_interval_skiplist(&skiplist_compare_ex_off, NULL, NULL, NULL);
+
+    pos = 0;
+    it = iter_search_interval_skiplist(s->mapping, (skiplist_key_t *)NULL, (skiplist_key_t *)NULL);
+    while ((r = (slog_range_t *)next_interval_skiplist(&it)) != NULL) {
+        if (r->lo > pos) _slog_merged_copy(s->merged, s->base_seg, bmerged, pos, r->lo-1);
+        _slog_merged_add(s->merged, s->data_seg, r->lo, r->hi, r->data_offset);
+        pos = r->hi + 1;
+    }
+
+    if (pos < s->file_size) _slog_merged_copy(s->merged, s->base_seg, bmerged, pos, s->file_size-1);
+
+    log_printf(15, "seg=" XIDT " mapping=%d merged=%d\n", segment_id(seg), interval_skiplist_count(s->mapping), interval_skiplist_count(s->merged));
+}
+
+//***********************************************************************
+// _slog_merged_get - Returns the flattened index for a read only log level
+//    building it if needed.  NULL is returned if the segment isn't a
+//    frozen log level.  Since the level can no longer change the index
+//    is never invalidated.
+//***********************************************************************
+
+interval_skiplist_t *_slog_merged_get(segment_t *seg)
+{
+    seglog_priv_t *s;
+    interval_skiplist_t *merged;
+
+    if (strcmp(segment_type(seg), SEGMENT_TYPE_LOG) != 0) return(NULL);
+
+    s = (seglog_priv_t *)seg->priv;
+    segment_lock(seg);
+    if ((s->read_only == 1) && (s->merged == NULL)) _slog_merged_build(seg);
+    merged = s->merged;
+    segment_unlock(seg);
+
+    return(merged);
+}
+
+//***********************************************************************
+// _slog_merged_destroy - Frees a flattened chain index
+//***********************************************************************
+
+void _slog_merged_destroy(interval_skiplist_t *isl)
+{
+    interval_skiplist_iter_t it;
+    slog_merged_t **m_list;
+    int i, n;
+
+    n = interval_skiplist_count(isl);
+    type_malloc_clear(m_list, slog_merged_t *, n+1);
+    it = iter_search_interval_skiplist(isl, (skiplist_key_t *)NULL, (skiplist_key_t *)NULL);
+    for (i=0; i<n; i++) {
+        m_list[i] = (slog_merged_t *)next_interval_skiplist(&it);
+    }
+    destroy_interval_skiplist(isl);
+
+    for (i=0; i<n; i++) free(m_list[i]);
+    free(m_list);
+}
 
 //***********************************************************************
 //  slog_truncate_range - Inserts a truncate range into the log.
@@ -343,6 +475,11 @@ op_generic_t *seglog_write(segment_t *seg, data_attr_t *da, segment_rw_hints_t *
     seglog_rw_t *sw;
     op_generic_t *gop;
 
+    if (s->read_only == 1) {  //** Frozen snapshot level so no changes allowed
+        log_printf(1, "seg=" XIDT " is read only!\n", segment_id(seg));
+        return(gop_dummy(op_failure_status));
+    }
+
     type_malloc(sw, seglog_rw_t, 1);
     sw->seg = seg;
     sw->da = da;
@@ -358,6 +495,57 @@ op_generic_t *seglog_write(segment_t *seg, data_attr_t *da, segment_rw_hints_t *
     return(gop);
 }
 
+//***********************************************************************
+// _slog_read_merged - Queues the reads for the [offset, offset+len) range
+//    using the flattened index.  If no index is provided the whole range
+//    is read from the fallback segment.  Returns the next free ex_iov slot.
+//***********************************************************************
+
+int _slog_read_merged(seglog_rw_t *sw, opque_t *q, interval_skiplist_t *merged, segment_t *fallback, ex_iovec_t *ex_iov, int slot, ex_off_t offset, ex_off_t len, ex_off_t bpos)
+{
+    interval_skiplist_iter_t it;
+    slog_merged_t *m;
+    ex_off_t lo, hi, pos, clo, chi;
+
+    lo = offset;
+    hi = offset + len - 1;
+
+    if (merged == NULL) {
+        ex_iov[slot].offset = lo;
+        ex_iov[slot].len = len;
+        opque_add(q, segment_read(fallback, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos, sw->timeout));
+        return(slot+1);
+    }
+
+    pos = lo;
+    it = iter_search_interval_skiplist(merged, (skiplist_key_t *)&lo, (skiplist_key_t *)&hi);
+    while ((m = (slog_merged_t *)next_interval_skiplist(&it)) != NULL) {
+        clo = (m->lo < lo) ? lo : m->lo;
+        chi = (m->hi > hi) ? hi : m->hi;
+        if (clo > pos) {  //** Not covered so let the fallback handle it
+            ex_iov[slot].offset = pos;
+            ex_iov[slot].len = clo - pos;
+            opque_add(q, segment_read(fallback, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos + pos - lo, sw->timeout));
+            slot++;
+        }
+
+        ex_iov[slot].offset = m->offset + (clo - m->lo);
+        ex_iov[slot].len = chi - clo + 1;
+        opque_add(q, segment_read(m->seg, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos + clo - lo, sw->timeout));
+        slot++;
+        pos = chi + 1;
+    }
+
+    if (pos <= hi) {
+        ex_iov[slot].offset = pos;
+        ex_iov[slot].len = hi - pos + 1;
+        opque_add(q, segment_read(fallback, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos + pos - lo, sw->timeout));
+        slot++;
+    }
+
+    return(slot);
+}
+
 //***********************************************************************
 // seglog_read_func - Does the actual log read operation
 //***********************************************************************
@@ -367,18 +555,44 @@ op_status_t seglog_read_func(void *arg, int id)
     seglog_rw_t *sw = (seglog_rw_t *)arg;
     seglog_priv_t *s = (seglog_priv_t *)sw->seg->priv;
     interval_skiplist_iter_t it;
+    interval_skiplist_t *merged, *bmerged;
     slog_range_t *ir;
     opque_t *q;
     op_generic_t *gop;
     int i, err, n_iov, slot;
     op_status_t status;
-    ex_off_t lo, hi, prev_end;
+    ex_off_t lo, hi, prev_end, len;
     ex_off_t bpos, pos, range_offset;
     ex_iovec_t *ex_iov, *iov;
 
     q = new_opque();
     iov = sw->iov;
 
+    //** Frozen levels resolve everything through their own flattened index.
+    //** Otherwise holes are resolved through the base's index if it has one.
+    merged = _slog_merged_get(sw->seg);
+    bmerged = (merged == NULL) ? _slog_merged_get(s->base_seg) : NULL;
+
+    if (merged != NULL) {
+        n_iov = 0;
+        for (i=0; i< sw->n_iov; i++) {
+            lo = iov[i].offset;
+            hi = lo + iov[i].len - 1;
+            n_iov += 2*count_interval_skiplist(merged, (skiplist_key_t *)&lo, (skiplist_key_t *)&hi) + 1;
+        }
+        n_iov += 10;  //** Just to be safe
+        type_malloc(ex_iov, ex_iovec_t, n_iov);
+
+        bpos = sw->boff;
+        slot = 0;
+        for (i=0; i < sw->n_iov; i++) {
+            slot = _slog_read_merged(sw, q, merged, s->base_seg, ex_iov, slot, iov[i].offset, iov[i].len, bpos);
+            bpos = bpos + iov[i].len;
+        }
+
+        goto wait;
+    }
+
     //** Do the mapping of where to retreive the data
     segment_lock(sw->seg);
 
@@ -387,7 +601,8 @@ op_status_t seglog_read_func(void *arg, int id)
     for (i=0; i< sw->n_iov; i++) {
         lo = iov[i].offset;
         hi = lo + iov[i].len - 1;
-        n_iov += 2*count_interval_skiplist(s->mapping, (skiplist_key_t *)&lo, (skiplist_key_t *)&hi) + 1;
+        n_iov += 3*count_interval_skiplist(s->mapping, (skiplist_key_t *)&lo, (skiplist_key_t *)&hi) + 2;
+        if (bmerged != NULL) n_iov += 2*count_interval_skiplist(bmerged, (skiplist_key_t *)&lo, (skiplist_key_t *)&hi);
     }
     n_iov += 10;  //** Just to be safe
     type_malloc(ex_iov, ex_iovec_t, n_iov);
@@ -411,13 +626,10 @@ op_status_t seglog_read_func(void *arg, int id)
             }
 
             if (prev_end != ir->lo-1) { //** We have a hole so get it from the base
-                ex_iov[slot].offset = pos;
-                ex_iov[slot].len = ir->lo - pos;
-                gop = segment_read(s->base_seg, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos, sw->timeout);
-                opque_add(q, gop);
-                pos = pos + ex_iov[slot].len;
-                bpos = bpos + ex_iov[slot].len;
-                slot++;
+                len = ir->lo - pos;
+                slot = _slog_read_merged(sw, q, bmerged, s->base_seg, ex_iov, slot, pos, len, bpos);
+                pos = pos + len;
+                bpos = bpos + len;
             }
 
             if (ir->lo < lo) {  //** Need to read the middle portion
@@ -447,24 +659,19 @@ op_status_t seglog_read_func(void *arg, int id)
         }
 
         if (prev_end == -1) { //** We have a hole so get it from the base
-            ex_iov[slot].offset = lo;
-            ex_iov[slot].len = hi - lo + 1;
-            gop = segment_read(s->base_seg, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos, sw->timeout);
-            opque_add(q, gop);
-            bpos = bpos + ex_iov[slot].len;
-            slot++;
+            len = hi - lo + 1;
+            slot = _slog_read_merged(sw, q, bmerged, s->base_seg, ex_iov, slot, lo, len, bpos);
+            bpos = bpos + len;
         } else if (prev_end < hi) {    //** Check if we read from the base on the end
-            ex_iov[slot].offset = pos;
-            ex_iov[slot].len = hi - (prev_end+1) + 1;
-            gop = segment_read(s->base_seg, sw->da, sw->rw_hints, 1, &(ex_iov[slot]), sw->buffer, bpos, sw->timeout);
-            opque_add(q, gop);
-            bpos = bpos + ex_iov[slot].len;
-            slot++;
+            len = hi - (prev_end+1) + 1;
+            slot = _slog_read_merged(sw, q, bmerged, s->base_seg, ex_iov, slot, pos, len, bpos);
+            bpos = bpos + len;
         }
     }
 
     segment_unlock(sw->seg);
 
+wait:
     err = opque_waitall(q);
     if (err != OP_STATE_SUCCESS) {
         status = op_failure_status;
@@ -730,9 +937,9 @@ op_status_t seglog_clone_func(void *arg, int id)
     if (do_segment_copy == 1) {  //** segment_copy() method
         type_malloc(buffer, char, bufsize);
         opque_add(q, segment_copy(ss->tpc, slc->da, NULL, slc->sseg, slc->dseg, 0, 0, ss->file_size, bufsize, buffer, 0, slc->timeout));
-    } else if (slc->mode == CLONE_STRUCT_AND_DATA) {  //** Use the incremental log+base method
-        //** First clone the base struct and data
-        opque_add(q, segment_clone(base, slc->da, &(sd->base_seg), CLONE_STRUCT_AND_DATA, slc->attr, slc->timeout));
+    } else if (slc->mode != CLONE_STRUCTURE) {  //** Use the incremental log+base method
+        //** First clone the base struct and data.  The mode is passed through so dedup clones are honored
+        opque_add(q, segment_clone(base, slc->da, &(sd->base_seg), slc->mode, slc->attr, slc->timeout));
 
         //** Now do the logs
         //** Set up the buffers
@@ -967,6 +1174,11 @@ op_generic_t *seglog_truncate(segment_t *seg, data_attr_t *da, ex_off_t new_size
         return(gop_dummy(op_success_status));
     }
 
+    if (s->read_only == 1) {  //** Frozen snapshot level so no changes allowed
+        log_printf(1, "seg=" XIDT " is read only!\n", segment_id(seg));
+        return(gop_dummy(op_failure_status));
+    }
+
     type_malloc_clear(st, seglog_truncate_t, 1);
 
     st->seg = seg;
@@ -1097,6 +1309,12 @@ int seglog_serialize_text(segment_t *seg, exnode_exchange_t *exp)
     }
     append_printf(segbuf, &sused, bufsize, "type=%s\n", SEGMENT_TYPE_LOG);
     append_printf(segbuf, &sused, bufsize, "ref_count=%d\n", seg->ref_count);
+    if (s->read_only == 1) append_printf(segbuf, &sused, bufsize, "read_only=1\n");
+    if (s->snap_name != NULL) {
+        etext = escape_text("=", '\\', s->snap_name);
+        append_printf(segbuf, &sused, bufsize, "snapshot=%s\n", etext);
+        free(etext);
+    }
 
 
     //** And the children segments
@@ -1169,6 +1387,8 @@ int seglog_deserialize_text(segment_t *seg, ex_id_t id, exnode_exchange_t *exp)
     seg->header.id = id;
     seg->header.type = SEGMENT_TYPE_LOG;
     seg->header.name = inip_get_string(fd, seggrp, "name", "");
+    s->read_only = inip_get_integer(fd, seggrp, "read_only", 0);
+    s->snap_name = inip_get_string(fd, seggrp, "snapshot", NULL);
 
     //** Load the child segments
     id = inip_get_integer(fd, seggrp, "log", 0);
@@ -1264,6 +1484,9 @@ void seglog_destroy(segment_t *seg)
     for (i=0; i<n; i++) free(r_list[i]);
     free(r_list);
 
+    if (s->merged != NULL) _slog_merged_destroy(s->merged);
+    if (s->snap_name != NULL) free(s->snap_name);
+
     free(s);
 
     ex_header_release(&(seg->header));
@@ -1512,6 +1735,12 @@ op_generic_t *slog_merge_with_base(segment_t *seg, data_attr_t *da, ex_off_t buf
     seglog_merge_t *st;
     seglog_priv_t *s = (seglog_priv_t *)seg->priv;
 
+    //** Merging into a snapshot would change it out from under its readers
+    if ((s->read_only == 1) || (s->snap_name != NULL)) {
+        log_printf(1, "seg=" XIDT " base is a read only snapshot!\n", segment_id(seg));
+        return(gop_dummy(op_failure_status));
+    }
+
     type_malloc_clear(st, seglog_merge_t, 1);
 
     st->seg = seg;
@@ -1524,3 +1753,158 @@ op_generic_t *slog_merge_with_base(segment_t *seg, data_attr_t *da, ex_off_t buf
     return(new_thread_pool_op(s->tpc, NULL, seglog_merge_with_base_func, (void *)st, free, 1));
 }
 
+
+//***********************************************************************
+// slog_freeze - Marks the log level as read only.  Once frozen all
+//    writes and truncates fail and reads go through the flattened index.
+//***********************************************************************
+
+void slog_freeze(segment_t *seg)
+{
+    seglog_priv_t *s;
+
+    if (strcmp(segment_type(seg), SEGMENT_TYPE_LOG) != 0) return;
+
+    s = (seglog_priv_t *)seg->priv;
+    segment_lock(seg);
+    s->read_only = 1;
+    segment_unlock(seg);
+}
+
+//***********************************************************************
+// slog_snapshot_next - Walks down the log chain starting at seg and returns
+//    the next snapshot found storing its name in *name.  Pass the returned
+//    segment back in to continue the walk.  NULL is returned when there
+//    are no more snapshots.
+//***********************************************************************
+
+segment_t *slog_snapshot_next(segment_t *seg, char **name)
+{
+    seglog_priv_t *s;
+
+    while (strcmp(segment_type(seg), SEGMENT_TYPE_LOG) == 0) {
+        s = (seglog_priv_t *)seg->priv;
+        if (s->snap_name != NULL) {
+            *name = s->snap_name;
+            return(s->base_seg);
+        }
+        seg = s->base_seg;
+    }
+
+    *name = NULL;
+    return(NULL);
+}
+
+//***********************************************************************
+// slog_snapshot_find - Returns the frozen segment for the named snapshot
+//    or NULL if it doesn't exist.
+//***********************************************************************
+
+segment_t *slog_snapshot_find(segment_t *seg, char *name)
+{
+    char *sname;
+
+    while ((seg = slog_snapshot_next(seg, &sname)) != NULL) {
+        if (strcmp(sname, name) == 0) return(seg);
+    }
+
+    return(NULL);
+}
+
+//***********************************************************************
+// slog_snapshot_func - Freezes the segment and stacks a new empty log on it
+//***********************************************************************
+
+op_status_t slog_snapshot_func(void *arg, int id)
+{
+    seglog_snapshot_t *op = (seglog_snapshot_t *)arg;
+    segment_t *root, *table, *data, *top;
+    seglog_priv_t *s;
+    opque_t *q;
+    int err;
+
+    //** Make the empty table and data segments using the root's layout
+    root = _slog_find_base(op->seg);
+    table = data = NULL;
+    q = new_opque();
+    opque_add(q, segment_clone(root, op->da, &table, CLONE_STRUCTURE, NULL, op->timeout));
+    opque_add(q, segment_clone(root, op->da, &data, CLONE_STRUCTURE, NULL, op->timeout));
+    err = opque_waitall(q);
+    opque_free(q, OP_DESTROY);
+
+    if (err != OP_STATE_SUCCESS) {
+        log_printf(1, "seg=" XIDT " Failed creating the new log segments!\n", segment_id(op->seg));
+        if (table != NULL) segment_destroy(table);
+        if (data != NULL) segment_destroy(data);
+        return(op_failure_status);
+    }
+
+    top = slog_make(op->seg->ess, table, data, op->seg);
+    if (top == NULL) {
+        segment_destroy(table);
+        segment_destroy(data);
+        return(op_failure_status);
+    }
+
+    atomic_inc(table->ref_count);
+    atomic_inc(data->ref_count);
+    atomic_inc(op->seg->ref_count);
+
+    //** Freeze the old top and tag the new one
+    slog_freeze(op->seg);
+    s = (seglog_priv_t *)top->priv;
+    s->snap_name = strdup(op->name);
+
+    log_printf(5, "seg=" XIDT " snapshot=%s new_top=" XIDT "\n", segment_id(op->seg), op->name, segment_id(top));
+
+    *op->top_seg = top;
+    return(op_success_status);
+}
+
+//***********************************************************************
+// slog_snapshot_abort - Removes the table and data of a new top made by
+//    slog_snapshot() when the snapshot can't be stored.  The frozen
+//    segment underneath is left alone.  The caller still destroys top.
+//***********************************************************************
+
+op_generic_t *slog_snapshot_abort(segment_t *top, data_attr_t *da, int timeout)
+{
+    seglog_priv_t *s = (seglog_priv_t *)top->priv;
+    opque_t *q;
+
+    q = new_opque();
+    opque_add(q, segment_remove(s->table_seg, da, timeout));
+    opque_add(q, segment_remove(s->data_seg, da, timeout));
+    return(opque_get_gop(q));
+}
+
+//***********************************************************************
+// slog_snapshot - Takes a named snapshot of seg.  The segment, either a log
+//    or the original base, is frozen as a read only level and a new empty
+//    log level is stacked on top of it to take any further writes.  The new
+//    top is returned in *top_seg and should replace seg as the file's
+//    default segment.  No data is copied so this is cheap regardless of
+//    the file size.
+//***********************************************************************
+
+op_generic_t *slog_snapshot(segment_t *seg, data_attr_t *da, char *name, segment_t **top_seg, int timeout)
+{
+    seglog_snapshot_t *op;
+    thread_pool_context_t *tpc;
+
+    if (slog_snapshot_find(seg, name) != NULL) {
+        log_printf(1, "seg=" XIDT " snapshot %s already exists!\n", segment_id(seg), name);
+        return(gop_dummy(op_failure_status));
+    }
+
+    tpc = lookup_service(seg->ess, ESS_RUNNING, ESS_TPC_UNLIMITED);
+
+    type_malloc_clear(op, seglog_snapshot_t, 1);
+    op->seg = seg;
+    op->da = da;
+    op->name = name;
+    op->top_seg = top_seg;
+    op->timeout = timeout;
+
+    return(new_thread_pool_op(tpc, NULL, slog_snapshot_func, (void *)op, free, 1));
+}
@@ -48,6 +48,11 @@ segment_t *slog_make(service_manager_t *sm, segment_t *table, segment_t *data, s
 
 //redundant---op_generic_t *slog_compact(segment_t *seg);  //** Compatcts the table/data log and optionally destroy's the old
 op_generic_t *slog_merge_with_base(segment_t *seg, data_attr_t *da, ex_off_t bufsize, char *buffer, int truncate_old_log, int timeout);  //** Merges the current log with the base
+void slog_freeze(segment_t *seg);  //** Makes the log level read only
+op_generic_t *slog_snapshot(segment_t *seg, data_attr_t *da, char *name, segment_t **top_seg, int timeout);  //** Freezes seg and stacks a new log on it
+op_generic_t *slog_snapshot_abort(segment_t *top, data_attr_t *da, int timeout);  //** Removes the new level if the snapshot can't be stored
+segment_t *slog_snapshot_find(segment_t *seg, char *name);  //** Returns the named snapshot's segment
+segment_t *slog_snapshot_next(segment_t *seg, char **name);  //** Iterates over the snapshots in the chain
 //segment_clone -- Does a recursive merge_with_base by performing a deep copy
 //int slog_get_segments(segment_t *seg, segment_t **table, segment_t **data, segment_t **base);
 //int slog_set_segments(segment_t *seg, segment_t *table, segment_t *data, segment_t *base);
@@ -46,18 +46,28 @@ typedef struct {
     ex_off_t data_offset;
 } slog_range_t;
 
+typedef struct {    //** Flattened chain range.  Only used in memory
+    ex_off_t lo;
+    ex_off_t hi;
+    ex_off_t offset;  //** Offset in seg where the range starts
+    segment_t *seg;   //** Segment actually holding the bytes
+} slog_merged_t;
+
 typedef struct {
     segment_t *table_seg;
     segment_t *data_seg;
     segment_t *base_seg;
     data_service_fn_t *ds;
     interval_skiplist_t *mapping;
+    interval_skiplist_t *merged;  //** Flattened view of the whole chain.  Only built for read only levels
+    char *snap_name;              //** If set the base is a frozen snapshot with this name
     thread_pool_context_t *tpc;
     ex_off_t file_size;
     ex_off_t log_size;
     ex_off_t data_size;
     int soft_errors;
     int hard_errors;
+    int read_only;
 } seglog_priv_t;
 
 #ifdef __cplusplus
@@ -34,6 +34,7 @@ http://www.accre.vanderbilt.edu
 
 #define _log_module_index 177
 
+#include <openssl/sha.h>
 #include "ex3_abstract.h"
 #include "ex3_system.h"
 #include "interval_skiplist.h"
@@ -243,6 +244,9 @@ int slun_row_placement_fix(segment_t *seg, data_attr_t *da, seglun_row_t *b, int
     char *migrate;
     op_generic_t *gop;
     opque_t *q;
+    char *xfer_src[n_devices], *xfer_dest[n_devices];
+    ex_off_t xfer_bytes[n_devices];
+    int xfer_index[n_devices], xfer_ok[n_devices], n_xfer;
 
     rid_changes = args->rid_changes;
     rid_lock = args->rid_lock;
@@ -318,6 +322,22 @@ int slun_row_placement_fix(segment_t *seg, data_attr_t *da, seglun_row_t *b, int
         gop_waitall(gop);
         gop_free(gop, OP_DESTROY);
 
+        //** Let the throttle pace the copies if we have one
+        n_xfer = 0;
+        if (args->throttle != NULL) {
+            for (j=0; j<m; j++) {
+                xfer_index[j] = -1;
+                if (ds_get_cap(db[j]->ds, db[j]->cap, DS_CAP_READ) == NULL) continue;
+                xfer_index[j] = n_xfer;
+                xfer_src[n_xfer] = b->block[missing[j]].data->rid_key;
+                xfer_dest[n_xfer] = req[j].rid_key;
+                xfer_bytes[n_xfer] = b->block_len;
+                xfer_ok[n_xfer] = 0;
+                n_xfer++;
+            }
+            if (n_xfer > 0) args->throttle->acquire(args->throttle->arg, n_xfer, xfer_src, xfer_dest, xfer_bytes);
+        }
+
         //** Process the results
         opque_start_execution(q);
         for (j=0; j<m; j++) {
@@ -373,6 +393,7 @@ int slun_row_placement_fix(segment_t *seg, data_attr_t *da, seglun_row_t *b, int
                 i = missing[j];
                 log_printf(15, "missing[%d]=%d status=%d\n", j,i, gop_completed_successfully(gop));
                 if (gop_completed_successfully(gop) == OP_STATE_SUCCESS) {  //** Update the block
+                    if ((n_xfer > 0) && (xfer_index[j] >= 0)) xfer_ok[xfer_index[j]] = 1;
                     dbs = b->block[i].data;
                     dbd = db[j];
 
@@ -426,6 +447,8 @@ int slun_row_placement_fix(segment_t *seg, data_attr_t *da, seglun_row_t *b, int
             }
         }
 
+        if (n_xfer > 0) args->throttle->release(args->throttle->arg, n_xfer, xfer_src, xfer_dest, xfer_bytes, xfer_ok);
+
         opque_waitall(q);  //** Wait for the removal to complete.  Don't care if there are errors we can still continue
         opque_free(q, OP_DESTROY);
 
@@ -1446,6 +1469,33 @@ int seglun_row_decompose_test()
     return(cerr);
 }
 
+//***********************************************************************
+// _slun_update_ioperf - Folds the I/O op's bandwidth into the RID's running
+//    average stored in the blacklist.  This is used by the RS for placement.
+//***********************************************************************
+
+void _slun_update_ioperf(blacklist_t *bl, char *rid_key, ex_off_t len, apr_time_t exec_time)
+{
+    blacklist_ioperf_t *p;
+    double bw;
+
+    bw = len;
+    bw = bw * APR_USEC_PER_SEC / exec_time;
+
+    apr_thread_mutex_lock(bl->lock);
+    p = apr_hash_get(bl->ioperf, rid_key, APR_HASH_KEY_STRING);
+    if (p == NULL) {
+        type_malloc(p, blacklist_ioperf_t, 1);
+        p->rid = strdup(rid_key);
+        p->bandwidth = bw;
+        apr_hash_set(bl->ioperf, p->rid, APR_HASH_KEY_STRING, p);
+    } else {
+        p->bandwidth = 0.8*p->bandwidth + 0.2*bw;
+    }
+    p->last_update = apr_time_now();
+    apr_thread_mutex_unlock(bl->lock);
+}
+
 //***********************************************************************
 // seglun_rw_op - Reads/Writes to a LUN segment
 //***********************************************************************
@@ -1655,6 +1705,9 @@ op_status_t seglun_rw_op(segment_t *seg, data_attr_t *da, segment_rw_hints_t *rw
             if ((dt_status.error_code != -1234) && (bl != NULL)) { //** Skip the blacklisted ops
                 exec_time = gop_exec_time(gop);
                 log_printf(5, "exec_time=" TT " min_time=" TT "\n", exec_time, bl->min_io_time);
+                if ((exec_time > 0) && (dt_status.op_status == OP_STATE_SUCCESS)) { //** Track the RID performance for data placement
+                    _slun_update_ioperf(bl, rwb_table[gop_get_myid(gop)].block->data->rid_key, rwb_table[gop_get_myid(gop)].len, exec_time);
+                }
                 if (exec_time > bl->min_io_time) { //** Make sure the exec time was long enough
                     dt = rwb_table[gop_get_myid(gop)].len;
                     dt /= exec_time;
@@ -2336,6 +2389,414 @@ op_generic_t *seglun_flush(segment_t *seg, data_attr_t *da, ex_off_t lo, ex_off_
     return(gop_dummy(op_success_status));
 }
 
+//***********************************************************************
+// Deduplicating clones.  Each whole allocation copied by a CLONE_DEDUP
+// clone is read once through the client.  That data is fingerprinted and,
+// unless the fingerprint is already in the catalog, written to the
+// destination.  Matches are shared by bumping the depot's reference count
+// instead of writing the data.  The fingerprint is stored as a block
+// attribute so later snapshots can seed the catalog from earlier ones.
+//
+// The depot can't do copy-on-write so every fingerprinted allocation has
+// its write cap blanked.  A write through one clone can then never change
+// the data another clone sees.
+//
+// A fingerprint is only cataloged once its data has been written.  Until
+// then the entry is pending and anyone else with the same data waits for
+// it to either be ready or abandoned.
+//***********************************************************************
+
+#define SEGLUN_DEDUP_INFLIGHT 8   //** Max allocations being fingerprinted at once.  Each holds a block sized buffer
+
+struct seglun_dedup_s {
+    apr_pool_t *mpool;
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;  //** Signaled when a pending entry is resolved
+    apr_hash_t *table;
+    int n_shared;
+    ex_off_t bytes_shared;
+};
+
+typedef struct {
+    char *key;                //** fingerprint:length
+    data_service_fn_t *ds;
+    char *rid_key;
+    char *cap[3];             //** Read, write, and manage caps.  The write cap is always blank
+    ex_off_t size;
+    ex_off_t max_size;
+    int ready;                //** 0 while the data is still being written
+} seglun_dedup_entry_t;
+
+typedef struct {
+    seglun_clone_t *slc;
+    seglun_dedup_t *dd;
+    data_service_fn_t *ds;    //** Source allocation
+    char *rcap;
+    ex_off_t len;
+    seglun_block_t *bd;       //** Destination block
+} seglun_dedup_task_t;
+
+static int _dedup_cap_type[3] = { DS_CAP_READ, DS_CAP_WRITE, DS_CAP_MANAGE };
+
+//***********************************************************************
+// seglun_dedup_create - Creates an empty dedup catalog
+//***********************************************************************
+
+seglun_dedup_t *seglun_dedup_create()
+{
+    seglun_dedup_t *dd;
+
+    type_malloc_clear(dd, seglun_dedup_t, 1);
+    assert_result(apr_pool_create(&(dd->mpool), NULL), APR_SUCCESS);
+    apr_thread_mutex_create(&(dd->lock), APR_THREAD_MUTEX_DEFAULT, dd->mpool);
+    apr_thread_cond_create(&(dd->cond), dd->mpool);
+    dd->table = apr_hash_make(dd->mpool);
+
+    return(dd);
+}
+
+//***********************************************************************
+// _seglun_dedup_entry_free - Frees a catalog entry
+//***********************************************************************
+
+void _seglun_dedup_entry_free(seglun_dedup_entry_t *e)
+{
+    int i;
+
+    for (i=0; i<3; i++) {
+        if (e->cap[i] != NULL) free(e->cap[i]);
+    }
+    if (e->rid_key != NULL) free(e->rid_key);
+    free(e->key);
+    free(e);
+}
+
+//***********************************************************************
+// seglun_dedup_destroy - Destroys the catalog.  The allocations are untouched.
+//***********************************************************************
+
+void seglun_dedup_destroy(seglun_dedup_t *dd)
+{
+    apr_hash_index_t *hi;
+    seglun_dedup_entry_t *e;
+
+    for (hi = apr_hash_first(NULL, dd->table); hi != NULL; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&e);
+        _seglun_dedup_entry_free(e);
+    }
+
+    apr_thread_mutex_destroy(dd->lock);
+    apr_thread_cond_destroy(dd->cond);
+    apr_pool_destroy(dd->mpool);
+    free(dd);
+}
+
+//***********************************************************************
+// seglun_dedup_stats - Returns how many allocations were shared
+//***********************************************************************
+
+void seglun_dedup_stats(seglun_dedup_t *dd, int *n_shared, ex_off_t *bytes_shared)
+{
+    apr_thread_mutex_lock(dd->lock);
+    *n_shared = dd->n_shared;
+    *bytes_shared = dd->bytes_shared;
+    apr_thread_mutex_unlock(dd->lock);
+}
+
+//***********************************************************************
+// _seglun_dedup_fill - Loads the entry from the data block and marks it ready
+//***********************************************************************
+
+void _seglun_dedup_fill(seglun_dedup_entry_t *e, data_block_t *db)
+{
+    char *cap;
+    int i;
+
+    e->ds = db->ds;
+    e->rid_key = (db->rid_key != NULL) ? strdup(db->rid_key) : NULL;
+    e->size = db->size;
+    e->max_size = db->max_size;
+    for (i=0; i<3; i++) {
+        cap = (_dedup_cap_type[i] == DS_CAP_WRITE) ? "" : (char *)ds_get_cap(db->ds, db->cap, _dedup_cap_type[i]);
+        e->cap[i] = (cap != NULL) ? strdup(cap) : NULL;
+    }
+    e->ready = 1;
+}
+
+//***********************************************************************
+// _seglun_dedup_claim - Returns the ready catalog entry for the fingerprint.
+//    If there isn't one a pending entry is added and NULL is returned.  The
+//    caller then owns it and has to _seglun_dedup_resolve() it.  If another
+//    thread owns a pending entry we wait for it to be resolved.
+//***********************************************************************
+
+seglun_dedup_entry_t *_seglun_dedup_claim(seglun_dedup_t *dd, char *key)
+{
+    seglun_dedup_entry_t *e;
+
+    apr_thread_mutex_lock(dd->lock);
+    while (((e = apr_hash_get(dd->table, key, APR_HASH_KEY_STRING)) != NULL) && (e->ready == 0)) {
+        apr_thread_cond_wait(dd->cond, dd->lock);
+    }
+
+    if (e == NULL) {
+        type_malloc_clear(e, seglun_dedup_entry_t, 1);
+        e->key = strdup(key);
+        apr_hash_set(dd->table, e->key, APR_HASH_KEY_STRING, e);
+        e = NULL;
+    }
+    apr_thread_mutex_unlock(dd->lock);
+
+    return(e);
+}
+
+//***********************************************************************
+// _seglun_dedup_resolve - Resolves a pending entry.  If db is NULL the
+//    write failed and the entry is dropped otherwise it's made ready.
+//***********************************************************************
+
+void _seglun_dedup_resolve(seglun_dedup_t *dd, char *key, data_block_t *db)
+{
+    seglun_dedup_entry_t *e;
+
+    apr_thread_mutex_lock(dd->lock);
+    e = apr_hash_get(dd->table, key, APR_HASH_KEY_STRING);
+    if ((e != NULL) && (e->ready == 0)) {
+        if (db != NULL) {
+            _seglun_dedup_fill(e, db);
+        } else {
+            apr_hash_set(dd->table, e->key, APR_HASH_KEY_STRING, NULL);
+            _seglun_dedup_entry_free(e);
+        }
+    }
+    apr_thread_cond_broadcast(dd->cond);
+    apr_thread_mutex_unlock(dd->lock);
+}
+
+//***********************************************************************
+// seglun_dedup_add_segment - Adds the fingerprinted allocations from the
+//    segment to the catalog.  Returns the number of allocations added.
+//***********************************************************************
+
+int seglun_dedup_add_segment(seglun_dedup_t *dd, segment_t *seg)
+{
+    seglun_priv_t *s = (seglun_priv_t *)seg->priv;
+    interval_skiplist_iter_t it;
+    seglun_dedup_entry_t *e;
+    seglun_row_t *b;
+    char *fp;
+    int i, n;
+
+    if (strcmp(segment_type(seg), SEGMENT_TYPE_LUN) != 0) return(0);
+
+    n = 0;
+    segment_lock(seg);
+    it = iter_search_interval_skiplist(s->isl, (skiplist_key_t *)NULL, (skiplist_key_t *)NULL);
+    while ((b = (seglun_row_t *)next_interval_skiplist(&it)) != NULL) {
+        for (i=0; i < s->n_devices; i++) {
+            if (b->block[i].cap_offset != 0) continue;
+            fp = data_block_get_attr(b->block[i].data, SEGMENT_LUN_DEDUP_ATTR);
+            if (fp == NULL) continue;
+
+            apr_thread_mutex_lock(dd->lock);
+            if (apr_hash_get(dd->table, fp, APR_HASH_KEY_STRING) == NULL) {
+                type_malloc_clear(e, seglun_dedup_entry_t, 1);
+                e->key = strdup(fp);
+                _seglun_dedup_fill(e, b->block[i].data);
+                apr_hash_set(dd->table, e->key, APR_HASH_KEY_STRING, e);
+                n++;
+            }
+            apr_thread_mutex_unlock(dd->lock);
+        }
+    }
+    segment_unlock(seg);
+
+    return(n);
+}
+
+//***********************************************************************
+// _seglun_dedup_blank_write_cap - Makes the block read-only
+//***********************************************************************
+
+void _seglun_dedup_blank_write_cap(data_block_t *db)
+{
+    char *cap;
+
+    cap = (char *)ds_get_cap(db->ds, db->cap, DS_CAP_WRITE);
+    ds_set_cap(db->ds, db->cap, DS_CAP_WRITE, strdup(""));
+    if (cap != NULL) free(cap);
+}
+
+//***********************************************************************
+// seglun_dedup_share - Replaces the destination block with a reference to
+//    the catalog's allocation.  Returns 0 on success.
+//***********************************************************************
+
+int seglun_dedup_share(seglun_clone_t *slc, seglun_dedup_t *dd, seglun_dedup_entry_t *e, seglun_block_t *block, char *key)
+{
+    seglun_priv_t *sd = (seglun_priv_t *)slc->dseg->priv;
+    data_block_t *db, *old;
+    int i;
+
+    //** Add our reference first.  If that fails we just do a normal copy
+    if (gop_sync_exec(ds_modify_count(e->ds, slc->da, e->cap[2], DS_MODE_INCR, DS_CAP_READ, slc->timeout)) != OP_STATE_SUCCESS) {
+        log_printf(5, "Unable to add a reference to rid_key=%s.  Copying instead\n", e->rid_key);
+        return(1);
+    }
+
+    db = data_block_create(e->ds);
+    db->rid_key = (e->rid_key != NULL) ? strdup(e->rid_key) : NULL;
+    db->size = e->size;
+    db->max_size = e->max_size;
+    for (i=0; i<3; i++) {
+        ds_set_cap(db->ds, db->cap, _dedup_cap_type[i], (e->cap[i] != NULL) ? strdup(e->cap[i]) : NULL);
+    }
+    data_block_set_attr(db, SEGMENT_LUN_DEDUP_ATTR, key);
+    atomic_inc(db->ref_count);
+
+    //** Swap it in and release the allocation made during the grow
+    segment_lock(slc->dseg);
+    old = block->data;
+    block->data = db;
+    block->cap_offset = 0;
+    atomic_dec(old->ref_count);
+    if (sd->db_cleanup == NULL) sd->db_cleanup = new_stack();
+    push(sd->db_cleanup, old);
+    segment_unlock(slc->dseg);
+
+    gop_sync_exec(ds_remove(old->ds, slc->da, ds_get_cap(old->ds, old->cap, DS_CAP_MANAGE), slc->timeout));
+
+    apr_thread_mutex_lock(dd->lock);
+    dd->n_shared++;
+    dd->bytes_shared += db->size;
+    apr_thread_mutex_unlock(dd->lock);
+
+    return(0);
+}
+
+//***********************************************************************
+// seglun_dedup_write - Writes the buffer to the destination allocation
+//***********************************************************************
+
+int seglun_dedup_write(seglun_clone_t *slc, seglun_block_t *bd, char *buffer, ex_off_t len)
+{
+    tbuffer_t tbuf;
+    ex_off_t off, n;
+
+    for (off=0; off<len; off += n) {
+        n = len - off;
+        if (n > slc->max_transfer) n = slc->max_transfer;
+        tbuffer_single(&tbuf, n, buffer + off);
+        if (gop_sync_exec(ds_write(bd->data->ds, slc->da, ds_get_cap(bd->data->ds, bd->data->cap, DS_CAP_WRITE),
+                                   bd->cap_offset + off, &tbuf, 0, n, slc->timeout)) != OP_STATE_SUCCESS) {
+            return(1);
+        }
+    }
+
+    return(0);
+}
+
+//***********************************************************************
+// seglun_dedup_block_fn - Clones a single allocation.  The source is read
+//    once and the fingerprint is calculated on that data.  The data is
+//    then either shared with a matching allocation or written to the
+//    destination.  No segment locks are held while doing the IO.
+//***********************************************************************
+
+op_status_t seglun_dedup_block_fn(void *arg, int id)
+{
+    seglun_dedup_task_t *t = (seglun_dedup_task_t *)arg;
+    seglun_clone_t *slc = t->slc;
+    seglun_dedup_entry_t *e;
+    SHA256_CTX ctx;
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    char key[2*SHA256_DIGEST_LENGTH + 64];
+    tbuffer_t tbuf;
+    char *buffer;
+    ex_off_t off, n;
+    int i, used, err;
+
+    type_malloc(buffer, char, t->len);
+
+    SHA256_Init(&ctx);
+    for (off=0; off<t->len; off += n) {
+        n = t->len - off;
+        if (n > slc->max_transfer) n = slc->max_transfer;
+        tbuffer_single(&tbuf, n, buffer + off);
+        if (gop_sync_exec(ds_read(t->ds, slc->da, t->rcap, off, &tbuf, 0, n, slc->timeout)) != OP_STATE_SUCCESS) {
+            log_printf(1, "Unable to read source allocation.  sseg=" XIDT "\n", segment_id(slc->sseg));
+            free(buffer);
+            return(op_failure_status);
+        }
+        SHA256_Update(&ctx, buffer + off, n);
+    }
+    SHA256_Final(md, &ctx);
+
+    used = 0;
+    for (i=0; i<SHA256_DIGEST_LENGTH; i++) append_printf(key, &used, sizeof(key), "%02x", md[i]);
+    append_printf(key, &used, sizeof(key), ":" XOT, t->len);
+
+    e = _seglun_dedup_claim(t->dd, key);
+    if (e != NULL) {
+        if (seglun_dedup_share(slc, t->dd, e, t->bd, key) == 0) {
+            free(buffer);
+            return(op_success_status);
+        }
+    }
+
+    //** New data or we couldn't share it so store our own copy
+    err = seglun_dedup_write(slc, t->bd, buffer, t->len);
+    free(buffer);
+
+    if (err == 0) {
+        data_block_set_attr(t->bd->data, SEGMENT_LUN_DEDUP_ATTR, key);
+        _seglun_dedup_blank_write_cap(t->bd->data);
+    } else {
+        log_printf(1, "Unable to write destination allocation.  dseg=" XIDT "\n", segment_id(slc->dseg));
+    }
+
+    //** Only catalog it now that the data is actually there
+    if (e == NULL) _seglun_dedup_resolve(t->dd, key, (err == 0) ? t->bd->data : NULL);
+
+    return((err == 0) ? op_success_status : op_failure_status);
+}
+
+//***********************************************************************
+// seglun_dedup_task_free - Frees a dedup task
+//***********************************************************************
+
+void seglun_dedup_task_free(void *arg)
+{
+    seglun_dedup_task_t *t = (seglun_dedup_task_t *)arg;
+
+    free(t->rcap);
+    free(t);
+}
+
+//***********************************************************************
+// seglun_dedup_task - Generates the task to clone the allocation or NULL
+//    if it's not a whole allocation and has to be copied normally
+//***********************************************************************
+
+op_generic_t *seglun_dedup_task(seglun_clone_t *slc, seglun_dedup_t *dd, seglun_block_t *bs, seglun_block_t *bd, ex_off_t len)
+{
+    seglun_priv_t *sd = (seglun_priv_t *)slc->dseg->priv;
+    seglun_dedup_task_t *t;
+
+    //** Only whole allocations can be shared
+    if ((bs->cap_offset != 0) || (bd->cap_offset != 0) || (bd->data->max_size != len)) return(NULL);
+
+    type_malloc_clear(t, seglun_dedup_task_t, 1);
+    t->slc = slc;
+    t->dd = dd;
+    t->ds = bs->data->ds;
+    t->rcap = strdup((char *)ds_get_cap(bs->data->ds, bs->data->cap, DS_CAP_READ));  //** The source can change once it's unlocked
+    t->len = len;
+    t->bd = bd;
+
+    return(new_thread_pool_op(sd->tpc, NULL, seglun_dedup_block_fn, (void *)t, seglun_dedup_task_free, 1));
+}
+
 //***********************************************************************
 // seglun_clone_func - Clone data from the segment
 //***********************************************************************
@@ -2356,6 +2817,9 @@ op_status_t seglun_clone_func(void *arg, int id)
     op_generic_t *gop = NULL;
     op_generic_t *gop_next;
     op_status_t status;
+    seglun_dedup_t *dd, *dd_local;
+    Stack_t *dd_stack;
+    int n_dd;
 
     //** See if we are using an old seg.  If so we need to trunc it first
     if (slc->trunc == 1) {
@@ -2426,6 +2890,19 @@ op_status_t seglun_clone_func(void *arg, int id)
     opque_start_execution(q);
     dir = ((slc->mode & DS_PULL) > 0) ? DS_PULL : DS_PUSH;
 
+    //** Use the shared dedup catalog if one is running otherwise we just dedup within the segment
+    dd = NULL;
+    dd_local = NULL;
+    dd_stack = new_stack();
+    n_dd = 0;
+    if ((slc->mode & CLONE_DEDUP) == CLONE_DEDUP) {
+        dd = lookup_service(slc->sseg->ess, ESS_RUNNING, SEGMENT_LUN_DEDUP_SERVICE);
+        if (dd == NULL) {
+            dd_local = seglun_dedup_create();
+            dd = dd_local;
+        }
+    }
+
     its = iter_search_interval_skiplist(ss->isl, (skiplist_key_t *)NULL, (skiplist_key_t *)NULL);
     itd = iter_search_interval_skiplist(sd->isl, (skiplist_key_t *)NULL, (skiplist_key_t *)NULL);
     j = 0;
@@ -2434,6 +2911,23 @@ op_status_t seglun_clone_func(void *arg, int id)
         bd = (seglun_row_t *)next_interval_skiplist(&itd);
 
         for (i=0; i < ss->n_devices; i++) {
+            if (dd != NULL) {  //** Whole allocations are fingerprinted and possibly shared instead of copied
+                gop = seglun_dedup_task(slc, dd, &(bs->block[i]), &(bd->block[i]), bs->block_len);
+                if (gop != NULL) {
+                    gop_set_private(gop, dd_stack);
+                    if (n_dd < SEGLUN_DEDUP_INFLIGHT) {
+                        opque_add(q, gop);
+                    } else {
+                        move_to_bottom(dd_stack);
+                        insert_below(dd_stack, gop);
+                    }
+                    n_dd++;
+                    n++;
+                    j++;
+                    continue;
+                }
+            }
+
             len = slc->max_transfer;
             d_offset = bd->block[i].cap_offset;
             offset = bs->block[i].cap_offset;
@@ -2470,7 +2964,7 @@ op_status_t seglun_clone_func(void *arg, int id)
 
     segment_unlock(slc->sseg);
 
-    log_printf(5, "Total number of tasks: %d\n", n);
+    log_printf(5, "Total number of tasks: %d dedup: %d\n", n, n_dd);
 
     //** Loop through adding tasks as needed
     for (i=0; i<n; i++) {
@@ -2478,6 +2972,11 @@ op_status_t seglun_clone_func(void *arg, int id)
         gop_next = pop((Stack_t *)gop_get_private(gop));
         if (gop_next != NULL) opque_add(q, gop_next);
 
+        if (gop_get_private(gop) == dd_stack) {  //** Dedup tasks aren't IBP ops
+            gop_free(gop, OP_DESTROY);
+            continue;
+        }
+
         //** This is for diagnostics
         dtus = gop->op->cmd.end_time - gop->op->cmd.start_time;
         dts = (1.0*dtus) / (1.0*APR_USEC_PER_SEC);
@@ -2497,6 +2996,8 @@ op_status_t seglun_clone_func(void *arg, int id)
     free(max_index);
     for (i=0; i<n_rows*ss->n_devices; i++) free_stack(gop_stack[i], 0);
     free(gop_stack);
+    free_stack(dd_stack, 0);
+    if (dd_local != NULL) seglun_dedup_destroy(dd_local);
     return(status);
 }
 
@@ -2566,6 +3067,332 @@ op_generic_t *seglun_clone(segment_t *seg, data_attr_t *da, segment_t **clone_se
     return(gop);
 }
 
+//***********************************************************************
+// Depot-to-depot copy between LUN segments with different layouts
+//***********************************************************************
+
+#define SEGLUN_DIRECT_MIN (64*1024)        //** Anything smaller than this is streamed through the client
+#define SEGLUN_DIRECT_MAX_TRANSFER (20*1024*1024)
+
+typedef struct {
+    seglun_block_t *sblock;
+    seglun_block_t *dblock;
+    ex_off_t soff;         //** Offset in the source allocation
+    ex_off_t doff;         //** Offset in the destination allocation
+    ex_off_t len;
+    ex_iovec_t *iov;       //** Segment ranges making up the run.  Only used if streamed
+    int n_iov;
+    int c_iov;
+} seglun_direct_run_t;
+
+typedef struct {
+    segment_t *sseg;
+    segment_t *dseg;
+    data_attr_t *da;
+    segment_rw_hints_t *rw_hints;
+    char *buffer;
+    ex_off_t bufsize;
+    int timeout;
+} seglun_direct_t;
+
+//***********************************************************************
+// _seglun_locate - Maps the segment offset to the allocation holding it.
+//    The allocation offset and how many bytes are contiguous in the
+//    allocation from there are returned.  Returns 1 if pos isn't mapped.
+//    NOTE: Assumes the segment is locked
+//***********************************************************************
+
+int _seglun_locate(segment_t *seg, ex_off_t pos, seglun_row_t **row, seglun_block_t **block, ex_off_t *boff, ex_off_t *nleft)
+{
+    seglun_priv_t *s = (seglun_priv_t *)seg->priv;
+    interval_skiplist_iter_t it;
+    seglun_row_t *b;
+    ex_off_t row_off, stripe, soff, coff;
+    int dev, i;
+
+    it = iter_search_interval_skiplist(s->isl, (skiplist_key_t *)&pos, (skiplist_key_t *)&pos);
+    b = (seglun_row_t *)next_interval_skiplist(&it);
+    if (b == NULL) return(1);
+
+    //** Same mapping as lun_row_decompose just in reverse
+    row_off = pos - b->seg_offset;
+    stripe = row_off / s->stripe_size;
+    soff = row_off % s->stripe_size;
+    dev = soff / s->chunk_size;
+    coff = soff % s->chunk_size;
+    i = (dev - (int)((stripe * s->n_shift) % s->n_devices) + s->n_devices) % s->n_devices;
+
+    *row = b;
+    *block = &(b->block[i]);
+    *boff = b->block[i].cap_offset + stripe * s->chunk_size + coff;
+    *nleft = s->chunk_size - coff;
+    if (*nleft > (b->seg_end - pos + 1)) *nleft = b->seg_end - pos + 1;
+
+    return(0);
+}
+
+//***********************************************************************
+// _seglun_direct_map - Walks the segment generating the list of runs that
+//    are contiguous in both a source and destination allocation.
+//    NOTE: Assumes both segments are locked
+//***********************************************************************
+
+seglun_direct_run_t *_seglun_direct_map(segment_t *sseg, segment_t *dseg, ex_off_t size, int *n_runs)
+{
+    seglun_direct_run_t *runs, *r;
+    seglun_row_t *srow, *drow, *last_srow, *last_drow;
+    seglun_block_t *sb, *db;
+    ex_off_t pos, soff, doff, slen, dlen, len;
+    int *open;
+    int n, c, n_open, c_open, k;
+
+    c = 16;
+    n = 0;
+    type_malloc_clear(runs, seglun_direct_run_t, c);
+    c_open = 16;
+    n_open = 0;
+    type_malloc(open, int, c_open);
+
+    last_srow = last_drow = NULL;
+    pos = 0;
+    while (pos < size) {
+        if ((_seglun_locate(sseg, pos, &srow, &sb, &soff, &slen) != 0) || (_seglun_locate(dseg, pos, &drow, &db, &doff, &dlen) != 0)) {
+            log_printf(1, "sseg=" XIDT " dseg=" XIDT " unmapped offset=" XOT "\n", segment_id(sseg), segment_id(dseg), pos);
+            break;
+        }
+
+        len = (slen < dlen) ? slen : dlen;
+        if (len > (size - pos)) len = size - pos;
+
+        //** Runs never span rows so only the current rows can be extended
+        if ((srow != last_srow) || (drow != last_drow)) {
+            n_open = 0;
+            last_srow = srow;
+            last_drow = drow;
+        }
+
+        r = NULL;
+        for (k=0; k<n_open; k++) {
+            r = &(runs[open[k]]);
+            if ((r->sblock == sb) && (r->dblock == db) && ((r->soff + r->len) == soff) && ((r->doff + r->len) == doff)) break;
+            r = NULL;
+        }
+
+        if (r == NULL) {  //** Start a new run
+            if (n == c) {
+                c = 2*c;
+                type_realloc(runs, seglun_direct_run_t, c);
+            }
+            if (n_open == c_open) {
+                c_open = 2*c_open;
+                type_realloc(open, int, c_open);
+            }
+            r = &(runs[n]);
+            memset(r, 0, sizeof(seglun_direct_run_t));
+            r->sblock = sb;
+            r->dblock = db;
+            r->soff = soff;
+            r->doff = doff;
+            open[n_open] = n;
+            n_open++;
+            n++;
+        }
+
+        //** Add the range to the run merging it with the last one if possible
+        r->len += len;
+        if ((r->n_iov > 0) && ((r->iov[r->n_iov-1].offset + r->iov[r->n_iov-1].len) == pos)) {
+            r->iov[r->n_iov-1].len += len;
+        } else {
+            if (r->n_iov == r->c_iov) {
+                r->c_iov = 2*r->c_iov + 4;
+                if (r->iov == NULL) {
+                    type_malloc(r->iov, ex_iovec_t, r->c_iov);
+                } else {
+                    type_realloc(r->iov, ex_iovec_t, r->c_iov);
+                }
+            }
+            ex_iovec_single(&(r->iov[r->n_iov]), pos, len);
+            r->n_iov++;
+        }
+
+        pos += len;
+    }
+
+    free(open);
+
+    if (pos < size) {  //** Mapping error so throw everything away
+        for (k=0; k<n; k++) {
+            if (runs[k].iov != NULL) free(runs[k].iov);
+        }
+        free(runs);
+        *n_runs = -1;
+        return(NULL);
+    }
+
+    *n_runs = n;
+    return(runs);
+}
+
+//***********************************************************************
+// _seglun_stream - Copies the ranges by reading them into the buffer and
+//    writing them back out
+//***********************************************************************
+
+int _seglun_stream(seglun_direct_t *op, int n_iov, ex_iovec_t *iov, ex_off_t nbytes)
+{
+    tbuffer_t tbuf;
+    int err;
+
+    tbuffer_single(&tbuf, nbytes, op->buffer);
+    err = gop_sync_exec(segment_read(op->sseg, op->da, op->rw_hints, n_iov, iov, &tbuf, 0, op->timeout));
+    if (err == OP_STATE_SUCCESS) {
+        err = gop_sync_exec(segment_write(op->dseg, op->da, op->rw_hints, n_iov, iov, &tbuf, 0, op->timeout));
+    }
+
+    return(err);
+}
+
+//***********************************************************************
+// seglun_copy_direct_func - Does the actual copy
+//***********************************************************************
+
+op_status_t seglun_copy_direct_func(void *arg, int id)
+{
+    seglun_direct_t *op = (seglun_direct_t *)arg;
+    seglun_direct_run_t *runs, *r;
+    ex_iovec_t *siov;
+    ex_off_t size, offset, d_offset, end, len, nbytes, n_direct, n_streamed, direct_min;
+    int i, j, n_runs, n_siov, c_siov, n_failed;
+    opque_t *q;
+    op_generic_t *gop;
+    apr_time_t dt;
+
+    dt = apr_time_now();
+    size = segment_size(op->sseg);
+
+    //** Make the destination the same size which also allocates the space
+    if (gop_sync_exec(segment_truncate(op->dseg, op->da, size, op->timeout)) != OP_STATE_SUCCESS) {
+        log_printf(1, "dseg=" XIDT " Error growing destination to " XOT "\n", segment_id(op->dseg), size);
+        return(op_failure_status);
+    }
+    if (size == 0) return(op_success_status);
+
+    segment_lock(op->sseg);
+    segment_lock(op->dseg);
+    runs = _seglun_direct_map(op->sseg, op->dseg, size, &n_runs);
+    segment_unlock(op->dseg);
+    segment_unlock(op->sseg);
+
+    if (runs == NULL) return(op_failure_status);
+
+    //** Anything that won't fit in the buffer has to go direct
+    direct_min = (op->bufsize < SEGLUN_DIRECT_MIN) ? op->bufsize : SEGLUN_DIRECT_MIN;
+
+    //** Fire off all the depot-depot copies
+    q = new_opque();
+    opque_start_execution(q);
+    n_direct = n_streamed = 0;
+    for (i=0; i<n_runs; i++) {
+        r = &(runs[i]);
+        if (r->len < direct_min) continue;
+
+        n_direct += r->len;
+        offset = r->soff;
+        d_offset = r->doff;
+        end = r->soff + r->len;
+        while (offset < end) {
+            len = ((end - offset) > SEGLUN_DIRECT_MAX_TRANSFER) ? SEGLUN_DIRECT_MAX_TRANSFER : end - offset;
+            gop = ds_copy(r->dblock->data->ds, op->da, DS_PUSH, NS_TYPE_SOCK, "",
+                          ds_get_cap(r->sblock->data->ds, r->sblock->data->cap, DS_CAP_READ), offset,
+                          ds_get_cap(r->dblock->data->ds, r->dblock->data->cap, DS_CAP_WRITE), d_offset,
+                          len, op->timeout);
+            opque_add(q, gop);
+            offset += len;
+            d_offset += len;
+        }
+    }
+
+    //** While those are going stream the small stuff through the buffer
+    n_failed = 0;
+    c_siov = 64;
+    n_siov = 0;
+    type_malloc(siov, ex_iovec_t, c_siov);
+    nbytes = 0;
+    for (i=0; i<n_runs; i++) {
+        r = &(runs[i]);
+        if (r->len >= direct_min) continue;
+
+        n_streamed += r->len;
+        for (j=0; j<r->n_iov; j++) {
+            if ((nbytes + r->iov[j].len) > op->bufsize) {
+                if (n_siov > 0) {
+                    if (_seglun_stream(op, n_siov, siov, nbytes) != OP_STATE_SUCCESS) n_failed++;
+                }
+                n_siov = 0;
+                nbytes = 0;
+            }
+            if (n_siov == c_siov) {
+                c_siov = 2*c_siov;
+                type_realloc(siov, ex_iovec_t, c_siov);
+            }
+            siov[n_siov] = r->iov[j];
+            nbytes += r->iov[j].len;
+            n_siov++;
+        }
+    }
+    if (n_siov > 0) {
+        if (_seglun_stream(op, n_siov, siov, nbytes) != OP_STATE_SUCCESS) n_failed++;
+    }
+    free(siov);
+
+    //** Wait for the copies to complete
+    if (opque_waitall(q) != OP_STATE_SUCCESS) n_failed += opque_tasks_failed(q);
+    opque_free(q, OP_DESTROY);
+
+    for (i=0; i<n_runs; i++) {
+        if (runs[i].iov != NULL) free(runs[i].iov);
+    }
+    free(runs);
+
+    dt = apr_time_now() - dt;
+    log_printf(5, "sseg=" XIDT " dseg=" XIDT " n_runs=%d direct=" XOT " streamed=" XOT " n_failed=%d dt=%lf\n", segment_id(op->sseg), segment_id(op->dseg),
+               n_runs, n_direct, n_streamed, n_failed, (1.0*dt)/APR_USEC_PER_SEC);
+
+    return((n_failed == 0) ? op_success_status : op_failure_status);
+}
+
+//***********************************************************************
+// seglun_copy_direct - Copies the source LUN into the destination LUN.
+//    Unlike a clone the layouts don't have to match.  Every range that is
+//    contiguous in both a source and destination allocation is copied
+//    depot-to-depot in parallel and only the leftover slivers are streamed
+//    through the client using the buffer provided.
+//***********************************************************************
+
+op_generic_t *seglun_copy_direct(data_attr_t *da, segment_rw_hints_t *rw_hints, segment_t *src, segment_t *dest, ex_off_t bufsize, char *buffer, int timeout)
+{
+    seglun_priv_t *s;
+    seglun_direct_t *op;
+
+    if ((strcmp(segment_type(src), SEGMENT_TYPE_LUN) != 0) || (strcmp(segment_type(dest), SEGMENT_TYPE_LUN) != 0)) {
+        log_printf(1, "Both segments must be LUNs! src=%s dest=%s\n", segment_type(src), segment_type(dest));
+        return(gop_dummy(op_failure_status));
+    }
+
+    s = (seglun_priv_t *)dest->priv;
+
+    type_malloc(op, seglun_direct_t, 1);
+    op->sseg = src;
+    op->dseg = dest;
+    op->da = da;
+    op->rw_hints = rw_hints;
+    op->bufsize = bufsize;
+    op->buffer = buffer;
+    op->timeout = timeout;
+
+    return(new_thread_pool_op(s->tpc, NULL, seglun_copy_direct_func, (void *)op, free, 1));
+}
+
 //***********************************************************************
 // seglun_size - Returns the segment size.
 //***********************************************************************
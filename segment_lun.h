@@ -41,12 +41,26 @@ extern "C" {
 #endif
 
 #define SEGMENT_TYPE_LUN "lun"
+#define SEGMENT_LUN_DEDUP_ATTR "dedup_sha256"
+#define SEGMENT_LUN_DEDUP_SERVICE "lun_dedup"
+
+typedef struct seglun_dedup_s seglun_dedup_t;
 
 segment_t *segment_lun_load(void *arg, ex_id_t id, exnode_exchange_t *ex);
 segment_t *segment_lun_create(void *arg);
 //op_generic_t *segment_lun_make(segment_t *seg, data_attr_t *da, rs_query_t *rsq, int n_rid, ex_off_t block_size, ex_off_t total_size, int timeout);
 int seglun_row_decompose_test();
 
+//** Dedup catalog used by CLONE_DEDUP.  Register it with the ESS_RUNNING
+//** SEGMENT_LUN_DEDUP_SERVICE to share allocations across clones.
+seglun_dedup_t *seglun_dedup_create();
+void seglun_dedup_destroy(seglun_dedup_t *dd);
+int seglun_dedup_add_segment(seglun_dedup_t *dd, segment_t *seg);
+void seglun_dedup_stats(seglun_dedup_t *dd, int *n_shared, ex_off_t *bytes_shared);
+
+//** Depot-to-depot copy between LUNs whose layouts needn't match
+op_generic_t *seglun_copy_direct(data_attr_t *da, segment_rw_hints_t *rw_hints, segment_t *src, segment_t *dest, ex_off_t bufsize, char *buffer, int timeout);
+
 #ifdef __cplusplus
 }
 #endif
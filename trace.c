@@ -30,7 +30,15 @@ http://www.accre.vanderbilt.edu
 #define _log_module_index 164
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "trace.h"
+#include "liblio_trace.h"
 #include "iniparse.h"
 #include "type_malloc.h"
 #include "log.h"
@@ -52,7 +60,7 @@ void trace_rw_dist_print(trace_stats_t *s, FILE *fd)
     dw = dw / (1024.0*1024.0);
     dt = dr + dw;
     ntotal = s->total_bytes[CMD_READ] + s->total_bytes[CMD_WRITE];
-    dops = ntotal;
+    dops = s->total_ops[CMD_READ] + s->total_ops[CMD_WRITE];
     drops = s->total_ops[CMD_READ];
     dwops = s->total_ops[CMD_WRITE];
 
@@ -62,12 +70,12 @@ void trace_rw_dist_print(trace_stats_t *s, FILE *fd)
     fprintf(fd, "Total Commands -- Read: %8" XOTC " Write: %8" XOTC " Combined: %8" XOTC "\n", s->total_ops[CMD_READ], s->total_ops[CMD_WRITE], ntotal);
 
     for (i=0; i<MAX_BIN; i++) {
-        dr = (100.0*s->rw_dist[i][CMD_READ]) / drops;
-        dw = (100.0*s->rw_dist[i][CMD_WRITE]) / dwops;
-        ntotal = s->rw_dist[i][CMD_READ] + s->rw_dist[i][CMD_WRITE];
-        dt = (100.0*ntotal)/dops;
+        dr = (drops > 0) ? (100.0*s->rw_dist[CMD_READ][i]) / drops : 0;
+        dw = (dwops > 0) ? (100.0*s->rw_dist[CMD_WRITE][i]) / dwops : 0;
+        ntotal = s->rw_dist[CMD_READ][i] + s->rw_dist[CMD_WRITE][i];
+        dt = (dops > 0) ? (100.0*ntotal)/dops : 0;
         fprintf(fd, "2^%d  -- Read: %8" XOTC " (%lf%%) Write: %8" XOTC " (%lf%%)  Combined: %8" XOTC " (%lf%%)\n",
-                i, s->rw_dist[i][CMD_READ], dr, s->rw_dist[i][CMD_WRITE], dw, ntotal, dt);
+                i, s->rw_dist[CMD_READ][i], dr, s->rw_dist[CMD_WRITE][i], dw, ntotal, dt);
     }
 }
 
@@ -101,6 +109,166 @@ void trace_print_summary(trace_t *trace, FILE *fd)
     return;
 }
 
+//**********************************************************************
+// _trace_op_stats - Adds the op to the file's stats
+//**********************************************************************
+
+void _trace_op_stats(trace_t *trace, trace_op_t *op, int index)
+{
+    trace_file_t *file = &(trace->files[op->fd]);
+    double d;
+    int j;
+
+    if ((index == 0) || (op->time < trace->t_start)) trace->t_start = op->time;
+    if (op->time > trace->t_end) trace->t_end = op->time;
+
+    //** Update the RW distribution table
+    j = 0;
+    if (op->len > 1) {
+        d = op->len;
+        d = log(d)/log(2.0);
+        j = d;
+        if (j >= MAX_BIN) j = MAX_BIN-1;
+    }
+    file->stats.rw_dist[op->cmd][j]++;
+
+    file->op_count++;
+    if (op->len > file->max_len) file->max_len = op->len;
+    if ((op->offset + op->len) > file->max_offset) file->max_offset = op->offset + op->len;
+
+    file->stats.total_bytes[op->cmd] += op->len;
+    file->stats.total_ops[op->cmd] ++;
+}
+
+//**********************************************************************
+// _trace_load_text - Loads the commands from a text trace
+//**********************************************************************
+
+void _trace_load_text(trace_t *trace, int n_ops)
+{
+    FILE *fd;
+    trace_op_t *op;
+    char buffer[1024];
+    char *bstate, *str;
+    int i, fin;
+
+    fd = fopen(trace->data, "r");
+    if (fd == NULL) {
+        log_printf(0, "trace_load:  Cannot load data file: %s\n", trace->data);
+        assert(fd != NULL);
+    }
+
+    type_malloc_clear(trace->ops, trace_op_t, n_ops);
+    trace->n_ops = n_ops;
+
+    for (i=0; i<n_ops; i++) {
+        op = &(trace->ops[i]);
+        fgets(buffer, 1024, fd);
+        sscanf(string_token(buffer, " ,", &bstate, &fin), "%d", &(op->fd));
+        sscanf(string_token(NULL, " ,", &bstate, &fin), XOT, &(op->offset));
+        sscanf(string_token(NULL, " ,", &bstate, &fin), XOT, &(op->len));
+        str = string_token(NULL, " ,", &bstate, &fin);
+        if ((str[0] == 'R') || (str[0] == 'r')) {
+            op->cmd = CMD_READ;
+        }
+        if ((str[0] == 'W') || (str[0] == 'w')) {
+            op->cmd = CMD_WRITE;
+        }
+
+        //** Older traces don't have the timestamp
+        str = string_token(NULL, " ,\n", &bstate, &fin);
+        op->time = ((str != NULL) && (str[0] != '\0')) ? atof(str) : 0;
+
+        _trace_op_stats(trace, op, i);
+    }
+
+    fclose(fd);
+}
+
+//**********************************************************************
+// _trace_op_time_compare - Sorts ops by their timestamp
+//**********************************************************************
+
+int _trace_op_time_compare(const void *p1, const void *p2)
+{
+    const trace_op_t *a = (const trace_op_t *)p1;
+    const trace_op_t *b = (const trace_op_t *)p2;
+
+    if (a->time < b->time) return(-1);
+    if (a->time > b->time) return(1);
+    return(0);
+}
+
+//**********************************************************************
+// _trace_load_binary - Loads the commands from a binary trace using mmap.
+//     The op count comes from the file size so traces from jobs that
+//     didn't exit cleanly can still be loaded.
+//**********************************************************************
+
+void _trace_load_binary(trace_t *trace)
+{
+    int fd, i, n, nbad;
+    struct stat sbuf;
+    char *base;
+    lt_bin_header_t *hdr;
+    lt_bin_record_t *rec;
+    trace_op_t *op;
+
+    fd = open(trace->data, O_RDONLY);
+    if (fd == -1) {
+        log_printf(0, "trace_load:  Cannot load data file: %s\n", trace->data);
+        assert(fd != -1);
+    }
+
+    assert(fstat(fd, &sbuf) == 0);
+    assert(sbuf.st_size >= (off_t)sizeof(lt_bin_header_t));
+
+    base = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert(base != MAP_FAILED);
+    madvise(base, sbuf.st_size, MADV_SEQUENTIAL);
+
+    hdr = (lt_bin_header_t *)base;
+    if ((hdr->magic != LT_BIN_MAGIC) || (hdr->version != LT_BIN_VERSION) || (hdr->record_size != sizeof(lt_bin_record_t))) {
+        log_printf(0, "trace_load:  Invalid binary trace header! file=%s magic=%x version=%d record_size=%d\n", trace->data, hdr->magic, hdr->version, hdr->record_size);
+        assert(hdr->magic == LT_BIN_MAGIC);
+        assert(hdr->version == LT_BIN_VERSION);
+        assert(hdr->record_size == sizeof(lt_bin_record_t));
+    }
+
+    n = (sbuf.st_size - sizeof(lt_bin_header_t)) / sizeof(lt_bin_record_t);
+    rec = (lt_bin_record_t *)(base + sizeof(lt_bin_header_t));
+    type_malloc_clear(trace->ops, trace_op_t, n + 1);
+
+    nbad = 0;
+    trace->n_ops = 0;
+    for (i=0; i<n; i++) {
+        if ((rec[i].fd >= (uint32_t)trace->n_files) || (rec[i].cmd > LT_CMD_WRITE)) {
+            nbad++;
+            continue;
+        }
+
+        op = &(trace->ops[trace->n_ops]);
+        op->fd = rec[i].fd;
+        op->offset = rec[i].offset;
+        op->len = rec[i].len;
+        op->cmd = (rec[i].cmd == LT_CMD_READ) ? CMD_READ : CMD_WRITE;
+        op->time = (double)rec[i].time_ns / 1000000000.0;
+        trace->n_ops++;
+    }
+
+    munmap(base, sbuf.st_size);
+    close(fd);
+
+    if (nbad > 0) log_printf(0, "trace_load:  Skipped %d invalid records in %s\n", nbad, trace->data);
+
+    //** Each thread's records are flushed separately so put them in time order
+    qsort(trace->ops, trace->n_ops, sizeof(trace_op_t), _trace_op_time_compare);
+
+    for (i=0; i<trace->n_ops; i++) {
+        _trace_op_stats(trace, &(trace->ops[i]), i);
+    }
+}
+
 //**********************************************************************
 // trace_load - Loads a trace
 //**********************************************************************
@@ -108,16 +276,10 @@ void trace_print_summary(trace_t *trace, FILE *fd)
 trace_t *trace_load(service_manager_t *exs, exnode_t *tex, data_attr_t *da, int timeout, char *fname)
 {
     inip_file_t *tfd;
-    int n_files, n_ops, i, j, k, fin;
-    char *trace_fname;
-    FILE *fd;
+    int n_files, n_ops, i, j, k;
+    char *trace_fname, *format;
     trace_t *trace;
-    trace_op_t *op;
     trace_file_t *file;
-    char buffer[1024];
-    char *bstate, *str;
-    double log2, d;
-//  char *template;
     segment_t *tseg;
 
     tfd = inip_read(fname);
@@ -125,25 +287,17 @@ trace_t *trace_load(service_manager_t *exs, exnode_t *tex, data_attr_t *da, int
     n_files = inip_get_integer(tfd, "trace", "n_files", -1);
     n_ops = inip_get_integer(tfd, "trace", "n_ops", -1);
     trace_fname = inip_get_string(tfd, "trace", "trace", "");
+    format = inip_get_string(tfd, "trace", "format", "text");
 
     assert(n_files > 0);
-    assert(n_ops > 0);
     assert(strlen(trace_fname) > 0);
 
-    fd = fopen(trace_fname, "r");
-    if (fd == NULL) {
-        log_printf(0, "trace_load:  Cannot load data file: %s\n", trace_fname);
-        assert(fd != NULL);
-    }
-
     type_malloc_clear(trace, trace_t, 1);
-    type_malloc_clear(trace->ops, trace_op_t, n_ops);
     type_malloc_clear(trace->files, trace_file_t, n_files);
 
     trace->da = da;
     trace->header = fname;
     trace->data = trace_fname;
-    trace->n_ops = n_ops;
     trace->n_files = n_files;
 
     //** Load the files
@@ -156,6 +310,7 @@ trace_t *trace_load(service_manager_t *exs, exnode_t *tex, data_attr_t *da, int
     for (i=0; i<n_files; i++) {
         file = &(trace->files[i]);
 
+        file->id = i;
         file->seg = NULL;
         file->ex = exnode_create();
         segment_clone(tseg, da, &(file->seg), CLONE_STRUCTURE, NULL, timeout);
@@ -163,34 +318,17 @@ trace_t *trace_load(service_manager_t *exs, exnode_t *tex, data_attr_t *da, int
     }
 
     //** and the commands
-    d = 2;
-    log2 = log(d);
-    file = trace->files;
-    for (i=0; i<n_ops; i++) {
-        op = &(trace->ops[i]);
-        fgets(buffer, 1024, fd);
-        sscanf(string_token(buffer, " ,", &bstate, &fin), "%d", &(op->fd));
-        sscanf(string_token(NULL, " ,", &bstate, &fin), XOT, &(op->offset));
-        sscanf(string_token(NULL, " ,", &bstate, &fin), XOT, &(op->len));
-        str = string_token(NULL, " ,", &bstate, &fin);
-        if ((str[0] == 'R') || (str[0] == 'r')) {
-            op->cmd = CMD_WRITE;
-        }
-        if ((str[0] == 'W') || (str[0] == 'w')) {
-            op->cmd = CMD_READ;
-        }
-
-        //** Update the RW distribution table
-        d = op->len;
-        d = log(d)/log2;
-        j = d;
-        file[op->fd].stats.rw_dist[op->cmd][j]++;
-
-        file[op->fd].stats.total_bytes[op->cmd] += op->len;
-        file[op->fd].stats.total_ops[op->cmd] ++;
+    if (strcmp(format, "binary") == 0) {
+        _trace_load_binary(trace);
+    } else {
+        assert(n_ops > 0);
+        _trace_load_text(trace, n_ops);
     }
+    free(format);
+    inip_destroy(tfd);
 
     //** Make the summary
+    file = trace->files;
     for (i=0; i<n_files; i++) {
         for (j=0; j<2; j++) {
             trace->stats.total_bytes[j] += file[i].stats.total_bytes[j];
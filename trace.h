@@ -41,6 +41,7 @@ http://www.accre.vanderbilt.edu
 typedef struct {
     ex_off_t offset;
     ex_off_t len;
+    double time;     //** Time the op was issued, in secs since the trace started
     int fd;
     int cmd;
 } trace_op_t;
@@ -56,7 +57,7 @@ typedef struct {
     segment_t *seg;
 //  os_fd_t *fd;
     int op_count;
-    ex_off_t max_offset;
+    ex_off_t max_offset;   //** Largest offset+len touched by the trace
     ex_off_t max_len;
     int id;
     trace_stats_t stats;
@@ -70,6 +71,8 @@ typedef struct {
     trace_op_t *ops;
     trace_file_t *files;
     trace_stats_t stats;
+    double t_start;   //** Time of the first and last op in the trace
+    double t_end;
     data_attr_t *da;
 } trace_t;
 
@@ -30,6 +30,9 @@ http://www.accre.vanderbilt.edu
 #define _log_module_index 168
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "assert_result.h"
 #include "exnode.h"
 #include "log.h"
@@ -39,6 +42,383 @@ http://www.accre.vanderbilt.edu
 #include "trace.h"
 #include "lio.h"
 
+#define REPLAY_AFAP     0   //** Issue ops as fast as possible
+#define REPLAY_REALTIME 1   //** Honor the recorded timestamps
+#define REPLAY_SCALED   2   //** Recorded timestamps divided by a speedup factor
+
+typedef struct {      //** Throughput timeline bucket
+    ex_off_t bytes[2];
+    ex_off_t ops[2];
+} replay_interval_t;
+
+typedef struct {
+    ex_off_t n[2];
+    ex_off_t failed[2];
+    ex_off_t bytes[2];
+    apr_time_t min_lat[2];
+    apr_time_t max_lat[2];
+    double sum_lat[2];
+    ex_off_t lat_hist[2][MAX_BIN];  //** Latency histogram in log2(usec) bins
+    ex_off_t n_lag;
+    apr_time_t max_lag;      //** How far behind schedule ops were issued
+    double sum_lag;
+    int n_intervals;
+    replay_interval_t *interval;
+} replay_stats_t;
+
+typedef struct replay_worker_s replay_worker_t;
+
+typedef struct {
+    replay_worker_t *w;
+    trace_op_t *top;
+    ex_iovec_t iov;
+    apr_time_t submit_time;
+    apr_time_t end_time;
+} replay_slot_t;
+
+struct replay_worker_s {
+    int id;
+    int n_ops;
+    int *op_index;       //** Ops for the files handled by this worker in trace order
+    int n_free;
+    int *free_slot;
+    replay_slot_t *slot;
+    apr_thread_t *thread;
+    replay_stats_t stats;
+};
+
+typedef struct {
+    trace_t *trace;
+    int mode;
+    double scale;
+    int np;
+    int n_threads;
+    int update_interval;
+    apr_time_t interval;
+    apr_time_t start_time;
+    char **buffer;       //** Per file I/O buffers
+    tbuffer_t *tbuf;
+} replay_t;
+
+replay_t rp;
+
+//*************************************************************************
+// replay_op_cb - Records the completion time of an op
+//*************************************************************************
+
+void replay_op_cb(void *arg, int state)
+{
+    replay_slot_t *slot = (replay_slot_t *)arg;
+
+    slot->end_time = apr_time_now();
+}
+
+//*************************************************************************
+// replay_stats_add - Adds a completed op to the stats
+//*************************************************************************
+
+void replay_stats_add(replay_stats_t *s, int cmd, ex_off_t len, apr_time_t dt, apr_time_t end_time)
+{
+    int i, n;
+
+    s->n[cmd]++;
+    s->bytes[cmd] += len;
+    s->sum_lat[cmd] += dt;
+    if ((s->n[cmd] == 1) || (dt < s->min_lat[cmd])) s->min_lat[cmd] = dt;
+    if (dt > s->max_lat[cmd]) s->max_lat[cmd] = dt;
+
+    for (i=0; (i<MAX_BIN-1) && ((dt >> (i+1)) > 0); i++) {}
+    s->lat_hist[cmd][i]++;
+
+    //** Update the timeline
+    i = (end_time - rp.start_time) / rp.interval;
+    if (i < 0) i = 0;
+    if (i >= s->n_intervals) {
+        n = 2*i + 1;
+        type_realloc(s->interval, replay_interval_t, n);
+        memset(&(s->interval[s->n_intervals]), 0, sizeof(replay_interval_t)*(n - s->n_intervals));
+        s->n_intervals = n;
+    }
+    s->interval[i].bytes[cmd] += len;
+    s->interval[i].ops[cmd]++;
+}
+
+//*************************************************************************
+// replay_stats_merge - Merges the src stats into dest
+//*************************************************************************
+
+void replay_stats_merge(replay_stats_t *dest, replay_stats_t *src)
+{
+    int i, j, n;
+
+    for (i=0; i<2; i++) {
+        if (src->n[i] > 0) {
+            if ((dest->n[i] == 0) || (src->min_lat[i] < dest->min_lat[i])) dest->min_lat[i] = src->min_lat[i];
+            if (src->max_lat[i] > dest->max_lat[i]) dest->max_lat[i] = src->max_lat[i];
+        }
+        dest->n[i] += src->n[i];
+        dest->failed[i] += src->failed[i];
+        dest->bytes[i] += src->bytes[i];
+        dest->sum_lat[i] += src->sum_lat[i];
+        for (j=0; j<MAX_BIN; j++) dest->lat_hist[i][j] += src->lat_hist[i][j];
+    }
+
+    dest->n_lag += src->n_lag;
+    dest->sum_lag += src->sum_lag;
+    if (src->max_lag > dest->max_lag) dest->max_lag = src->max_lag;
+
+    if (src->n_intervals > dest->n_intervals) {
+        n = src->n_intervals;
+        type_realloc(dest->interval, replay_interval_t, n);
+        memset(&(dest->interval[dest->n_intervals]), 0, sizeof(replay_interval_t)*(n - dest->n_intervals));
+        dest->n_intervals = n;
+    }
+    for (i=0; i<src->n_intervals; i++) {
+        for (j=0; j<2; j++) {
+            dest->interval[i].bytes[j] += src->interval[i].bytes[j];
+            dest->interval[i].ops[j] += src->interval[i].ops[j];
+        }
+    }
+}
+
+//*************************************************************************
+// replay_percentile - Returns the upper bound of the latency bin
+//     containing the given percentile
+//*************************************************************************
+
+apr_time_t replay_percentile(replay_stats_t *s, int cmd, double pct)
+{
+    ex_off_t target, sum;
+    int i;
+
+    if (s->n[cmd] == 0) return(0);
+
+    target = pct * s->n[cmd] / 100.0;
+    if (target < 1) target = 1;
+    sum = 0;
+    for (i=0; i<MAX_BIN; i++) {
+        sum += s->lat_hist[cmd][i];
+        if (sum >= target) break;
+    }
+    if (i >= MAX_BIN) i = MAX_BIN-1;
+
+    return((apr_time_t)1 << (i+1));
+}
+
+//*************************************************************************
+// replay_print_report - Prints the latency and throughput report
+//*************************************************************************
+
+void replay_print_report(FILE *fd, replay_stats_t *s, double dt)
+{
+    char *cmd_name[2] = { "Read", "Write" };
+    double mb, avg, t;
+    int i, j, last;
+
+    fprintf(fd, "Trace Replay Report for header file %s\n", rp.trace->header);
+    fprintf(fd, "------------------------------------------------------------------------------------------------------------\n");
+    fprintf(fd, "Mode: %s  Scale: %lf  Threads: %d  Outstanding/thread: %d\n",
+            (rp.mode == REPLAY_AFAP) ? "afap" : ((rp.mode == REPLAY_REALTIME) ? "realtime" : "scaled"), rp.scale, rp.n_threads, rp.np);
+    fprintf(fd, "Trace duration: %lf  Replay time: %lf\n", rp.trace->t_end - rp.trace->t_start, dt);
+    if (s->n_lag > 0) {
+        avg = s->sum_lag / s->n_lag;
+        fprintf(fd, "Schedule lag -- avg: %lf ms  max: %lf ms\n", avg / 1000.0, (double)s->max_lag / 1000.0);
+    }
+    fprintf(fd, "\n");
+
+    for (i=0; i<2; i++) {
+        mb = s->bytes[i];
+        mb = mb / (1024.0*1024.0);
+        avg = (s->n[i] > 0) ? s->sum_lat[i] / s->n[i] : 0;
+        fprintf(fd, "%-5s -- ops: " XOT "  failed: " XOT "  bytes: " XOT " (%lf MB)  rate: %lf MB/s\n",
+                cmd_name[i], s->n[i], s->failed[i], s->bytes[i], mb, (dt > 0) ? mb/dt : 0);
+        fprintf(fd, "%-5s -- latency(us) min: " TT "  avg: %lf  max: " TT "  p50: " TT "  p90: " TT "  p99: " TT "  p99.9: " TT "\n",
+                cmd_name[i], s->min_lat[i], avg, s->max_lat[i],
+                replay_percentile(s, i, 50), replay_percentile(s, i, 90), replay_percentile(s, i, 99), replay_percentile(s, i, 99.9));
+    }
+    fprintf(fd, "\n");
+
+    fprintf(fd, "Latency Histogram (usec)\n");
+    fprintf(fd, "---------------------------------------------\n");
+    last = 0;
+    for (j=0; j<MAX_BIN; j++) {
+        if ((s->lat_hist[CMD_READ][j] > 0) || (s->lat_hist[CMD_WRITE][j] > 0)) last = j;
+    }
+    for (j=0; j<=last; j++) {
+        fprintf(fd, "<2^%-2d  -- Read: %8" XOTC " Write: %8" XOTC "\n", j+1, s->lat_hist[CMD_READ][j], s->lat_hist[CMD_WRITE][j]);
+    }
+    fprintf(fd, "\n");
+
+    fprintf(fd, "Throughput Timeline (interval=%lf s)\n", (double)rp.interval / APR_USEC_PER_SEC);
+    fprintf(fd, "---------------------------------------------\n");
+    last = -1;
+    for (j=0; j<s->n_intervals; j++) {
+        if ((s->interval[j].ops[CMD_READ] > 0) || (s->interval[j].ops[CMD_WRITE] > 0)) last = j;
+    }
+    t = rp.interval;
+    t = t / APR_USEC_PER_SEC;
+    for (j=0; j<=last; j++) {
+        fprintf(fd, "t=%10.3lf -- Read: %8" XOTC " ops %10.3lf MB/s  Write: %8" XOTC " ops %10.3lf MB/s\n", j*t,
+                s->interval[j].ops[CMD_READ], s->interval[j].bytes[CMD_READ] / (1024.0*1024.0*t),
+                s->interval[j].ops[CMD_WRITE], s->interval[j].bytes[CMD_WRITE] / (1024.0*1024.0*t));
+    }
+    fprintf(fd, "\n");
+}
+
+//*************************************************************************
+// replay_reap - Waits for one of the worker's ops to complete and
+//     records it.
+//*************************************************************************
+
+void replay_reap(replay_worker_t *w, opque_t *q)
+{
+    op_generic_t *gop;
+    replay_slot_t *slot;
+    int slot_index;
+
+    gop = opque_waitany(q);
+    slot_index = gop_get_myid(gop);
+    slot = &(w->slot[slot_index]);
+    if (slot->end_time == 0) slot->end_time = apr_time_now();
+
+    if (gop_completed_successfully(gop) != OP_STATE_SUCCESS) {
+        log_printf(0, "trace_replay: Error with command index=%d\n", (int)(slot->top - rp.trace->ops));
+        w->stats.failed[slot->top->cmd]++;
+    } else {
+        replay_stats_add(&(w->stats), slot->top->cmd, slot->top->len, slot->end_time - slot->submit_time, slot->end_time);
+    }
+    gop_free(gop, OP_DESTROY);
+
+    w->free_slot[w->n_free] = slot_index;
+    w->n_free++;
+}
+
+//*************************************************************************
+// replay_worker_thread - Replays the ops for the worker's files
+//*************************************************************************
+
+void *replay_worker_thread(apr_thread_t *th, void *data)
+{
+    replay_worker_t *w = (replay_worker_t *)data;
+    trace_t *trace = rp.trace;
+    trace_op_t *top;
+    replay_slot_t *slot;
+    segment_t *seg;
+    op_generic_t *gop;
+    callback_t *cb;
+    opque_t *q;
+    apr_time_t now, target, lag;
+    int i, n;
+
+    q = new_opque();
+    target = 0;
+    for (i=0; i<w->n_ops; i++) {
+        if ((i%rp.update_interval) == 0) {
+            log_printf(0, "trace_replay: worker=%d Submitting task %d of %d\n", w->id, i, w->n_ops);
+        }
+
+        top = &(trace->ops[w->op_index[i]]);
+
+        //** Wait until the op is due
+        if (rp.mode != REPLAY_AFAP) {
+            target = rp.start_time + (apr_time_t)(((top->time - trace->t_start) * APR_USEC_PER_SEC) / rp.scale);
+            now = apr_time_now();
+            if (now < target) apr_sleep(target - now);
+        }
+
+        //** Get a free slot.  Waiting for an op to complete if needed
+        if (w->n_free == 0) replay_reap(w, q);
+        w->n_free--;
+        n = w->free_slot[w->n_free];
+        slot = &(w->slot[n]);
+
+        slot->top = top;
+        slot->end_time = 0;
+        slot->submit_time = apr_time_now();
+        if (rp.mode != REPLAY_AFAP) {
+            lag = slot->submit_time - target;
+            if (lag < 0) lag = 0;
+            w->stats.n_lag++;
+            w->stats.sum_lag += lag;
+            if (lag > w->stats.max_lag) w->stats.max_lag = lag;
+        }
+
+        seg = trace->files[top->fd].seg;
+        ex_iovec_single(&(slot->iov), top->offset, top->len);
+        if (top->cmd == CMD_READ) {
+            gop = segment_read(seg, trace->da, NULL, 1, &(slot->iov), &(rp.tbuf[top->fd]), 0, lio_gc->timeout);
+        } else {
+            gop = segment_write(seg, trace->da, NULL, 1, &(slot->iov), &(rp.tbuf[top->fd]), 0, lio_gc->timeout);
+        }
+
+        gop_set_myid(gop, n);
+        type_malloc_clear(cb, callback_t, 1);  //** Freed along with the gop
+        callback_set(cb, replay_op_cb, slot);
+        gop_callback_append(gop, cb);
+        opque_add(q, gop);
+    }
+
+    while (opque_tasks_left(q) > 0) {
+        replay_reap(w, q);
+    }
+
+    opque_free(q, OP_DESTROY);
+
+    return(NULL);
+}
+
+//*************************************************************************
+// replay_prefill - Populates the files that are read by the trace so
+//     the reads have data to act on.
+//*************************************************************************
+
+void replay_prefill(trace_t *trace, int bufsize)
+{
+    char *buffer;
+    tbuffer_t tbuf;
+    ex_iovec_t **iov;
+    trace_file_t *file;
+    opque_t *q;
+    op_generic_t *gop;
+    ex_off_t off, len;
+    int i, j, n;
+
+    type_malloc_clear(buffer, char, bufsize);
+    tbuffer_single(&tbuf, bufsize, buffer);
+    type_malloc_clear(iov, ex_iovec_t *, trace->n_files);
+
+    q = new_opque();
+    for (i=0; i<trace->n_files; i++) {
+        file = &(trace->files[i]);
+        if ((file->stats.total_ops[CMD_READ] == 0) || (file->max_offset <= 0)) continue;
+
+        n = (file->max_offset / bufsize) + 1;
+        type_malloc(iov[i], ex_iovec_t, n);
+        j = 0;
+        for (off=0; off<file->max_offset; off += bufsize) {
+            len = file->max_offset - off;
+            if (len > bufsize) len = bufsize;
+            ex_iovec_single(&(iov[i][j]), off, len);
+            gop = segment_write(file->seg, trace->da, NULL, 1, &(iov[i][j]), &tbuf, 0, lio_gc->timeout);
+            opque_add(q, gop);
+            j++;
+        }
+    }
+
+    if (opque_tasks_left(q) > 0) {
+        log_printf(0, "trace_replay: Prefilling files for reads.  n_ops=%d\n", opque_tasks_left(q));
+        if (opque_waitall(q) != OP_STATE_SUCCESS) {
+            log_printf(0, "trace_replay: ERROR prefilling files! nfailed=%d\n", opque_tasks_failed(q));
+        }
+    }
+    opque_free(q, OP_DESTROY);
+
+    for (i=0; i<trace->n_files; i++) {
+        if (iov[i] != NULL) free(iov[i]);
+    }
+    free(iov);
+    free(buffer);
+}
 
 //*************************************************************************
 //*************************************************************************
@@ -46,30 +426,38 @@ http://www.accre.vanderbilt.edu
 int main(int argc, char **argv)
 {
     int bufsize = 1024*1024;
-    char buffer[bufsize+1];
-    tbuffer_t tbuf;
-    int i, start_option, np, update_interval;
-    char *trace_header;
+    int i, j, start_option, prefill;
+    char *trace_header = NULL;
     char *base_path;
     char *template_name = NULL;
+    char *report_name = NULL;
+    FILE *rfd;
     exnode_t *tex;
     exnode_exchange_t *template_exchange;
-    ex_iovec_t *iov;
-    op_generic_t *gop;
     trace_t *trace;
-    trace_op_t *top;
-    opque_t *q;
-    apr_time_t start_time, end_time;
-
+    replay_worker_t *worker, *w;
+    replay_stats_t stats;
+    apr_status_t value;
+    apr_pool_t *mpool;
+    apr_time_t end_time;
     double dt;
 
 //printf("argc=%d\n", argc);
     if (argc < 2) {
         printf("\n");
-        printf("trace_replay LIO_COMMON_OPTIONS [-np n_at_once] [-i update_interval] [-path base_path] -template template.ex3 -t header.trh \n");
+        printf("trace_replay LIO_COMMON_OPTIONS [-np n_at_once] [-nt n_threads] [-afap | -realtime | -scale factor] [-ti interval]\n");
+        printf("             [-noprefill] [-o report] [-i update_interval] [-path base_path] -template template.ex3 -t header.trh \n");
         lio_print_options(stdout);
         printf("    -path base_path - Base LIO directory path\n");
-        printf("    -np n_at_once   - Number of commands to execute in parallel (default is 1)\n");
+        printf("    -np n_at_once   - Number of commands each thread can have outstanding (default is 1)\n");
+        printf("    -nt n_threads   - Number of replay threads.  Files are sharded across the threads (default is 1)\n");
+        printf("    -afap           - Ignore the recorded timestamps and issue commands as fast as possible (default)\n");
+        printf("    -realtime       - Issue commands at their recorded times\n");
+        printf("    -scale factor   - Issue commands at their recorded times divided by factor. 2 replays twice as fast\n");
+        printf("    -ti interval    - Throughput timeline interval in seconds (default is 1)\n");
+        printf("    -noprefill      - Don't populate the files that are read before starting the replay\n");
+        printf("    -o report       - Store the report in the given file instead of stdout\n");
+        printf("    -i interval     - Log progress every interval commands (default is 1000)\n");
         printf("    -t header.trh   - Trace header file\n");
         printf("\n");
         return(1);
@@ -77,8 +465,14 @@ int main(int argc, char **argv)
 
     lio_init(&argc, &argv);
 
-    np = 1;
-    update_interval = 1000;
+    memset(&rp, 0, sizeof(rp));
+    rp.np = 1;
+    rp.n_threads = 1;
+    rp.mode = REPLAY_AFAP;
+    rp.scale = 1;
+    rp.update_interval = 1000;
+    rp.interval = APR_USEC_PER_SEC;
+    prefill = 1;
 
     //*** Parse the args
     i=1;
@@ -97,18 +491,56 @@ int main(int argc, char **argv)
             i++;
             trace_header = argv[i];
             i++;
-        } else if (strcmp(argv[i], "-np") == 0) { //** TRace config file
+        } else if (strcmp(argv[i], "-np") == 0) { //** Outstanding commands per thread
+            i++;
+            rp.np = atoi(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-nt") == 0) { //** Replay threads
+            i++;
+            rp.n_threads = atoi(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-afap") == 0) { //** As fast as possible
+            i++;
+            rp.mode = REPLAY_AFAP;
+        } else if (strcmp(argv[i], "-realtime") == 0) { //** Use the recorded times
+            i++;
+            rp.mode = REPLAY_REALTIME;
+            rp.scale = 1;
+        } else if (strcmp(argv[i], "-scale") == 0) { //** Scaled recorded times
+            i++;
+            rp.mode = REPLAY_SCALED;
+            rp.scale = atof(argv[i]);
+            i++;
+        } else if (strcmp(argv[i], "-ti") == 0) { //** Timeline interval
+            i++;
+            rp.interval = atof(argv[i]) * APR_USEC_PER_SEC;
             i++;
-            np = atoi(argv[i]);
+        } else if (strcmp(argv[i], "-noprefill") == 0) { //** Skip populating the files
             i++;
-        } else if (strcmp(argv[i], "-i") == 0) { //** TRace config file
+            prefill = 0;
+        } else if (strcmp(argv[i], "-o") == 0) { //** Report file
             i++;
-            update_interval = atoi(argv[i]);
+            report_name = argv[i];
+            i++;
+        } else if (strcmp(argv[i], "-i") == 0) { //** Update interval
+            i++;
+            rp.update_interval = atoi(argv[i]);
             i++;
         }
-    } while (start_option < i);
+    } while ((start_option < i) && (i < argc));
 
-    assert(template_name == NULL);
+    if ((template_name == NULL) || (trace_header == NULL)) {
+        printf("Missing the template exnode or trace header!\n");
+        return(1);
+    }
+    if (rp.np < 1) rp.np = 1;
+    if (rp.n_threads < 1) rp.n_threads = 1;
+    if (rp.scale <= 0) {
+        printf("Invalid scale factor: %lf\n", rp.scale);
+        return(1);
+    }
+    if (rp.interval <= 0) rp.interval = APR_USEC_PER_SEC;
+    if (rp.update_interval <= 0) rp.update_interval = 1000;
 
     //** Load the template
     template_exchange = exnode_exchange_load_file(template_name);
@@ -117,44 +549,95 @@ int main(int argc, char **argv)
 
     //** Load the trace
     trace = trace_load(exnode_service_set, tex, lio_gc->da, lio_gc->timeout, trace_header);
-    type_malloc_clear(iov, ex_iovec_t, trace->n_files);
+    rp.trace = trace;
+    if (rp.n_threads > trace->n_files) rp.n_threads = trace->n_files;
 
-    q = new_opque();
-    tbuffer_single(&tbuf, bufsize, buffer);
-    start_time = apr_time_now();
-    for (i=0; i<trace->n_ops; i++) {
-        if ((i%update_interval) == 0) {
-            log_printf(0, "trace_replay: Submitting task %d\n", i);
-        }
+    //** Make the per file buffers
+    type_malloc_clear(rp.buffer, char *, trace->n_files);
+    type_malloc_clear(rp.tbuf, tbuffer_t, trace->n_files);
+    for (i=0; i<trace->n_files; i++) {
+        j = (trace->files[i].max_len > 0) ? trace->files[i].max_len : 1;
+        type_malloc_clear(rp.buffer[i], char, j);
+        tbuffer_single(&(rp.tbuf[i]), j, rp.buffer[i]);
+    }
 
-        top = &(trace->ops[i]);
-        ex_iovec_single(&(iov[top->fd]), top->offset, top->len);
-        if (top->cmd == CMD_READ) {
-            gop = segment_write(trace->files[top->fd].seg, lio_gc->da, NULL, 1, &(iov[top->fd]), &tbuf, 0, lio_gc->timeout);
-        } else {
-            gop = segment_write(trace->files[top->fd].seg, lio_gc->da, NULL, 1, &(iov[top->fd]), &tbuf, 0, lio_gc->timeout);
-        }
+    if (prefill == 1) replay_prefill(trace, bufsize);
 
-        gop_set_id(gop, i);
-        opque_add(q, gop);
-        if (opque_tasks_left(q) >= np) {
-            gop = opque_waitany(q);
-            if (gop_completed_successfully(gop) != OP_STATE_SUCCESS) {
-                log_printf(0, "trace_replay: Errow with command index=%d\n", gop_id(gop));
-            }
-            gop_free(gop, OP_DESTROY);
+    //** Shard the ops across the workers by file
+    type_malloc_clear(worker, replay_worker_t, rp.n_threads);
+    for (i=0; i<trace->n_ops; i++) {
+        worker[trace->ops[i].fd % rp.n_threads].n_ops++;
+    }
+    for (i=0; i<rp.n_threads; i++) {
+        w = &(worker[i]);
+        w->id = i;
+        type_malloc(w->op_index, int, w->n_ops + 1);
+        w->n_ops = 0;
+        type_malloc_clear(w->slot, replay_slot_t, rp.np);
+        type_malloc(w->free_slot, int, rp.np);
+        for (j=0; j<rp.np; j++) {
+            w->slot[j].w = w;
+            w->free_slot[j] = j;
         }
+        w->n_free = rp.np;
+    }
+    for (i=0; i<trace->n_ops; i++) {
+        w = &(worker[trace->ops[i].fd % rp.n_threads]);
+        w->op_index[w->n_ops] = i;
+        w->n_ops++;
     }
 
-    log_printf(0, "trace_replay:: Completed task submission (n_ops=%d).  Waiting for taks to complete\n", trace->n_ops);
-    opque_waitall(q);
+    //** Launch the replay
+    assert_result(apr_pool_create(&mpool, NULL), APR_SUCCESS);
+    rp.start_time = apr_time_now();
+    for (i=0; i<rp.n_threads; i++) {
+        thread_create_assert(&(worker[i].thread), NULL, replay_worker_thread, (void *)&(worker[i]), mpool);
+    }
 
+    memset(&stats, 0, sizeof(stats));
+    for (i=0; i<rp.n_threads; i++) {
+        apr_thread_join(&value, worker[i].thread);
+    }
     end_time = apr_time_now();
 
-    dt = end_time - start_time;
+    log_printf(0, "trace_replay:: Completed replay (n_ops=%d)\n", trace->n_ops);
+
+    dt = end_time - rp.start_time;
     dt = dt / APR_USEC_PER_SEC;
     log_printf(0, "trace_replay:  Total processing time: %lf\n", dt);
 
+    //** Generate the report
+    for (i=0; i<rp.n_threads; i++) {
+        replay_stats_merge(&stats, &(worker[i].stats));
+    }
+
+    rfd = stdout;
+    if (report_name != NULL) {
+        rfd = fopen(report_name, "w");
+        if (rfd == NULL) {
+            log_printf(0, "trace_replay: Unable to open report file %s.  Using stdout\n", report_name);
+            rfd = stdout;
+        }
+    }
+    replay_print_report(rfd, &stats, dt);
+    if (rfd != stdout) fclose(rfd);
+
+    //** Clean up
+    for (i=0; i<rp.n_threads; i++) {
+        w = &(worker[i]);
+        free(w->op_index);
+        free(w->slot);
+        free(w->free_slot);
+        if (w->stats.interval != NULL) free(w->stats.interval);
+    }
+    free(worker);
+    if (stats.interval != NULL) free(stats.interval);
+    apr_pool_destroy(mpool);
+
+    for (i=0; i<trace->n_files; i++) free(rp.buffer[i]);
+    free(rp.buffer);
+    free(rp.tbuf);
+
     trace_destroy(trace);
 
     //** Shut everything down;
@@ -164,5 +647,3 @@ int main(int argc, char **argv)
 
     return(0);
 }
-
-